@@ -29,6 +29,7 @@
 #include <stdlib.h>
 #include <SDL_video.h>
 #include "blit.h"
+#include "trs_metrics.h"
 
 static Uint8 *blitMap;
 
@@ -300,6 +301,8 @@ void TrsSoftBlit(SDL_Surface *src, SDL_Rect *srcrect,
   Uint8 *srcpix, *dstpix;
   int srcskip, dstskip;
 
+  trs_metrics_blits++;
+
   /* Lock the destination if it's in hardware */
   if (SDL_MUSTLOCK(dst)) {
     if (SDL_LockSurface(dst) < 0)
@@ -0,0 +1,135 @@
+/*
+ * Cassette signal detector and pulse-to-bit recovery.
+ *
+ * The code was moved here from trs_cassette.c (transition_in and
+ * transition_out) so that the casscan tool can share it.
+ */
+#include <stdlib.h>
+#include "cas_decode.h"
+
+void
+cas_detector_reset(struct cas_detector *det)
+{
+  det->avg = NOISE_FLOOR;
+  det->env = 127;
+  det->noisefloor = NOISE_FLOOR;
+}
+
+int
+cas_detect_level(struct cas_detector *det, int c, int speed)
+{
+  int next, cabs;
+
+  if (c > 127 + det->noisefloor) {
+    next = 1;
+  } else if (c <= 127 - det->noisefloor) {
+    next = 2;
+  } else {
+    next = 0;
+  }
+  if (speed == SPEED_1500) {
+    det->noisefloor = 2;
+  } else {
+    /* Attempt to learn the correct noise cutoff adaptively.
+     * This code is just a hack; it would be nice to know a
+     * real signal-processing algorithm for this application
+     */
+    cabs = abs(c - 127);
+    if (cabs > 1) {
+      det->avg = (99*det->avg + cabs) / 100;
+    }
+    if (cabs > det->env) {
+      det->env = (det->env + 9*cabs) / 10;
+    } else if (cabs > 10) {
+      det->env = (99*det->env + cabs) / 100;
+    }
+    det->noisefloor = (det->avg + det->env) / 2;
+  }
+  return next;
+}
+
+int
+cas_pulse_to_bit(int *pulsestate, int value, int next, float ddelta_us)
+{
+  int bit = CAS_NOBIT;
+
+  switch (*pulsestate) {
+  case ST_INITIAL:
+    if (value == 2 && next == 0) {
+      /* Low speed, end of first pulse.  Assume clock */
+      *pulsestate = ST_500GOTCLK;
+    } else if (value == 2 && next == 1) {
+      /* High speed, nothing interesting yet. */
+      *pulsestate = ST_1500;
+    }
+    break;
+
+  case ST_500GOTCLK:
+    if (value == 0 && next == 1) {
+      /* Low speed, start of next pulse. */
+      if (ddelta_us > ST_250THRESH) {
+	/* Oops, really ultra-low speed */
+	/* It's the next clock; bit was 0 */
+	bit = 0;
+	/* Watch for end of this clock */
+	*pulsestate = ST_250;
+      } else if (ddelta_us > ST_500THRESH) {
+	/* It's the next clock; bit was 0 */
+	bit = 0;
+	/* Watch for end of this clock */
+	*pulsestate = ST_INITIAL;
+      } else {
+	/* It's a data pulse; bit was 1 */
+	bit = 1;
+	/* Ignore the data pulse falling edge */
+	*pulsestate = ST_500GOTDAT;
+      }
+    }
+    break;
+
+  case ST_500GOTDAT:
+    if (value == 2 && next == 0) {
+      /* End of data pulse; watch for end of next clock */
+      *pulsestate = ST_INITIAL;
+    }
+    break;
+
+  case ST_1500:
+    if (value == 1 && next == 2) {
+      bit = (ddelta_us < ST_1500THRESH);
+    }
+    break;
+
+  case ST_250:
+    if (value == 2 && next == 0) {
+      /* Ultra-low speed, end of first pulse.  Assume clock */
+      *pulsestate = ST_250GOTCLK;
+    }
+    break;
+
+  case ST_250GOTCLK:
+    if (value == 0 && next == 1) {
+      /* Low speed, start of next pulse. */
+      if (ddelta_us > ST_250THRESH) {
+	/* It's the next clock; bit was 0 */
+	bit = 0;
+	/* Watch for end of this clock */
+	*pulsestate = ST_250;
+      } else {
+	/* It's a data pulse; bit was 1 */
+	bit = 1;
+	/* Ignore the data pulse falling edge */
+	*pulsestate = ST_250GOTDAT;
+      }
+    }
+    break;
+
+  case ST_250GOTDAT:
+    if (value == 2 && next == 0) {
+      /* End of data pulse; watch for end of next clock */
+      *pulsestate = ST_250;
+    }
+    break;
+  }
+  return bit;
+}
@@ -0,0 +1,56 @@
+/*
+ * Cassette signal detector and pulse-to-bit recovery.
+ *
+ * Shared by the emulator (reading .wav and writing .cas files) and
+ * the casscan batch converter, so both decode tapes the same way.
+ */
+#ifndef _CAS_DECODE_H
+#define _CAS_DECODE_H
+
+/* Cassette speeds */
+#define SPEED_500     0
+#define SPEED_1500    1
+#define SPEED_250     2
+
+#define NOISE_FLOOR   64
+
+/*
+ * Signal levels on the cassette port:
+ *   0 = zero (no signal), 1 = positive pulse, 2 = negative pulse
+ */
+
+/* States and thresholds for conversion to .cas on output */
+#define ST_INITIAL    0
+#define ST_500GOTCLK  1
+#define ST_500GOTDAT  2
+#define ST_1500       3
+#define ST_250        4
+#define ST_250GOTCLK  5
+#define ST_250GOTDAT  6
+#define ST_500THRESH  1250.0 /* us threshold between 0 and 1 */
+#define ST_1500THRESH  282.0 /* us threshold between 1 and 0 */
+#define ST_250THRESH  2500.0 /* us threshold between 0 and 1 */
+
+#define CAS_NOBIT     2      /* transition did not complete a bit */
+
+/* Adaptive noise cutoff of the zero-crossing detector */
+struct cas_detector {
+  float avg;
+  float env;
+  int noisefloor;
+};
+
+extern void cas_detector_reset(struct cas_detector *det);
+
+/* Convert an 8-bit unsigned sample into a signal level (0, 1 or 2) */
+extern int cas_detect_level(struct cas_detector *det, int sample, int speed);
+
+/*
+ * Feed one transition of the signal from level "value" to level "next",
+ * after "delta_us" microseconds at level "value".  Returns the recovered
+ * bit (0 or 1) or CAS_NOBIT.  "pulsestate" holds one of the ST_* states.
+ */
+extern int cas_pulse_to_bit(int *pulsestate, int value, int next,
+                            float delta_us);
+
+#endif
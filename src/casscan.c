@@ -0,0 +1,662 @@
+/*
+ * casscan - batch cassette image analyzer and .cas extractor
+ *
+ * Converts .wav tape rips to .cas files without running the emulator,
+ * using the same signal detector and pulse decoder (cas_decode.c) as
+ * the emulated cassette port.  Directories are scanned for *.wav files
+ * and all files are decoded in parallel on all available CPUs.
+ *
+ * For each tape a report is printed with the detected speed and for
+ * each recorded file its leader length, sync byte, file name and the
+ * result of the block checksums.
+ */
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <SDL.h>
+#include "cas_decode.h"
+#include "error.h"
+
+#ifndef TRUE
+#define TRUE  1
+#define FALSE 0
+#endif
+
+#if defined(__OS2__) || defined(_WIN32)
+#define DIR_SLASH '\\'
+#else
+#define DIR_SLASH '/'
+#endif
+
+#define MAX_JOBS    64
+#define GAP_US      100000.0  /* silence that separates recorded files */
+#define SYNC_LOW    0x00A5    /* leader 0x00 + sync 0xA5 (250/500 bps) */
+#define SYNC_HIGH   0x557F    /* leader 0x55 + sync 0x7F (1500 bps) */
+
+const char *program_name;
+
+struct wave {
+  Uint8 *samples;             /* 8-bit unsigned mono */
+  long count;
+  int rate;
+};
+
+struct block {
+  Uint8 *bits;
+  long nbits;
+  long size;
+  int slow;                   /* bits decoded at 250 bps */
+};
+
+struct tape {
+  struct block *blocks;
+  int nblocks;
+  int size;
+};
+
+struct job {
+  char path[FILENAME_MAX];
+  char *report;
+  size_t len;
+  size_t size;
+  int failed;
+};
+
+static struct job *jobs;
+static int num_jobs;
+static int next_job;
+static SDL_mutex *job_lock;
+static char out_dir[FILENAME_MAX];
+static int verbose;
+
+static void report(struct job *job, const char *fmt, ...)
+{
+  va_list args;
+  int len;
+
+  for (;;) {
+    size_t const avail = job->size - job->len;
+
+    va_start(args, fmt);
+    len = vsnprintf(job->report + job->len, avail, fmt, args);
+    va_end(args);
+    if (len < 0)
+      return;
+    if ((size_t)len < avail) {
+      job->len += len;
+      return;
+    }
+    job->size = job->size * 2 + len + 1;
+    if ((job->report = realloc(job->report, job->size)) == NULL)
+      fatal("failed to allocate report");
+  }
+}
+
+static int get_le16(const Uint8 *p)
+{
+  return p[0] | (p[1] << 8);
+}
+
+static Uint32 get_le32(const Uint8 *p)
+{
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((Uint32)p[3] << 24);
+}
+
+/*
+ * Unlike the emulator, accept 8 or 16 bit PCM and mono or stereo files
+ * (using the left channel only): tape rips are rarely in 8-bit mono.
+ */
+static int read_wave(struct job *job, struct wave *wave)
+{
+  FILE *f;
+  Uint8 *data;
+  Uint8 *fmt = NULL;
+  Uint8 *pcm = NULL;
+  long size, pos, pcm_size = 0;
+  int bits, channels, frame;
+  long i;
+
+  if ((f = fopen(job->path, "rb")) == NULL) {
+    report(job, "%s: %s\n", job->path, strerror(errno));
+    return -1;
+  }
+  fseek(f, 0, SEEK_END);
+  size = ftell(f);
+  rewind(f);
+  if (size < 12 || (data = malloc(size)) == NULL) {
+    report(job, "%s: not a wav file\n", job->path);
+    fclose(f);
+    return -1;
+  }
+  if (fread(data, 1, size, f) != (size_t)size) {
+    report(job, "%s: %s\n", job->path, strerror(errno));
+    fclose(f);
+    free(data);
+    return -1;
+  }
+  fclose(f);
+
+  if (memcmp(data, "RIFF", 4) || memcmp(data + 8, "WAVE", 4)) {
+    report(job, "%s: not a wav file\n", job->path);
+    free(data);
+    return -1;
+  }
+
+  for (pos = 12; pos + 8 <= size; ) {
+    long const chunk = get_le32(data + pos + 4);
+    long const left = size - pos - 8;
+
+    if (memcmp(data + pos, "fmt ", 4) == 0) {
+      if (chunk >= 16 && left >= 16)
+        fmt = data + pos + 8;
+    } else if (memcmp(data + pos, "data", 4) == 0) {
+      pcm = data + pos + 8;
+      pcm_size = (chunk < 0 || chunk > left) ? left : chunk;
+    }
+    /* Truncated file: the chunk is the last one */
+    if (chunk < 0 || chunk >= left)
+      break;
+    pos += 8 + chunk + (chunk & 1);
+  }
+
+  if (fmt == NULL || pcm == NULL || get_le16(fmt) != 1) {
+    report(job, "%s: unusable wav file: must be pcm\n", job->path);
+    free(data);
+    return -1;
+  }
+
+  channels = get_le16(fmt + 2);
+  wave->rate = get_le32(fmt + 4);
+  bits = get_le16(fmt + 14);
+  if ((bits != 8 && bits != 16) || channels < 1 || wave->rate <= 0) {
+    report(job, "%s: unusable wav file: %d bits/sample\n", job->path, bits);
+    free(data);
+    return -1;
+  }
+
+  frame = channels * bits / 8;
+  if (frame == 0) {
+    report(job, "%s: unusable wav file: %d channels\n", job->path, channels);
+    free(data);
+    return -1;
+  }
+  wave->count = pcm_size / frame;
+  if ((wave->samples = malloc(wave->count + 1)) == NULL)
+    fatal("failed to allocate %ld samples", wave->count);
+
+  for (i = 0; i < wave->count; i++) {
+    Uint8 const *s = pcm + i * frame;
+
+    if (bits == 8)
+      wave->samples[i] = s[0];
+    else
+      wave->samples[i] = (Uint8)(((Sint16)get_le16(s) >> 8) + 128);
+  }
+
+  free(data);
+  return 0;
+}
+
+static void add_bit(struct tape *tape, int bit, int slow)
+{
+  struct block *block = &tape->blocks[tape->nblocks - 1];
+
+  if (block->nbits == block->size) {
+    block->size = block->size ? block->size * 2 : 4096;
+    if ((block->bits = realloc(block->bits, block->size)) == NULL)
+      fatal("failed to allocate bit buffer");
+  }
+  block->bits[block->nbits++] = bit;
+  block->slow += slow;
+}
+
+static void new_block(struct tape *tape)
+{
+  if (tape->nblocks && tape->blocks[tape->nblocks - 1].nbits == 0)
+    return;
+
+  if (tape->nblocks == tape->size) {
+    tape->size = tape->size ? tape->size * 2 : 16;
+    if ((tape->blocks = realloc(tape->blocks,
+        tape->size * sizeof(struct block))) == NULL)
+      fatal("failed to allocate block list");
+  }
+  memset(&tape->blocks[tape->nblocks++], 0, sizeof(struct block));
+}
+
+static void free_tape(struct tape *tape)
+{
+  int i;
+
+  for (i = 0; i < tape->nblocks; i++)
+    free(tape->blocks[i].bits);
+  free(tape->blocks);
+  memset(tape, 0, sizeof(struct tape));
+}
+
+/*
+ * Recover the bit stream at low (250/500 bps) or high (1500 bps) speed,
+ * feeding the signal levels to the pulse decoder just like the emulated
+ * Z80 would output them when writing a tape.
+ */
+static void decode_tape(const struct wave *wave, int speed, struct tape *tape)
+{
+  struct cas_detector det;
+  int const initial = (speed == SPEED_1500) ? ST_1500 : ST_INITIAL;
+  int pulsestate = initial;
+  int value = 0, lastnonzero = 2;
+  long run = 0;
+  long i;
+
+  cas_detector_reset(&det);
+  new_block(tape);
+
+  for (i = 0; i <= wave->count; i++) {
+    int next;
+
+    if (i < wave->count) {
+      next = cas_detect_level(&det, wave->samples[i], speed);
+      /* Hysteresis in 1500 bps zero-crossing detector */
+      if (speed == SPEED_1500) {
+        if (next == 0)
+          next = lastnonzero;
+        else
+          lastnonzero = next;
+      }
+    } else {
+      /* End of tape: a pulse would follow to complete the last bit */
+      next = value ? 0 : 1;
+      run = GAP_US * wave->rate / 1000000.0 + 1;
+    }
+
+    if (next == value) {
+      run++;
+    } else {
+      float const delta_us = run * (1000000.0 / wave->rate);
+      int const bit = cas_pulse_to_bit(&pulsestate, value, next, delta_us);
+
+      if (speed != SPEED_1500 && pulsestate == ST_1500)
+        pulsestate = ST_INITIAL;
+      if (bit != CAS_NOBIT)
+        add_bit(tape, bit, pulsestate >= ST_250);
+      if (delta_us > GAP_US) {
+        new_block(tape);
+        pulsestate = initial;
+      }
+      value = next;
+      run = 1;
+    }
+  }
+}
+
+static int find_sync(const struct block *block, int speed)
+{
+  unsigned int const sync = (speed == SPEED_1500) ? SYNC_HIGH : SYNC_LOW;
+  unsigned int shift = (speed == SPEED_1500) ? 0 : 0xFFFF;
+  long i;
+
+  for (i = 0; i < block->nbits; i++) {
+    shift = ((shift << 1) | block->bits[i]) & 0xFFFF;
+    if (shift == sync)
+      return i + 1;
+  }
+  return -1;
+}
+
+static long get_bytes(const struct block *block, long start, Uint8 *buf)
+{
+  long n = 0;
+  long i;
+
+  for (i = start; i + 8 <= block->nbits; i += 8) {
+    int byte = 0, bit;
+
+    for (bit = 0; bit < 8; bit++)
+      byte = (byte << 1) | block->bits[i + bit];
+    buf[n++] = byte;
+  }
+  return n;
+}
+
+static void describe(struct job *job, const Uint8 *data, long len)
+{
+  if (len >= 7 && data[0] == 0x55) {
+    int blocks = 0, bad = 0, entry = -1;
+    long i = 7;
+
+    while (i < len) {
+      if (data[i] == 0x3C && i + 4 < len) {
+        int const count = data[i + 1] ? data[i + 1] : 256;
+        int sum = data[i + 2] + data[i + 3];
+        int j;
+
+        if (i + 4 + count >= len)
+          break;
+        for (j = 0; j < count; j++)
+          sum += data[i + 4 + j];
+        if ((sum & 0xFF) != data[i + 4 + count])
+          bad++;
+        blocks++;
+        i += 5 + count;
+      } else if (data[i] == 0x78 && i + 2 < len) {
+        entry = data[i + 1] | (data[i + 2] << 8);
+        break;
+      } else
+        break;
+    }
+    report(job, " SYSTEM \"%.6s\" %d block%s", data + 1, blocks,
+           blocks == 1 ? "" : "s");
+    if (bad)
+      report(job, ", %d bad checksum%s", bad, bad == 1 ? "" : "s");
+    else if (blocks)
+      report(job, ", checksums ok");
+    if (entry >= 0)
+      report(job, ", entry 0x%04X\n", entry);
+    else
+      report(job, ", truncated\n");
+  } else if (len >= 4 && data[0] == 0xD3 && data[1] == 0xD3 && data[2] == 0xD3) {
+    report(job, " BASIC \"%c\" %ld bytes\n",
+           data[3] >= 0x20 && data[3] < 0x7F ? data[3] : '?', len - 4);
+  } else
+    report(job, " data %ld bytes\n", len);
+}
+
+static const char *speed_name(int speed)
+{
+  switch (speed) {
+    case SPEED_250:
+      return "250";
+    case SPEED_1500:
+      return "1500";
+    default:
+      return "500";
+  }
+}
+
+static int cas_filename(const char *path, char *name)
+{
+  const char *base = strrchr(path, DIR_SLASH);
+  char *ext;
+  int len;
+
+  if (out_dir[0]) {
+    base = base ? base + 1 : path;
+    len = snprintf(name, FILENAME_MAX, "%s%c%s", out_dir, DIR_SLASH, base);
+  } else
+    len = snprintf(name, FILENAME_MAX, "%s", path);
+  if (len < 0 || len >= FILENAME_MAX)
+    return -1;
+
+  ext = strrchr(name, '.');
+  if (ext && strrchr(name, DIR_SLASH) < ext)
+    *ext = '\0';
+  if (strlen(name) + 4 >= FILENAME_MAX)
+    return -1;
+  strcat(name, ".cas");
+  return 0;
+}
+
+/* Score of a decoding pass: bytes found after a sync byte */
+static long score_tape(const struct tape *tape, int speed)
+{
+  long score = 0;
+  int i;
+
+  for (i = 0; i < tape->nblocks; i++) {
+    long const sync = find_sync(&tape->blocks[i], speed);
+
+    if (sync >= 0)
+      score += (tape->blocks[i].nbits - sync) / 8 + 1;
+  }
+  return score;
+}
+
+static void scan_file(struct job *job)
+{
+  struct wave wave;
+  struct tape low = { NULL, 0, 0 }, high = { NULL, 0, 0 };
+  struct tape *tape;
+  char name[FILENAME_MAX];
+  FILE *f = NULL;
+  Uint8 *buf;
+  int speed, files = 0;
+  int i;
+
+  if (cas_filename(job->path, name) < 0) {
+    report(job, "%s: output path too long\n", job->path);
+    job->failed = TRUE;
+    return;
+  }
+  if (read_wave(job, &wave) < 0) {
+    job->failed = TRUE;
+    return;
+  }
+
+  decode_tape(&wave, SPEED_500, &low);
+  decode_tape(&wave, SPEED_1500, &high);
+
+  if (score_tape(&high, SPEED_1500) > score_tape(&low, SPEED_500)) {
+    tape = &high;
+    speed = SPEED_1500;
+    free_tape(&low);
+  } else {
+    tape = &low;
+    speed = SPEED_500;
+    free_tape(&high);
+  }
+
+  if ((buf = malloc(wave.count / 8 + 16)) == NULL)
+    fatal("failed to allocate byte buffer");
+
+  report(job, "%s: %d Hz, %.1f s\n", job->path, wave.rate,
+         (double)wave.count / wave.rate);
+
+  for (i = 0; i < tape->nblocks; i++) {
+    struct block const *block = &tape->blocks[i];
+    long const sync = find_sync(block, speed);
+    int const block_speed = (speed == SPEED_500 && block->slow * 2 > block->nbits)
+        ? SPEED_250 : speed;
+    long leader, len, j;
+
+    if (sync < 0) {
+      if (verbose && block->nbits)
+        report(job, "  noise: %ld bits without sync\n", block->nbits);
+      continue;
+    }
+
+    if (f == NULL && (f = fopen(name, "wb")) == NULL) {
+      report(job, "  %s: %s\n", name, strerror(errno));
+      job->failed = TRUE;
+      break;
+    }
+
+    leader = (sync - 8) / 8;
+    len = get_bytes(block, sync, buf);
+    for (j = 0; j < leader; j++)
+      putc(speed == SPEED_1500 ? 0x55 : 0x00, f);
+    putc(speed == SPEED_1500 ? 0x7F : 0xA5, f);
+    fwrite(buf, 1, len, f);
+
+    report(job, "  #%d %s bps, leader %ld, sync %02X,", ++files,
+           speed_name(block_speed), leader, speed == SPEED_1500 ? 0x7F : 0xA5);
+    describe(job, buf, len);
+  }
+
+  if (f) {
+    fclose(f);
+    report(job, "  -> %s\n", name);
+  } else if (!job->failed) {
+    report(job, "  no recorded files found\n");
+    job->failed = TRUE;
+  }
+
+  free(buf);
+  free_tape(tape);
+  free(wave.samples);
+}
+
+static int scan_thread(void *data)
+{
+  for (;;) {
+    int job;
+
+    SDL_LockMutex(job_lock);
+    job = next_job++;
+    SDL_UnlockMutex(job_lock);
+
+    if (job >= num_jobs)
+      return 0;
+    scan_file(&jobs[job]);
+  }
+}
+
+static void add_job(const char *path)
+{
+  if (num_jobs % 256 == 0) {
+    if ((jobs = realloc(jobs, (num_jobs + 256) * sizeof(struct job))) == NULL)
+      fatal("failed to allocate job list");
+  }
+  memset(&jobs[num_jobs], 0, sizeof(struct job));
+  snprintf(jobs[num_jobs].path, FILENAME_MAX, "%s", path);
+  num_jobs++;
+}
+
+static int compare_jobs(const void *a, const void *b)
+{
+  return strcmp(((const struct job *)a)->path, ((const struct job *)b)->path);
+}
+
+static void add_path(const char *path)
+{
+  struct stat st;
+
+  if (stat(path, &st) < 0) {
+    error("'%s': %s", path, strerror(errno));
+    return;
+  }
+
+  if (S_ISDIR(st.st_mode)) {
+    DIR *dir = opendir(path);
+    struct dirent *entry;
+    int const first = num_jobs;
+
+    if (dir == NULL) {
+      error("failed to open directory '%s': %s", path, strerror(errno));
+      return;
+    }
+    while ((entry = readdir(dir)) != NULL) {
+      int const len = strlen(entry->d_name);
+
+      if (len > 4 && strcasecmp(entry->d_name + len - 4, ".wav") == 0) {
+        char name[FILENAME_MAX];
+
+        if (path[strlen(path) - 1] == DIR_SLASH)
+          snprintf(name, FILENAME_MAX, "%s%s", path, entry->d_name);
+        else
+          snprintf(name, FILENAME_MAX, "%s%c%s", path, DIR_SLASH,
+                   entry->d_name);
+        add_job(name);
+      }
+    }
+    closedir(dir);
+    qsort(jobs + first, num_jobs - first, sizeof(struct job), compare_jobs);
+  } else
+    add_job(path);
+}
+
+static void usage(void)
+{
+  fprintf(stderr,
+          "Usage: %s [-j jobs] [-o dir] [-r report] [-v] file.wav|dir ...\n"
+          "  -j jobs    number of files decoded in parallel (default: CPUs)\n"
+          "  -o dir     write .cas files to dir (default: next to .wav)\n"
+          "  -r report  write report to file (default: stdout)\n"
+          "  -v         also report blocks without sync byte\n",
+          program_name);
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+  SDL_Thread *threads[MAX_JOBS];
+  FILE *out = stdout;
+  const char *report_name = NULL;
+  int num_threads = 0, failed = 0;
+  int i;
+
+  program_name = strrchr(argv[0], DIR_SLASH);
+  if (program_name == NULL)
+    program_name = argv[0];
+  else
+    program_name++;
+
+  for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+    if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+      num_threads = atoi(argv[++i]);
+    else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+      snprintf(out_dir, FILENAME_MAX, "%s", argv[++i]);
+    else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+      report_name = argv[++i];
+    else if (strcmp(argv[i], "-v") == 0)
+      verbose = TRUE;
+    else
+      usage();
+  }
+  if (i == argc)
+    usage();
+
+  for (; i < argc; i++)
+    add_path(argv[i]);
+
+  if (num_jobs == 0)
+    fatal("no .wav files found");
+
+  if (num_threads <= 0) {
+#ifdef SDL2
+    num_threads = SDL_GetCPUCount();
+#else
+    num_threads = 1;
+#endif
+  }
+  if (num_threads > MAX_JOBS)
+    num_threads = MAX_JOBS;
+  if (num_threads > num_jobs)
+    num_threads = num_jobs;
+
+  if ((job_lock = SDL_CreateMutex()) == NULL)
+    fatal("failed to create mutex: %s", SDL_GetError());
+
+  for (i = 0; i < num_threads; i++) {
+#ifdef SDL2
+    threads[i] = SDL_CreateThread(scan_thread, "casscan", NULL);
+#else
+    threads[i] = SDL_CreateThread(scan_thread, NULL);
+#endif
+    if (threads[i] == NULL)
+      fatal("failed to create thread: %s", SDL_GetError());
+  }
+  for (i = 0; i < num_threads; i++)
+    SDL_WaitThread(threads[i], NULL);
+  SDL_DestroyMutex(job_lock);
+
+  if (report_name && (out = fopen(report_name, "w")) == NULL)
+    fatal("failed to write '%s': %s", report_name, strerror(errno));
+
+  for (i = 0; i < num_jobs; i++) {
+    if (jobs[i].report)
+      fputs(jobs[i].report, out);
+    failed += jobs[i].failed;
+    free(jobs[i].report);
+  }
+  fprintf(out, "%d of %d tape%s decoded\n", num_jobs - failed, num_jobs,
+          num_jobs == 1 ? "" : "s");
+
+  if (out != stdout)
+    fclose(out);
+  free(jobs);
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,171 @@
+/*
+ * cmddis - disassemble TRS-80 /cmd files and memory images
+ *
+ * Loads a /cmd file, or a binary image at a given address, and writes
+ * the disassembly of every block it loads, using the same disassembler
+ * (dis.c) as the emulator.  With -t each instruction is followed by its
+ * T-states, the address it jumps or calls to and the memory and I/O it
+ * accesses, for tools analysing the listing.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dis.h"
+#include "error.h"
+#include "load_cmd.h"
+
+#if defined(__OS2__) || defined(_WIN32)
+#define DIR_SLASH '\\'
+#else
+#define DIR_SLASH '/'
+#endif
+
+const char *program_name;
+
+static Uint8 memory[0x10000];
+static Uint8 loadmap[0x10000];
+static int details;
+
+/* Used by dis.c when disassembling from memory */
+int mem_peek(int address)
+{
+  return memory[address & 0xFFFF];
+}
+
+static void print_details(const dis_instruction *ins)
+{
+  int const flags = ins->flags;
+
+  printf("%14s; %d", "", ins->t_states);
+  if (ins->t_taken != ins->t_states)
+    printf("/%d", ins->t_taken);
+  if (ins->target >= 0)
+    printf(" -> %04xh", ins->target);
+  if (flags & DIS_INDIRECT)
+    printf(" -> (%s)", dis_register(ins->operands[0].reg));
+  if (flags & DIS_READ)
+    printf(" read");
+  if (flags & DIS_WRITE)
+    printf(" write");
+  if (ins->memory >= 0)
+    printf(" (%04xh)", ins->memory);
+  if (flags & DIS_STACK)
+    printf(" stack");
+  if (flags & DIS_INPUT)
+    printf(" in");
+  if (flags & DIS_OUTPUT)
+    printf(" out");
+  if (ins->port >= 0)
+    printf(" (%02xh)", ins->port);
+  if (flags & DIS_UNDOCUMENTED)
+    printf(" undoc");
+  putchar('\n');
+}
+
+static void disassemble_block(int start, int end)
+{
+  dis_instruction ins;
+  int addr, length;
+
+  if (!details) {
+    dis_range(stdout, memory + start, end - start, start);
+    return;
+  }
+  for (addr = start; addr < end; addr += length) {
+    if ((length = dis_decode(memory + addr, end - addr, addr, &ins)) == 0) {
+      printf("%04x  %02x%11sdefb\t%02xh\n", addr, memory[addr], "",
+             memory[addr]);
+      length = 1;
+    } else {
+      dis_print(stdout, &ins);
+      print_details(&ins);
+    }
+  }
+}
+
+static void load(const char *name, int org)
+{
+  FILE *file;
+  int entry = -1;
+  int status;
+
+  if ((file = fopen(name, "rb")) == NULL)
+    fatal("failed to open '%s': %s", name, strerror(errno));
+
+  if (org >= 0) {
+    size_t const size = fread(memory + org, 1, 0x10000 - org, file);
+
+    memset(loadmap, 0, sizeof(loadmap));
+    memset(loadmap + org, 1, size);
+  } else {
+    status = load_cmd(file, memory, loadmap, VERBOSITY_QUIET, NULL,
+                      ISAM_NONE, NULL, &entry, 1);
+    if (status != LOAD_CMD_OK && status != LOAD_CMD_ISAM &&
+        status != LOAD_CMD_PDS)
+      fatal("%s: bad /cmd file (%d)", name, status);
+  }
+  fclose(file);
+
+  if (entry >= 0)
+    printf("; %s: entry %04xh\n", name, entry);
+}
+
+static void usage(void)
+{
+  fprintf(stderr,
+          "Usage: %s [-a start-end] [-b org] [-t] file\n"
+          "  -a start-end  only the hex addresses from start to end\n"
+          "  -b org        file is a binary image loaded at hex org\n"
+          "                (default: /cmd file)\n"
+          "  -t            add T-states, targets and memory and I/O used\n",
+          program_name);
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+  static char buffer[1 << 16];
+  int start = 0, end = 0xFFFF;
+  int org = -1;
+  int addr, first = 1;
+  int i;
+
+  program_name = strrchr(argv[0], DIR_SLASH);
+  if (program_name == NULL)
+    program_name = argv[0];
+  else
+    program_name++;
+
+  for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+    if (strcmp(argv[i], "-a") == 0 && i + 1 < argc) {
+      if (sscanf(argv[++i], "%x-%x", &start, &end) != 2)
+        usage();
+    } else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc)
+      org = strtol(argv[++i], NULL, 16) & 0xFFFF;
+    else if (strcmp(argv[i], "-t") == 0)
+      details = 1;
+    else
+      usage();
+  }
+  if (argc - i != 1)
+    usage();
+
+  setvbuf(stdout, buffer, _IOFBF, sizeof(buffer));
+  load(argv[i], org);
+
+  /* Each block of contiguous loaded bytes */
+  for (addr = start & 0xFFFF; addr <= (end & 0xFFFF); addr++) {
+    int block;
+
+    if (!loadmap[addr])
+      continue;
+    for (block = addr; addr <= (end & 0xFFFF) && loadmap[addr]; addr++)
+      ;
+    if (!first)
+      putchar('\n');
+    disassemble_block(block, addr);
+    first = 0;
+  }
+  return EXIT_SUCCESS;
+}
@@ -50,6 +50,8 @@
 
 #include "error.h"
 #include "trs.h"
+#include "trs_input.h"
+#include "trs_rewind.h"
 
 #define MAXLINE		(256)
 #define ADDRESS_SPACE	(0x10000)
@@ -62,20 +64,53 @@
 #define BREAK_ONCE_FLAG		(0x10)
 #define WATCHPOINT_FLAG		(0x20)
 
+/* Comparisons of conditions */
+#define COND_EQ	(1)
+#define COND_NE	(2)
+#define COND_LT	(3)
+#define COND_GT	(4)
+#define COND_LE	(5)
+#define COND_GE	(6)
+
+Uint8 *debug_traps;
+Uint8 *debug_watches;
+Uint8 debug_port_watches[256];
+
 static Uint8 *traps;
+static Uint8 *watches;
 static int num_traps;
 static int print_instructions;
 static int stop_signaled;
-static unsigned int num_watchpoints;
+static int running;
+static int num_trap_addresses;
+static int num_watch_addresses;
+static int ports_watched;
+static tstate_t resume_t_count;
 
 static struct
 {
     int   valid;
     int   address;
     int   flag;
-    Uint8 byte; /* used only by watchpoints */
+    Uint8 byte;       /* used only by watchpoints */
+    int   access;     /* WATCH_* flags of watchpoints */
+    int   hits;
+    int   ignore;     /* number of hits not to stop at */
+    int   cond;       /* COND_* comparison, or 0 for none */
+    int   cond_reg;   /* register compared, -1 for memory at cond_addr */
+    int   cond_addr;
+    int   cond_value;
 } trap_table[MAX_TRAPS];
 
+static const char *const reg_names[] = {
+    "a", "f", "b", "c", "d", "e", "h", "l", "af", "bc", "de", "hl",
+    "ix", "iy", "sp", "pc", "i", "r", NULL
+};
+
+static const char *const cond_names[] = {
+    "", "==", "!=", "<", ">", "<=", ">=", NULL
+};
+
 static void help_message(void)
 {
     puts("(zbx) commands:\n\
@@ -98,6 +133,11 @@ Running:\n\
         until the return.  If the instruction is repeating (such as LDIR),\n\
         continue until it finishes.  Interrupts are always allowed during\n\
         execution, but only \"nextint\" allows an interrupt afterwards.\n\
+    r(everse-)s(tep)\n\
+        Go back by one instruction.\n\
+    r(everse-)c(ontinue)\n\
+        Go back to the last time a breakpoint was reached, or to the start\n\
+        of the history.  Going back needs the -rewind option.\n\
     re(set)\n\
         Hard reset the Z80 and devices.\n\
     s(oft)r(eset)\n\
@@ -133,7 +173,12 @@ Traps:\n\
         Delete trap n, or all traps.\n\
     stop at <address>\n\
     b(reak) <address>\n\
-        Set a breakpoint at the specified hex address.\n\
+    b(reak) <address> if <$reg|(addr)> <op> <value>\n\
+        Set a breakpoint at the specified hex address, which only stops\n\
+        if the hex value of the register or memory compares true with\n\
+        ==, !=, <, >, <= or >=.\n\
+    ig(nore) <n> <count>\n\
+        Do not stop at trap n for the next count hits.\n\
     t(race) <address>\n\
         Set a trap to trace execution at the specified hex address.\n\
     traceon at <address>\n\
@@ -144,6 +189,12 @@ Traps:\n\
         Set a trap to disable tracing at the specified hex address.\n\
     w(atch) <address>\n\
         Set a trap to watch specified hex address for changes.\n\
+    w(atch) <address> r|w|rw|x\n\
+        Set a trap to watch reads, writes, both or execution of the\n\
+        specified hex address.  Reads include opcode fetches.\n\
+    w(atch) in|out <port>\n\
+        Set a trap to watch input or output of the specified hex port.\n\
+        Watchpoints take a condition like breakpoints.\n\
 Miscellaneous:\n\
     a(ssign) $<reg> = <value>\n\
     a(ssign) <addr> = <value>\n\
@@ -207,6 +258,8 @@ static void show_zbxinfo(void)
     printf("Traps set: %d (maximum %d)\n", num_traps, MAX_TRAPS);
     printf("Size of address space: 0x%x\n", ADDRESS_SPACE);
     printf("Maximum length of command line: %d\n", MAXLINE);
+    printf("Sound buffer underruns: %u, overruns: %u\n",
+           trs_sound_underruns, trs_sound_overruns);
 #ifdef READLINE
     puts("GNU Readline library support enabled.");
 #else
@@ -214,19 +267,94 @@ static void show_zbxinfo(void)
 #endif
 }
 
-static void clear_all_traps(void)
+/*
+ * Build the maps checked while running from the table, so traps which
+ * share an address are cleared one at a time.
+ */
+static void update_traps(void)
 {
     int i;
+    int ports = 0;
+
+    memset(traps, 0, ADDRESS_SPACE * sizeof(Uint8));
+    memset(watches, 0, ADDRESS_SPACE * sizeof(Uint8));
+    memset(debug_port_watches, 0, sizeof(debug_port_watches));
+    num_trap_addresses = 0;
+    num_watch_addresses = 0;
+
     for(i = 0; i < MAX_TRAPS; ++i)
     {
-	if(trap_table[i].valid)
+	int const address = trap_table[i].address;
+
+	if(!trap_table[i].valid)
+	    continue;
+	if(trap_table[i].flag != WATCHPOINT_FLAG)
+	{
+	    traps[address] |= trap_table[i].flag;
+	}
+	else if(trap_table[i].access & (WATCH_IN | WATCH_OUT))
 	{
-	    traps[trap_table[i].address] &= ~(trap_table[i].flag);
-	    trap_table[i].valid = 0;
+	    debug_port_watches[address] |= trap_table[i].access;
+	    ports = 1;
 	}
+	else
+	{
+	    if(trap_table[i].access & WATCH_EXEC)
+		traps[address] |= WATCHPOINT_FLAG;
+	    watches[address] |= trap_table[i].access & ~WATCH_EXEC;
+	}
+    }
+    for(i = 0; i < ADDRESS_SPACE; ++i)
+    {
+	if(traps[i]) num_trap_addresses++;
+	if(watches[i]) num_watch_addresses++;
     }
+    /* Watched ports are called through a wrapper */
+    if(ports || ports_watched)
+	trs_io_config();
+    ports_watched = ports;
+}
+
+static void clear_all_traps(void)
+{
+    int i;
+    for(i = 0; i < MAX_TRAPS; ++i)
+	trap_table[i].valid = 0;
     num_traps = 0;
-    num_watchpoints = 0;
+    update_traps();
+}
+
+static void print_trap(int i)
+{
+    printf("[%d] ", i);
+    if(trap_table[i].flag != WATCHPOINT_FLAG)
+	printf("%.4x (%s)", trap_table[i].address,
+	       trap_name(trap_table[i].flag));
+    else if(trap_table[i].access & (WATCH_IN | WATCH_OUT))
+	printf("port %.2x (watch %s)", trap_table[i].address,
+	       trap_table[i].access & WATCH_IN ? "in" : "out");
+    else if(trap_table[i].access & WATCH_CHANGE)
+	printf("%.4x (watchpoint)", trap_table[i].address);
+    else
+	printf("%.4x (watch %s%s%s)", trap_table[i].address,
+	       trap_table[i].access & WATCH_READ ? "r" : "",
+	       trap_table[i].access & WATCH_WRITE ? "w" : "",
+	       trap_table[i].access & WATCH_EXEC ? "x" : "");
+    if(trap_table[i].cond)
+    {
+	if(trap_table[i].cond_reg < 0)
+	    printf(" if (%.4x)", trap_table[i].cond_addr);
+	else
+	    printf(" if $%s", reg_names[trap_table[i].cond_reg]);
+	printf(" %s %x", cond_names[trap_table[i].cond],
+	       trap_table[i].cond_value);
+    }
+    if(trap_table[i].hits)
+	printf(" hit %d time%s", trap_table[i].hits,
+	       trap_table[i].hits == 1 ? "" : "s");
+    if(trap_table[i].ignore)
+	printf(", ignore next %d", trap_table[i].ignore);
+    putchar('\n');
 }
 
 static void print_traps(void)
@@ -239,8 +367,7 @@ static void print_traps(void)
 	{
 	    if(trap_table[i].valid)
 	    {
-		printf("[%d] %.4x (%s)\n", i, trap_table[i].address,
-		       trap_name(trap_table[i].flag));
+		print_trap(i);
 	    }
 	}
     }
@@ -250,13 +377,120 @@ static void print_traps(void)
     }
 }
 
-static void set_trap(int address, int flag)
+/*
+ * Parse a condition "if $reg op value" or "if (addr) op value" from the
+ * text, which is left alone if there is none.  Returns -1 if it is bad.
+ */
+static int parse_condition(const char *input, int i)
+{
+    const char *text = strstr(input, " if ");
+    char name[8], op[3];
+    unsigned int addr, value;
+    int reg = -1;
+
+    trap_table[i].cond = 0;
+    if(text == NULL)
+	return 0;
+
+    if(sscanf(text, " if $%7[a-zA-Z] %2[=!<>] %x", name, op, &value) == 3)
+    {
+	for(reg = 0; reg_names[reg]; ++reg)
+	    if(!strcasecmp(name, reg_names[reg])) break;
+	if(reg_names[reg] == NULL)
+	{
+	    printf("Unrecognized register name '%s'.\n", name);
+	    return -1;
+	}
+    }
+    else if(sscanf(text, " if (%x) %2[=!<>] %x", &addr, op, &value) == 3)
+    {
+	trap_table[i].cond_addr = addr % ADDRESS_SPACE;
+    }
+    else
+    {
+	puts("Bad condition.");
+	return -1;
+    }
+
+    for(trap_table[i].cond = 1; cond_names[trap_table[i].cond];
+	++trap_table[i].cond)
+	if(!strcmp(op, cond_names[trap_table[i].cond])) break;
+    if(cond_names[trap_table[i].cond] == NULL)
+    {
+	trap_table[i].cond = 0;
+	printf("Unrecognized comparison '%s'.\n", op);
+	return -1;
+    }
+    trap_table[i].cond_reg = reg;
+    trap_table[i].cond_value = value;
+    return 0;
+}
+
+static int reg_value(int reg)
+{
+    switch(reg)
+    {
+      case 0:  return Z80_A;
+      case 1:  return Z80_F;
+      case 2:  return Z80_B;
+      case 3:  return Z80_C;
+      case 4:  return Z80_D;
+      case 5:  return Z80_E;
+      case 6:  return Z80_H;
+      case 7:  return Z80_L;
+      case 8:  return Z80_AF;
+      case 9:  return Z80_BC;
+      case 10: return Z80_DE;
+      case 11: return Z80_HL;
+      case 12: return Z80_IX;
+      case 13: return Z80_IY;
+      case 14: return Z80_SP;
+      case 15: return Z80_PC;
+      case 16: return Z80_I;
+      case 17: return (Z80_R & 0x7f) | Z80_R7;
+      default: return 0;
+    }
+}
+
+/* Count a hit of trap i if its condition is true; non-zero to stop */
+static int trap_hit(int i)
+{
+    if(trap_table[i].cond)
+    {
+	int const x = trap_table[i].cond_reg < 0
+	    ? mem_peek(trap_table[i].cond_addr)
+	    : reg_value(trap_table[i].cond_reg);
+	int const y = trap_table[i].cond_value;
+	int result;
+
+	switch(trap_table[i].cond)
+	{
+	  case COND_EQ: result = x == y; break;
+	  case COND_NE: result = x != y; break;
+	  case COND_LT: result = x < y;  break;
+	  case COND_GT: result = x > y;  break;
+	  case COND_LE: result = x <= y; break;
+	  default:      result = x >= y; break;
+	}
+	if(!result) return 0;
+    }
+    trap_table[i].hits++;
+    if(trap_table[i].ignore > 0)
+    {
+	trap_table[i].ignore--;
+	return 0;
+    }
+    return 1;
+}
+
+static int set_trap(int address, int flag, int access)
 {
     int i;
 
     if(num_traps == MAX_TRAPS)
     {
 	printf("Cannot set more than %d traps.\n", MAX_TRAPS);
+	return -1;
     }
     else
     {
@@ -266,16 +500,19 @@ static void set_trap(int address, int flag)
 	trap_table[i].valid = 1;
 	trap_table[i].address = address;
 	trap_table[i].flag = flag;
-	if (trap_table[i].flag == WATCHPOINT_FLAG) {
+	trap_table[i].access = access;
+	trap_table[i].hits = 0;
+	trap_table[i].ignore = 0;
+	trap_table[i].cond = 0;
+	if (access & WATCH_CHANGE) {
 	    /* Initialize the byte field to current memory contents. */
-	    trap_table[i].byte = mem_read(address);
-	    /* Increment number of set watchpoints. */
-	    num_watchpoints++;
+	    trap_table[i].byte = mem_peek(address);
 	}
-	traps[address] |= flag;
 	num_traps++;
+	update_traps();
 
 	printf("Set %s [%d] at %.4x\n", trap_name(flag), i, address);
+	return i;
     }
 }
 
@@ -287,13 +524,9 @@ static void clear_trap(int i)
     }
     else
     {
-	traps[trap_table[i].address] &= ~(trap_table[i].flag);
 	trap_table[i].valid = 0;
-	if (trap_table[i].flag == WATCHPOINT_FLAG) {
-	    /* Decrement number of set watchpoints. */
-	    num_watchpoints--;
-	}
 	num_traps--;
+	update_traps();
 	printf("Cleared %s [%d] at %.4x\n",
 	       trap_name(trap_table[i].flag), i, trap_table[i].address);
     }
@@ -312,6 +545,162 @@ static void clear_trap_address(int address, int flag)
     }
 }
 
+static int at_breakpoint(void)
+{
+    return traps[Z80_PC] & BREAKPOINT_FLAG;
+}
+
+/*
+ * Called by z80_run() before the instruction at a trap in debug_traps.
+ * Breakpoints do not stop before the first instruction run, which is
+ * where the debugger stopped.
+ */
+int debug_trap(void)
+{
+    Uint8 const t = traps[Z80_PC];
+    int const address = Z80_PC;
+    int i;
+    int stop = 0;
+
+    if(t & TRACE_FLAG)
+    {
+	printf("Trace: ");
+	disassemble(Z80_PC);
+    }
+    if((t & DISASSEMBLE_ON_FLAG) && !print_instructions)
+    {
+	/* Go on one instruction at a time */
+	print_instructions = 1;
+	disassemble(Z80_PC);
+	if (trs_continuous > 0) trs_continuous = 0;
+    }
+    if(t & DISASSEMBLE_OFF_FLAG)
+    {
+	print_instructions = 0;
+    }
+    if(z80_state.t_count == resume_t_count)
+	return 0;
+
+    for(i = 0; i < MAX_TRAPS; ++i)
+    {
+	if(!trap_table[i].valid || trap_table[i].address != address)
+	    continue;
+	if(trap_table[i].flag == WATCHPOINT_FLAG)
+	{
+	    if((trap_table[i].access & WATCH_EXEC) && trap_hit(i))
+	    {
+		printf("Memory location 0x%.4x executed.\n", address);
+		stop = 1;
+	    }
+	}
+	else if((trap_table[i].flag & (BREAKPOINT_FLAG | BREAK_ONCE_FLAG))
+		&& trap_hit(i))
+	{
+	    stop = 1;
+	}
+    }
+    if(stop)
+    {
+	stop_signaled = 1;
+	clear_trap_address(address, BREAK_ONCE_FLAG);
+    }
+    return stop;
+}
+
+static void watch_stop(void)
+{
+    stop_signaled = 1;
+    if (trs_continuous > 0) trs_continuous = 0;
+}
+
+/* Called on accesses to addresses in debug_watches */
+void debug_watch_mem(int address, int value, int access)
+{
+    int i;
+
+    if(!running || trs_input_replaying == INPUT_REPLAY_HISTORY)
+	return;
+
+    for(i = 0; i < MAX_TRAPS; ++i)
+    {
+	if(!trap_table[i].valid || trap_table[i].flag != WATCHPOINT_FLAG ||
+	   trap_table[i].address != address ||
+	   (trap_table[i].access & (WATCH_IN | WATCH_OUT)))
+	    continue;
+	if(trap_table[i].access & access & (WATCH_READ | WATCH_WRITE))
+	{
+	    if(trap_hit(i))
+	    {
+		if(access == WATCH_READ)
+		    printf("Memory location 0x%.4x read.\n", address);
+		else
+		    printf("Memory location 0x%.4x written with 0x%.2x.\n",
+			   address, value);
+		watch_stop();
+	    }
+	}
+	else if((trap_table[i].access & WATCH_CHANGE) &&
+		access == WATCH_CHANGE && value != trap_table[i].byte)
+	{
+	    Uint8 const byte = trap_table[i].byte;
+
+	    trap_table[i].byte = value;
+	    if(trap_hit(i))
+	    {
+		/*
+		 * If a watched memory location changes, report it and
+		 * stop after the instruction.
+		 */
+		printf("Memory location 0x%.4x changed value from "
+		       "0x%.2x to 0x%.2x.\n", address, byte, value);
+		watch_stop();
+	    }
+	}
+    }
+}
+
+/*
+ * Compare the watched bytes with memory after writes which don't go
+ * through mem_write, like those of the emulator traps.
+ */
+void debug_watch_check(void)
+{
+    int i;
+
+    for(i = 0; i < MAX_TRAPS; ++i)
+    {
+	int value;
+
+	if(!trap_table[i].valid || trap_table[i].flag != WATCHPOINT_FLAG ||
+	   !(trap_table[i].access & WATCH_CHANGE))
+	    continue;
+	value = mem_peek(trap_table[i].address);
+	if(value != trap_table[i].byte)
+	    debug_watch_mem(trap_table[i].address, value, WATCH_CHANGE);
+    }
+}
+
+/* Called on input or output of ports in debug_port_watches */
+void debug_watch_port(int port, int value, int access)
+{
+    int i;
+
+    if(!running || trs_input_replaying == INPUT_REPLAY_HISTORY)
+	return;
+
+    for(i = 0; i < MAX_TRAPS; ++i)
+    {
+	if(trap_table[i].valid && trap_table[i].flag == WATCHPOINT_FLAG &&
+	   trap_table[i].address == port &&
+	   (trap_table[i].access & access) && trap_hit(i))
+	{
+	    printf("Port 0x%.2x %s 0x%.2x.\n", port,
+		   access == WATCH_IN ? "input" : "output", value);
+	    watch_stop();
+	}
+    }
+}
+
 static void debug_print_registers(void)
 {
     puts("\n       S Z - H - PV N C   IFF1 IFF2 IM");
@@ -352,10 +741,12 @@ void debug_init(void)
     int i;
 
     traps = (Uint8 *) malloc(ADDRESS_SPACE * sizeof(Uint8));
-    if (traps == NULL)
+    watches = (Uint8 *) malloc(ADDRESS_SPACE * sizeof(Uint8));
+    if (traps == NULL || watches == NULL)
       fatal("debug_init: failed to allocate traps");
 
     memset(traps, 0, ADDRESS_SPACE * sizeof(Uint8));
+    memset(watches, 0, ADDRESS_SPACE * sizeof(Uint8));
 
     for(i = 0; i < MAX_TRAPS; ++i) trap_table[i].valid = 0;
 
@@ -431,91 +822,30 @@ static void save_memory(Uint16 address, int num_bytes, const char *filename)
     }
 }
 
+/*
+ * Traps are checked by z80_run() and the memory and port access through
+ * the maps, so the Z80 runs at full speed unless tracing.
+ */
 static void debug_run(void)
 {
-    Uint8 t;
-    Uint8 byte;
-    int continuous;
-    int i;
-    int watch_triggered = 0;
-
     stop_signaled = 0;
+    resume_t_count = z80_state.t_count;
+    running = 1;
+    debug_traps = num_trap_addresses ? traps : NULL;
+    debug_watches = num_watch_addresses ? watches : NULL;
 
-    t = traps[Z80_PC];
     while(!stop_signaled)
     {
-	if(t)
-	{
-	    if(t & TRACE_FLAG)
-	    {
-		printf("Trace: ");
-		disassemble(Z80_PC);
-	    }
-	    if(t & DISASSEMBLE_ON_FLAG)
-	    {
-		print_instructions = 1;
-	    }
-	    if(t & DISASSEMBLE_OFF_FLAG)
-	    {
-		print_instructions = 0;
-	    }
-	}
-
 	if(print_instructions) disassemble(Z80_PC);
 
-	continuous = (!print_instructions && num_traps == 0);
-	if (z80_run(continuous)) {
+	if (z80_run(!print_instructions)) {
 	  puts("emt_debug instruction executed.");
 	  stop_signaled = 1;
 	}
-
-	t = traps[Z80_PC];
-	if(t & BREAKPOINT_FLAG)
-	{
-	    stop_signaled = 1;
-	}
-	if(t & BREAK_ONCE_FLAG)
-	{
-	    stop_signaled = 1;
-	    clear_trap_address(Z80_PC, BREAK_ONCE_FLAG);
-	}
-
-	/*
-	 * Iterate over the trap list looking for watchpoints only if we
-	 * know there are any to be found.
-	 */
-	if (num_watchpoints)
-	{
-	    for (i = 0; i < MAX_TRAPS; ++i)
-	    {
-		if (trap_table[i].valid &&
-		    trap_table[i].flag == WATCHPOINT_FLAG)
-		{
-		    byte = mem_read(trap_table[i].address);
-		    if (byte != trap_table[i].byte)
-		    {
-			/*
-			 * If a watched memory location has changed, report
-			 * it, update the watch entry in the trap table to
-			 * reflect the new value, and set the
-			 * watch_triggered flag so that we stop after all
-			 * watchpoints have been processed.
-			 */
-			printf("Memory location 0x%.4x changed value from "
-			       "0x%.2x to 0x%.2x.\n", trap_table[i].address,
-			       trap_table[i].byte, byte);
-			trap_table[i].byte = byte;
-			watch_triggered = 1;
-		    }
-		}
-	    }
-	    if (watch_triggered)
-	    {
-		stop_signaled = 1;
-	    }
-	}
-
     }
+    debug_traps = NULL;
+    debug_watches = NULL;
+    running = 0;
     printf("Stopped at %.4x\n", Z80_PC);
 }
 
@@ -730,13 +1060,13 @@ void debug_shell(void)
 		    break;
 		}
 		if (is_call) {
-		    set_trap((Z80_PC + 3) % ADDRESS_SPACE, BREAK_ONCE_FLAG);
+		    set_trap((Z80_PC + 3) % ADDRESS_SPACE, BREAK_ONCE_FLAG, 0);
 		    debug_run();
 		} else if (is_rst) {
-		    set_trap((Z80_PC + 1) % ADDRESS_SPACE, BREAK_ONCE_FLAG);
+		    set_trap((Z80_PC + 1) % ADDRESS_SPACE, BREAK_ONCE_FLAG, 0);
 		    debug_run();
 		} else if (is_rep) {
-		    set_trap((Z80_PC + 2) % ADDRESS_SPACE, BREAK_ONCE_FLAG);
+		    set_trap((Z80_PC + 2) % ADDRESS_SPACE, BREAK_ONCE_FLAG, 0);
 		    debug_run();
 		} else {
 		    z80_run((!strcmp(command, "nextint") || !strcmp(command, "ni")) ? 0 : -1);
@@ -850,18 +1180,45 @@ void debug_shell(void)
 	    {
 		z80_run(0);
 	    }
+	    else if(!strcmp(command, "reverse-step") || !strcmp(command, "rs"))
+	    {
+		if (trs_rewind_search(NULL) < 0)
+		    puts("No history to go back to.");
+		trs_screen_refresh();
+	    }
+	    else if(!strcmp(command, "reverse-continue") ||
+		    !strcmp(command, "rc"))
+	    {
+		switch (trs_rewind_search(at_breakpoint))
+		{
+		  case 0:
+		    printf("Stopped at %.4x\n", Z80_PC);
+		    break;
+		  case 1:
+		    puts("No more history.");
+		    break;
+		  default:
+		    puts("No history to go back to.");
+		    break;
+		}
+		trs_screen_refresh();
+	    }
 	    else if(!strcmp(command, "stop") || !strcmp(command, "break") ||
 		    !strcmp(command, "b"))
 	    {
 		unsigned int address;
 
+		int i;
+
 		if(sscanf(input, "stop at %x", &address) != 1 &&
 		   sscanf(input, "%*s %x", &address) != 1)
 		{
 		    address = Z80_PC;
 		}
 		address %= ADDRESS_SPACE;
-		set_trap(address, BREAKPOINT_FLAG);
+		if((i = set_trap(address, BREAKPOINT_FLAG, 0)) >= 0 &&
+		   parse_condition(input, i) < 0)
+		    clear_trap(i);
 	    }
 	    else if(!strcmp(command, "trace") || !strcmp(command, "t"))
 	    {
@@ -872,7 +1229,7 @@ void debug_shell(void)
 		    address = Z80_PC;
 		}
 		address %= ADDRESS_SPACE;
-		set_trap(address, TRACE_FLAG);
+		set_trap(address, TRACE_FLAG, 0);
 	    }
 	    else if(!strcmp(command, "traceon") || !strcmp(command, "tron"))
 	    {
@@ -881,7 +1238,7 @@ void debug_shell(void)
 		if(sscanf(input, "traceon at %x", &address) == 1 ||
 		   sscanf(input, "tron %x", &address) == 1)
 		{
-		    set_trap(address, DISASSEMBLE_ON_FLAG);
+		    set_trap(address, DISASSEMBLE_ON_FLAG, 0);
 		}
 		else
 		{
@@ -896,7 +1253,7 @@ void debug_shell(void)
 		if(sscanf(input, "traceoff at %x", &address) == 1 ||
 		   sscanf(input, "troff %x", &address) == 1)
 		{
-		    set_trap(address, DISASSEMBLE_OFF_FLAG);
+		    set_trap(address, DISASSEMBLE_OFF_FLAG, 0);
 		}
 		else
 		{
@@ -907,11 +1264,59 @@ void debug_shell(void)
 	    else if(!strcmp(command, "watch") || !strcmp(command, "w"))
 	    {
 		unsigned int address;
+		char mode[8] = "";
+		int access = 0;
+		int i;
 
-		if(sscanf(input, "%*s %x", &address) == 1)
+		if(sscanf(input, "%*s in %x", &address) == 1)
+		{
+		    address %= 0x100;
+		    access = WATCH_IN;
+		}
+		else if(sscanf(input, "%*s out %x", &address) == 1)
+		{
+		    address %= 0x100;
+		    access = WATCH_OUT;
+		}
+		else if(sscanf(input, "%*s %x %7s", &address, mode) >= 1)
 		{
 		    address %= ADDRESS_SPACE;
-		    set_trap(address, WATCHPOINT_FLAG);
+		    if(mode[0] == '\0' || !strcmp(mode, "if"))
+			access = WATCH_CHANGE;
+		    else
+		    {
+			if(strchr(mode, 'r')) access |= WATCH_READ;
+			if(strchr(mode, 'w')) access |= WATCH_WRITE;
+			if(strchr(mode, 'x')) access |= WATCH_EXEC;
+			if(strspn(mode, "rwx") != strlen(mode)) access = 0;
+		    }
+		}
+		if(access == 0)
+		{
+		    puts("Syntax error.  (Type \"h(elp)\" for commands.)");
+		}
+		else if((i = set_trap(address, WATCHPOINT_FLAG, access)) >= 0 &&
+			parse_condition(input, i) < 0)
+		{
+		    clear_trap(i);
+		}
+	    }
+	    else if(!strcmp(command, "ignore") || !strcmp(command, "ig"))
+	    {
+		int i, count;
+
+		if(sscanf(input, "%*s %d %d", &i, &count) != 2 || count < 0)
+		{
+		    puts("A trap and a count must be specified.");
+		}
+		else if((i < 0) || (i >= MAX_TRAPS) || !trap_table[i].valid)
+		{
+		    printf("[%d] is not a valid trap.\n", i);
+		}
+		else
+		{
+		    trap_table[i].ignore = count;
+		    print_trap(i);
 		}
 	    }
 	    else if(!strcmp(command, "timeroff"))
@@ -937,6 +1342,7 @@ void debug_shell(void)
 	    {
 		trs_io_debug_flags = 0;
 		sscanf(input, "iodebug %x", (unsigned int *)&trs_io_debug_flags);
+		trs_io_config();
 	    }
 	    else if(!strcmp(command, "load"))
 	    {
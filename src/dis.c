@@ -42,7 +42,9 @@
  * as they are executed.
  */
 
-#ifdef ZBX
+#include <stdlib.h>
+#include <string.h>
+#include "dis.h"
 #include "z80.h"
 
 /* Argument printing */
@@ -983,8 +985,8 @@ static const struct opcode minor[6][256] = {
 	{ "emt_mouse",		A_0 },		/* ed29 */
 	{ "emt_getdir",		A_0 },		/* ed2a */
 	{ "emt_setdir",		A_0 },		/* ed2b */
-	{ undefined,		A_0 },		/* ed2c */
-	{ undefined,		A_0 },		/* ed2d */
+	{ "emt_readx",		A_0 },		/* ed2c */
+	{ "emt_writex",		A_0 },		/* ed2d */
 	{ "dmk_sspd",		A_0 },		/* ed2e */
 	{ "emt_debug",		A_0 },		/* ed2f */
 
@@ -2094,61 +2096,650 @@ static const struct opcode minor[6][256] = {
     }
 };
 
-int disassemble(Uint16 pc)
+/* T-states of the unprefixed instructions, when not taken */
+static const Uint8 major_t[256] = {
+	 4, 10,  7,  6,  4,  4,  7,  4,  4, 11,  7,  6,  4,  4,  7,  4,	/* 00 */
+	 8, 10,  7,  6,  4,  4,  7,  4, 12, 11,  7,  6,  4,  4,  7,  4,	/* 10 */
+	 7, 10, 16,  6,  4,  4,  7,  4,  7, 11, 16,  6,  4,  4,  7,  4,	/* 20 */
+	 7, 10, 13,  6, 11, 11, 10,  4,  7, 11, 13,  6,  4,  4,  7,  4,	/* 30 */
+	 4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,	/* 40 */
+	 4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,	/* 50 */
+	 4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,	/* 60 */
+	 7,  7,  7,  7,  7,  7,  4,  7,  4,  4,  4,  4,  4,  4,  7,  4,	/* 70 */
+	 4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,	/* 80 */
+	 4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,	/* 90 */
+	 4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,	/* a0 */
+	 4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,	/* b0 */
+	 5, 10, 10, 10, 10, 11,  7, 11,  5, 10, 10,  0, 10, 17,  7, 11,	/* c0 */
+	 5, 10, 10, 11, 10, 11,  7, 11,  5,  4, 10, 11, 10,  0,  7, 11,	/* d0 */
+	 5, 10, 10, 19, 10, 11,  7, 11,  5,  4, 10,  4, 10,  0,  7, 11,	/* e0 */
+	 5, 10, 10,  4, 10, 11,  7, 11,  5,  6, 10,  4, 10,  0,  7, 11,	/* f0 */
+};
+
+static const char *const mnemonic_names[DIS_NUM_MNEMONICS] = {
+	"adc", "add", "and", "bit", "call", "ccf", "cp", "cpd", "cpdr", "cpi",
+	"cpir", "cpl", "daa", "dec", "di", "djnz", "ei", "ex", "exx", "halt",
+	"im", "in", "inc", "ind", "indr", "ini", "inir", "jp", "jr", "ld",
+	"ldd", "lddr", "ldi", "ldir", "neg", "nop", "or", "otdr", "otir", "out",
+	"outd", "outi", "pop", "push", "res", "ret", "reti", "retn", "rl", "rla",
+	"rlc", "rlca", "rld", "rr", "rra", "rrc", "rrca", "rrd", "rst", "sbc",
+	"scf", "set", "sla", "slia", "sra", "srl", "sub", "xor", "emt", undefined
+};
+
+static const char *const register_names[DIS_NUM_REGS] = {
+	"b", "c", "d", "e", "h", "l", "a", "i", "r", "ixh", "ixl", "iyh", "iyl",
+	"af", "bc", "de", "hl", "sp", "ix", "iy", "af'"
+};
+
+static const char *const condition_names[8] = {
+	"nz", "z", "nc", "c", "po", "pe", "p", "m"
+};
+
+/* Instructions of the tables decoded once, at the first use */
+struct opinfo {
+	int		mnemonic;
+	int		num_operands;
+	dis_operand	operands[DIS_MAX_OPERANDS];
+	int		arg[DIS_MAX_OPERANDS];	/* 1: first, 2: second argument */
+	int		flags;
+	int		t_states;
+	int		t_taken;
+};
+
+static struct opinfo major_info[256];
+static struct opinfo minor_info[6][256];
+static int info_ready;
+
+static int find_name(const char *const *names, int count, const char *name)
+{
+    int	i;
+
+    for (i = 0; i < count; i++)
+	if (strcmp(names[i], name) == 0)
+	    return i;
+    return -1;
+}
+
+static int is_memory(const dis_operand *op)
+{
+    return op->kind == DIS_OP_MEM || op->kind == DIS_OP_INDEX ||
+	(op->kind == DIS_OP_IND && op->reg != DIS_REG_C);
+}
+
+static void parse_operand(char *text, struct opinfo *info, int n, int *args)
+{
+    dis_operand	*op = &info->operands[n];
+    int		const branch = info->mnemonic == DIS_JP ||
+	info->mnemonic == DIS_CALL || info->mnemonic == DIS_JR ||
+	info->mnemonic == DIS_RET;
+    char	*end;
+
+    if (strchr(text, '%'))
+    {
+	info->arg[n] = ++*args;
+	if (strncmp(text, "(ix+", 4) == 0 || strncmp(text, "(iy+", 4) == 0)
+	{
+	    op->kind = DIS_OP_INDEX;
+	    op->reg = text[2] == 'x' ? DIS_REG_IX : DIS_REG_IY;
+	}
+	else if (text[0] == '(')
+	    op->kind = strstr(text, "%02x%02x") ? DIS_OP_MEM : DIS_OP_PORT;
+	else if (strstr(text, "%04x") || (strstr(text, "%02x%02x") && branch))
+	    op->kind = DIS_OP_ADDR;
+	else
+	    op->kind = DIS_OP_IMM;
+    }
+    else if (text[0] == '(')
+    {
+	if ((end = strchr(text, ')')))
+	    *end = '\0';
+	op->kind = DIS_OP_IND;
+	op->reg = find_name(register_names, DIS_NUM_REGS, text + 1);
+    }
+    else if (branch && n == 0 && (info->num_operands == 2 ||
+	     info->mnemonic == DIS_RET) &&
+	     (op->value = find_name(condition_names, 8, text)) >= 0)
+	op->kind = DIS_OP_COND;
+    else if ((op->reg = find_name(register_names, DIS_NUM_REGS, text)) >= 0)
+    {
+	op->kind = DIS_OP_REG;
+	op->value = 0;
+    }
+    else
+    {
+	op->kind = DIS_OP_IMM;
+	op->reg = 0;
+	op->value = strtol(text, NULL, 16);
+    }
+}
+
+static void set_effects(struct opinfo *info)
+{
+    int	i, memory = 0;
+
+    for (i = 0; i < info->num_operands; i++)
+    {
+	if (is_memory(&info->operands[i]))
+	    memory |= 1 << i;
+	if (info->operands[i].kind == DIS_OP_COND)
+	    info->flags |= DIS_CONDITIONAL;
+	if (info->operands[i].kind == DIS_OP_REG &&
+	    info->operands[i].reg >= DIS_REG_IXH &&
+	    info->operands[i].reg <= DIS_REG_IYL)
+	    info->flags |= DIS_UNDOCUMENTED;
+    }
+
+    switch (info->mnemonic)
+    {
+      case DIS_JP:
+	info->flags |= DIS_JUMP;
+	if (info->operands[0].kind == DIS_OP_IND)
+	    info->flags |= DIS_INDIRECT;
+	break;
+      case DIS_JR:
+	info->flags |= DIS_JUMP;
+	break;
+      case DIS_DJNZ:
+	info->flags |= DIS_JUMP | DIS_CONDITIONAL;
+	break;
+      case DIS_CALL:
+      case DIS_RST:
+	info->flags |= DIS_CALL_SUB | DIS_WRITE | DIS_STACK;
+	break;
+      case DIS_RET:
+      case DIS_RETI:
+      case DIS_RETN:
+	info->flags |= DIS_RETURN | DIS_READ | DIS_STACK;
+	break;
+      case DIS_PUSH:
+	info->flags |= DIS_WRITE | DIS_STACK;
+	break;
+      case DIS_POP:
+	info->flags |= DIS_READ | DIS_STACK;
+	break;
+      case DIS_EX:
+	if (memory)
+	    info->flags |= DIS_READ | DIS_WRITE | DIS_STACK;
+	break;
+      case DIS_LD:
+	if (memory & 1)
+	    info->flags |= DIS_WRITE;
+	if (memory & ~1)
+	    info->flags |= DIS_READ;
+	break;
+      case DIS_LDIR:
+      case DIS_LDDR:
+	info->flags |= DIS_REPEAT;
+	/* fall through */
+      case DIS_LDI:
+      case DIS_LDD:
+      case DIS_RLD:
+      case DIS_RRD:
+	info->flags |= DIS_READ | DIS_WRITE;
+	break;
+      case DIS_CPIR:
+      case DIS_CPDR:
+	info->flags |= DIS_REPEAT;
+	/* fall through */
+      case DIS_CPI:
+      case DIS_CPD:
+	info->flags |= DIS_READ;
+	break;
+      case DIS_INIR:
+      case DIS_INDR:
+	info->flags |= DIS_REPEAT;
+	/* fall through */
+      case DIS_INI:
+      case DIS_IND:
+	info->flags |= DIS_INPUT | DIS_WRITE;
+	break;
+      case DIS_OTIR:
+      case DIS_OTDR:
+	info->flags |= DIS_REPEAT;
+	/* fall through */
+      case DIS_OUTI:
+      case DIS_OUTD:
+	info->flags |= DIS_OUTPUT | DIS_READ;
+	break;
+      case DIS_IN:
+	info->flags |= DIS_INPUT;
+	break;
+      case DIS_OUT:
+	info->flags |= DIS_OUTPUT;
+	break;
+      case DIS_SLIA:
+	info->flags |= DIS_UNDOCUMENTED;
+	/* fall through */
+      case DIS_INC:
+      case DIS_DEC:
+      case DIS_RL:
+      case DIS_RLC:
+      case DIS_RR:
+      case DIS_RRC:
+      case DIS_SLA:
+      case DIS_SRA:
+      case DIS_SRL:
+      case DIS_SET:
+      case DIS_RES:
+	if (memory)
+	    info->flags |= DIS_READ | DIS_WRITE;
+	break;
+      default:
+	if (memory)
+	    info->flags |= DIS_READ;
+	break;
+    }
+}
+
+static int ed_t_states(int i)
+{
+    if (i >= 0x40 && i <= 0x7f)
+    {
+	switch (i & 7)
+	{
+	  case 0: case 1: return 12;	/* in r,(c) out (c),r */
+	  case 2: return 15;		/* sbc adc */
+	  case 3: return 20;		/* ld (nn),rr ld rr,(nn) */
+	  case 5: return 14;		/* retn reti */
+	  case 7:
+	    if (i <= 0x5f)
+		return 9;		/* ld i,a ld r,a ld a,i ld a,r */
+	    if (i <= 0x6f)
+		return 18;		/* rrd rld */
+	    break;
+	}
+	return 8;
+    }
+    if ((i & 0xe4) == 0xa0)
+	return 16;			/* block instructions */
+    return 8;
+}
+
+static void set_timing(struct opinfo *info, const struct opcode *code,
+		       int table, int i)
+{
+    int	n, indexed = 0;
+
+    for (n = 0; n < info->num_operands; n++)
+	if (info->operands[n].kind == DIS_OP_INDEX)
+	    indexed = 1;
+
+    switch (table)
+    {
+      case -1:
+	info->t_states = major_t[i];
+	break;
+      case 0:	/* cb */
+	if ((i & 7) == 6)
+	    info->t_states = (i & 0xc0) == 0x40 ? 12 : 15;
+	else
+	    info->t_states = 8;
+	break;
+      case 2:	/* ed */
+	info->t_states = ed_t_states(i);
+	break;
+      case 1:	/* dd */
+      case 3:	/* fd */
+	if (code->args == A_0B)
+	    info->t_states = 4;
+	else if (i == 0x36)
+	    info->t_states = 19;
+	else
+	    info->t_states = major_t[i] + (indexed ? 12 : 4);
+	break;
+      default:	/* dd cb, fd cb */
+	info->t_states = (i & 0xc0) == 0x40 ? 20 : 23;
+	break;
+    }
+
+    info->t_taken = info->t_states;
+    if (info->flags & DIS_REPEAT)
+	info->t_taken = info->t_states + 5;
+    else if (info->flags & DIS_CONDITIONAL)
+    {
+	if (info->mnemonic == DIS_RET)
+	    info->t_taken = info->t_states + 6;
+	else if (info->mnemonic == DIS_CALL)
+	    info->t_taken = info->t_states + 7;
+	else if (info->mnemonic != DIS_JP)
+	    info->t_taken = info->t_states + 5;
+    }
+}
+
+static void parse_info(const struct opcode *code, int table, int i,
+		       struct opinfo *info)
+{
+    char	text[64];
+    char	*ops[DIS_MAX_OPERANDS + 1];
+    char	*p;
+    int		n, args = 0, load = -1;
+
+    snprintf(text, sizeof(text), "%s", code->name);
+    if (strstr(text, ";undoc"))
+	info->flags |= DIS_UNDOCUMENTED;
+    if ((p = strchr(text, ';')))
+	*p = '\0';
+    if ((p = strchr(text, '\t')))
+	*p++ = '\0';
+    else
+	p = text + strlen(text);
+    for (n = strlen(p); n > 0 && (p[n - 1] == '\t' || p[n - 1] == ' '); n--)
+	p[n - 1] = '\0';
+
+    if (code->name == undefined)
+	info->mnemonic = DIS_UNDEFINED;
+    else if (strncmp(text, "emt_", 4) == 0 || strncmp(text, "dmk_", 4) == 0)
+	info->mnemonic = DIS_EMT;
+    else
+	info->mnemonic = find_name(mnemonic_names, DIS_NUM_MNEMONICS, text);
+
+    /* ld b,rlc (ix+d) or ld b,set 0,(ix+d): the result is loaded into b */
+    if (info->mnemonic == DIS_LD && strchr(p, ' '))
+    {
+	char	*inner = strchr(p, ',');
+
+	*inner++ = '\0';
+	load = find_name(register_names, DIS_NUM_REGS, p);
+	p = strchr(inner, ' ');
+	*p++ = '\0';
+	info->mnemonic = find_name(mnemonic_names, DIS_NUM_MNEMONICS, inner);
+	info->flags |= DIS_UNDOCUMENTED;
+    }
+
+    n = 0;
+    while (*p && n < DIS_MAX_OPERANDS)
+    {
+	ops[n++] = p;
+	if ((p = strchr(p, ',')))
+	    *p++ = '\0';
+	else
+	    break;
+    }
+    info->num_operands = n;
+    for (n = 0; n < info->num_operands; n++)
+	parse_operand(ops[n], info, n, &args);
+    if (load >= 0 && info->num_operands < DIS_MAX_OPERANDS)
+    {
+	info->operands[info->num_operands].kind = DIS_OP_REG;
+	info->operands[info->num_operands++].reg = load;
+    }
+
+    if (code->args == A_0B)
+	info->flags |= DIS_INVALID;
+    set_effects(info);
+    set_timing(info, code, table, i);
+}
+
+static void dis_init(void)
 {
     int	i, j;
-    const struct opcode	*code;
-    int	const addr = pc;
 
-    i = mem_read(pc++);
+    for (i = 0; i < 256; i++)
+	if (major[i].name)
+	    parse_info(&major[i], -1, i, &major_info[i]);
+    for (j = 0; j < 6; j++)
+	for (i = 0; i < 256; i++)
+	    if (minor[j][i].name)
+		parse_info(&minor[j][i], j, i, &minor_info[j][i]);
+    info_ready = 1;
+}
+
+/* Find the opcode in bytes, return the offset of its arguments */
+static int lookup(const Uint8 *bytes, const struct opcode **code,
+		  const struct opinfo **info)
+{
+    int	i, j, pos = 0;
+
+    i = bytes[pos++];
     if (!major[i].name)
     {
 	j = major[i].args;
-	i = mem_read(pc++);
+	i = bytes[pos++];
 	if (!minor[j][i].name)
 	{
 	    /* dd cb or fd cb; offset comes *before* instruction */
 	    j = minor[j][i].args;
-            pc++; /* skip over offset */
-	    i = mem_read(pc++);
+	    pos++; /* skip over offset */
+	    i = bytes[pos++];
 	}
-	code = &minor[j][i];
+	*code = &minor[j][i];
+	*info = &minor_info[j][i];
     }
     else
     {
-	code = &major[i];
+	*code = &major[i];
+	*info = &major_info[i];
+    }
+    return pos;
+}
+
+static void decode(const Uint8 *bytes, Uint16 address, int pos,
+		   const struct opcode *code, const struct opinfo *info,
+		   dis_instruction *ins)
+{
+    int	n, first = 0, second = 0, word = 0;
+
+    switch (code->args)
+    {
+      case A_16:
+	word = bytes[pos] | bytes[pos + 1] << 8;
+	break;
+      case A_8X2:
+	second = bytes[pos + 1];
+	/* fall through */
+      case A_8:
+	first = bytes[pos];
+	break;
+      case A_8P:
+	first = bytes[pos - 2];
+	break;
+      case A_8R:
+	word = (address + pos + 1 + (signed char) bytes[pos]) & 0xffff;
+	break;
+    }
+
+    ins->address = address;
+    memcpy(ins->bytes, bytes, DIS_MAX_LENGTH);
+    ins->length = pos + arglen(code->args);
+    ins->mnemonic = info->mnemonic;
+    ins->num_operands = info->num_operands;
+    ins->flags = info->flags;
+    ins->t_states = info->t_states;
+    ins->t_taken = info->t_taken;
+    ins->target = ins->memory = ins->port = -1;
+
+    for (n = 0; n < info->num_operands; n++)
+    {
+	dis_operand	*op = &ins->operands[n];
+
+	*op = info->operands[n];
+	if (info->arg[n] == 2)
+	    op->value = second;
+	else if (info->arg[n])
+	{
+	    if (code->args == A_16 || code->args == A_8R)
+		op->value = word;
+	    else if (op->kind == DIS_OP_INDEX)
+		op->value = (signed char) first;
+	    else
+		op->value = first;
+	}
+
+	if (op->kind == DIS_OP_ADDR)
+	    ins->target = op->value;
+	else if (op->kind == DIS_OP_MEM)
+	    ins->memory = op->value;
+	else if (op->kind == DIS_OP_PORT)
+	    ins->port = op->value;
+    }
+    if (ins->mnemonic == DIS_RST)
+	ins->target = ins->operands[0].value;
+}
+
+int dis_decode(const Uint8 *buf, int size, Uint16 address,
+	       dis_instruction *ins)
+{
+    Uint8	bytes[DIS_MAX_LENGTH];
+    const struct opcode	*code;
+    const struct opinfo	*info;
+    int		pos;
+
+    if (size <= 0)
+	return 0;
+    if (!info_ready)
+	dis_init();
+
+    memset(bytes, 0, sizeof(bytes));
+    memcpy(bytes, buf, size < DIS_MAX_LENGTH ? size : DIS_MAX_LENGTH);
+    pos = lookup(bytes, &code, &info);
+    if (pos > size || pos + arglen(code->args) > size)
+	return 0;
+    decode(bytes, address, pos, code, info, ins);
+    return ins->length;
+}
+
+int dis_decode_mem(Uint16 address, dis_instruction *ins)
+{
+    Uint8	bytes[DIS_MAX_LENGTH];
+    const struct opcode	*code;
+    const struct opinfo	*info;
+    int		i, pos;
+
+    if (!info_ready)
+	dis_init();
+
+    /* Read only the bytes of the instruction */
+    memset(bytes, 0, sizeof(bytes));
+    bytes[0] = mem_peek(address);
+    if (!major[bytes[0]].name)
+    {
+	bytes[1] = mem_peek((address + 1) & 0xffff);
+	if (!minor[major[bytes[0]].args][bytes[1]].name)
+	{
+	    bytes[2] = mem_peek((address + 2) & 0xffff);
+	    bytes[3] = mem_peek((address + 3) & 0xffff);
+	}
     }
-    printf ("%04x  ", addr);
+    pos = lookup(bytes, &code, &info);
+    for (i = pos; i < pos + arglen(code->args); i++)
+	bytes[i] = mem_peek((address + i) & 0xffff);
+    decode(bytes, address, pos, code, info, ins);
+    return ins->length;
+}
 
-    for (i = 0; i < ((pc + arglen(code->args) - addr) & 0xffff); i++)
-	printf("%02x ", mem_read(addr + i));
-    for (; i < 4; i++)
-	printf("   ");
-    putchar (' ');
+const char *dis_mnemonic(int mnemonic)
+{
+    if (mnemonic < 0 || mnemonic >= DIS_NUM_MNEMONICS)
+	return undefined;
+    return mnemonic_names[mnemonic];
+}
+
+const char *dis_register(int reg)
+{
+    if (reg < 0 || reg >= DIS_NUM_REGS)
+	return "";
+    return register_names[reg];
+}
+
+int dis_format(const dis_instruction *ins, char *text, int size)
+{
+    const struct opcode	*code;
+    const struct opinfo	*info;
+    const Uint8	*args = ins->bytes + lookup(ins->bytes, &code, &info);
 
     switch (code->args) {
       case A_16: /* 16-bit number */
-	printf (code->name, mem_read(pc + 1), mem_read(pc));
-	break;
+	return snprintf(text, size, code->name, args[1], args[0]);
       case A_8X2: /* Two 8-bit numbers */
-	printf (code->name, mem_read(pc), mem_read(pc + 1));
-	break;
+	return snprintf(text, size, code->name, args[0], args[1]);
       case A_8:  /* One 8-bit number */
-	printf (code->name, mem_read(pc));
-	break;
+	return snprintf(text, size, code->name, args[0]);
       case A_8P: /* One 8-bit number before last opcode byte */
-	printf (code->name, mem_read(pc - 2));
-	break;
-      case A_0:  /* No args */
-      case A_0B: /* No args, backskip over last opcode byte */
-	fputs (code->name, stdout);
-	break;
+	return snprintf(text, size, code->name, args[-2]);
       case A_8R: /* One 8-bit relative address */
-	printf (code->name, (pc + 1 + (signed char) mem_read(pc)) & 0xffff);
-	break;
+	return snprintf(text, size, code->name, ins->target);
+      default:   /* No args */
+	return snprintf(text, size, "%s", code->name);
+    }
+}
+
+/* Line of the address, the bytes and the text */
+static void print_line(FILE *file, Uint16 address, const Uint8 *bytes,
+		       int length, const char *text)
+{
+    static const char	hex[] = "0123456789abcdef";
+    char	line[128];
+    char	*p = line;
+    int		i;
+
+    *p++ = hex[address >> 12];
+    *p++ = hex[(address >> 8) & 0xf];
+    *p++ = hex[(address >> 4) & 0xf];
+    *p++ = hex[address & 0xf];
+    *p++ = ' ';
+    *p++ = ' ';
+    for (i = 0; i < DIS_MAX_LENGTH; i++)
+    {
+	*p++ = i < length ? hex[bytes[i] >> 4] : ' ';
+	*p++ = i < length ? hex[bytes[i] & 0xf] : ' ';
+	*p++ = ' ';
+    }
+    *p++ = ' ';
+    snprintf(p, sizeof(line) - (p - line), "%s\n", text);
+    fputs(line, file);
+}
+
+void dis_print(FILE *file, const dis_instruction *ins)
+{
+    char	text[64];
+
+    dis_format(ins, text, sizeof(text));
+    print_line(file, ins->address, ins->bytes, ins->length, text);
+}
+
+long dis_range(FILE *file, const Uint8 *buf, int size, Uint16 address)
+{
+    dis_instruction	ins;
+    char	text[64];
+    long	count = 0;
+    int		pos, length;
+
+    for (pos = 0; pos < size; pos += length, count++)
+    {
+	Uint16	const addr = (address + pos) & 0xffff;
+
+	if ((length = dis_decode(buf + pos, size - pos, addr, &ins)) > 0)
+	    dis_print(file, &ins);
+	else
+	{
+	    /* The last bytes are not a whole instruction */
+	    snprintf(text, sizeof(text), "defb\t%02xh", buf[pos]);
+	    print_line(file, addr, buf + pos, 1, text);
+	    length = 1;
+	}
     }
-    putchar ('\n');
-    pc += arglen(code->args);
-    return pc;  /* return the location of the next instruction */
+    return count;
+}
+
+/* Number of bytes of the instruction at pc */
+int instruction_length(Uint16 pc)
+{
+    dis_instruction	ins;
+
+    return dis_decode_mem(pc, &ins);
+}
+
+/* Print the instruction at pc, return the location of the next */
+int disassemble_file(FILE *file, Uint16 pc)
+{
+    dis_instruction	ins;
+
+    dis_decode_mem(pc, &ins);
+    dis_print(file, &ins);
+    return (pc + ins.length) & 0xffff;
+}
+
+int disassemble(Uint16 pc)
+{
+    return disassemble_file(stdout, pc);
 }
-#endif
@@ -0,0 +1,181 @@
+/*
+ * Z80 disassembler: decodes an instruction into a struct which tells
+ * what it is and what it does, and formats it as text apart from that.
+ */
+#ifndef _DIS_H
+#define _DIS_H
+
+#include <stdio.h>
+#include <SDL_types.h>
+
+#define DIS_MAX_LENGTH     (4)
+#define DIS_MAX_OPERANDS   (3)
+
+/* Mnemonics */
+#define DIS_ADC            (0)
+#define DIS_ADD            (1)
+#define DIS_AND            (2)
+#define DIS_BIT            (3)
+#define DIS_CALL           (4)
+#define DIS_CCF            (5)
+#define DIS_CP             (6)
+#define DIS_CPD            (7)
+#define DIS_CPDR           (8)
+#define DIS_CPI            (9)
+#define DIS_CPIR           (10)
+#define DIS_CPL            (11)
+#define DIS_DAA            (12)
+#define DIS_DEC            (13)
+#define DIS_DI             (14)
+#define DIS_DJNZ           (15)
+#define DIS_EI             (16)
+#define DIS_EX             (17)
+#define DIS_EXX            (18)
+#define DIS_HALT           (19)
+#define DIS_IM             (20)
+#define DIS_IN             (21)
+#define DIS_INC            (22)
+#define DIS_IND            (23)
+#define DIS_INDR           (24)
+#define DIS_INI            (25)
+#define DIS_INIR           (26)
+#define DIS_JP             (27)
+#define DIS_JR             (28)
+#define DIS_LD             (29)
+#define DIS_LDD            (30)
+#define DIS_LDDR           (31)
+#define DIS_LDI            (32)
+#define DIS_LDIR           (33)
+#define DIS_NEG            (34)
+#define DIS_NOP            (35)
+#define DIS_OR             (36)
+#define DIS_OTDR           (37)
+#define DIS_OTIR           (38)
+#define DIS_OUT            (39)
+#define DIS_OUTD           (40)
+#define DIS_OUTI           (41)
+#define DIS_POP            (42)
+#define DIS_PUSH           (43)
+#define DIS_RES            (44)
+#define DIS_RET            (45)
+#define DIS_RETI           (46)
+#define DIS_RETN           (47)
+#define DIS_RL             (48)
+#define DIS_RLA            (49)
+#define DIS_RLC            (50)
+#define DIS_RLCA           (51)
+#define DIS_RLD            (52)
+#define DIS_RR             (53)
+#define DIS_RRA            (54)
+#define DIS_RRC            (55)
+#define DIS_RRCA           (56)
+#define DIS_RRD            (57)
+#define DIS_RST            (58)
+#define DIS_SBC            (59)
+#define DIS_SCF            (60)
+#define DIS_SET            (61)
+#define DIS_SLA            (62)
+#define DIS_SLIA           (63)
+#define DIS_SRA            (64)
+#define DIS_SRL            (65)
+#define DIS_SUB            (66)
+#define DIS_XOR            (67)
+#define DIS_EMT            (68) /* emulator trap, see xtrs */
+#define DIS_UNDEFINED      (69)
+#define DIS_NUM_MNEMONICS  (70)
+
+/* Registers */
+#define DIS_REG_B          (0)
+#define DIS_REG_C          (1)
+#define DIS_REG_D          (2)
+#define DIS_REG_E          (3)
+#define DIS_REG_H          (4)
+#define DIS_REG_L          (5)
+#define DIS_REG_A          (6)
+#define DIS_REG_I          (7)
+#define DIS_REG_R          (8)
+#define DIS_REG_IXH        (9)
+#define DIS_REG_IXL        (10)
+#define DIS_REG_IYH        (11)
+#define DIS_REG_IYL        (12)
+#define DIS_REG_AF         (13)
+#define DIS_REG_BC         (14)
+#define DIS_REG_DE         (15)
+#define DIS_REG_HL         (16)
+#define DIS_REG_SP         (17)
+#define DIS_REG_IX         (18)
+#define DIS_REG_IY         (19)
+#define DIS_REG_AF_PRIME   (20)
+#define DIS_NUM_REGS       (21)
+
+/* Kinds of operands */
+#define DIS_OP_REG         (1) /* reg */
+#define DIS_OP_COND        (2) /* value: nz, z, nc, c, po, pe, p, m */
+#define DIS_OP_IMM         (3) /* value: number, bit, mode or restart */
+#define DIS_OP_ADDR        (4) /* value: address jumped or called to */
+#define DIS_OP_MEM         (5) /* value: address of the memory, (nn) */
+#define DIS_OP_IND         (6) /* reg: holds the address or port, (hl) */
+#define DIS_OP_INDEX       (7) /* reg and value: index and offset, (ix+d) */
+#define DIS_OP_PORT        (8) /* value: port, (n) */
+
+/* What an instruction does */
+#define DIS_JUMP           (0x0001)
+#define DIS_CALL_SUB       (0x0002) /* call and rst */
+#define DIS_RETURN         (0x0004)
+#define DIS_CONDITIONAL    (0x0008) /* jump, call, return only if true */
+#define DIS_INDIRECT       (0x0010) /* jump to an address in a register */
+#define DIS_READ           (0x0020) /* reads memory */
+#define DIS_WRITE          (0x0040) /* writes memory */
+#define DIS_STACK          (0x0080) /* the memory is on the stack */
+#define DIS_INPUT          (0x0100)
+#define DIS_OUTPUT         (0x0200)
+#define DIS_REPEAT         (0x0400) /* runs again until BC or B is 0 */
+#define DIS_UNDOCUMENTED   (0x0800)
+#define DIS_INVALID        (0x1000) /* prefix without instruction */
+
+typedef struct {
+  int kind;
+  int reg;
+  int value;
+} dis_operand;
+
+typedef struct {
+  Uint16 address;
+  Uint8 bytes[DIS_MAX_LENGTH];
+  int length;
+  int mnemonic;
+  int num_operands;
+  dis_operand operands[DIS_MAX_OPERANDS];
+  int flags;
+  int t_states;   /* when not taken or the last time repeated */
+  int t_taken;    /* when the jump, call or return is taken or repeated */
+  int target;     /* address jumped or called to, or -1 */
+  int memory;     /* address of the memory read or written, or -1 */
+  int port;       /* port read or written, or -1 */
+} dis_instruction;
+
+/*
+ * Decode the instruction at address from the size bytes in buf, or from
+ * memory with mem_peek().  Return its length, or 0 if buf ends before.
+ * The undocumented DD CB and FD CB instructions which also load the
+ * result into a register have it as their last operand.
+ */
+extern int dis_decode(const Uint8 *buf, int size, Uint16 address,
+                      dis_instruction *ins);
+extern int dis_decode_mem(Uint16 address, dis_instruction *ins);
+
+/* Names of mnemonics and registers */
+extern const char *dis_mnemonic(int mnemonic);
+extern const char *dis_register(int reg);
+
+/* Assembler text of the instruction, returns its length like snprintf */
+extern int dis_format(const dis_instruction *ins, char *text, int size);
+
+/* Write a line with the address, bytes and text of the instruction */
+extern void dis_print(FILE *file, const dis_instruction *ins);
+
+/* Write all instructions in size bytes of buf which start at address,
+ * return the number of instructions */
+extern long dis_range(FILE *file, const Uint8 *buf, int size, Uint16 address);
+
+#endif
@@ -45,9 +45,17 @@
 #include "error.h"
 #include "load_cmd.h"
 #include "trs.h"
+#include "trs_auto.h"
 #include "trs_disk.h"
+#include "trs_input.h"
+#include "trs_memory.h"
+#include "trs_metrics.h"
+#include "trs_profile.h"
 #include "trs_sdl_keyboard.h"
 #include "trs_state_save.h"
+#include "trs_textdump.h"
+#include "trs_trace.h"
+#include "trs_video.h"
 
 /* Include ROMs */
 #include "trs_fakerom.c"
@@ -206,6 +214,7 @@ int trs_load_cmd(const char *filename)
     return -1;
   }
   if (load_cmd(program, memory, NULL, 0, NULL, -1, NULL, &entry, 1) == LOAD_CMD_OK) {
+    mem_dirty_range(MEM_RAM, 0, 0x10000);
     debug("entry point of '%s': 0x%x (%d) ...\n", filename, entry, entry);
     if (entry >= 0)
       Z80_PC = entry;
@@ -297,6 +306,27 @@ int main(int argc, char *argv[])
   if (trs_cmd_file[0])
     trs_load_cmd(trs_cmd_file);
 
+  if (trs_input_replay_file[0]) {
+    if (trs_input_record_file[0])
+      error("cannot record while replaying '%s'", trs_input_replay_file);
+    if (trs_input_replay_start(trs_input_replay_file) == 0)
+      trs_screen_init(1);
+  } else if (trs_input_record_file[0]) {
+    trs_input_record_start(trs_input_record_file);
+  }
+  if (trs_profile_file[0])
+    trs_profile_start();
+  if (trs_trace_file[0])
+    trs_trace_open();
+  if (trs_textdump_file[0])
+    trs_textdump_open();
+  if (trs_metrics_file[0])
+    trs_metrics_open();
+  if (trs_video_file[0])
+    trs_video_open();
+
+  trs_auto_init();
+
   if (!debug || fullscreen) {
     /* Run continuously until exit or request to enter debugger */
     z80_run(TRUE);
@@ -0,0 +1,342 @@
+/*
+ * tracedump - print, filter and compare execution traces
+ *
+ * Reads the binary traces written by sdltrs with -trace and prints one
+ * line for each instruction with its T-state and disassembly, followed
+ * by the registers it changed, the memory it wrote and the ports it
+ * read and wrote.  Records can be limited to a range of addresses and
+ * to a number of instructions.
+ *
+ * With -d two traces are compared, for example of the same program run
+ * before and after a change to the emulator.  The first instruction
+ * where they differ is printed with the instructions before it, and the
+ * exit status is 1.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "error.h"
+#include "trs_trace.h"
+#include "z80.h"
+
+#if defined(__OS2__) || defined(_WIN32)
+#define DIR_SLASH '\\'
+#else
+#define DIR_SLASH '/'
+#endif
+
+typedef struct {
+  int kind;
+  Uint16 address;
+  Uint8 value;
+} access;
+
+typedef struct {
+  tstate_t t_count;            /* when the instruction started */
+  Uint16 pc;
+  Uint8 op[4];
+  int op_len;
+  int mask;                    /* registers changed */
+  Uint16 regs[TRACE_NUM_REGS]; /* after the instruction */
+  access accesses[TRACE_MAX_ACCESS];
+  int count;
+  int truncated;               /* more accesses than recorded */
+} record;
+
+typedef struct {
+  FILE *file;
+  const char *name;
+  tstate_t t_count;
+  Uint16 regs[TRACE_NUM_REGS];
+  unsigned long number;
+} trace;
+
+static const char *reg_names[TRACE_NUM_REGS] = {
+  "AF", "BC", "DE", "HL", "IX", "IY", "SP",
+  "AF'", "BC'", "DE'", "HL'", "I", "IFF"
+};
+
+const char *program_name;
+
+/* Opcodes of the last records, for the disassembler */
+static Uint8 memory[0x10000];
+
+int mem_peek(int address)
+{
+  return memory[address & 0xFFFF];
+}
+
+static int get_byte(trace *tr)
+{
+  int const c = getc(tr->file);
+
+  if (c == EOF)
+    fatal("%s: unexpected end of trace", tr->name);
+  return c;
+}
+
+static int get_word(trace *tr)
+{
+  int const low = get_byte(tr);
+
+  return low | get_byte(tr) << 8;
+}
+
+static Uint64 get_number(trace *tr)
+{
+  Uint64 number = 0;
+  int shift = 0;
+  int c;
+
+  do {
+    c = get_byte(tr);
+    if (shift < 64)
+      number |= (Uint64)(c & 0x7F) << shift;
+    shift += 7;
+  } while (c & 0x80);
+  return number;
+}
+
+static void open_trace(trace *tr, const char *name)
+{
+  size_t const len = strlen(TRACE_BANNER);
+  char banner[sizeof(TRACE_BANNER)];
+  int i;
+
+  if ((tr->file = fopen(name, "rb")) == NULL)
+    fatal("failed to open '%s': %s", name, strerror(errno));
+  tr->name = name;
+  if (fread(banner, 1, len, tr->file) != len ||
+      memcmp(banner, TRACE_BANNER, len) != 0)
+    fatal("%s: not an execution trace", name);
+  if ((i = get_byte(tr)) != TRACE_VERSION)
+    fatal("%s: unsupported trace version %d", name, i);
+
+  tr->t_count = 0;
+  for (i = 0; i < 8; i++)
+    tr->t_count |= (tstate_t)get_byte(tr) << (i * 8);
+  get_word(tr);
+  for (i = 0; i < TRACE_NUM_REGS; i++)
+    tr->regs[i] = get_word(tr);
+  tr->number = 0;
+}
+
+/* Returns 0 at the end of the trace */
+static int read_record(trace *tr, record *rec)
+{
+  Uint64 delta;
+  int head;
+  int i;
+
+  if ((head = getc(tr->file)) == EOF)
+    fatal("%s: unexpected end of trace", tr->name);
+  if (head == 0)
+    return 0;
+
+  rec->t_count = tr->t_count;
+  rec->pc = get_word(tr);
+  rec->op_len = head & TRACE_LENGTH;
+  if (rec->op_len > 4)
+    fatal("%s: bad record %lu", tr->name, tr->number);
+  for (i = 0; i < rec->op_len; i++)
+    rec->op[i] = get_byte(tr);
+
+  delta = get_number(tr);
+  if (delta & 1)
+    tr->t_count -= (delta >> 1) + 1;
+  else
+    tr->t_count += delta >> 1;
+
+  rec->mask = 0;
+  if (head & TRACE_REGS) {
+    rec->mask = get_word(tr);
+    for (i = 0; i < TRACE_NUM_REGS; i++) {
+      if (rec->mask & (1 << i))
+        tr->regs[i] = get_word(tr);
+    }
+  }
+  memcpy(rec->regs, tr->regs, sizeof(rec->regs));
+
+  rec->count = 0;
+  rec->truncated = (head & TRACE_TRUNCATED) != 0;
+  if (head & TRACE_ACCESS) {
+    if ((rec->count = get_byte(tr)) > TRACE_MAX_ACCESS)
+      fatal("%s: bad record %lu", tr->name, tr->number);
+    for (i = 0; i < rec->count; i++) {
+      rec->accesses[i].kind = get_byte(tr);
+      rec->accesses[i].address = get_word(tr);
+      rec->accesses[i].value = get_byte(tr);
+    }
+  }
+  tr->number++;
+  return 1;
+}
+
+static void print_record(const char *prefix, const record *rec)
+{
+  int i;
+
+  for (i = 0; i < rec->op_len; i++)
+    memory[(rec->pc + i) & 0xFFFF] = rec->op[i];
+  printf("%s%12" TSTATE_T_LEN "  ", prefix, rec->t_count);
+  disassemble_file(stdout, rec->pc);
+
+  if (rec->mask == 0 && rec->count == 0 && !rec->truncated)
+    return;
+  printf("%s%14s", prefix, "");
+  for (i = 0; i < TRACE_NUM_REGS; i++) {
+    if (rec->mask & (1 << i))
+      printf(" %s=%04x", reg_names[i], rec->regs[i]);
+  }
+  for (i = 0; i < rec->count; i++) {
+    access const *acc = &rec->accesses[i];
+
+    switch (acc->kind) {
+      case TRACE_WRITE:
+        printf(" (%04x)=%02x", acc->address, acc->value);
+        break;
+      case TRACE_IN:
+        printf(" in(%02x)=%02x", acc->address, acc->value);
+        break;
+      case TRACE_OUT:
+        printf(" out(%02x)=%02x", acc->address, acc->value);
+        break;
+    }
+  }
+  if (rec->truncated)
+    printf(" ...");
+  putchar('\n');
+}
+
+static int same_record(const record *a, const record *b)
+{
+  return a->t_count == b->t_count && a->pc == b->pc &&
+      a->op_len == b->op_len &&
+      memcmp(a->op, b->op, a->op_len) == 0 &&
+      memcmp(a->regs, b->regs, sizeof(a->regs)) == 0 &&
+      a->count == b->count && a->truncated == b->truncated &&
+      memcmp(a->accesses, b->accesses, a->count * sizeof(access)) == 0;
+}
+
+static int dump(const char *name, int start, int end, long max)
+{
+  trace tr;
+  record rec;
+
+  open_trace(&tr, name);
+  while (max != 0 && read_record(&tr, &rec)) {
+    if (rec.pc < start || rec.pc > end)
+      continue;
+    print_record("", &rec);
+    if (max > 0)
+      max--;
+  }
+  fclose(tr.file);
+  return EXIT_SUCCESS;
+}
+
+static int diff(const char *name1, const char *name2, int context)
+{
+  trace tr1, tr2;
+  record rec1, rec2;
+  record *history;
+  int more1, more2;
+  int kept = 0, next = 0;
+  int i;
+
+  if ((history = malloc((context + 1) * sizeof(record))) == NULL)
+    fatal("failed to allocate context: %s", strerror(errno));
+  open_trace(&tr1, name1);
+  open_trace(&tr2, name2);
+
+  if (tr1.t_count != tr2.t_count ||
+      memcmp(tr1.regs, tr2.regs, sizeof(tr1.regs)) != 0)
+    printf("traces start in different states\n");
+
+  for (;;) {
+    more1 = read_record(&tr1, &rec1);
+    more2 = read_record(&tr2, &rec2);
+    if (!more1 || !more2 || !same_record(&rec1, &rec2))
+      break;
+    if (context > 0) {
+      history[next] = rec1;
+      next = (next + 1) % context;
+      if (kept < context)
+        kept++;
+    }
+  }
+  if (!more1 && !more2) {
+    free(history);
+    return EXIT_SUCCESS;
+  }
+
+  printf("traces differ at instruction %lu\n", tr1.number - more1);
+  for (i = 0; i < kept; i++)
+    print_record("  ", &history[(next - kept + i + context) % context]);
+  if (more1)
+    print_record("< ", &rec1);
+  else
+    printf("< end of %s\n", name1);
+  if (more2)
+    print_record("> ", &rec2);
+  else
+    printf("> end of %s\n", name2);
+
+  fclose(tr1.file);
+  fclose(tr2.file);
+  free(history);
+  return EXIT_FAILURE;
+}
+
+static void usage(void)
+{
+  fprintf(stderr,
+          "Usage: %s [-a start-end] [-n count] trace\n"
+          "       %s -d [-c lines] trace1 trace2\n"
+          "  -a start-end  only instructions at these hex addresses\n"
+          "  -n count      stop after count instructions\n"
+          "  -d            print where two traces begin to differ\n"
+          "  -c lines      instructions before the difference (default: 5)\n",
+          program_name, program_name);
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+  int start = 0, end = 0xFFFF;
+  int context = 5, compare = 0;
+  long max = -1;
+  int i;
+
+  program_name = strrchr(argv[0], DIR_SLASH);
+  if (program_name == NULL)
+    program_name = argv[0];
+  else
+    program_name++;
+
+  for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+    if (strcmp(argv[i], "-a") == 0 && i + 1 < argc) {
+      if (sscanf(argv[++i], "%x-%x", &start, &end) != 2)
+        usage();
+    } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+      context = atoi(argv[++i]);
+    else if (strcmp(argv[i], "-d") == 0)
+      compare = 1;
+    else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+      max = atol(argv[++i]);
+    else
+      usage();
+  }
+  if (context < 0)
+    context = 0;
+
+  if (compare) {
+    if (argc - i != 2)
+      usage();
+    return diff(argv[i], argv[i + 1], context);
+  }
+  if (argc - i != 1)
+    usage();
+  return dump(argv[i], start, end, max);
+}
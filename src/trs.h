@@ -80,6 +80,7 @@ extern int trs_continuous; /* 1= run continuously,
 			     -1= suppress interrupt and enter debugger */
 extern int trs_disk_debug_flags;
 extern int trs_io_debug_flags;
+extern void trs_io_config(void);
 extern int trs_emtsafe;
 
 extern void trs_parse_command_line(int argc, char **argv, int *debug);
@@ -97,7 +98,12 @@ extern void trs_screen_alternate(int flag);
 extern void trs_screen_80x24(int flag);
 extern void trs_screen_inverse(int flag);
 extern void trs_screen_refresh(void);
+extern int trs_screen_text(char *buf, int size);
+extern int trs_screen_utf8(char *buf, int size);
+extern void trs_screen_size(int *width, int *height);
+extern void trs_screen_pixels(Uint32 *pixels, int width, int height);
 extern void trs_screen_caption(void);
+extern const Uint8 *trs_char_bitmap(int charset, int char_index);
 
 extern void trs_disk_led(int drive, int on_off);
 extern void trs_hard_led(int drive, int on_off);
@@ -105,6 +111,7 @@ extern void trs_turbo_led(void);
 
 extern void trs_reset(int poweron);
 extern void trs_exit(int confirm);
+extern int trs_paste_speed(int on);
 extern void trs_sdl_cleanup(void);
 
 extern void trs_kb_reset(void);
@@ -113,6 +120,7 @@ extern int trs_kb_mem_read(int address);
 extern void trs_kb_heartbeat(void);
 extern void trs_xlate_keysym(int keysym);
 extern void clear_key_queue(void);
+extern void queue_key(int state);
 extern int stretch_amount;
 extern int trs_kb_bracket_state;
 
@@ -130,6 +138,8 @@ extern int trs_charset3;
 extern int trs_charset4;
 extern int trs_paused;
 extern int trs_printer;
+extern int trs_printer_pdf;
+extern int trs_printer_cps;
 extern int trs_sound;
 
 extern void trs_get_event(int wait);
@@ -137,11 +147,15 @@ extern void trs_get_event(int wait);
 extern void trs_printer_write(int value);
 extern int trs_printer_read(void);
 extern int trs_printer_reset(void);
+extern void trs_printer_idle(void);
 
 extern void trs_cassette_motor(int value);
 extern void trs_cassette_out(int value);
 extern int trs_cassette_in(void);
 extern void trs_sound_out(int value);
+extern int trs_sound_latency(void);
+extern Uint32 trs_sound_underruns;
+extern Uint32 trs_sound_overruns;
 
 extern int trs_joystick_in(void);
 
@@ -165,7 +179,7 @@ extern void trs_timer_mode(int mode);
 extern void trs_timer_off(void);
 extern void trs_timer_on(void);
 extern void trs_timer_speed(int flag);
-extern void trs_timer_sync_with_host(void);
+extern int trs_timer_sync_with_host(void);
 extern void trs_cassette_rise_interrupt(int dummy);
 extern void trs_cassette_fall_interrupt(int dummy);
 extern void trs_cassette_clear_interrupts(void);
@@ -252,6 +266,9 @@ void trs_set_mouse_max(int x, int y, unsigned int sens);
 extern int timer_hz;
 extern int timer_overclock_rate;
 extern int timer_overclock;
+extern int timer_audio_sync;
+extern int timer_audio_low;
+extern int timer_audio_high;
 extern int speedup;
 extern float clock_mhz_1;
 extern float clock_mhz_3;
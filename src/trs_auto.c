@@ -0,0 +1,646 @@
+/*
+ * Line-oriented automation protocol over stdin or a UNIX socket.
+ *
+ * Each command is one line, answered by one line starting with "ok" or
+ * "error".  Commands are executed at instruction boundaries inside
+ * z80_run(), and the emulation holds while no command is in progress,
+ * so the emulated time at which anything happens depends only on the
+ * script.  "continue" lets the emulation run freely until the next
+ * command arrives.
+ *
+ *   type <text>              type keys (\n \r \t \\ \xHH, \B break,
+ *                            \C clear, \U \D \L \R arrows)
+ *   wait <tstates> <text>    wait until <text> appears on the screen,
+ *                            at most <tstates> unless 0
+ *   run <tstates>            let the emulation run
+ *   continue                 run freely until the next command
+ *   insert <media> <unit> <file>, eject <media> <unit>
+ *                            media: disk, hard, wafer or cass
+ *   save <file>, load <file> save or load the emulator state
+ *   load <file> <part>,...   load only some parts, e.g. memory,z80
+ *   checkpoint <file>        save a compressed snapshot, loadable as state
+ *   peek <addr> [count]      read memory, hex bytes
+ *   poke <addr> <byte>...    write memory
+ *   screen [utf8]            current screen text, rows separated by |,
+ *                            with utf8 as shown, graphics included
+ *   screenshot <file>        save the screen as BMP
+ *   tstates                  current T-state counter
+ *   quit [code]              exit the emulator
+ */
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+#include "error.h"
+#include "trs.h"
+#include "trs_auto.h"
+#include "trs_cassette.h"
+#include "trs_disk.h"
+#include "trs_hard.h"
+#include "trs_sdl_gui.h"
+#include "trs_snapshot.h"
+#include "trs_state_save.h"
+#include "trs_stringy.h"
+
+#define AUTO_LINE   (8192)
+#define AUTO_NEVER  ((tstate_t) -1)
+#define AUTO_POLL   (10) /* ms to wait for input while holding */
+
+enum {
+  AUTO_OFF,   /* no automation */
+  AUTO_IDLE,  /* holding, waiting for a command */
+  AUTO_RUN,   /* running for auto_span T-states */
+  AUTO_TYPE,  /* typing auto_keys */
+  AUTO_WAIT,  /* waiting for auto_text on the screen */
+  AUTO_FREE   /* running freely */
+};
+
+char trs_auto_source[FILENAME_MAX];
+tstate_t trs_auto_due = AUTO_NEVER;
+
+static int auto_state = AUTO_OFF;
+static int auto_in = -1;
+static int auto_out = -1;
+static int auto_listen = -1;
+static char auto_buf[AUTO_LINE];
+static int auto_len;
+
+/* Progress of the current command */
+static tstate_t auto_start;
+static tstate_t auto_span;
+static char auto_text[AUTO_LINE];
+static int auto_keys[AUTO_LINE];
+static int auto_nkeys;
+static int auto_key;
+static int auto_key_down;
+
+static void auto_reply(const char *fmt, ...)
+{
+  char line[AUTO_LINE];
+  int len, pos = 0;
+  va_list args;
+
+  va_start(args, fmt);
+  len = vsnprintf(line, sizeof(line) - 1, fmt, args);
+  va_end(args);
+  if (len < 0)
+    return;
+  if (len > (int)sizeof(line) - 2)
+    len = sizeof(line) - 2;
+  line[len++] = '\n';
+
+#ifndef _WIN32
+  while (auto_out >= 0 && pos < len) {
+    ssize_t n = write(auto_out, line + pos, len - pos);
+
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    pos += n;
+  }
+#endif
+}
+
+#ifndef _WIN32
+static void auto_disconnect(void)
+{
+  if (auto_in >= 0 && auto_listen >= 0)
+    close(auto_in);
+  auto_in = auto_out = -1;
+  auto_len = 0;
+}
+
+/*
+ * Read what is available of the command channel, waiting up to timeout
+ * ms for it.  Returns -1 once stdin is exhausted.
+ */
+static int auto_fill(int timeout)
+{
+  struct pollfd pfd;
+  ssize_t n;
+
+  if (auto_in < 0) {
+    if (auto_listen < 0)
+      return -1;
+    pfd.fd = auto_listen;
+    pfd.events = POLLIN;
+    if (poll(&pfd, 1, timeout) <= 0)
+      return 0;
+    auto_in = auto_out = accept(auto_listen, NULL, NULL);
+    if (auto_in < 0)
+      return 0;
+    auto_len = 0;
+    timeout = 0;
+  }
+
+  pfd.fd = auto_in;
+  pfd.events = POLLIN;
+  if (poll(&pfd, 1, timeout) <= 0)
+    return 0;
+
+  n = read(auto_in, auto_buf + auto_len, sizeof(auto_buf) - 1 - auto_len);
+  if (n < 0)
+    return errno == EINTR || errno == EAGAIN ? 0 : -1;
+  if (n == 0) {
+    if (auto_listen < 0)
+      return -1;
+    /* Client went away: wait for the next one */
+    auto_disconnect();
+    return 0;
+  }
+  auto_len += n;
+  return 1;
+}
+#endif
+
+/*
+ * Get the next command line.  Returns 1 if there is one, 0 if not yet
+ * and -1 at the end of the input.
+ */
+static int auto_getline(char *line, int timeout)
+{
+#ifndef _WIN32
+  for (;;) {
+    char *eol = memchr(auto_buf, '\n', auto_len);
+    int ret;
+
+    if (eol != NULL || auto_len == sizeof(auto_buf) - 1) {
+      int len = eol ? eol - auto_buf : auto_len;
+
+      memcpy(line, auto_buf, len);
+      line[len] = 0;
+      if (len > 0 && line[len - 1] == '\r')
+        line[len - 1] = 0;
+      if (eol)
+        len++;
+      auto_len -= len;
+      memmove(auto_buf, auto_buf + len, auto_len);
+      return 1;
+    }
+
+    ret = auto_fill(timeout);
+    if (ret <= 0) {
+      if (ret < 0 && auto_len > 0) {
+        /* Last line without newline */
+        memcpy(line, auto_buf, auto_len);
+        line[auto_len] = 0;
+        auto_len = 0;
+        return 1;
+      }
+      return ret;
+    }
+  }
+#else
+  return -1;
+#endif
+}
+
+/* Split off the next blank-separated word of *args */
+static char *auto_word(char **args)
+{
+  char *word = *args;
+
+  while (*word == ' ' || *word == '\t')
+    word++;
+  if (*word == 0)
+    return NULL;
+  *args = word + strcspn(word, " \t");
+  if (**args)
+    *(*args)++ = 0;
+  return word;
+}
+
+static int auto_number(const char *word, unsigned long *value)
+{
+  char *end;
+
+  if (word == NULL)
+    return -1;
+  *value = strtoul(word, &end, 0);
+  return *end == 0 ? 0 : -1;
+}
+
+static int auto_hex(int ch)
+{
+  if (ch >= '0' && ch <= '9')
+    return ch - '0';
+  if (ch >= 'a' && ch <= 'f')
+    return ch - 'a' + 10;
+  if (ch >= 'A' && ch <= 'F')
+    return ch - 'A' + 10;
+  return -1;
+}
+
+/* Decode the text of a "type" command into key symbols */
+static int auto_parse_keys(const char *text)
+{
+  auto_nkeys = 0;
+
+  while (*text) {
+    int key = (Uint8)*text++;
+
+    if (key == '\\' && *text) {
+      switch (*text++) {
+        case 'n':
+        case 'r':  key = 0x0d;  break;
+        case 't':  key = 0x09;  break;
+        case 'B':  key = 0x13e; break;
+        case 'C':  key = 0x116; break;
+        case 'U':  key = 0x111; break;
+        case 'D':  key = 0x112; break;
+        case 'L':  key = 0x114; break;
+        case 'R':  key = 0x113; break;
+        case 'x':
+          if (auto_hex(text[0]) < 0 || auto_hex(text[1]) < 0)
+            return -1;
+          key = auto_hex(text[0]) << 4 | auto_hex(text[1]);
+          text += 2;
+          break;
+        default:
+          key = (Uint8)text[-1];
+          break;
+      }
+    }
+    /* Same case and bracket fixups as for pasted text */
+    if (key >= 0x5b && key <= 0x60)
+      key += 0x20;
+    else if (key >= 0x7b && key <= 0x7e)
+      key -= 0x20;
+    auto_keys[auto_nkeys++] = key;
+  }
+  return 0;
+}
+
+/*
+ * Each key is pressed and released with two stretch periods in between,
+ * so the keyboard queue never fills and every change is seen by a ROM
+ * that polls the keyboard matrix.
+ */
+static void auto_type_step(void)
+{
+  if (auto_key_down) {
+    trs_xlate_keysym(0x10000 | auto_keys[auto_key++]);
+    auto_key_down = 0;
+  } else if (auto_key < auto_nkeys) {
+    trs_xlate_keysym(auto_keys[auto_key]);
+    auto_key_down = 1;
+  } else {
+    auto_reply("ok");
+    auto_state = AUTO_IDLE;
+    return;
+  }
+  trs_auto_due = z80_state.t_count + 2 * stretch_amount;
+}
+
+static void auto_wait_step(void)
+{
+  char screen[AUTO_LINE];
+
+  trs_screen_text(screen, sizeof(screen));
+  if (strstr(screen, auto_text)) {
+    auto_reply("ok %" TSTATE_T_LEN, z80_state.t_count);
+    auto_state = AUTO_IDLE;
+  } else if (z80_state.t_count - auto_start >= auto_span) {
+    auto_reply("error timeout");
+    auto_state = AUTO_IDLE;
+  } else {
+    trs_auto_due = z80_state.t_count + cycles_per_timer;
+  }
+}
+
+static int auto_media(char **args, int insert)
+{
+  char *media = auto_word(args);
+  char *file = NULL;
+  unsigned long unit;
+
+  if (media == NULL || auto_number(auto_word(args), &unit) || unit > 7)
+    return -1;
+  if (insert) {
+    while (**args == ' ' || **args == '\t')
+      (*args)++;
+    file = *args;
+    if (*file == 0)
+      return -1;
+  }
+
+  if (strcmp(media, "disk") == 0) {
+    if (insert)
+      trs_disk_insert(unit, file);
+    else
+      trs_disk_remove(unit);
+  } else if (strcmp(media, "hard") == 0 && unit < 4) {
+    if (insert)
+      trs_hard_attach(unit, file);
+    else
+      trs_hard_remove(unit);
+  } else if (strcmp(media, "wafer") == 0) {
+    if (insert)
+      return stringy_insert(unit, file);
+    stringy_remove(unit);
+  } else if (strcmp(media, "cass") == 0 && unit == 0) {
+    if (insert)
+      trs_cassette_insert(file);
+    else
+      trs_cassette_remove();
+  } else {
+    return -1;
+  }
+  return 0;
+}
+
+static void auto_peek(char **args)
+{
+  char line[AUTO_LINE];
+  unsigned long addr, count = 1;
+  char *word = auto_word(args);
+  int len = 2;
+
+  if (auto_number(word, &addr) ||
+      ((word = auto_word(args)) && auto_number(word, &count)) ||
+      count == 0 || count > (sizeof(line) - 3) / 3) {
+    auto_reply("error usage: peek <addr> [count]");
+    return;
+  }
+  strcpy(line, "ok");
+  while (count--) {
+    snprintf(line + len, sizeof(line) - len, " %02x", mem_peek(addr++));
+    len += 3;
+  }
+  auto_reply("%s", line);
+}
+
+static void auto_poke(char **args)
+{
+  unsigned long addr, value;
+  char *word;
+
+  if (auto_number(auto_word(args), &addr)) {
+    auto_reply("error usage: poke <addr> <byte>...");
+    return;
+  }
+  while ((word = auto_word(args)) != NULL) {
+    if (auto_number(word, &value) || value > 0xff) {
+      auto_reply("error bad byte '%s'", word);
+      return;
+    }
+    mem_write(addr++ & 0xffff, value);
+  }
+  auto_reply("ok");
+}
+
+static void auto_command(char *line)
+{
+  char *args = line;
+  char *cmd = auto_word(&args);
+  unsigned long value;
+
+  if (cmd == NULL || *cmd == '#')
+    return;
+
+  auto_start = z80_state.t_count;
+
+  if (strcmp(cmd, "type") == 0) {
+    if (*args == ' ' || *args == '\t')
+      args++;
+    if (auto_parse_keys(args)) {
+      auto_reply("error bad escape");
+      return;
+    }
+    auto_key = 0;
+    auto_key_down = 0;
+    auto_state = AUTO_TYPE;
+    auto_type_step();
+  } else if (strcmp(cmd, "wait") == 0) {
+    if (auto_number(auto_word(&args), &value) || *args == 0) {
+      auto_reply("error usage: wait <tstates> <text>");
+      return;
+    }
+    snprintf(auto_text, sizeof(auto_text), "%s", args);
+    auto_span = value ? (tstate_t)value : AUTO_NEVER;
+    auto_state = AUTO_WAIT;
+    auto_wait_step();
+  } else if (strcmp(cmd, "run") == 0) {
+    if (auto_number(auto_word(&args), &value)) {
+      auto_reply("error usage: run <tstates>");
+      return;
+    }
+    auto_span = value;
+    auto_state = AUTO_RUN;
+    trs_auto_due = auto_start + auto_span;
+  } else if (strcmp(cmd, "continue") == 0) {
+    auto_reply("ok");
+    auto_state = AUTO_FREE;
+  } else if (strcmp(cmd, "insert") == 0 || strcmp(cmd, "eject") == 0) {
+    if (auto_media(&args, cmd[0] == 'i'))
+      auto_reply("error usage: %s <disk|hard|wafer|cass> <unit>%s",
+          cmd, cmd[0] == 'i' ? " <file>" : "");
+    else
+      auto_reply("ok");
+  } else if (strcmp(cmd, "save") == 0 || strcmp(cmd, "load") == 0) {
+    char *file = auto_word(&args);
+    char *names = auto_word(&args);
+    unsigned int parts = STATE_ALL;
+
+    if (file == NULL || (cmd[0] == 's' && names) ||
+        (names && trs_state_parts(names, &parts))) {
+      auto_reply("error usage: %s <file>%s", cmd,
+          cmd[0] == 's' ? "" : " [part,...]");
+    } else if (cmd[0] == 's') {
+      auto_reply(trs_state_save(file) == 0 ? "ok" : "error %s", file);
+    } else if (trs_state_load_parts(file, parts) == 0) {
+      trs_screen_init(1);
+      auto_reply("ok");
+    } else {
+      auto_reply("error %s", file);
+    }
+  } else if (strcmp(cmd, "checkpoint") == 0) {
+    char *file = auto_word(&args);
+    trs_snapshot *snap;
+
+    if (file == NULL) {
+      auto_reply("error usage: checkpoint <file>");
+    } else if ((snap = trs_snapshot_take()) == NULL) {
+      auto_reply("error out of memory");
+    } else {
+      auto_reply(trs_snapshot_write(snap, file) == 0 ? "ok" : "error %s", file);
+      trs_snapshot_free(snap);
+    }
+  } else if (strcmp(cmd, "peek") == 0) {
+    auto_peek(&args);
+  } else if (strcmp(cmd, "poke") == 0) {
+    auto_poke(&args);
+  } else if (strcmp(cmd, "screen") == 0) {
+    char screen[AUTO_LINE];
+    char *mode = auto_word(&args);
+    char *eol;
+
+    if (mode && strcmp(mode, "utf8") == 0) {
+      trs_screen_utf8(screen, sizeof(screen));
+      /* No trailing separator */
+      if ((eol = strrchr(screen, '\n')) != NULL)
+        *eol = 0;
+    } else {
+      trs_screen_text(screen, sizeof(screen));
+    }
+    while ((eol = strchr(screen, '\n')) != NULL)
+      *eol = '|';
+    auto_reply("ok %s", screen);
+  } else if (strcmp(cmd, "screenshot") == 0) {
+    char *file = auto_word(&args);
+
+    if (file == NULL)
+      auto_reply("error usage: screenshot <file>");
+    else
+      auto_reply(trs_sdl_savebmp(file) == 0 ? "ok" : "error %s", file);
+  } else if (strcmp(cmd, "tstates") == 0) {
+    auto_reply("ok %" TSTATE_T_LEN, z80_state.t_count);
+  } else if (strcmp(cmd, "quit") == 0) {
+    if (auto_number(auto_word(&args), &value))
+      value = 0;
+    auto_reply("ok");
+    exit(value);
+  } else {
+    auto_reply("error unknown command '%s'", cmd);
+  }
+}
+
+static void auto_stop(void)
+{
+#ifndef _WIN32
+  auto_disconnect();
+  if (auto_listen >= 0)
+    close(auto_listen);
+#endif
+  auto_listen = -1;
+  auto_state = AUTO_OFF;
+  trs_auto_due = AUTO_NEVER;
+}
+
+/* Execute commands until one of them needs emulated time */
+static void auto_hold(void)
+{
+  char line[AUTO_LINE];
+
+  while (auto_state == AUTO_IDLE) {
+    int ret = auto_getline(line, AUTO_POLL);
+
+    if (ret < 0)
+      auto_stop();
+    else if (ret > 0)
+      auto_command(line);
+    else
+      trs_get_event(0);
+  }
+}
+
+void trs_auto_run(void)
+{
+  trs_auto_due = AUTO_NEVER;
+
+  switch (auto_state) {
+    case AUTO_RUN:
+      if (z80_state.t_count - auto_start < auto_span) {
+        trs_auto_due = auto_start + auto_span;
+        return;
+      }
+      auto_reply("ok %" TSTATE_T_LEN, z80_state.t_count);
+      auto_state = AUTO_IDLE;
+      break;
+    case AUTO_TYPE:
+      auto_type_step();
+      break;
+    case AUTO_WAIT:
+      auto_wait_step();
+      break;
+    default:
+      break;
+  }
+  auto_hold();
+}
+
+void trs_auto_poll(void)
+{
+  char line[AUTO_LINE];
+  int ret;
+
+  switch (auto_state) {
+    case AUTO_OFF:
+    case AUTO_IDLE:
+      return;
+    case AUTO_FREE:
+      ret = auto_getline(line, 0);
+      if (ret < 0) {
+        auto_stop();
+      } else if (ret > 0) {
+        auto_state = AUTO_IDLE;
+        auto_command(line);
+        auto_hold();
+      }
+      return;
+    default:
+      /* The T-state counter went back when a state was loaded from
+         the GUI; restart timing the current command from here */
+      if (z80_state.t_count < auto_start) {
+        auto_start = z80_state.t_count;
+        trs_auto_due = auto_start;
+      }
+      return;
+  }
+}
+
+void trs_auto_init(void)
+{
+  if (trs_auto_source[0] == 0)
+    return;
+
+#ifdef _WIN32
+  error("automation is not supported on this platform");
+#else
+  if (strcmp(trs_auto_source, "stdin") == 0) {
+    auto_in = STDIN_FILENO;
+    auto_out = STDOUT_FILENO;
+  } else if (strncmp(trs_auto_source, "unix:", 5) == 0) {
+    struct sockaddr_un addr;
+    const char *path = trs_auto_source + 5;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+      error("automation socket name too long: '%s'", path);
+      return;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    if ((auto_listen = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+        bind(auto_listen, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(auto_listen, 1) < 0) {
+      error("failed to open automation socket '%s': %s",
+          path, strerror(errno));
+      if (auto_listen >= 0)
+        close(auto_listen);
+      auto_listen = -1;
+      return;
+    }
+    /* A client closing early must not kill the emulator */
+    signal(SIGPIPE, SIG_IGN);
+  } else {
+    error("unknown automation source '%s'", trs_auto_source);
+    return;
+  }
+
+  auto_state = AUTO_IDLE;
+  trs_auto_due = z80_state.t_count;
+#endif
+}
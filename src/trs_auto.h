@@ -0,0 +1,29 @@
+/*
+ * Line-oriented automation protocol over stdin or a UNIX socket.
+ *
+ * Commands are executed at instruction boundaries inside z80_run(), and
+ * the emulation holds while waiting for the next command, so a script
+ * drives the emulator the same way on every run.
+ */
+#ifndef _TRS_AUTO_H
+#define _TRS_AUTO_H
+
+#include <stdio.h>
+#include "z80.h"
+
+/* "stdin" or "unix:<path>", empty if automation is off */
+extern char trs_auto_source[FILENAME_MAX];
+
+/* T-state count at which trs_auto_run() must be called next */
+extern tstate_t trs_auto_due;
+
+/* Open the command channel and take control of the emulation */
+extern void trs_auto_init(void);
+
+/* Advance the current command; called from z80_run() when due */
+extern void trs_auto_run(void);
+
+/* Check the command channel while running freely; called per time slice */
+extern void trs_auto_poll(void);
+
+#endif
@@ -56,10 +56,12 @@
 
 #include <SDL.h>
 
+#include "cas_decode.h"
 #include "error.h"
 #include "trs.h"
 #include "trs_cassette.h"
 #include "trs_state_save.h"
+#include "trs_video.h"
 
 #ifndef SDL_memcpy
 #define SDL_memcpy	memcpy
@@ -80,7 +82,6 @@
 #define DEBUG_FORMAT	5  /* like cpt but in ASCII */
 static const char *format_name[] = {
   NULL, "cas", "cpt", "wav", "direct", "debug" };
-#define NOISE_FLOOR	64
 
 #define DEFAULT_FORMAT	CAS_FORMAT
 
@@ -92,9 +93,7 @@ static unsigned int cassette_format = DEFAULT_FORMAT;
 static int cassette_state = CLOSE;
 static int cassette_motor;
 static FILE *cassette_file;
-static float cassette_avg;
-static float cassette_env;
-static int cassette_noisefloor;
+static struct cas_detector cassette_detector;
 static int cassette_sample_rate;
 int cassette_default_sample_rate = MAX_SAMPLE_RATE;
 static int cassette_stereo;
@@ -117,6 +116,13 @@ static Uint8 *sound_ring_read_ptr = sound_ring;
 static Uint8 *sound_ring_write_ptr = sound_ring;
 static Uint32 sound_ring_count;
 static Uint8 *sound_ring_end = sound_ring + SOUND_RING_SIZE;
+static int sound_ring_active;  /* samples written since last latency check */
+static int sound_ring_written; /* samples written since last callback */
+static int sound_bytes_per_sec;
+
+/* Audio buffer health, for monitoring */
+Uint32 trs_sound_underruns;
+Uint32 trs_sound_overruns;
 
 /* For bit-level emulation */
 static tstate_t cassette_transition;
@@ -132,9 +138,6 @@ static float cassette_roundoff_error;
 static int cassette_byte;
 static int cassette_bitnumber;
 static int cassette_pulsestate;
-#define SPEED_500     0
-#define SPEED_1500    1
-#define SPEED_250     2
 static int cassette_speed = SPEED_500;
 
 /* Pulse shapes for conversion from .cas on input */
@@ -192,18 +195,6 @@ static const struct {
   }}
 };
 
-/* States and thresholds for conversion to .cas on output */
-#define ST_INITIAL   0
-#define ST_500GOTCLK 1
-#define ST_500GOTDAT 2
-#define ST_1500      3
-#define ST_250       4
-#define ST_250GOTCLK 5
-#define ST_250GOTDAT 6
-#define ST_500THRESH  1250.0 /* us threshold between 0 and 1 */
-#define ST_1500THRESH  282.0 /* us threshold between 1 and 0 */
-#define ST_250THRESH  2500.0 /* us threshold between 0 and 1 */
-
 #define DETECT_250    1200.0 /* detect level 1 input routine */
 
 /* Values for conversion to .wav on output */
@@ -319,6 +310,13 @@ put_sample(Uint8 sample, int convert, FILE* f)
 
   if (convert) {
     SDL_LockAudio();
+    sound_ring_active = sound_ring_written = TRUE;
+    if (sound_ring_count + 2 > SOUND_RING_SIZE) {
+      /* Ring full: drop the sample instead of overwriting unplayed data */
+      trs_sound_overruns++;
+      SDL_UnlockAudio();
+      return;
+    }
     switch (cassette_afmt) {
       case AUDIO_U8:
         *sound_ring_write_ptr++ = sample;
@@ -462,6 +460,10 @@ parse_wav_header(FILE *f)
 
 static void trs_sdl_sound_update(void *userdata, Uint8 * stream, int len)
 {
+  /* Count underruns only while sound is being produced */
+  if (sound_ring_count < (unsigned int)len && sound_ring_written)
+    trs_sound_underruns++;
+  sound_ring_written = FALSE;
   if (sound_ring_count == 0) {
     SDL_memset(stream, cassette_silence, len);
   } else {
@@ -490,6 +492,23 @@ static void trs_sdl_sound_update(void *userdata, Uint8 * stream, int len)
   }
 }
 
+/* Return the sound buffered in the ring in ms, or -1 if no sound
+ * was produced since the last call. */
+int
+trs_sound_latency(void)
+{
+  int latency = -1;
+
+  if (soundDeviceOpen && sound_bytes_per_sec) {
+    SDL_LockAudio();
+    if (sound_ring_active)
+      latency = (int)((Uint64)sound_ring_count * 1000 / sound_bytes_per_sec);
+    sound_ring_active = FALSE;
+    SDL_UnlockAudio();
+  }
+  return latency;
+}
+
 static int
 set_audio_format(int state)
 {
@@ -543,6 +562,8 @@ set_audio_format(int state)
   cassette_afmt = obtained.format;
   cassette_stereo = (obtained.channels == 2);
   cassette_silence = obtained.silence;
+  sound_bytes_per_sec = obtained.freq * obtained.channels *
+                        (obtained.format == AUDIO_U8 ? 1 : 2);
 
   SDL_PauseAudio(0);
 
@@ -833,86 +854,9 @@ transition_out(int value)
       cassette_byte = 0;
       break;
     }
-    sample = 2; /* i.e., no bit */
-    switch (cassette_pulsestate) {
-    case ST_INITIAL:
-      if (cassette_value == 2 && value == 0) {
-	/* Low speed, end of first pulse.  Assume clock */
-	cassette_pulsestate = ST_500GOTCLK;
-      } else if (cassette_value == 2 && value == 1) {
-	/* High speed, nothing interesting yet. */
-	cassette_pulsestate = ST_1500;
-      }
-      break;
-
-    case ST_500GOTCLK:
-      if (cassette_value == 0 && value == 1) {
-	/* Low speed, start of next pulse. */
-	if (ddelta_us > ST_250THRESH) {
-	  /* Oops, really ultra-low speed */
-	  /* It's the next clock; bit was 0 */
-	  sample = 0;
-	  /* Watch for end of this clock */
-	  cassette_pulsestate = ST_250;
-	} else if (ddelta_us > ST_500THRESH) {
-	  /* It's the next clock; bit was 0 */
-	  sample = 0;
-	  /* Watch for end of this clock */
-	  cassette_pulsestate = ST_INITIAL;
-	} else {
-	  /* It's a data pulse; bit was 1 */
-	  sample = 1;
-	  /* Ignore the data pulse falling edge */
-	  cassette_pulsestate = ST_500GOTDAT;
-	}
-      }
-      break;
-
-    case ST_500GOTDAT:
-      if (cassette_value == 2 && value == 0) {
-	/* End of data pulse; watch for end of next clock */
-	cassette_pulsestate = ST_INITIAL;
-      }
-      break;
-
-    case ST_1500:
-      if (cassette_value == 1 && value == 2) {
-	sample = (ddelta_us < ST_1500THRESH);
-      }
-      break;
-
-    case ST_250:
-      if (cassette_value == 2 && value == 0) {
-	/* Ultra-low speed, end of first pulse.  Assume clock */
-	cassette_pulsestate = ST_250GOTCLK;
-      }
-      break;
-
-    case ST_250GOTCLK:
-      if (cassette_value == 0 && value == 1) {
-	/* Low speed, start of next pulse. */
-	if (ddelta_us > ST_250THRESH) {
-	  /* It's the next clock; bit was 0 */
-	  sample = 0;
-	  /* Watch for end of this clock */
-	  cassette_pulsestate = ST_250;
-	} else {
-	  /* It's a data pulse; bit was 1 */
-	  sample = 1;
-	  /* Ignore the data pulse falling edge */
-	  cassette_pulsestate = ST_250GOTDAT;
-	}
-      }
-      break;
-
-    case ST_250GOTDAT:
-      if (cassette_value == 2 && value == 0) {
-	/* End of data pulse; watch for end of next clock */
-	cassette_pulsestate = ST_250;
-      }
-      break;
-    }
-    if (sample == 2) break;
+    sample = cas_pulse_to_bit(&cassette_pulsestate, cassette_value, value,
+                              ddelta_us);
+    if (sample == CAS_NOBIT) break;
 
     cassette_bitnumber--;
     if (cassette_bitnumber < 0) cassette_bitnumber = 7;
@@ -946,7 +890,7 @@ transition_in(void)
   Uint16 code;
   Uint32 d;
   int next, ret = 0;
-  int c, cabs;
+  int c;
   float delta_ts;
 
   switch (cassette_format) {
@@ -992,35 +936,12 @@ transition_in(void)
     do {
       c = getc(cassette_file);
       if (c == EOF) goto fail;
-      if (c > 127 + cassette_noisefloor) {
-	next = 1;
-      } else if (c <= 127 - cassette_noisefloor) {
-	next = 2;
-      } else {
-	next = 0;
-      }
-      if (cassette_speed == SPEED_1500) {
-	cassette_noisefloor = 2;
-      } else {
-	/* Attempt to learn the correct noise cutoff adaptively.
-	 * This code is just a hack; it would be nice to know a
-	 * real signal-processing algorithm for this application
-	 */
-	cabs = abs(c - 127);
+      next = cas_detect_level(&cassette_detector, c, cassette_speed);
 #if CASSDEBUG2
-	debug("%f %f %d %d -> %d\n", cassette_avg, cassette_env,
-	       cassette_noisefloor, cabs, next);
+      debug("%f %f %d %d -> %d\n", cassette_detector.avg,
+             cassette_detector.env, cassette_detector.noisefloor,
+             abs(c - 127), next);
 #endif
-	if (cabs > 1) {
-	  cassette_avg = (99*cassette_avg + cabs) / 100;
-	}
-	if (cabs > cassette_env) {
-	  cassette_env = (cassette_env + 9*cabs) / 10;
-	} else if (cabs > 10) {
-	  cassette_env = (99*cassette_env + cabs) / 100;
-	}
-	cassette_noisefloor = (cassette_avg + cassette_env) / 2;
-      }
       nsamples++;
       /* Allow reset button */
       trs_get_event(0);
@@ -1127,9 +1048,7 @@ void trs_cassette_motor(int value)
       cassette_pulsestate = 0;
       cassette_speed = SPEED_500;
       cassette_roundoff_error = 0.0;
-      cassette_avg = NOISE_FLOOR;
-      cassette_env = 127;
-      cassette_noisefloor = NOISE_FLOOR;
+      cas_detector_reset(&cassette_detector);
       cassette_firstoutread = 0;
       cassette_transitionsout = 0;
       if (trs_model > 1) {
@@ -1169,6 +1088,9 @@ void trs_cassette_out(int value)
     }
   }
 
+  if (cassette_motor == 0)
+    trs_video_audio(value_to_sample[value & 3], value_to_sample[value & 3]);
+
   /* Do sound emulation by sending samples to /dev/dsp */
   if (trs_sound && cassette_motor == 0) {
     if (cassette_state != SOUND && value == 0) return;
@@ -1182,6 +1104,10 @@ void trs_cassette_out(int value)
 void
 trs_sound_out(int value)
 {
+  if (cassette_motor == 0)
+    trs_video_audio(value_to_sample[value ? 1 : 2],
+                    value_to_sample[value ? 1 : 2]);
+
   if (trs_sound && cassette_motor == 0) {
     if (assert_state(SOUND) < 0) return;
     transition_out(value ? 1 : 2);
@@ -1208,6 +1134,9 @@ trs_orch90_out(int channels, int value)
   /* Convert 8-bit signed to 8-bit unsigned */
   v = (value & 0xff) ^ 0x80;
 
+  if (value != FLUSH && cassette_motor == 0)
+    trs_video_audio(channels & 1 ? v : -1, channels & 2 ? v : -1);
+
   if (cassette_motor != 0) return;
   if (assert_state(ORCH90) < 0) return;
   if (channels & 1) {
@@ -1353,9 +1282,9 @@ trs_cassette_save(FILE *file)
   trs_save_uint32(file, &cassette_format, 1);
   trs_save_int(file, &cassette_state, 1);
   trs_save_int(file, &cassette_motor, 1);
-  trs_save_float(file,&cassette_avg, 1);
-  trs_save_float(file,&cassette_env, 1);
-  trs_save_int(file, &cassette_noisefloor, 1);
+  trs_save_float(file,&cassette_detector.avg, 1);
+  trs_save_float(file,&cassette_detector.env, 1);
+  trs_save_int(file, &cassette_detector.noisefloor, 1);
   trs_save_int(file, &cassette_sample_rate, 1);
   trs_save_int(file, &cassette_default_sample_rate, 1);
   trs_save_int(file, &cassette_stereo, 1);
@@ -1390,9 +1319,9 @@ trs_cassette_load(FILE *file)
   trs_load_uint32(file, &cassette_format, 1);
   trs_load_int(file, &cassette_state, 1);
   trs_load_int(file, &cassette_motor, 1);
-  trs_load_float(file,&cassette_avg, 1);
-  trs_load_float(file,&cassette_env, 1);
-  trs_load_int(file, &cassette_noisefloor, 1);
+  trs_load_float(file,&cassette_detector.avg, 1);
+  trs_load_float(file,&cassette_detector.env, 1);
+  trs_load_int(file, &cassette_detector.noisefloor, 1);
   trs_load_int(file, &cassette_sample_rate, 1);
   trs_load_int(file, &cassette_default_sample_rate, 1);
   trs_load_int(file, &cassette_stereo, 1);
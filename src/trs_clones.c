@@ -22,6 +22,9 @@ static int current_clone;
 
 void trs_clones_model(int clone)
 {
+  /* The ports of EG 3200 and Genie IIIs differ from the Model I */
+  trs_io_config();
+
   if (clone == current_clone)
     return;
 
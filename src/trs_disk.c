@@ -65,6 +65,8 @@
 #include "trs_clones.h"
 #include "trs_disk.h"
 #include "trs_hard.h"
+#include "trs_hostdir.h"
+#include "trs_metrics.h"
 #include "trs_stringy.h"
 #include "trs_state_save.h"
 
@@ -766,6 +768,7 @@ trs_disk_remove(int drive)
   DiskState *d = &disk[drive];
 
   if (d->file != NULL) {
+    trs_hostdir_close(drive, d->file);
     if (fclose(d->file) == EOF) state.status |= TRSDISK_WRITEFLT;
     d->file = NULL;
     d->filename[0] = 0;
@@ -781,6 +784,7 @@ trs_disk_insert(int drive, const char *diskname)
   int c;
 
   if (d->file != NULL) {
+    trs_hostdir_close(drive, d->file);
     c = fclose(d->file);
     if (c == EOF) state.status |= TRSDISK_WRITEFLT;
   }
@@ -792,6 +796,19 @@ trs_disk_insert(int drive, const char *diskname)
         drive, diskname, strerror(errno));
     return;
   }
+  if (S_ISDIR(st.st_mode)) {
+    /* Host directory as LDOS data disk */
+    d->file = trs_hostdir_open(drive, diskname, trs_model != 1,
+                               trs_model >= 4);
+    if (d->file == NULL) {
+      d->filename[0] = 0;
+      d->writeprot = 0;
+      return;
+    }
+    d->writeprot = access(diskname, W_OK) != 0;
+    d->emutype = JV3;
+    snprintf(d->filename, FILENAME_MAX, "%s", diskname);
+  } else
   #if __linux
   if (S_ISBLK(st.st_mode)) {
     /* Real floppy drive */
@@ -944,6 +961,8 @@ trs_disk_motoroff(void)
   if (stopped) {
     int const cmdtype = cmd_type(state.currcommand);
 
+    int i;
+
     state.status |= TRSDISK_NOTRDY;
     if ((cmdtype == 2 || cmdtype == 3) && (state.status & TRSDISK_DRQ)) {
       /* Also end the command and set Lost Data for good measure */
@@ -951,6 +970,9 @@ trs_disk_motoroff(void)
 	~(TRSDISK_BUSY | TRSDISK_DRQ);
       state.bytecount = 0;
     }
+    /* The DOS is done with the disks for now */
+    for (i = 0; i < NDRIVES; i++)
+      trs_hostdir_sync(i, disk[i].file);
   }
   return stopped;
 }
@@ -1419,6 +1441,7 @@ trs_disk_data_read(void)
   DiskState *d = &disk[state.curdrive];
   SectorId *sid;
 
+  trs_metrics_disk++;
   if (trs_show_led)
     trs_disk_led(state.curdrive, 1);
 
@@ -1596,6 +1619,7 @@ trs_disk_data_write(Uint8 data)
   DiskState *d = &disk[state.curdrive];
   int c;
 
+  trs_metrics_disk++;
   if (trs_show_led)
     trs_disk_led(state.curdrive, 1);
 
@@ -2229,6 +2253,20 @@ trs_disk_command_write(Uint8 cmd)
     debug("command_write(0x%02x) pc 0x%04x\n", cmd, Z80_PC);
   }
 
+  switch (cmd & TRSDISK_CMDMASK) {
+    case TRSDISK_WRITE:
+    case TRSDISK_WRITEM:
+      trs_hostdir_dirty(state.curdrive);
+      break;
+    case TRSDISK_WRITETRK:
+      if (trs_hostdir_active(state.curdrive)) {
+        error("disk %d reformatted, no longer written back to '%s'",
+              state.curdrive, d->filename);
+        trs_hostdir_close(state.curdrive, NULL);
+      }
+      break;
+  }
+
   /* Handle DMK partial track reformat */
   if (d->emutype == DMK &&
       (state.currcommand & ~TRSDISK_EBIT) == TRSDISK_WRITETRK &&
@@ -3857,13 +3895,23 @@ void trs_disk_save(FILE *file)
   }
 }
 
+/*
+ * An image which stays in its drive is kept open, and a host directory
+ * mounted, so restoring a snapshot doesn't touch the host.  A host
+ * directory which a snapshot takes out of a drive is written back first,
+ * so the changes made since the motor last stopped are not lost.
+ */
 void trs_disk_load(FILE *file)
 {
+  static char old_name[NDRIVES][FILENAME_MAX];
+  FILE *old_file[NDRIVES];
+  int old_writeprot[NDRIVES];
   int i;
 
   for (i = 0; i < NDRIVES; i++) {
-    if (disk[i].file != NULL)
-      fclose(disk[i].file);
+    old_file[i] = disk[i].file;
+    old_writeprot[i] = disk[i].writeprot;
+    snprintf(old_name[i], FILENAME_MAX, "%s", disk[i].filename);
   }
   trs_load_int(file, &trs_disk_controller, 1);
   trs_load_int(file, &trs_disk_doubler, 1);
@@ -3873,7 +3921,29 @@ void trs_disk_load(FILE *file)
   trs_fdc_load(file, &other_state);
   for (i = 0; i < NDRIVES; i++) {
     trs_load_diskstate(file, &disk[i]);
-     if (disk[i].file != NULL) {
+    if (old_file[i] != NULL) {
+      if (disk[i].file != NULL && strcmp(disk[i].filename, old_name[i]) == 0) {
+        disk[i].file = old_file[i];
+        disk[i].writeprot = old_writeprot[i];
+        continue;
+      }
+      trs_hostdir_close(i, old_file[i]);
+      fclose(old_file[i]);
+    }
+    if (disk[i].file != NULL) {
+      struct stat st = { 0 };
+
+      if (stat(disk[i].filename, &st) == 0 && S_ISDIR(st.st_mode)) {
+        /* Rebuilt with the same layout if the files are unchanged */
+        disk[i].file = trs_hostdir_open(i, disk[i].filename,
+                                       trs_model != 1, trs_model >= 4);
+        if (disk[i].file == NULL) {
+          disk[i].emutype = NONE;
+          disk[i].writeprot = 0;
+          disk[i].filename[0] = 0;
+        }
+        continue;
+      }
       disk[i].file = fopen(disk[i].filename, "rb+");
       if (disk[i].file == NULL) {
         disk[i].file = fopen(disk[i].filename, "rb");
@@ -34,6 +34,7 @@
 #include "trs.h"
 #include "trs_hard.h"
 #include "trs_imp_exp.h"
+#include "trs_metrics.h"
 #include "trs_state_save.h"
 
 #include "reed.h"
@@ -177,6 +178,7 @@ int trs_hard_in(int port)
       v = state.control;
       break;
     case TRS_HARD_DATA:
+      trs_metrics_disk++;
       v = hard_data_in();
       break;
     case TRS_HARD_ERROR:
@@ -232,6 +234,7 @@ void trs_hard_out(int port, int value)
     state.control = value;
     break;
   case TRS_HARD_DATA:
+    trs_metrics_disk++;
     hard_data_out(value);
     break;
   case TRS_HARD_PRECOMP:
@@ -606,13 +609,18 @@ void trs_hard_save(FILE *file)
     trs_save_harddrive(file, &state.d[i]);
 }
 
+/* An image which stays in its drive is kept open */
 void trs_hard_load(FILE *file)
 {
+  static char old_name[TRS_HARD_MAXDRIVES][FILENAME_MAX];
+  FILE *old_file[TRS_HARD_MAXDRIVES];
+  int old_writeprot[TRS_HARD_MAXDRIVES];
   int i;
 
   for (i = 0; i < TRS_HARD_MAXDRIVES; i++) {
-    if (state.d[i].file != NULL)
-      fclose(state.d[i].file);
+    old_file[i] = state.d[i].file;
+    old_writeprot[i] = state.d[i].writeprot;
+    snprintf(old_name[i], FILENAME_MAX, "%s", state.d[i].filename);
   }
   trs_load_int(file, &state.present, 1);
   trs_load_uint8(file, &state.control, 1);
@@ -628,6 +636,15 @@ void trs_hard_load(FILE *file)
   trs_load_int(file, &state.bytesdone, 1);
   for (i = 0; i < TRS_HARD_MAXDRIVES; i++) {
     trs_load_harddrive(file, &state.d[i]);
+    if (old_file[i] != NULL) {
+      if (state.d[i].file != NULL &&
+          strcmp(state.d[i].filename, old_name[i]) == 0) {
+        state.d[i].file = old_file[i];
+        state.d[i].writeprot = old_writeprot[i];
+        continue;
+      }
+      fclose(old_file[i]);
+    }
     if (state.d[i].file != NULL) {
       state.d[i].file = fopen(state.d[i].filename, "rb+");
       if (state.d[i].file == NULL) {
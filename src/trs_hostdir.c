@@ -0,0 +1,764 @@
+/*
+ * Host directory mounted as an emulated floppy disk.
+ *
+ * When a directory is inserted into a floppy drive, a JV3 image of an
+ * LDOS/LS-DOS data disk is built in a temporary file: 40 tracks, single
+ * density (10 sectors, 2 granules per track) on the Model I, double
+ * density (18 sectors, 3 granules per track) otherwise.  The regular
+ * files of the directory are allocated contiguously, and the GAT, HIT
+ * and directory entries are synthesized on the directory track.
+ *
+ * The floppy emulation works on that image as usual.  After the drive
+ * was written to and the motor has stopped, or when the disk is removed,
+ * the directory on the image is read back: new and modified files are
+ * written to the host directory, renamed files are renamed, and files
+ * killed by the DOS are deleted.  Host files which were not mounted are
+ * never overwritten, and a file is deleted only when its directory slot
+ * is free again.
+ *
+ * LDOS 5 and LS-DOS 6 store the end of a file differently, the version
+ * in the GAT tells which: LDOS 5 has the number of sectors in the ERN
+ * and the bytes in the last sector in EOF (0 for a full sector), LS-DOS
+ * 6 the byte position of the end of file as ERN:EOF.
+ */
+
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <SDL_types.h>
+#include "error.h"
+#include "trs_hostdir.h"
+
+#define NDRIVES        8
+
+/* JV3 layout, see trs_disk.c */
+#define JV3_SECSTART   (34*256)
+#define JV3_SECSPERBLK ((int)(JV3_SECSTART/3))
+#define JV3_DENSITY    0x80
+#define JV3_DAMDIR     0x20  /* FA single density, F8 double density */
+#define JV3_SIDE       0x10
+#define JV3_SIZE       0x03
+#define JV3_FREE       0xff
+
+#define SECSIZE        256
+#define NTRACKS        40
+#define DIRTRACK       20
+#define HIT_SIZE       256
+#define ENTRY_SIZE     32
+#define EXTENTS        5
+#define BLANK_PW       0x4296  /* hash of an empty password */
+
+/* Directory entry */
+#define DIR_ATTR       0
+#define DIR_EOF        3
+#define DIR_NAME       5
+#define DIR_UPDPW      16
+#define DIR_ACCPW      18
+#define DIR_ERN        20
+#define DIR_EXTENT     22
+
+#define ATTR_FXDE      0x80
+#define ATTR_SYS       0x40
+#define ATTR_INUSE     0x10
+#define ATTR_INV       0x08
+
+/* GAT sector */
+#define GAT_LOCKOUT    0x60
+#define GAT_VERSION    0xCB
+#define GAT_CYLEXCESS  0xCC
+#define GAT_CONFIG     0xCD
+#define GAT_PASSWORD   0xCE
+#define GAT_NAME       0xD0
+#define GAT_DATE       0xD8
+#define GAT_AUTO       0xE0
+
+typedef struct {
+  int dden;
+  int spt;                        /* sectors per track */
+  int gpt;                        /* granules per track */
+  int spg;                        /* sectors per granule */
+  int dirtrack;
+  int dos6;                       /* LS-DOS 6 end of file */
+} Geometry;
+
+typedef struct {
+  char *host;                     /* file in the directory, NULL if none */
+  Uint8 name[11];                 /* TRS-80 name and extension */
+  Uint32 hash;                    /* of the contents */
+  int size;
+} HostFile;
+
+typedef struct {
+  char path[FILENAME_MAX];
+  int dirty;
+  HostFile file[HIT_SIZE];        /* by HIT slot */
+} HostDir;
+
+static HostDir *hostdir[NDRIVES];
+
+static void geometry_init(Geometry *g, int dden, int dos6)
+{
+  g->dden = dden;
+  g->spt = dden ? 18 : 10;
+  g->gpt = dden ? 3 : 2;
+  g->spg = g->spt / g->gpt;
+  g->dirtrack = DIRTRACK;
+  g->dos6 = dos6;                 /* as the version in the GAT */
+}
+
+/* HIT slot to directory sector and offset */
+static int slot_valid(const Geometry *g, int slot)
+{
+  return (slot & 0x1F) < g->spt - 2;
+}
+
+static int slot_sector(int slot)
+{
+  return 2 + (slot & 0x1F);
+}
+
+static int slot_offset(int slot)
+{
+  return (slot >> 5) * ENTRY_SIZE;
+}
+
+/* LDOS filename hash for the HIT */
+static Uint8 name_hash(const Uint8 *name)
+{
+  Uint8 hash = 0;
+  int i;
+
+  for (i = 0; i < 11; i++) {
+    hash ^= name[i];
+    hash = (hash << 1) | (hash >> 7);
+  }
+  return hash ? hash : 1;
+}
+
+static Uint32 data_hash(const Uint8 *data, int size)
+{
+  Uint32 hash = 2166136261U;
+  int i;
+
+  for (i = 0; i < size; i++)
+    hash = (hash ^ data[i]) * 16777619U;
+  return hash;
+}
+
+/* Convert host file name to TRS-80 name, -1 if not possible */
+static int trs_name(const char *host, Uint8 *name)
+{
+  const char *dot = strrchr(host, '.');
+  const char *p;
+  int n = 0;
+
+  memset(name, ' ', 11);
+  if (dot == host)
+    return -1;
+  for (p = host; *p && p != dot; p++) {
+    if (isalnum((unsigned char)*p)) {
+      if (n == 0 && !isalpha((unsigned char)*p))
+        return -1;
+      if (n == 8)
+        return -1;
+      name[n++] = toupper((unsigned char)*p);
+    }
+  }
+  if (n == 0)
+    return -1;
+  if (dot) {
+    for (n = 8, p = dot + 1; *p; p++) {
+      if (isalnum((unsigned char)*p)) {
+        if (n == 8 && !isalpha((unsigned char)*p))
+          return -1;
+        if (n == 11)
+          return -1;
+        name[n++] = toupper((unsigned char)*p);
+      }
+    }
+  }
+  return 0;
+}
+
+/* Convert TRS-80 name to host file name */
+static void host_name(const Uint8 *name, char *host)
+{
+  int i, n = 0;
+
+  for (i = 0; i < 8 && name[i] != ' '; i++)
+    host[n++] = tolower(name[i]);
+  if (name[8] != ' ') {
+    host[n++] = '.';
+    for (i = 8; i < 11 && name[i] != ' '; i++)
+      host[n++] = tolower(name[i]);
+  }
+  host[n] = 0;
+}
+
+static int host_path(const HostDir *hd, const char *name, char *path)
+{
+  if (snprintf(path, FILENAME_MAX, "%s/%s", hd->path, name) >= FILENAME_MAX) {
+    error("host directory path too long: '%s/%s'", hd->path, name);
+    return -1;
+  }
+  return 0;
+}
+
+static int name_compare(const void *p1, const void *p2)
+{
+  return strcmp(*(char * const *)p1, *(char * const *)p2);
+}
+
+static void put_word(Uint8 *p, int value)
+{
+  p[0] = value & 0xFF;
+  p[1] = value >> 8;
+}
+
+/*
+ * Allocate ngrans contiguous granules starting at *next, and record
+ * them as extents in the directory entry.  Runs are split at the
+ * directory track and after 32 granules.  Returns -1 if out of space.
+ */
+static int alloc_grans(const Geometry *g, Uint8 *gat, Uint8 *entry,
+                       int *next, int ngrans)
+{
+  int ext = 0;
+
+  while (ngrans > 0) {
+    int track, gran, count = 0;
+
+    if (*next / g->gpt == g->dirtrack)
+      *next += g->gpt;
+    if (*next >= NTRACKS * g->gpt || ext == EXTENTS)
+      return -1;
+    track = *next / g->gpt;
+    gran = *next % g->gpt;
+    while (ngrans > 0 && count < 32 && *next < NTRACKS * g->gpt &&
+           *next / g->gpt != g->dirtrack) {
+      gat[*next / g->gpt] |= 1 << (*next % g->gpt);
+      (*next)++;
+      ngrans--;
+      count++;
+    }
+    entry[DIR_EXTENT + ext * 2] = track;
+    entry[DIR_EXTENT + ext * 2 + 1] = (gran << 5) | (count - 1);
+    ext++;
+  }
+  return 0;
+}
+
+static void make_entry(const Geometry *g, Uint8 *entry, int attr,
+                       const char *name, int size)
+{
+  int const ern = g->dos6 ? size / SECSIZE : (size + SECSIZE - 1) / SECSIZE;
+
+  memset(entry, 0, ENTRY_SIZE);
+  entry[DIR_ATTR] = attr;
+  entry[DIR_EOF] = size % SECSIZE;
+  memcpy(&entry[DIR_NAME], name, 11);
+  put_word(&entry[DIR_UPDPW], BLANK_PW);
+  put_word(&entry[DIR_ACCPW], BLANK_PW);
+  put_word(&entry[DIR_ERN], ern);
+  memset(&entry[DIR_EXTENT], 0xFF, EXTENTS * 2);
+}
+
+/* Load one host file into the image, returns 0 if OK */
+static int load_file(HostDir *hd, const Geometry *g, Uint8 *data,
+                     Uint8 *gat, Uint8 *hit, int slot, int *next,
+                     const char *host, const Uint8 *name)
+{
+  char path[FILENAME_MAX];
+  Uint8 *dir = data + (g->dirtrack * g->spt + slot_sector(slot)) * SECSIZE;
+  Uint8 *entry = dir + slot_offset(slot);
+  Uint8 *contents;
+  FILE *f;
+  struct stat st = { 0 };
+  int nsec, sec, ext, size, start = *next;
+
+  if (host_path(hd, host, path) < 0)
+    return -1;
+  if (stat(path, &st) < 0 || !S_ISREG(st.st_mode))
+    return -1;
+  size = st.st_size;
+  if (st.st_size > NTRACKS * g->spt * SECSIZE) {
+    error("hostdir: '%s' too large, skipped", path);
+    return -1;
+  }
+
+  if ((contents = (Uint8 *)malloc(size + 1)) == NULL)
+    fatal("hostdir: out of memory");
+  if ((f = fopen(path, "rb")) == NULL ||
+      (int)fread(contents, 1, size, f) != size) {
+    error("hostdir: failed to read '%s': %s", path, strerror(errno));
+    if (f)
+      fclose(f);
+    free(contents);
+    return -1;
+  }
+  fclose(f);
+
+  make_entry(g, entry, ATTR_INUSE, (const char *)name, size);
+  nsec = (size + SECSIZE - 1) / SECSIZE;
+  if (alloc_grans(g, gat, entry, next, (nsec + g->spg - 1) / g->spg) < 0) {
+    error("hostdir: no space on disk for '%s', skipped", path);
+    memset(entry, 0, ENTRY_SIZE);
+    for (; *next > start; (*next)--) {
+      if ((*next - 1) / g->gpt != g->dirtrack)
+        gat[(*next - 1) / g->gpt] &= ~(1 << ((*next - 1) % g->gpt));
+    }
+    free(contents);
+    return -1;
+  }
+
+  for (ext = 0, sec = 0; ext < EXTENTS && sec < nsec; ext++) {
+    int const grans = entry[DIR_EXTENT + ext * 2 + 1];
+    int const gran = entry[DIR_EXTENT + ext * 2] * g->gpt + (grans >> 5);
+    int i;
+
+    for (i = 0; i < ((grans & 0x1F) + 1) * g->spg && sec < nsec; i++, sec++)
+      memcpy(data + (gran * g->spg + i) * SECSIZE, contents + sec * SECSIZE,
+             size - sec * SECSIZE < SECSIZE ? size - sec * SECSIZE : SECSIZE);
+  }
+
+  hit[slot] = name_hash(name);
+  hd->file[slot].host = strdup(host);
+  memcpy(hd->file[slot].name, name, 11);
+  hd->file[slot].hash = data_hash(contents, size);
+  hd->file[slot].size = size;
+  free(contents);
+  return 0;
+}
+
+FILE *trs_hostdir_open(int drive, const char *dirname, int dden, int dos6)
+{
+  static const Uint8 boot_code[] = { 0xF3, 0x76 }; /* DI; HALT */
+  HostDir *hd;
+  Geometry g;
+  DIR *dir;
+  struct dirent *ent;
+  char **names = NULL;
+  int nnames = 0, i, n, slot, next;
+  Uint8 *image, *data, *gat, *hit, *ids;
+  FILE *f;
+  time_t now = time(NULL);
+  struct tm *tm = localtime(&now);
+  char label[32];
+  const char *base;
+  int const size = JV3_SECSTART + NTRACKS * 18 * SECSIZE;
+
+  trs_hostdir_close(drive, NULL);
+  geometry_init(&g, dden, dos6);
+
+  if ((dir = opendir(dirname)) == NULL) {
+    error("failed to open directory '%s': %s", dirname, strerror(errno));
+    return NULL;
+  }
+  while ((ent = readdir(dir)) != NULL) {
+    if ((names = (char **)realloc(names, (nnames + 1) * sizeof(char *))) == NULL)
+      fatal("hostdir: out of memory");
+    names[nnames++] = strdup(ent->d_name);
+  }
+  closedir(dir);
+  /* Same layout for the same files, for saved states */
+  qsort(names, nnames, sizeof(char *), name_compare);
+
+  if ((hd = (HostDir *)calloc(1, sizeof(HostDir))) == NULL ||
+      (image = (Uint8 *)malloc(size)) == NULL)
+    fatal("hostdir: out of memory");
+  snprintf(hd->path, FILENAME_MAX, "%s", dirname);
+
+  /* Sector ids, followed by the write protect flag */
+  ids = image;
+  memset(ids, JV3_FREE, JV3_SECSTART);
+  for (i = 0; i < NTRACKS * g.spt; i++) {
+    ids[i * 3] = i / g.spt;
+    ids[i * 3 + 1] = i % g.spt;
+    ids[i * 3 + 2] = (dden ? JV3_DENSITY : 0) |
+      (i / g.spt == g.dirtrack ? JV3_DAMDIR : 0);
+  }
+
+  /* Formatted data area */
+  data = image + JV3_SECSTART;
+  memset(data, 0xE5, NTRACKS * g.spt * SECSIZE);
+  memset(data, 0, SECSIZE);
+  data[1] = 0xFE;
+  data[2] = g.dirtrack;
+  memcpy(data + 3, boot_code, sizeof(boot_code));
+
+  gat = data + g.dirtrack * g.spt * SECSIZE;
+  hit = gat + SECSIZE;
+  memset(gat, 0, g.spt * SECSIZE);
+  memset(gat, 0xFF, GAT_LOCKOUT * 2);
+  for (i = 0; i < NTRACKS; i++) {
+    gat[i] = (0xFF << g.gpt) & 0xFF;
+    gat[GAT_LOCKOUT + i] = gat[i];
+  }
+  gat[0] |= 1;
+  gat[g.dirtrack] = 0xFF;
+  gat[GAT_VERSION] = dos6 ? 0x62 : 0x51;
+  gat[GAT_CYLEXCESS] = NTRACKS - 35;
+  gat[GAT_CONFIG] = 0x80 | (dden ? 0x40 : 0) | (g.gpt - 1);
+  put_word(&gat[GAT_PASSWORD], BLANK_PW);
+  base = strrchr(dirname, '/');
+  base = base && base[1] ? base + 1 : dirname;
+  memset(label, ' ', 8);
+  label[8] = 0;
+  for (i = 0, n = 0; base[i] && n < 8; i++) {
+    if (isalnum((unsigned char)base[i]))
+      label[n++] = toupper((unsigned char)base[i]);
+  }
+  memcpy(&gat[GAT_NAME], label, 8);
+  snprintf(label, sizeof(label), "%02d/%02d/%02d",
+           tm->tm_mon + 1, tm->tm_mday, tm->tm_year % 100);
+  memcpy(&gat[GAT_DATE], label, 8);
+  gat[GAT_AUTO] = 0x0D;
+
+  /* BOOT/SYS and DIR/SYS */
+  make_entry(&g, gat + slot_sector(0) * SECSIZE + slot_offset(0),
+             ATTR_SYS | ATTR_INUSE | ATTR_INV | 5, "BOOT    SYS",
+             g.spg * SECSIZE);
+  gat[slot_sector(0) * SECSIZE + DIR_EXTENT] = 0;
+  gat[slot_sector(0) * SECSIZE + DIR_EXTENT + 1] = 0;
+  hit[0] = name_hash((const Uint8 *)"BOOT    SYS");
+  make_entry(&g, gat + slot_sector(1) * SECSIZE + slot_offset(1),
+             ATTR_SYS | ATTR_INUSE | ATTR_INV | 5, "DIR     SYS",
+             g.spt * SECSIZE);
+  gat[slot_sector(1) * SECSIZE + DIR_EXTENT] = g.dirtrack;
+  gat[slot_sector(1) * SECSIZE + DIR_EXTENT + 1] = g.gpt - 1;
+  hit[1] = name_hash((const Uint8 *)"DIR     SYS");
+
+  /* User files, outside the slots reserved for system files */
+  slot = 0;
+  next = g.gpt;
+  for (i = 0; i < nnames; i++) {
+    Uint8 name[11];
+    int j, dup = 0;
+
+    if (trs_name(names[i], name) < 0)
+      continue;
+    for (j = 0; j < HIT_SIZE; j++) {
+      if (hd->file[j].host && memcmp(hd->file[j].name, name, 11) == 0)
+        dup = 1;
+    }
+    if (dup) {
+      error("hostdir: '%s' has the same TRS-80 name as another file, skipped",
+            names[i]);
+      continue;
+    }
+    while (slot < HIT_SIZE && (!slot_valid(&g, slot) || slot < 0x08 ||
+           (slot >= 0x20 && slot < 0x28)))
+      slot++;
+    if (slot == HIT_SIZE) {
+      error("hostdir: directory of '%s' full", dirname);
+      break;
+    }
+    if (load_file(hd, &g, data, gat, hit, slot, &next, names[i], name) == 0)
+      slot++;
+  }
+  for (i = 0; i < nnames; i++)
+    free(names[i]);
+  free(names);
+
+  if ((f = tmpfile()) == NULL || fwrite(image, 1, JV3_SECSTART +
+      NTRACKS * g.spt * SECSIZE, f) != (size_t)(JV3_SECSTART +
+      NTRACKS * g.spt * SECSIZE)) {
+    error("failed to create image of '%s': %s", dirname, strerror(errno));
+    if (f)
+      fclose(f);
+    free(image);
+    hostdir[drive] = hd;
+    trs_hostdir_close(drive, NULL);
+    return NULL;
+  }
+  fflush(f);
+  free(image);
+  hostdir[drive] = hd;
+  return f;
+}
+
+void trs_hostdir_dirty(int drive)
+{
+  if (hostdir[drive])
+    hostdir[drive]->dirty = 1;
+}
+
+int trs_hostdir_active(int drive)
+{
+  return hostdir[drive] != NULL;
+}
+
+/* Read a sector of side 0 from the JV3 image */
+static int read_sector(FILE *f, const Uint8 *ids, int track, int sector,
+                       Uint8 *buf)
+{
+  long offset = JV3_SECSTART;
+  int i;
+
+  for (i = 0; i < JV3_SECSPERBLK; i++) {
+    const Uint8 *id = ids + i * 3;
+    int const size = 128 << ((id[2] & JV3_SIZE) ^
+                             (id[0] == JV3_FREE ? 2 : 1));
+
+    if (id[0] == track && id[1] == sector && !(id[2] & JV3_SIDE) &&
+        id[0] != JV3_FREE) {
+      memset(buf, 0, SECSIZE);
+      if (fseek(f, offset, SEEK_SET) < 0 ||
+          fread(buf, 1, size < SECSIZE ? size : SECSIZE, f) == 0)
+        return -1;
+      return 0;
+    }
+    offset += size;
+  }
+  return -1;
+}
+
+static int read_entry(FILE *f, const Uint8 *ids, const Geometry *g,
+                      int slot, Uint8 *entry)
+{
+  Uint8 buf[SECSIZE];
+
+  if (!slot_valid(g, slot) ||
+      read_sector(f, ids, g->dirtrack, slot_sector(slot), buf) < 0)
+    return -1;
+  memcpy(entry, buf + slot_offset(slot), ENTRY_SIZE);
+  return 0;
+}
+
+/* Read the contents of a file following its extents */
+static Uint8 *read_file(FILE *f, const Uint8 *ids, const Geometry *g,
+                        const Uint8 *primary, int *psize)
+{
+  Uint8 entry[ENTRY_SIZE];
+  Uint8 buf[SECSIZE];
+  Uint8 *contents;
+  int const ern = primary[DIR_ERN] | (primary[DIR_ERN + 1] << 8);
+  int const eof = primary[DIR_EOF];
+  int size, pos = 0, ext, links = 0;
+
+  if (g->dos6)
+    size = ern * SECSIZE + eof;
+  else
+    size = ern == 0 ? 0 : eof ? (ern - 1) * SECSIZE + eof : ern * SECSIZE;
+  if ((contents = (Uint8 *)malloc(size + 1)) == NULL)
+    fatal("hostdir: out of memory");
+
+  memcpy(entry, primary, ENTRY_SIZE);
+  for (ext = 0; ext < EXTENTS && pos < size; ext++) {
+    int const track = entry[DIR_EXTENT + ext * 2];
+    int const grans = entry[DIR_EXTENT + ext * 2 + 1];
+    int gran, sec;
+
+    if (track == 0xFF)
+      break;
+    if (track == 0xFE) {
+      /* Link to extended directory entry */
+      if (++links > HIT_SIZE || read_entry(f, ids, g, grans, entry) < 0)
+        break;
+      ext = -1;
+      continue;
+    }
+    gran = track * g->gpt + (grans >> 5);
+    for (sec = 0; sec < ((grans & 0x1F) + 1) * g->spg && pos < size; sec++) {
+      int const lin = gran + sec / g->spg;
+
+      if (read_sector(f, ids, lin / g->gpt,
+                      (lin % g->gpt) * g->spg + sec % g->spg, buf) < 0)
+        break;
+      memcpy(contents + pos, buf, size - pos < SECSIZE ? size - pos : SECSIZE);
+      pos += SECSIZE;
+    }
+  }
+  if (pos < size) {
+    free(contents);
+    return NULL;
+  }
+  *psize = size;
+  return contents;
+}
+
+/* Whether host is mounted in another slot than skip */
+static int host_mounted(const HostDir *hd, int skip, const char *host)
+{
+  int slot;
+
+  for (slot = 0; slot < HIT_SIZE; slot++) {
+    if (slot != skip && hd->file[slot].host &&
+        strcmp(hd->file[slot].host, host) == 0)
+      return 1;
+  }
+  return 0;
+}
+
+/* Whether host is a file which was not mounted and must not be written */
+static int host_taken(const HostDir *hd, int skip, const char *host)
+{
+  char path[FILENAME_MAX];
+  struct stat st;
+
+  if (host_mounted(hd, skip, host))
+    return 0;
+  return host_path(hd, host, path) < 0 || stat(path, &st) == 0;
+}
+
+static int write_file(const HostDir *hd, const char *host,
+                      const Uint8 *contents, int size)
+{
+  char path[FILENAME_MAX];
+  FILE *f;
+
+  if (host_path(hd, host, path) < 0)
+    return -1;
+  if ((f = fopen(path, "wb")) == NULL ||
+      (int)fwrite(contents, 1, size, f) != size) {
+    error("hostdir: failed to write '%s': %s", path, strerror(errno));
+    if (f)
+      fclose(f);
+    return -1;
+  }
+  if (fclose(f) != 0) {
+    error("hostdir: failed to write '%s': %s", path, strerror(errno));
+    return -1;
+  }
+  return 0;
+}
+
+void trs_hostdir_sync(int drive, FILE *image)
+{
+  HostDir *hd = hostdir[drive];
+  Geometry g;
+  Uint8 ids[JV3_SECSPERBLK * 3];
+  Uint8 buf[SECSIZE], hit[SECSIZE], entry[ENTRY_SIZE];
+  char host[16], path[FILENAME_MAX], newpath[FILENAME_MAX];
+  int killed[HIT_SIZE] = { 0 };
+  int slot, i;
+
+  if (hd == NULL || image == NULL || !hd->dirty)
+    return;
+  hd->dirty = 0;
+
+  fflush(image);
+  if (fseek(image, 0, SEEK_SET) < 0 ||
+      fread(ids, 3, JV3_SECSPERBLK, image) != JV3_SECSPERBLK)
+    return;
+
+  /* Geometry from boot sector, GAT and directory track */
+  if (read_sector(image, ids, 0, 0, buf) < 0) {
+    error("hostdir: no boot sector on '%s', changes not written back",
+          hd->path);
+    return;
+  }
+  g.dirtrack = buf[2];
+  if (read_sector(image, ids, g.dirtrack, 0, buf) < 0 ||
+      read_sector(image, ids, g.dirtrack, 1, hit) < 0) {
+    error("hostdir: no directory on '%s', changes not written back",
+          hd->path);
+    return;
+  }
+  g.gpt = (buf[GAT_CONFIG] & 7) + 1;
+  g.spt = 0;
+  for (i = 0; i < JV3_SECSPERBLK; i++) {
+    if (ids[i * 3] == g.dirtrack && !(ids[i * 3 + 2] & JV3_SIDE))
+      g.spt++;
+  }
+  g.spg = g.spt / g.gpt;
+  g.dden = g.spt > 10;
+  g.dos6 = buf[GAT_VERSION] >= 0x60;
+  if (g.spg == 0 || g.spt < 3) {
+    error("hostdir: unknown format on '%s', changes not written back",
+          hd->path);
+    return;
+  }
+
+  for (slot = 0; slot < HIT_SIZE; slot++) {
+    HostFile *hf = &hd->file[slot];
+    Uint8 *contents;
+    int size;
+
+    if (hit[slot] == 0) {
+      killed[slot] = 1;
+      continue;
+    }
+    if (read_entry(image, ids, &g, slot, entry) < 0) {
+      if (hf->host)
+        error("hostdir: failed to read the entry of '%s' on '%s'",
+              hf->host, hd->path);
+      continue;
+    }
+    if (!(entry[DIR_ATTR] & ATTR_INUSE)) {
+      killed[slot] = 1;
+      continue;
+    }
+    if (entry[DIR_ATTR] & (ATTR_FXDE | ATTR_SYS))
+      continue;
+    if ((contents = read_file(image, ids, &g, entry, &size)) == NULL) {
+      error("hostdir: bad extents for '%.8s/%.3s' on '%s'",
+            &entry[DIR_NAME], &entry[DIR_NAME + 8], hd->path);
+      continue;
+    }
+    host_name(&entry[DIR_NAME], host);
+
+    if (hf->host && memcmp(hf->name, &entry[DIR_NAME], 11) != 0) {
+      /* Renamed, or slot reused for a new file */
+      if (host_taken(hd, slot, host)) {
+        error("hostdir: '%s' not mounted, '%s' not renamed to it",
+              host, hf->host);
+        free(contents);
+        continue;
+      }
+      if (host_path(hd, hf->host, path) == 0 &&
+          host_path(hd, host, newpath) == 0 &&
+          rename(path, newpath) != 0)
+        error("hostdir: failed to rename '%s': %s", path, strerror(errno));
+      free(hf->host);
+      hf->host = NULL;
+    } else if (hf->host == NULL && host_taken(hd, slot, host)) {
+      error("hostdir: '%s' not mounted, new file not written to it", host);
+      free(contents);
+      continue;
+    }
+    if (hf->host == NULL || hf->size != size ||
+        hf->hash != data_hash(contents, size)) {
+      if (write_file(hd, hf->host ? hf->host : host, contents, size) == 0) {
+        if (hf->host == NULL)
+          hf->host = strdup(host);
+        memcpy(hf->name, &entry[DIR_NAME], 11);
+        hf->size = size;
+        hf->hash = data_hash(contents, size);
+      }
+    }
+    free(contents);
+  }
+
+  /* Killed files, unless another file has taken over the name */
+  for (slot = 0; slot < HIT_SIZE; slot++) {
+    HostFile *hf = &hd->file[slot];
+
+    if (hf->host && killed[slot]) {
+      if (!host_mounted(hd, slot, hf->host) &&
+          host_path(hd, hf->host, path) == 0 && remove(path) != 0)
+        error("hostdir: failed to delete '%s': %s", path, strerror(errno));
+      free(hf->host);
+      hf->host = NULL;
+    }
+  }
+}
+
+void trs_hostdir_close(int drive, FILE *image)
+{
+  HostDir *hd = hostdir[drive];
+  int i;
+
+  if (hd == NULL)
+    return;
+  trs_hostdir_sync(drive, image);
+  for (i = 0; i < HIT_SIZE; i++)
+    free(hd->file[i].host);
+  free(hd);
+  hostdir[drive] = NULL;
+}
@@ -0,0 +1,32 @@
+/*
+ * Host directory mounted as an emulated floppy disk.
+ *
+ * The disk is a JV3 image synthesized from the files of the directory,
+ * formatted as an LDOS/LS-DOS data disk.  Files written, renamed or
+ * killed by the emulated DOS are written back to the directory.
+ */
+#ifndef _TRS_HOSTDIR_H
+#define _TRS_HOSTDIR_H
+
+#include <stdio.h>
+
+/*
+ * Build the image of the directory; NULL if it can't be done.  dos6
+ * selects the end of file of LS-DOS 6 instead of LDOS 5 in the entries.
+ */
+extern FILE *trs_hostdir_open(int drive, const char *dirname, int dden,
+                              int dos6);
+
+/* Note that the image of the drive may have changed */
+extern void trs_hostdir_dirty(int drive);
+
+/* Write back changes of the drive's image to the directory */
+extern void trs_hostdir_sync(int drive, FILE *image);
+
+/* Write back changes and forget about the directory */
+extern void trs_hostdir_close(int drive, FILE *image);
+
+/* Is the drive a mounted directory? */
+extern int trs_hostdir_active(int drive);
+
+#endif
@@ -37,11 +37,15 @@
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
+#ifndef _WIN32
+#include <sys/uio.h>
+#endif
 #include "error.h"
 #include "trs.h"
 #include "trs_disk.h"
 #include "trs_hard.h"
 #include "trs_imp_exp.h"
+#include "trs_memory.h"
 #include "trs_state_save.h"
 
 /*
@@ -72,6 +76,16 @@ typedef struct {
 static OpenDisk od[MAX_OPENDISK];
 static int xtrshard_fd[4] = {-1,-1,-1,-1};
 
+/* Largest number of host buffers per readv/writev call */
+#define EMT_IOV 64
+
+#ifdef _WIN32
+struct iovec {
+  void *iov_base;
+  size_t iov_len;
+};
+#endif
+
 static int emt_block(const char *emt_func)
 {
   if (trs_emtsafe) {
@@ -238,24 +252,114 @@ void do_emt_close(void)
   }
 }
 
-void do_emt_read(void)
+static void emt_hard_led(int fd)
 {
-  int size;
   int i;
 
+  if (trs_show_led) {
+    for (i = 0; i < 3; i++) {
+      if (fd == xtrshard_fd[i])
+        trs_hard_led(i, 1);
+    }
+  }
+}
+
+static int emt_readwrite(int fd, struct iovec *iov, int iovcnt, int to_mem)
+{
+#ifdef _WIN32
+  int i;
+  int size, total = 0;
+
+  for (i = 0; i < iovcnt; i++) {
+    if (to_mem)
+      size = read(fd, iov[i].iov_base, iov[i].iov_len);
+    else
+      size = write(fd, iov[i].iov_base, iov[i].iov_len);
+    if (size < 0)
+      return total ? total : -1;
+    total += size;
+    if (size < (int)iov[i].iov_len)
+      break;
+  }
+  return total;
+#else
+  return to_mem ? readv(fd, iov, iovcnt) : writev(fd, iov, iovcnt);
+#endif
+}
+
+/*
+ * Transfer count bytes between file fd and the Z80 address space at
+ * address, as seen through the current memory map.  Plain memory is
+ * read or written in place, page by page; video memory and memory-
+ * mapped I/O go through a bounce buffer and mem_read/mem_write.
+ * Returns the number of bytes transferred, -1 on error.
+ */
+static int emt_transfer(int fd, int address, int count, int to_mem)
+{
+  static Uint8 bounce[0x10000];
+  struct iovec iov[EMT_IOV];
+  int done = 0;
+
+  while (done < count) {
+    int i, n, pos, size, total;
+
+    for (n = 0, pos = done; n < EMT_IOV && pos < count; n++) {
+      int len = count - pos;
+      Uint8 *ptr = mem_pointer_span(address + pos, to_mem, &len);
+
+      if (ptr == NULL) {
+        ptr = &bounce[pos];
+        if (!to_mem) {
+          for (i = 0; i < len; i++)
+            ptr[i] = mem_read(address + pos + i);
+        }
+      }
+      iov[n].iov_base = ptr;
+      iov[n].iov_len = len;
+      pos += len;
+    }
+    total = pos - done;
+
+    size = emt_readwrite(fd, iov, n, to_mem);
+    if (size < 0)
+      return done ? done : -1;
+
+    if (to_mem) {
+      for (i = 0, pos = done; i < n && pos < done + size; i++) {
+        Uint8 *ptr = iov[i].iov_base;
+        int len = iov[i].iov_len;
+
+        if (ptr == &bounce[pos]) {
+          int j;
+
+          if (len > done + size - pos)
+            len = done + size - pos;
+          for (j = 0; j < len; j++)
+            mem_write(address + pos + j, ptr[j]);
+        }
+        pos += iov[i].iov_len;
+      }
+    }
+
+    done += size;
+    if (size < total)
+      break;
+  }
+  return done;
+}
+
+static void emt_readwrite_z80(int to_mem)
+{
+  int size;
+
   if (Z80_HL + Z80_BC > 0x10000) {
     Z80_A = EFAULT;
     Z80_F &= ~ZERO_MASK;
     Z80_BC = 0xFFFF;
     return;
   }
-  if (trs_show_led) {
-    for (i = 0; i < 3; i++) {
-      if (Z80_DE == xtrshard_fd[i])
-        trs_hard_led(i, 1);
-    }
-  }
-  size = read(Z80_DE, mem_pointer(Z80_HL, 1), Z80_BC);
+  emt_hard_led(Z80_DE);
+  size = emt_transfer(Z80_DE, Z80_HL, Z80_BC, to_mem);
   if (size >= 0) {
     Z80_A = 0;
     Z80_F |= ZERO_MASK;
@@ -266,25 +370,61 @@ void do_emt_read(void)
   Z80_BC = size;
 }
 
+void do_emt_read(void)
+{
+  emt_readwrite_z80(1);
+}
 
 void do_emt_write(void)
 {
-  int size;
-  int i;
+  emt_readwrite_z80(0);
+}
 
-  if (Z80_HL + Z80_BC > 0x10000) {
+static void emt_readwrite_bulk(int to_mem)
+{
+  unsigned int address = 0;
+  unsigned int count = 0;
+  int i, size;
+
+  if (Z80_HL + 8 > 0x10000) {
     Z80_A = EFAULT;
     Z80_F &= ~ZERO_MASK;
-    Z80_BC = 0xFFFF;
     return;
   }
-  if (trs_show_led) {
-    for (i = 0; i < 3; i++) {
-      if (Z80_DE == xtrshard_fd[i])
-        trs_hard_led(i, 1);
+  for (i = 0; i < 4; i++) {
+    address |= (unsigned int)mem_read(Z80_HL + i) << i * 8;
+    count |= (unsigned int)mem_read(Z80_HL + 4 + i) << i * 8;
+  }
+
+  if (Z80_A == EX_Z80) {
+    if (address > 0x10000 || count > 0x10000 - address) {
+      errno = EFAULT;
+      size = -1;
+    } else {
+      emt_hard_led(Z80_DE);
+      size = emt_transfer(Z80_DE, address, count, to_mem);
+    }
+  } else {
+    Uint8 *ptr = NULL;
+
+    if (Z80_A == EX_RAM)
+      ptr = mem_phys_pointer(MEM_RAM, address, count);
+    else if (Z80_A == EX_SUPERMEM)
+      ptr = mem_phys_pointer(MEM_SUPERMEM, address, count);
+    if (ptr == NULL) {
+      errno = (Z80_A > EX_SUPERMEM) ? EINVAL : EFAULT;
+      size = -1;
+    } else {
+      emt_hard_led(Z80_DE);
+      if (to_mem) {
+        size = read(Z80_DE, ptr, count);
+        mem_dirty_range(Z80_A == EX_RAM ? MEM_RAM : MEM_SUPERMEM, address, count);
+      } else {
+        size = write(Z80_DE, ptr, count);
+      }
     }
   }
-  size = write(Z80_DE, mem_pointer(Z80_HL, 0), Z80_BC);
+
   if (size >= 0) {
     Z80_A = 0;
     Z80_F |= ZERO_MASK;
@@ -292,7 +432,18 @@ void do_emt_write(void)
     Z80_A = errno;
     Z80_F &= ~ZERO_MASK;
   }
-  Z80_BC = size;
+  for (i = 0; i < 4; i++)
+    mem_write(Z80_HL + 4 + i, ((unsigned int)size >> i * 8) & 0xFF);
+}
+
+void do_emt_readx(void)
+{
+  emt_readwrite_bulk(1);
+}
+
+void do_emt_writex(void)
+{
+  emt_readwrite_bulk(0);
 }
 
 void do_emt_lseek(void)
@@ -94,7 +94,30 @@
  *         Before, HL => path, null terminated
  *         After,  AF =  0 if OK, error number if not (Z flag affected)
  *
- * ED2C-ED2E reserved
+ * ED2C emt_readx
+ *   Bulk version of emt_read.  Can fill all of the 64K address space or
+ *   the banks of the memory expansions in one call.  The Z80 address
+ *   space is accessed through the current memory map, including video
+ *   memory and memory-mapped I/O.  Physical memory bypasses the map:
+ *   main RAM starts with the low 64K, followed by the banks of the
+ *   Model 4 128K, HyperMem, MegaMem, etc. as the model lays them out.
+ *         Before, A  =  address space (use EX_ values defined below)
+ *                 DE =  fd
+ *                 HL => parameter block: 4-byte little-endian address,
+ *                       followed by 4-byte little-endian nbytes
+ *         After,  AF =  0 if OK, error number if not (Z flag affected)
+ *                 HL => same block, nbytes read, 0xFFFFFFFF if error
+ *
+ * ED2D emt_writex
+ *   Bulk version of emt_write.
+ *         Before, A  =  address space (use EX_ values defined below)
+ *                 DE =  fd
+ *                 HL => parameter block: 4-byte little-endian address,
+ *                       followed by 4-byte little-endian nbytes
+ *         After,  AF =  0 if OK, error number if not (Z flag affected)
+ *                 HL => same block, nbytes written, 0xFFFFFFFF if error
+ *
+ * ED2E reserved
  *
  * ED2F emt_debug
  *   Enter zbx, the xtrs debugger.
@@ -266,6 +289,11 @@
 #define EO_TRUNC  01000
 #define EO_APPEND 02000
 
+/* Address spaces for emt_readx and emt_writex */
+#define EX_Z80       0  /* 64K as seen through the current memory map */
+#define EX_RAM       1  /* Physical RAM including the expansion banks */
+#define EX_SUPERMEM  2  /* Physical AlphaTech SuperMem RAM */
+
 extern void do_emt_system(void);
 extern void do_emt_getddir(void);
 extern void do_emt_setddir(void);
@@ -274,6 +302,8 @@ extern void do_emt_open(void);
 extern void do_emt_close(void);
 extern void do_emt_read(void);
 extern void do_emt_write(void);
+extern void do_emt_readx(void);
+extern void do_emt_writex(void);
 extern void do_emt_lseek(void);
 extern void do_emt_strerror(void);
 extern void do_emt_time(void);
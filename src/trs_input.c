@@ -0,0 +1,418 @@
+/*
+ * Log of the input seen by the emulated machine.
+ *
+ * Key changes are logged where they enter the keyboard queue, and what
+ * the Z80 reads of the joystick, the mouse and the host clock where it
+ * reads it, each with the T-state counter.  The emulation being
+ * deterministic otherwise, restoring a snapshot and feeding the logged
+ * events back at the same T-states runs it again exactly the same way.
+ *
+ * Positions in the log are counted from the start of the emulation, so
+ * they stay valid when old events are dropped.  Events logged at the
+ * same T-state as a snapshot may be already in it or not: a snapshot
+ * keeps its position in the log instead.
+ *
+ * With -record, the log is also written to a file which starts with a
+ * compressed snapshot.  Every event takes a byte for its kind and the
+ * T-states since the previous one and its value as variable length
+ * numbers, 7 bits to a byte.  When going back in time, the position
+ * gone back to is written; the recording ends with a checksum of the
+ * state, so a replay with -replay tells whether it came out the same.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL.h>
+#include "error.h"
+#include "trs.h"
+#include "trs_input.h"
+#include "trs_rewind.h"
+#include "trs_snapshot.h"
+#include "trs_state_save.h"
+
+#define INPUT_UNKNOWN  ((Uint64) -1)
+
+typedef struct {
+  tstate_t t_count;
+  Uint64 value;
+  int type;
+} input_event;
+
+static const char inputFileBanner[] = "SDLTRS Input Recording";
+static int const inputFileBannerLen = sizeof(inputFileBanner) - 1;
+static unsigned inputVersionNumber = 1;
+
+int trs_input_replaying;
+tstate_t trs_input_due = INPUT_NEVER;
+char trs_input_record_file[FILENAME_MAX];
+char trs_input_replay_file[FILENAME_MAX];
+int trs_input_replay_quit;
+
+static input_event *input_log;
+static unsigned long input_base; /* position of the first event in the log */
+static int input_count;
+static int input_size;
+static int input_next;           /* next event to replay */
+static int input_feeding;        /* input comes from the log */
+
+/* Joystick, mouse and time last logged or replayed, and before the log */
+static Uint64 input_last[INPUT_TYPES];
+static Uint64 input_first[INPUT_TYPES];
+
+/* Recording being written */
+static FILE *input_file;
+static unsigned long input_file_base;
+static tstate_t input_file_t;
+
+/* Replay of a recording */
+static Uint32 input_replay_ticks;
+static tstate_t input_replay_t;
+
+static void input_put_number(Uint64 number)
+{
+  while (number >= 0x80) {
+    putc((number & 0x7F) | 0x80, input_file);
+    number >>= 7;
+  }
+  putc(number, input_file);
+}
+
+static int input_get_number(FILE *file, Uint64 *number)
+{
+  int c, shift = 0;
+
+  *number = 0;
+  do {
+    if ((c = getc(file)) == EOF || shift > 63)
+      return -1;
+    *number |= (Uint64)(c & 0x7F) << shift;
+    shift += 7;
+  } while (c & 0x80);
+  return 0;
+}
+
+static void input_write(int type, Uint64 value)
+{
+  /* Time goes backwards after rewinding */
+  Sint64 const delta = z80_state.t_count - input_file_t;
+
+  putc(type, input_file);
+  input_put_number(delta < 0 ? ((Uint64)~delta << 1) | 1 : (Uint64)delta << 1);
+  input_put_number(value);
+  input_file_t = z80_state.t_count;
+}
+
+static void input_push(tstate_t t_count, int type, Uint64 value)
+{
+  input_event *event;
+
+  if (input_count == input_size) {
+    int size = input_size ? input_size * 2 : 1024;
+    input_event *log = realloc(input_log, size * sizeof(*log));
+
+    if (log == NULL) {
+      error("failed to allocate input log");
+      return;
+    }
+    input_log = log;
+    input_size = size;
+  }
+  event = &input_log[input_count++];
+  event->t_count = t_count;
+  event->type = type;
+  event->value = value;
+}
+
+/* Log to the recording, and in memory if it may be replayed */
+static void input_append(int type, Uint64 value)
+{
+  if (input_file)
+    input_write(type, value);
+  else if (trs_rewind_mb <= 0)
+    return;
+  input_push(z80_state.t_count, type, value);
+}
+
+int trs_input_record(int type, int value)
+{
+  if (trs_input_replaying)
+    return input_feeding ? 0 : -1;
+  input_append(type, (Uint32)value);
+  return 0;
+}
+
+/* End of a recording replayed: compare with the state it ended with */
+static void input_replay_done(Uint64 checksum)
+{
+  Uint32 const ms = SDL_GetTicks() - input_replay_ticks;
+  tstate_t const t_count = z80_state.t_count - input_replay_t;
+  trs_snapshot *snap = trs_snapshot_take();
+  int const same = snap && trs_snapshot_checksum(snap) == checksum;
+
+  trs_snapshot_free(snap);
+  trs_input_replay_end();
+  printf("Replay of '%s': %" TSTATE_T_LEN " T-states in %u ms (%.2f MHz), "
+      "%s\n", trs_input_replay_file, t_count, ms,
+      ms ? t_count / (ms * 1000.0) : 0.0,
+      same ? "same end state" : "end state differs");
+  fflush(stdout);
+  if (trs_input_replay_quit)
+    exit(same ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+void trs_input_run(void)
+{
+  input_feeding = 1;
+  while (trs_input_replaying && input_next < input_count &&
+         input_log[input_next].t_count <= z80_state.t_count) {
+    input_event const *event = &input_log[input_next++];
+    int const value = (int)event->value;
+
+    switch (event->type) {
+      case INPUT_END:
+        input_replay_done(event->value);
+        break;
+      case INPUT_KEY:
+        queue_key(value);
+        break;
+      case INPUT_KEYCLEAR:
+        clear_key_queue();
+        break;
+      case INPUT_RESET:
+        trs_reset(value);
+        break;
+      case INPUT_PASTE:
+        trs_paste_speed(value);
+        break;
+      default:
+        input_last[event->type] = event->value;
+        break;
+    }
+  }
+  input_feeding = 0;
+  trs_input_due = trs_input_replaying && input_next < input_count ?
+      input_log[input_next].t_count : INPUT_NEVER;
+}
+
+/* Input which is read rather than sent: log it when it changed */
+static Uint64 input_read(int type, Uint64 live)
+{
+  if (trs_input_replaying) {
+    /* Logged in the middle of the instruction reading it */
+    trs_input_run();
+    if (input_last[type] != INPUT_UNKNOWN)
+      return input_last[type];
+  } else if (live != input_last[type]) {
+    input_append(type, live);
+    input_last[type] = live;
+  }
+  return live;
+}
+
+int trs_input_joystick(int live)
+{
+  return input_read(INPUT_JOY, (Uint32)live);
+}
+
+void trs_input_mouse(int *x, int *y, unsigned int *buttons)
+{
+  Uint64 const value = input_read(INPUT_MOUSE, (*x & 0x3FFF) |
+      (*y & 0x3FFF) << 14 | (Uint64)(*buttons & 7) << 28);
+
+  *x = value & 0x3FFF;
+  *y = (value >> 14) & 0x3FFF;
+  *buttons = (value >> 28) & 7;
+}
+
+time_t trs_input_time(void)
+{
+  return (time_t)input_read(INPUT_TIME, (Uint64)time(NULL));
+}
+
+unsigned long trs_input_mark(void)
+{
+  return input_base + (trs_input_replaying ? input_next : input_count);
+}
+
+/* Index in the log of a position, clipped to the events in it */
+static int input_index(unsigned long mark)
+{
+  if (mark < input_base)
+    return 0;
+  if (mark - input_base > (unsigned long)input_count)
+    return input_count;
+  return mark - input_base;
+}
+
+/* Value of input read before the event at index */
+static Uint64 input_value_at(int index, int type)
+{
+  while (--index >= 0) {
+    if (input_log[index].type == type)
+      return input_log[index].value;
+  }
+  return input_first[type];
+}
+
+void trs_input_replay(unsigned long mark)
+{
+  int type;
+
+  input_next = input_index(mark);
+  for (type = 0; type < INPUT_TYPES; type++)
+    input_last[type] = input_value_at(input_next, type);
+  trs_input_replaying = INPUT_REPLAY_HISTORY;
+  trs_input_due = input_next < input_count ?
+      input_log[input_next].t_count : INPUT_NEVER;
+}
+
+void trs_input_replay_end(void)
+{
+  trs_input_replaying = 0;
+  trs_input_due = INPUT_NEVER;
+}
+
+void trs_input_forget(unsigned long mark)
+{
+  int const n = input_index(mark);
+  int type;
+
+  for (type = 0; type < INPUT_TYPES; type++)
+    input_first[type] = input_value_at(n, type);
+  memmove(input_log, input_log + n, (input_count - n) * sizeof(*input_log));
+  input_count -= n;
+  input_next = input_next > n ? input_next - n : 0;
+  input_base += n;
+}
+
+void trs_input_truncate(unsigned long mark)
+{
+  input_count = input_index(mark);
+  if (input_next > input_count)
+    input_next = input_count;
+  if (input_file)
+    input_write(INPUT_TRUNCATE, input_base + input_count - input_file_base);
+}
+
+/* Nothing read yet, so the first value read will be logged */
+static void input_clear(void)
+{
+  int type;
+
+  for (type = 0; type < INPUT_TYPES; type++)
+    input_last[type] = input_first[type] = INPUT_UNKNOWN;
+}
+
+int trs_input_record_start(const char *filename)
+{
+  static int registered;
+  trs_snapshot *snap;
+  FILE *file;
+
+  trs_input_record_stop();
+  if ((file = fopen(filename, "wb")) == NULL) {
+    error("failed to write recording '%s': %s", filename, strerror(errno));
+    return -1;
+  }
+  /* Going back before the start of the recording is not possible */
+  trs_rewind_reset();
+  if ((snap = trs_snapshot_take()) == NULL) {
+    fclose(file);
+    return -1;
+  }
+  trs_save_uint8(file, (Uint8 *)inputFileBanner, inputFileBannerLen);
+  trs_save_uint32(file, &inputVersionNumber, 1);
+  trs_snapshot_save(snap, file);
+  trs_snapshot_free(snap);
+
+  input_file = file;
+  input_file_base = trs_input_mark();
+  input_file_t = z80_state.t_count;
+  input_clear();
+
+  if (!registered && atexit(trs_input_record_stop) == 0)
+    registered = 1;
+  return 0;
+}
+
+void trs_input_record_stop(void)
+{
+  trs_snapshot *snap;
+
+  if (input_file == NULL)
+    return;
+
+  snap = trs_snapshot_take();
+  input_write(INPUT_END, snap ? trs_snapshot_checksum(snap) : 0);
+  trs_snapshot_free(snap);
+  if (fclose(input_file) != 0)
+    error("failed to write recording '%s': %s", trs_input_record_file,
+        strerror(errno));
+  input_file = NULL;
+}
+
+int trs_input_replay_start(const char *filename)
+{
+  FILE *file = fopen(filename, "rb");
+  trs_snapshot *snap;
+  char banner[80];
+  unsigned version;
+  tstate_t t_count;
+  int type;
+
+  if (file == NULL) {
+    error("failed to read recording '%s': %s", filename, strerror(errno));
+    return -1;
+  }
+  trs_load_uint8(file, (Uint8 *)banner, inputFileBannerLen);
+  trs_load_uint32(file, &version, 1);
+  if (strncmp(banner, inputFileBanner, inputFileBannerLen) != 0 ||
+      version != inputVersionNumber) {
+    error("unsupported recording '%s'", filename);
+    fclose(file);
+    return -1;
+  }
+  if ((snap = trs_snapshot_load(file, filename)) == NULL) {
+    fclose(file);
+    return -1;
+  }
+
+  /* The log holds nothing but the recording */
+  trs_rewind_reset();
+  input_count = 0;
+  t_count = trs_snapshot_tstates(snap);
+  while ((type = getc(file)) != EOF) {
+    Uint64 delta, value;
+
+    if (type >= INPUT_TYPES || input_get_number(file, &delta) ||
+        input_get_number(file, &value))
+      break;
+    t_count += delta & 1 ? ~(delta >> 1) : delta >> 1;
+    if (type == INPUT_TRUNCATE) {
+      input_count = value < (Uint64)input_count ? (int)value : input_count;
+      continue;
+    }
+    input_push(t_count, type, value);
+    if (type == INPUT_END)
+      break;
+  }
+  if (type != INPUT_END)
+    error("recording '%s' ends early", filename);
+  fclose(file);
+
+  if (trs_snapshot_restore(snap)) {
+    trs_snapshot_free(snap);
+    input_count = 0;
+    return -1;
+  }
+  trs_snapshot_free(snap);
+
+  input_clear();
+  input_next = 0;
+  input_replay_ticks = SDL_GetTicks();
+  input_replay_t = z80_state.t_count;
+  trs_input_replaying = INPUT_REPLAY_FILE;
+  trs_input_due = input_count ? input_log[0].t_count : INPUT_NEVER;
+  return 0;
+}
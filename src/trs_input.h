@@ -0,0 +1,71 @@
+/*
+ * Log of the input seen by the emulated machine, stamped with the
+ * T-state counter, so a stretch of emulation can be run again exactly:
+ * when rewinding, or from a file recorded with -record.
+ */
+#ifndef _TRS_INPUT_H
+#define _TRS_INPUT_H
+
+#include <stdio.h>
+#include <time.h>
+#include "z80.h"
+
+/* Kinds of input events */
+#define INPUT_END       (0) /* end of a recording, with checksum */
+#define INPUT_KEY       (1) /* key state change passed to queue_key() */
+#define INPUT_KEYCLEAR  (2) /* clear_key_queue() */
+#define INPUT_JOY       (3) /* joystick state read by the Z80 */
+#define INPUT_RESET     (4) /* reset button or power on */
+#define INPUT_MOUSE     (5) /* mouse position and buttons read by the Z80 */
+#define INPUT_TIME      (6) /* host time read by the Z80 */
+#define INPUT_PASTE     (7) /* paste speed up on or off */
+#define INPUT_TRUNCATE  (8) /* recording went back to an earlier position */
+#define INPUT_TYPES     (9)
+
+#define INPUT_NEVER     ((tstate_t) -1)
+
+/* What is replayed */
+#define INPUT_REPLAY_HISTORY (1) /* going forward after rewinding */
+#define INPUT_REPLAY_FILE    (2) /* recording given with -replay */
+
+/* Non-zero while logged events are fed back instead of live input */
+extern int trs_input_replaying;
+
+/* T-state count at which trs_input_run() must be called next */
+extern tstate_t trs_input_due;
+
+/* Recording to write and to replay, and exit at the end of the replay */
+extern char trs_input_record_file[FILENAME_MAX];
+extern char trs_input_replay_file[FILENAME_MAX];
+extern int trs_input_replay_quit;
+
+/* Log an event happening now; -1 if it must be ignored while replaying */
+extern int trs_input_record(int type, int value);
+
+/* Feed the events which are due while replaying */
+extern void trs_input_run(void);
+
+/* Input the Z80 reads: logged while recording, replayed */
+extern int trs_input_joystick(int live);
+extern void trs_input_mouse(int *x, int *y, unsigned int *buttons);
+extern time_t trs_input_time(void);
+
+/* Position in the log after the last event, or of the next to replay */
+extern unsigned long trs_input_mark(void);
+
+/* Replay the log from a position on, or stop replaying */
+extern void trs_input_replay(unsigned long mark);
+extern void trs_input_replay_end(void);
+
+/* Drop the events before, or from, a position */
+extern void trs_input_forget(unsigned long mark);
+extern void trs_input_truncate(unsigned long mark);
+
+/* Record to a file from the current state on, or stop */
+extern int trs_input_record_start(const char *filename);
+extern void trs_input_record_stop(void);
+
+/* Replay a recording from the state it starts with */
+extern int trs_input_replay_start(const char *filename);
+
+#endif
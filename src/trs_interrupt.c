@@ -31,6 +31,9 @@
 #include <SDL.h>
 #include "trs.h"
 #include "trs_clones.h"
+#include "trs_input.h"
+#include "trs_memory.h"
+#include "trs_metrics.h"
 #include "trs_state_save.h"
 
 /*#define EDEBUG 1*/
@@ -63,6 +66,9 @@ static Uint8 nmi_mask = M3_RESET_BIT;
 int timer_hz = TIMER_HZ_1;
 int timer_overclock;
 int timer_overclock_rate = 5;
+int timer_audio_sync;
+int timer_audio_low = 40;   /* ms of buffered sound */
+int timer_audio_high = 120;
 int speedup = 1;
 unsigned int cycles_per_timer;
 
@@ -118,7 +124,15 @@ float clock_mhz_4 = CLOCK_4_MHZ;
 #define NEWDOS3_MIN                 0x42cd
 #define NEWDOS3_SEC                 0x42cc
 
-static Uint32 deltatime = 25;
+static Uint32 deltatime = 25000; /* us per timer interrupt */
+static int timer_slice;
+
+/* Sleep until this close to a deadline, then spin (us) */
+#if defined(CLOCK_MONOTONIC) && !defined(_WIN32)
+#define TIMER_SPIN_US 200
+#else
+#define TIMER_SPIN_US 1500
+#endif
 static int timer_on = 1;
 #ifdef IDEBUG
 static long lost_timer_interrupts;
@@ -354,21 +368,104 @@ trs_timer_event(void)
   }
 }
 
-void trs_timer_sync_with_host(void)
+/* Host clock in microseconds */
+static Uint64
+timer_host_us(void)
 {
-  Uint32 curtime;
-  static Uint32 lasttime;
+#ifdef SDL2
+  static Uint64 freq;
+  Uint64 count = SDL_GetPerformanceCounter();
+
+  if (freq == 0)
+    freq = SDL_GetPerformanceFrequency();
+  return (count / freq) * 1000000 + (count % freq) * 1000000 / freq;
+#elif defined(CLOCK_MONOTONIC)
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (Uint64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#else
+  return (Uint64)SDL_GetTicks() * 1000;
+#endif
+}
 
-  curtime = SDL_GetTicks();
+/* Sleep for most of the time left, then spin on the clock for the rest */
+static void
+timer_wait_until(Uint64 deadline)
+{
+  Uint64 now = timer_host_us();
+
+  if (deadline > now)
+    trs_metrics_wait_us += deadline - now;
+  if (deadline > now + TIMER_SPIN_US) {
+    Uint64 const sleep = deadline - now - TIMER_SPIN_US;
+#if defined(CLOCK_MONOTONIC) && !defined(_WIN32)
+    struct timespec ts;
+
+    ts.tv_sec = sleep / 1000000;
+    ts.tv_nsec = (sleep % 1000000) * 1000;
+    nanosleep(&ts, NULL);
+#else
+    SDL_Delay(sleep / 1000);
+#endif
+  }
 
-  if (lasttime + deltatime > curtime)
-    SDL_Delay(lasttime + deltatime - curtime);
+  while (timer_host_us() < deadline)
+    ;
+}
 
-  curtime = SDL_GetTicks();
+/* Keep the sound buffer between the low and high watermarks by
+ * shortening or stretching the time slice, up to half of it (us). */
+static int
+timer_audio_adjust(void)
+{
+  int const latency = trs_sound_latency();
+  int const limit = deltatime / 2;
+  int adjust = 0;
+
+  if (latency < 0 || timer_overclock)
+    return 0;
+
+  if (latency < timer_audio_low)
+    adjust = (latency - timer_audio_low) * 500;
+  else if (latency > timer_audio_high)
+    adjust = (latency - timer_audio_high) * 500;
+
+  if (adjust < -limit)
+    adjust = -limit;
+  else if (adjust > limit)
+    adjust = limit;
+  return adjust;
+}
 
-  lasttime += deltatime;
-  if ((lasttime + deltatime) < curtime)
-    lasttime = curtime;
+/*
+ * Called every 1/TIMER_SLICES of a timer interrupt period to pace the
+ * emulation against absolute deadlines on the host clock.  Lateness of
+ * up to one period is made up by the following slices; if we fall
+ * further behind (slow host, pause, debugger) the deadline is reset.
+ * Returns TRUE when the timer interrupt was generated.
+ */
+int trs_timer_sync_with_host(void)
+{
+  static Uint64 deadline;
+  Uint64 now;
+  Sint64 slice = deltatime;
+
+  if (timer_audio_sync && trs_sound)
+    slice += timer_audio_adjust();
+  deadline += slice / TIMER_SLICES;
+
+  now = timer_host_us();
+  if (trs_input_replaying)
+    deadline = now; /* run again what already ran in real time */
+  else if (deadline > now)
+    timer_wait_until(deadline);
+  else if (now - deadline > deltatime)
+    deadline = now;
+
+  if (++timer_slice < TIMER_SLICES)
+    return FALSE;
+  timer_slice = 0;
 
   if (trs_show_led) {
     trs_disk_led(0,0);
@@ -376,6 +473,7 @@ void trs_timer_sync_with_host(void)
   }
 
   trs_timer_event();
+  return TRUE;
 }
 
 void
@@ -416,7 +514,7 @@ trs_timer_init(void)
 
   if ((trs_clones.model & (EG3200 | GENIE3S)) == 0) {
     /* Also initialize the clock in memory - hack */
-    time_t tt = time(NULL);
+    time_t tt = trs_input_time();
     struct tm *lt = localtime(&tt);
     extern Uint8 memory[];
 
@@ -451,6 +549,7 @@ trs_timer_init(void)
           memory[LDOS4_YEAR]  = lt->tm_year;
         }
     }
+    mem_dirty_range(MEM_RAM, 0, 0x10000);
   }
 }
 
@@ -548,9 +647,9 @@ trs_timer_mode(int mode)
   if (mode != -1) {
     timer_overclock = mode;
     if (timer_overclock)
-      deltatime = 1000 / (timer_overclock_rate * timer_hz);
+      deltatime = 1000000 / (timer_overclock_rate * timer_hz);
     else
-      deltatime = 1000 / timer_hz;
+      deltatime = 1000000 / timer_hz;
 
     if (trs_show_led)
       trs_turbo_led();
@@ -599,6 +698,7 @@ trs_do_event(void)
   if (f) {
     event_func = NULL;
     z80_state.sched = 0;
+    trs_metrics_events++;
     f(event_arg);
   }
 }
@@ -664,6 +764,7 @@ void trs_interrupt_save(FILE *file)
 
   trs_save_int(file, &event, 1);
   trs_save_int(file, &event_arg, 1);
+  trs_save_int(file, &timer_slice, 1);
 }
 
 void trs_interrupt_load(FILE *file)
@@ -724,4 +825,9 @@ void trs_interrupt_load(FILE *file)
   }
 
   trs_load_int(file, &event_arg, 1);
+  /* Not in version 5 */
+  if (trs_state_version >= 1)
+    trs_load_int(file, &timer_slice, 1);
+  else
+    timer_slice = 0;
 }
@@ -51,9 +51,11 @@
 #include "trs_cp500.h"
 #include "trs_disk.h"
 #include "trs_hard.h"
+#include "trs_input.h"
 #include "trs_memory.h"
 #include "trs_state_save.h"
 #include "trs_stringy.h"
+#include "trs_trace.h"
 #include "trs_uart.h"
 
 int trs_io_debug_flags;
@@ -149,7 +151,7 @@ static void m6845_crtc(int value)
 
 static int rtc_read(int port)
 {
-  time_t time_secs = time(NULL);
+  time_t time_secs = trs_input_time();
   struct tm *time_info = localtime(&time_secs);
 
   switch (port & 0x0F) {
@@ -184,669 +186,807 @@ static int rtc_read(int port)
   }
 }
 
-void z80_out(int port, int value)
+/*
+ * I/O port dispatch.  The handlers of all 256 ports are looked up in
+ * tables built by trs_io_config() whenever the emulated model or clone
+ * changes, so z80_in() and z80_out() need only a single indirect call.
+ * Checks for optional hardware that can be switched on or off in the
+ * GUI without a reset are kept in the handlers themselves.
+ */
+typedef void (*io_out_func)(int port, int value);
+typedef int  (*io_in_func)(int port);
+
+static io_out_func out_port[256]; /* device handlers */
+static io_in_func  in_port[256];
+static io_out_func out_call[256]; /* called by z80_out(), may be traced */
+static io_in_func  in_call[256];  /* called by z80_in(), may be traced */
+
+static void out_none(int port, int value)
 {
-  if (trs_io_debug_flags & IODEBUG_OUT) {
-    debug("out (0x%02x), 0x%02x; pc 0x%04x\n", port, value, z80_state.pc.word);
-  }
+}
 
-  /* EG 3200 Genie III */
-  if (eg3200) {
-    switch (port) {
-      case 0x28: /* Genieplus Memory Card */
-        mem_bank_base(GENIEPLUS, value);
-        break;
-      case 0x48:
-        trs_hard_out(TRS_HARD_DATA, value);
-        break;
-      case 0x49:
-        trs_hard_out(TRS_HARD_PRECOMP, value);
-        break;
-      case 0x4A:
-        trs_hard_out(TRS_HARD_SECCNT, value);
-        break;
-      case 0x4B:
-        trs_hard_out(TRS_HARD_SECNUM, value);
-        break;
-      case 0x4C:
-        trs_hard_out(TRS_HARD_CYLLO, value);
-        break;
-      case 0x4D:
-        trs_hard_out(TRS_HARD_CYLHI, value);
-        break;
-      case 0x4E:
-        trs_hard_out(TRS_HARD_SDH, value);
-        break;
-      case 0x4F:
-        trs_hard_out(TRS_HARD_COMMAND, value);
-        break;
-      case 0x80: /* Genie III VideoExtension HRG */
-        grafyx_write_x(value);
-        break;
-      case 0x81: /* Genie III VideoExtension HRG */
-        grafyx_write_y(value);
-        break;
-      case 0x82: /* Genie III VideoExtension HRG */
-        grafyx_write_data(value);
-        break;
-      case 0x83: /* Genie III VideoExtension HRG */
-        grafyx_write_mode(value);
-        break;
-      case 0xE0:
-        rtc_reg = value >> 4;
-        break;
-      case 0xF5:
-        trs_screen_inverse(value & 1);
-        break;
-      case 0xF6:
-        ctrlimage = value;
-        break;
-      case 0xF7:
-        m6845_crtc(value);
-        break;
-      case 0xFA:
-        eg3200 = value;
-        break;
-      case 0xFD:
-        trs_printer_write(value);
-        break;
-      default:
-        break;
-    }
-    return;
-  }
+static int in_none(int port)
+{
+  return 0xFF; /* value returned for nonexistent ports */
+}
 
-  /* TCS Genie IIIs */
-  if (genie3s) {
-    switch (port) {
-      case 0x50:
-        trs_hard_out(TRS_HARD_DATA, value);
-        break;
-      case 0x51:
-        trs_hard_out(TRS_HARD_PRECOMP, value);
-        break;
-      case 0x52:
-        trs_hard_out(TRS_HARD_SECCNT, value);
-        break;
-      case 0x53:
-        trs_hard_out(TRS_HARD_SECNUM, value);
-        break;
-      case 0x54:
-        trs_hard_out(TRS_HARD_CYLLO, value);
-        break;
-      case 0x55:
-        trs_hard_out(TRS_HARD_CYLHI, value);
-        break;
-      case 0x56:
-        trs_hard_out(TRS_HARD_SDH, value);
-        break;
-      case 0x57:
-        trs_hard_out(TRS_HARD_COMMAND, value);
-        break;
-      case 0x5B:
-        rtc_reg = value >> 4;
-        break;
-      case 0xE0:
-      case 0xE1:
-      case 0xE2:
-      case 0xE3:
-        trs_disk_select_write(value);
-        break;
-      case 0xE8:
-      case 0xE9:
-      case 0xEA:
-      case 0xEB:
-        trs_printer_write(value);
-        break;
-      case 0xEC:
-        trs_disk_command_write(value);
-        break;
-      case 0xED:
-        trs_disk_track_write(value);
-        break;
-      case 0xEE:
-        trs_disk_sector_write(value);
-        break;
-      case 0xEF:
-        trs_disk_data_write(value);
-        break;
-      case 0xF1:
-        modeimage = value;
-        break;
-      case 0xF6:
-        ctrlimage = value;
-        break;
-      case 0xF7:
-        m6845_crtc(value);
-        break;
-      case 0xF9:
-        genie3s_bank_out(0x100 | value);
-        break;
-      case 0xFA:
-        genie3s_sys_out(value);
-        break;
-      case 0xFD:
-        trs_printer_write(value);
-        break;
-      case 0xFE:
-      case 0xFF:
-        modesel = (value >> 3) & 1;
-        trs_screen_expanded(modesel);
-        trs_cassette_out(value & 0x3);
-        break;
-      default:
-        break;
-    }
-    return;
-  }
+/* Shared by several models and clones */
+static void out_hard_eg3200(int port, int value)
+{
+  trs_hard_out(port - 0x48 + TRS_HARD_DATA, value);
+}
 
-  /* Ports common to all TRS-80 models */
-  switch (port) {
-  case TRS_HARD_WP:       /* 0xC0 */
-    if (trs_model == 1 && lubomir) {
-      lsb_bank_out(value);
-      return;
-    }
-    /* Fall through */
-  case TRS_HARD_CONTROL:  /* 0xC1 */
-  case TRS_HARD_DATA:     /* 0xC8 */
-  case TRS_HARD_ERROR:    /* 0xC9 */ /*=TRS_HARD_PRECOMP*/
-  case TRS_HARD_SECCNT:   /* 0xCA */
-  case TRS_HARD_SECNUM:   /* 0xCB */
-  case TRS_HARD_CYLLO:    /* 0xCC */
-  case TRS_HARD_CYLHI:    /* 0xCD */
-  case TRS_HARD_SDH:      /* 0xCE */
-  case TRS_HARD_STATUS:   /* 0xCF */ /*=TRS_HARD_COMMAND*/
-    trs_hard_out(port, value);
-    break;
-  case TRS_UART_RESET:    /* 0xE8 */
-    trs_uart_reset_out(value);
-    break;
-  case TRS_UART_BAUD:     /* 0xE9 */
-    trs_uart_baud_out(value);
-    break;
-  case TRS_UART_CONTROL:  /* 0xEA */
-    trs_uart_control_out(value);
-    break;
-  case TRS_UART_DATA:     /* 0xEB */
-    trs_uart_data_out(value);
-    break;
-  case 0x43: /* Alpha Technologies SuperMem */
-    if (trs_model < 4 && supermem)
-      mem_bank_base(SUPERMEM, value);
-    break;
-  }
+static int in_hard_eg3200(int port)
+{
+  return trs_hard_in(port - 0x48 + TRS_HARD_DATA);
+}
 
-  if (trs_model == 1) {
-    /* Next, Model I only */
-    switch (port) {
-    case 0x00: /* HRG off */
-    case 0x01: /* HRG on */
-      hrg_onoff(port);
-      break;
-    case 0x02: /* HRG write address low byte */
-      hrg_write_addr(value, 0xff);
-      break;
-    case 0x03: /* HRG write address high byte */
-      hrg_write_addr(value << 8, 0x3f00);
-      break;
-    case 0x05: /* HRG write data byte */
-      hrg_write_data(value);
-      break;
-      /* Selector doesn't decode A5 */
-    case 0x1F:
-    case 0x3F:
-      if (selector)
-        selector_out(value);
-      break;
-    case 0x7E: /* TCS Genie IIs/SpeedMaster RAM 192 B */
-      if (speedup == 6)
-        mem_bank_base(RAM192B, value);
-      return;
-    case 0xB5: /* Orchestra-85 right channel */
-      trs_orch90_out(2, value);
-      break;
-    case 0xB9: /* Orchestra-85 left channel */
-      trs_orch90_out(1, value);
-      break;
-    case 0xD0:
-    case 0x10: /* Homebrew 80*22 SYS80.SYS */
-      if (speedup <= 4)
-        ctrlimage = value;
-      break;
-    case 0xD1:
-    case 0x11: /* Homebrew 80*22 SYS80.SYS */
-      if (speedup <= 4)
-        m6845_crtc(value);
-      break;
-    case 0xD2:
-      if (speedup <= 4)
-        s80z_out(value);
-      break;
-    case 0xDF:
-      if (speedup <= 3 && lubomir == 0)
-        eg64_mba_out(value);
-      break;
-    case 0xEC:
-      if (lowe_le18)
-        lowe_le18_write_data(value);
-      else if (speedup == 3) /* Seatronics Super Speed-Up */
-        trs_timer_speed(value);
-      break;
-    case 0xED:
-      lowe_le18_write_x(value);
-      break;
-    case 0xEE:
-      lowe_le18_write_y(value);
-      break;
-    case 0xEF:
-      lowe_le18_write_control(value);
-      break;
-    case 0xF0:
-    case 0xF1:
-    case 0xF2:
-    case 0xF3:
-    case 0xF4:
-    case 0xF5:
-    case 0xF6:
-    case 0xF7:
-      if (stringy)
-        stringy_out(port & 7, value);
-      break;
-    case 0xF9:
-      if (speedup < 4 && trs_rom_size <= 0x2000)
-        genie3s_init_out(value);
-      break;
-    case 0xFA:
-      if (speedup < 4 && trs_rom_size <= 0x2000)
-        eg3200_init_out(value);
-      break;
-    case 0xFC:
-      if (speedup == 7) /* 6845 CRTC Aster CT-80 */
-        ctrlimage = value;
-      break;
-    case 0xFD:
-      if (speedup == 7) /* 6845 CRTC Aster CT-80 */
-        m6845_crtc(value);
-      else
-        /* Printer port of EACA Genie/System 80 */
-        trs_printer_write(value);
-      break;
-    case 0xFE:
-      /* Speedup kit or Banking/LNW80/TCS Genie IIs and SpeedMaster */
-      if (speedup) {
-        if (speedup < 4)
-          trs_timer_speed(value);
-        else
-          sys_byte_out(value);
-      }
-      break;
-    case 0xFF:
-      /* screen mode select is on D3 line */
-      modesel = (value >> 3) & 1;
-      trs_screen_expanded(modesel);
-      /* do cassette emulation */
-      trs_cassette_motor((value >> 2) & 1);
-      trs_cassette_out(value & 0x3);
-      /* Lubomir Bits 7 - 5 for EG 64.1 */
-      if (lubomir)
-        lsb_bank_out(value & 0xE0);
-      break;
+static void out_hard_genie3s(int port, int value)
+{
+  trs_hard_out(port - 0x50 + TRS_HARD_DATA, value);
+}
+
+static int in_hard_genie3s(int port)
+{
+  return trs_hard_in(port - 0x50 + TRS_HARD_DATA);
+}
+
+static void out_uart_reset(int port, int value)
+{
+  trs_uart_reset_out(value);
+}
+
+static void out_uart_baud(int port, int value)
+{
+  trs_uart_baud_out(value);
+}
+
+static void out_uart_control(int port, int value)
+{
+  trs_uart_control_out(value);
+}
+
+static void out_uart_data(int port, int value)
+{
+  trs_uart_data_out(value);
+}
+
+static int in_uart_modem(int port)
+{
+  return trs_uart_modem_in();
+}
+
+static int in_uart_switches(int port)
+{
+  return trs_uart_switches_in();
+}
+
+static int in_uart_status(int port)
+{
+  return trs_uart_status_in();
+}
+
+static int in_uart_data(int port)
+{
+  return trs_uart_data_in();
+}
+
+static void out_grafyx_x(int port, int value)
+{
+  grafyx_write_x(value);
+}
+
+static void out_grafyx_y(int port, int value)
+{
+  grafyx_write_y(value);
+}
+
+static void out_grafyx_data(int port, int value)
+{
+  grafyx_write_data(value);
+}
+
+static void out_grafyx_mode(int port, int value)
+{
+  grafyx_write_mode(value);
+}
+
+static int in_grafyx_data(int port)
+{
+  return grafyx_read_data();
+}
+
+static int in_grafyx_mode(int port)
+{
+  return grafyx_read_mode();
+}
+
+static void out_disk_select(int port, int value)
+{
+  /* This should cause a 1-2us wait in T states... */
+  trs_disk_select_write(value);
+}
+
+static void out_disk_command(int port, int value)
+{
+  trs_disk_command_write(value);
+}
+
+static void out_disk_track(int port, int value)
+{
+  trs_disk_track_write(value);
+}
+
+static void out_disk_sector(int port, int value)
+{
+  trs_disk_sector_write(value);
+}
+
+static void out_disk_data(int port, int value)
+{
+  trs_disk_data_write(value);
+}
+
+static int in_disk_status(int port)
+{
+  return trs_disk_status_read();
+}
+
+static int in_disk_track(int port)
+{
+  return trs_disk_track_read();
+}
+
+static int in_disk_sector(int port)
+{
+  return trs_disk_sector_read();
+}
+
+static int in_disk_data(int port)
+{
+  return trs_disk_data_read();
+}
+
+static void out_printer(int port, int value)
+{
+  trs_printer_write(value);
+}
+
+static int in_printer(int port)
+{
+  return trs_printer_read();
+}
+
+static void out_orch_left(int port, int value)
+{
+  trs_orch90_out(1, value);
+}
+
+static void out_orch_right(int port, int value)
+{
+  trs_orch90_out(2, value);
+}
+
+static void out_rtc_reg(int port, int value)
+{
+  rtc_reg = value >> 4;
+}
+
+static int in_rtc_reg(int port)
+{
+  return rtc_read(rtc_reg);
+}
+
+static void out_crtc_reg(int port, int value)
+{
+  ctrlimage = value;
+}
+
+static void out_crtc_data(int port, int value)
+{
+  m6845_crtc(value);
+}
+
+static int in_crtc_data(int port)
+{
+  switch (ctrlimage) {
+    case 0x0E: /* Cursor LSB */
+      return (cursor_pos >> 8) & 0xFF;
+    case 0x0F: /* Cursor MSB */
+      return (cursor_pos >> 0) & 0xFF;
     default:
-      break;
-    }
+      return 0xFF;
+  }
+}
 
-  } else {
-    /* Next, Models III/4/4P only */
-    switch (port) {
-    case 0x50: /* MegaMem memory slot */
-    case 0x51:
-    case 0x52:
-    case 0x60:
-    case 0x61:
-    case 0x62:
-      if (megamem)
-        megamem_out(port & 0x0F, value);
-      break;
-    case 0x5f: /* Sprinter III */
-      if (trs_model == 3)
-          trs_timer_speed(value);
-      break;
-    case 0x75: /* Orchestra-90 right channel */
-      trs_orch90_out(2, value);
-      break;
-    case 0x79: /* Orchestra-90 left channel */
-      trs_orch90_out(1, value);
-      break;
-    case 0x80:
-      grafyx_write_x(value);
-      break;
-    case 0x81:
-      grafyx_write_y(value);
-      break;
-    case 0x82:
-      grafyx_write_data(value);
-      break;
-    case 0x83:
-      grafyx_write_mode(value);
-      break;
-    case 0x84:
-    case 0x85:
-    case 0x86:
-    case 0x87:
-      if (trs_model >= 4) {
-	int changes = value ^ ctrlimage;
-	if (changes & 0x80) {
-	  mem_video_page(((value & 0x80) >> 7) ? 1024 : 0);
-	}
-	if (changes & 0x70) {
-	  mem_bank((value & 0x70) >> 4);
-	}
-	if (changes & 0x08) {
-	  trs_screen_inverse((value & 0x08) >> 3);
-	}
-	if (changes & 0x04) {
-	  trs_screen_80x24((value & 0x04) >> 2);
-	}
-	if (changes & 0x03) {
-	  mem_map(value & 0x03);
-	}
-	ctrlimage = value;
-      }
-      break;
-    case 0x8c:
-      if (trs_model >= 4) grafyx_write_xoffset(value);
-      break;
-    case 0x8d:
-      if (trs_model >= 4) grafyx_write_yoffset(value);
-      break;
-    case 0x8e:
-      if (trs_model >= 4) grafyx_write_overlay(value);
-      break;
-    case 0x90:
-      /* HyperMem uses bits 4-1 of this port, 0 is the existing
-         sound */
-      if (trs_model >= 4 && hypermem)
-        mem_bank_base(HYPERMEM, value);
-      /* Fall through - we affect the sound as well */
-    case 0x91:
-    case 0x92:
-    case 0x93:
-      trs_sound_out(value & 1);
-      break;
-    case 0x94:			/* Huffman memory expansion */
-      if (trs_model >= 4 && huffman)
-        mem_bank_base(HUFFMAN, value);
-      break;
-    case 0x9C:
-    case 0x9D: /* !!? */
-    case 0x9E: /* !!? */
-    case 0x9F: /* !!? */
-      if (trs_model == 5 /*4p*/) {
-	rominimage = value & 1;
-	mem_romin(rominimage);
-      }
-      break;
-    case 0xE0:
-    case 0xE1:
-    case 0xE2:
-    case 0xE3:
-      trs_interrupt_mask_write(value);
-      break;
-    case TRSDISK3_INTERRUPT: /* 0xE4 */
-    case 0xE5:
-    case 0xE7:
-      trs_nmi_mask_write(value);
-      break;
-    case 0xE6:
-      /* RTC of Holmes FDC DX-3D board */
-      if (trs_model == 3)
-        rtc_reg = value >> 4;
-      else
-        trs_nmi_mask_write(value);
-      break;
-    case 0xEC:
-    case 0xED:
-    case 0xEE:
-    case 0xEF:
-      modeimage = value;
-      /* cassette motor is on D1 */
-      trs_cassette_motor((modeimage & 0x02) >> 1);
-      /* screen mode select is on D2 */
-      trs_screen_expanded((modeimage & 0x04) >> 2);
-      /* alternate char set is on D3 */
-      trs_screen_alternate(!((modeimage & 0x08) >> 3));
-      /* Skip clock speed for Holmes Sprinter III & SO-08 (CP-500/M80) */
-      if (trs_model == 3) {
-        if (speedup == 2 || trs_clones.model == CP500_M80)
-          break;
-      }
-      /* clock speed is on D6; it affects timer HZ too */
-      trs_timer_speed(modeimage & 0xC0);
-      break;
-    case TRSDISK3_COMMAND: /* 0xF0 */
-      trs_disk_command_write(value);
-      break;
-    case TRSDISK3_TRACK: /* 0xF1 */
-      trs_disk_track_write(value);
-      break;
-    case TRSDISK3_SECTOR: /* 0xF2 */
-      trs_disk_sector_write(value);
+static void out_supermem(int port, int value)
+{
+  /* Alpha Technologies SuperMem */
+  if (supermem)
+    mem_bank_base(SUPERMEM, value);
+}
+
+static int in_supermem(int port)
+{
+  return supermem ? mem_read_bank_base(SUPERMEM) : 0xFF;
+}
+
+static int in_joystick(int port)
+{
+  return trs_joystick_in();
+}
+
+/* Ports in David Keil's TRS-80 Emulator */
+static int in_keil_clock(int port)
+{
+  time_t time_secs = trs_input_time();
+  struct tm *time_info = localtime(&time_secs);
+  int value = 0;
+
+  switch (port) {
+    case 0x68:
+      value = time_info->tm_sec;
       break;
-    case TRSDISK3_DATA: /* 0xF3 */
-      trs_disk_data_write(value);
+    case 0x69:
+      value = time_info->tm_min;
       break;
-    case TRSDISK3_SELECT: /* 0xF4 */
-    case 0xF5:
-    case 0xF6:
-    case 0xF7:
-      /* This should cause a 1-2us wait in T states... */
-      trs_disk_select_write(value);
+    case 0x6A:
+      value = time_info->tm_hour;
       break;
-    case 0xF8:
-    case 0xF9:
-    case 0xFA:
-    case 0xFB:
-      trs_printer_write(value);
+    case 0x6B:
+      value = (time_info->tm_year + 1900) % 100;
       break;
-    case 0xFC:
-    case 0xFD:
-    case 0xFE:
-    case 0xFF:
-      if (trs_model == 3 && (value & 0x20) && grafyx_get_microlabs()) {
-	/* do Model III Micro-Labs graphics card */
-	grafyx_m3_write_mode(value);
-      } else {
-	/* do cassette emulation */
-	trs_cassette_out(value & 3);
-      }
+    case 0x6C:
+      value = time_info->tm_mday;
       break;
-    default:
+    case 0x6D:
+      value = (time_info->tm_mon) + 1;
       break;
-    }
   }
+  /* BCD value */
+  return (value / 10 * 16 + value % 10);
 }
 
-int z80_in(int port)
+/* EG 3200 Genie III */
+static void out_eg3200_genieplus(int port, int value)
 {
-  int value = 0xff; /* value returned for nonexistent ports */
-
-  /* EG 3200 Genie III */
-  if (eg3200) {
-    switch (port) {
-      case 0x48:
-        value = trs_hard_in(TRS_HARD_DATA);
-        break;
-      case 0x49:
-        value = trs_hard_in(TRS_HARD_ERROR);
-        break;
-      case 0x4A:
-        value = trs_hard_in(TRS_HARD_SECCNT);
-        break;
-      case 0x4B:
-        value = trs_hard_in(TRS_HARD_SECNUM);
-        break;
-      case 0x4C:
-        value = trs_hard_in(TRS_HARD_CYLLO);
-        break;
-      case 0x4D:
-        value = trs_hard_in(TRS_HARD_CYLHI);
-        break;
-      case 0x4E:
-        value = trs_hard_in(TRS_HARD_SDH);
-        break;
-      case 0x4F:
-        value = trs_hard_in(TRS_HARD_STATUS);
-        break;
-      case 0x82: /* Genie III VideoExtension HRG */
-        value = grafyx_read_data();
-        break;
-      case 0x83: /* Genie III VideoExtension HRG */
-        value = grafyx_read_mode();
-        break;
-      case 0xE0:
-        value = rtc_read(rtc_reg);
-        break;
-      case 0xF7:
-        switch (ctrlimage) {
-          case 0x0E: /* Cursor LSB */
-            value = (cursor_pos >> 8) & 0xFF;
-            break;
-          case 0x0F: /* Cursor MSB */
-            value = (cursor_pos >> 0) & 0xFF;
-            break;
-        }
-        break;
-      case 0xFD:
-        value = trs_printer_read();
-        break;
-      default:
-        break;
-    }
-    goto done;
+  /* Genieplus Memory Card */
+  mem_bank_base(GENIEPLUS, value);
+}
+
+static void out_eg3200_inverse(int port, int value)
+{
+  trs_screen_inverse(value & 1);
+}
+
+static void out_eg3200_mode(int port, int value)
+{
+  eg3200 = value;
+  if (eg3200 == 0)
+    trs_io_config();
+}
+
+/* TCS Genie IIIs */
+static int in_genie3s_intrq(int port)
+{
+  trs_disk_intrq_interrupt(0);
+  return trs_interrupt_latch_read();
+}
+
+static void out_genie3s_mode(int port, int value)
+{
+  modeimage = value;
+}
+
+static int in_genie3s_mode(int port)
+{
+  return modeimage;
+}
+
+static void out_genie3s_bank(int port, int value)
+{
+  genie3s_bank_out(0x100 | value);
+}
+
+static int in_genie3s_bank(int port)
+{
+  return genie3s & 0xFF;
+}
+
+static void out_genie3s_sys(int port, int value)
+{
+  genie3s_sys_out(value);
+}
+
+static int in_sys_byte(int port)
+{
+  return sys_byte_in();
+}
+
+static void out_genie3s_cassette(int port, int value)
+{
+  modesel = (value >> 3) & 1;
+  trs_screen_expanded(modesel);
+  trs_cassette_out(value & 0x3);
+}
+
+static int in_genie3s_cassette(int port)
+{
+  return modesel ? 0xBF : 0xFF;
+}
+
+/* Model I */
+static void out_lubomir_wp(int port, int value)
+{
+  if (lubomir)
+    lsb_bank_out(value);
+  else
+    trs_hard_out(port, value);
+}
+
+static void out_hrg_onoff(int port, int value)
+{
+  hrg_onoff(port);
+}
+
+static int in_hrg_on(int port)
+{
+  /* HRG on (undocumented) */
+  hrg_onoff(port);
+  return 0xFF;
+}
+
+static void out_hrg_addr_lo(int port, int value)
+{
+  hrg_write_addr(value, 0xff);
+}
+
+static void out_hrg_addr_hi(int port, int value)
+{
+  hrg_write_addr(value << 8, 0x3f00);
+}
+
+static void out_hrg_data(int port, int value)
+{
+  hrg_write_data(value);
+}
+
+static int in_hrg_data(int port)
+{
+  return hrg_read_data();
+}
+
+static void out_selector(int port, int value)
+{
+  if (selector)
+    selector_out(value);
+}
+
+static void out_ram192b(int port, int value)
+{
+  /* TCS Genie IIs/SpeedMaster RAM 192 B */
+  if (speedup == 6)
+    mem_bank_base(RAM192B, value);
+}
+
+static int in_ram192b(int port)
+{
+  return speedup == 6 ? mem_read_bank_base(RAM192B) : 0xFF;
+}
+
+static void out_sys80_reg(int port, int value)
+{
+  /* Homebrew 80*22 SYS80.SYS */
+  if (speedup <= 4)
+    ctrlimage = value;
+}
+
+static void out_sys80_data(int port, int value)
+{
+  if (speedup <= 4)
+    m6845_crtc(value);
+}
+
+static void out_s80z(int port, int value)
+{
+  if (speedup <= 4)
+    s80z_out(value);
+}
+
+static void out_eg64_mba(int port, int value)
+{
+  if (speedup <= 3 && lubomir == 0)
+    eg64_mba_out(value);
+}
+
+static int in_eg64_mba(int port)
+{
+  if (speedup <= 3 && lubomir == 0) {
+    eg64_mba_out(7);
+    return 0;
   }
+  return 0xFF;
+}
 
-  /* TCS Genie IIIs */
-  if (genie3s) {
-    switch (port) {
-      case 0x50:
-        value = trs_hard_in(TRS_HARD_DATA);
-        break;
-      case 0x51:
-        value = trs_hard_in(TRS_HARD_ERROR);
-        break;
-      case 0x52:
-        value = trs_hard_in(TRS_HARD_SECCNT);
-        break;
-      case 0x53:
-        value = trs_hard_in(TRS_HARD_SECNUM);
-        break;
-      case 0x54:
-        value = trs_hard_in(TRS_HARD_CYLLO);
-        break;
-      case 0x55:
-        value = trs_hard_in(TRS_HARD_CYLHI);
-        break;
-      case 0x56:
-        value = trs_hard_in(TRS_HARD_SDH);
-        break;
-      case 0x57:
-        value = trs_hard_in(TRS_HARD_STATUS);
-        break;
-      case 0x5A:
-        value = rtc_read(rtc_reg);
-        break;
-      case 0xE0:
-      case 0xE1:
-      case 0xE2:
-      case 0xE3:
-        trs_disk_intrq_interrupt(0);
-        value = trs_interrupt_latch_read();
-        break;
-      case 0xE8:
-      case 0xE9:
-      case 0xEA:
-      case 0xEB:
-        value = trs_printer_read();
-        break;
-      case 0xEC:
-        value = trs_disk_status_read();
-        break;
-      case 0xED:
-        value = trs_disk_track_read();
-        break;
-      case 0xEE:
-        value = trs_disk_sector_read();
-        break;
-      case 0xEF:
-        value = trs_disk_data_read();
-        break;
-      case 0xF1:
-        value = modeimage;
-        break;
-      case 0xF7:
-        switch (ctrlimage) {
-          case 0x0E: /* Cursor LSB */
-            value = (cursor_pos >> 8) & 0xFF;
-            break;
-          case 0x0F: /* Cursor MSB */
-            value = (cursor_pos >> 0) & 0xFF;
-            break;
-        }
-        break;
-      case 0xF9:
-        value = genie3s & 0xFF;
-        break;
-      case 0xFA:
-        value = sys_byte_in();
-        break;
-      case 0xFD:
-        value = trs_printer_read();
-        break;
-      case 0xFE:
-      case 0xFF:
-        value = modesel ? 0xBF : 0xFF;
-        break;
-      default:
-        break;
-    }
-    goto done;
+static void out_lowe_le18_data(int port, int value)
+{
+  if (lowe_le18)
+    lowe_le18_write_data(value);
+  else if (speedup == 3) /* Seatronics Super Speed-Up */
+    trs_timer_speed(value);
+}
+
+static void out_lowe_le18_x(int port, int value)
+{
+  lowe_le18_write_x(value);
+}
+
+static void out_lowe_le18_y(int port, int value)
+{
+  lowe_le18_write_y(value);
+}
+
+static void out_lowe_le18_control(int port, int value)
+{
+  lowe_le18_write_control(value);
+}
+
+static int in_lowe_le18(int port)
+{
+  return lowe_le18_read();
+}
+
+static void out_stringy(int port, int value)
+{
+  if (stringy)
+    stringy_out(port & 7, value);
+}
+
+static int in_stringy(int port)
+{
+  return stringy ? stringy_in(port & 7) : 0xFF;
+}
+
+static void out_genie3s_init(int port, int value)
+{
+  if (speedup < 4 && trs_rom_size <= 0x2000)
+    genie3s_init_out(value);
+}
+
+static void out_eg3200_init(int port, int value)
+{
+  if (speedup < 4 && trs_rom_size <= 0x2000)
+    eg3200_init_out(value);
+}
+
+static void out_ct80_reg(int port, int value)
+{
+  if (speedup == 7) /* 6845 CRTC Aster CT-80 */
+    ctrlimage = value;
+}
+
+static void out_ct80_data(int port, int value)
+{
+  if (speedup == 7) /* 6845 CRTC Aster CT-80 */
+    m6845_crtc(value);
+  else
+    /* Printer port of EACA Genie/System 80 */
+    trs_printer_write(value);
+}
+
+static void out_speedup(int port, int value)
+{
+  /* Speedup kit or Banking/LNW80/TCS Genie IIs and SpeedMaster */
+  if (speedup) {
+    if (speedup < 4)
+      trs_timer_speed(value);
+    else
+      sys_byte_out(value);
   }
+}
 
-  /* Ports common to all TRS-80 models */
-  switch (port) {
-  case 0x00:
-    value = trs_joystick_in();
-    goto done;
-  case TRS_HARD_WP:       /* 0xC0 */
-  case TRS_HARD_CONTROL:  /* 0xC1 */
-  case TRS_HARD_DATA:     /* 0xC8 */
-  case TRS_HARD_ERROR:    /* 0xC9 */ /*=TRS_HARD_PRECOMP*/
-  case TRS_HARD_SECCNT:   /* 0xCA */
-  case TRS_HARD_SECNUM:   /* 0xCB */
-  case TRS_HARD_CYLLO:    /* 0xCC */
-  case TRS_HARD_CYLHI:    /* 0xCD */
-  case TRS_HARD_SDH:      /* 0xCE */
-  case TRS_HARD_STATUS:   /* 0xCF */ /*=TRS_HARD_COMMAND*/
-    value = trs_hard_in(port);
-    goto done;
-  case TRS_UART_MODEM:    /* 0xE8 */
-    value = trs_uart_modem_in();
-    goto done;
-  case TRS_UART_SWITCHES: /* 0xE9 */
-    value = trs_uart_switches_in();
-    goto done;
-  case TRS_UART_STATUS:   /* 0xEA */
-    value = trs_uart_status_in();
-    goto done;
-  case TRS_UART_DATA:     /* 0xEB */
-    value = trs_uart_data_in();
-    goto done;
-  case 0x43: /* Supermem memory expansion */
-    if (trs_model < 4 && supermem) {
-      value = mem_read_bank_base(SUPERMEM);
-      goto done;
-    }
+static int in_speedup(int port)
+{
+  return speedup >= 4 ? sys_byte_in() : 0xFF;
+}
+
+static void out_m1_cassette(int port, int value)
+{
+  /* screen mode select is on D3 line */
+  modesel = (value >> 3) & 1;
+  trs_screen_expanded(modesel);
+  /* do cassette emulation */
+  trs_cassette_motor((value >> 2) & 1);
+  trs_cassette_out(value & 0x3);
+  /* Lubomir Bits 7 - 5 for EG 64.1 */
+  if (lubomir)
+    lsb_bank_out(value & 0xE0);
+}
+
+static int in_m1_cassette(int port)
+{
+  return (!modesel ? 0x7f : 0x3f) | trs_cassette_in();
+}
+
+/* Models III/4/4P */
+static void out_megamem(int port, int value)
+{
+  if (megamem)
+    megamem_out(port & 0x0F, value);
+}
+
+static void out_timer_speed(int port, int value)
+{
+  /* Sprinter III */
+  trs_timer_speed(value);
+}
+
+static void out_m4_ctrl(int port, int value)
+{
+  int changes = value ^ ctrlimage;
+
+  if (changes & 0x80) {
+    mem_video_page(((value & 0x80) >> 7) ? 1024 : 0);
+  }
+  if (changes & 0x70) {
+    mem_bank((value & 0x70) >> 4);
+  }
+  if (changes & 0x08) {
+    trs_screen_inverse((value & 0x08) >> 3);
+  }
+  if (changes & 0x04) {
+    trs_screen_80x24((value & 0x04) >> 2);
+  }
+  if (changes & 0x03) {
+    mem_map(value & 0x03);
+  }
+  ctrlimage = value;
+}
+
+static void out_grafyx_xoffset(int port, int value)
+{
+  grafyx_write_xoffset(value);
+}
+
+static void out_grafyx_yoffset(int port, int value)
+{
+  grafyx_write_yoffset(value);
+}
+
+static void out_grafyx_overlay(int port, int value)
+{
+  grafyx_write_overlay(value);
+}
+
+static void out_hypermem(int port, int value)
+{
+  /* HyperMem uses bits 4-1 of this port, 0 is the existing sound */
+  if (hypermem)
+    mem_bank_base(HYPERMEM, value);
+  trs_sound_out(value & 1);
+}
+
+static void out_sound(int port, int value)
+{
+  trs_sound_out(value & 1);
+}
+
+static void out_huffman(int port, int value)
+{
+  /* Huffman memory expansion */
+  if (huffman)
+    mem_bank_base(HUFFMAN, value);
+}
+
+static int in_huffman(int port)
+{
+  return huffman ? mem_read_bank_base(HUFFMAN) : 0xFF;
+}
+
+static void out_m4p_romin(int port, int value)
+{
+  rominimage = value & 1;
+  mem_romin(rominimage);
+}
+
+static int in_m4p_romin(int port)
+{
+  return rominimage;
+}
+
+static void out_interrupt_mask(int port, int value)
+{
+  trs_interrupt_mask_write(value);
+}
+
+static int in_interrupt_latch(int port)
+{
+  return trs_interrupt_latch_read();
+}
+
+static void out_nmi_mask(int port, int value)
+{
+  trs_nmi_mask_write(value);
+}
+
+static int in_nmi_latch(int port)
+{
+  return trs_nmi_latch_read();
+}
+
+static void out_m3_mode(int port, int value)
+{
+  modeimage = value;
+  /* cassette motor is on D1 */
+  trs_cassette_motor((modeimage & 0x02) >> 1);
+  /* screen mode select is on D2 */
+  trs_screen_expanded((modeimage & 0x04) >> 2);
+  /* alternate char set is on D3 */
+  trs_screen_alternate(!((modeimage & 0x08) >> 3));
+  /* Skip clock speed for Holmes Sprinter III & SO-08 (CP-500/M80) */
+  if (trs_model == 3) {
+    if (speedup == 2 || trs_clones.model == CP500_M80)
+      return;
+  }
+  /* clock speed is on D6; it affects timer HZ too */
+  trs_timer_speed(modeimage & 0xC0);
+}
+
+static int in_timer_ack(int port)
+{
+  trs_timer_interrupt(0); /* acknowledge */
+  return 0xFF;
+}
+
+static int in_cp500_mode(int port)
+{
+  return cp500_switch_mode(Z80_A);
+}
+
+static int in_m3_printer(int port)
+{
+  return trs_printer_read() | (ctrlimage & 0x0F);
+}
+
+static void out_m3_cassette(int port, int value)
+{
+  if (trs_model == 3 && (value & 0x20) && grafyx_get_microlabs()) {
+    /* do Model III Micro-Labs graphics card */
+    grafyx_m3_write_mode(value);
+  } else {
+    /* do cassette emulation */
+    trs_cassette_out(value & 3);
+  }
+}
+
+static int in_m3_cassette(int port)
+{
+  return (modeimage & 0x7e) | trs_cassette_in();
+}
+
+static void out_debug(int port, int value)
+{
+  debug("out (0x%02x), 0x%02x; pc 0x%04x\n", port, value, z80_state.pc.word);
+  out_port[port](port, value);
+}
+
+static int in_debug(int port)
+{
+  int value = in_port[port](port);
+
+  debug("in (0x%02x) => 0x%02x; pc %04x\n", port, value, z80_state.pc.word);
+  return value;
+}
+
+#ifdef ZBX
+static void out_watch(int port, int value)
+{
+  debug_watch_port(port, value, WATCH_OUT);
+  if (trs_io_debug_flags & IODEBUG_OUT)
+    out_debug(port, value);
+  else
+    out_port[port](port, value);
+}
+
+static int in_watch(int port)
+{
+  int const value = (trs_io_debug_flags & IODEBUG_IN) ? in_debug(port)
+                                                      : in_port[port](port);
+
+  debug_watch_port(port, value, WATCH_IN);
+  return value;
+}
+#endif
+
+static void io_out_range(int first, int last, io_out_func func)
+{
+  while (first <= last)
+    out_port[first++] = func;
+}
+
+static void io_in_range(int first, int last, io_in_func func)
+{
+  while (first <= last)
+    in_port[first++] = func;
+}
+
+static void io_config_eg3200(void)
+{
+  out_port[0x28] = out_eg3200_genieplus;
+  io_out_range(0x48, 0x4F, out_hard_eg3200);
+  io_in_range(0x48, 0x4F, in_hard_eg3200);
+  /* Genie III VideoExtension HRG */
+  out_port[0x80] = out_grafyx_x;
+  out_port[0x81] = out_grafyx_y;
+  out_port[0x82] = out_grafyx_data;
+  out_port[0x83] = out_grafyx_mode;
+  in_port[0x82] = in_grafyx_data;
+  in_port[0x83] = in_grafyx_mode;
+  out_port[0xE0] = out_rtc_reg;
+  in_port[0xE0] = in_rtc_reg;
+  out_port[0xF5] = out_eg3200_inverse;
+  out_port[0xF6] = out_crtc_reg;
+  out_port[0xF7] = out_crtc_data;
+  in_port[0xF7] = in_crtc_data;
+  out_port[0xFA] = out_eg3200_mode;
+  out_port[0xFD] = out_printer;
+  in_port[0xFD] = in_printer;
+}
+
+static void io_config_genie3s(void)
+{
+  io_out_range(0x50, 0x57, out_hard_genie3s);
+  io_in_range(0x50, 0x57, in_hard_genie3s);
+  in_port[0x5A] = in_rtc_reg;
+  out_port[0x5B] = out_rtc_reg;
+  io_out_range(0xE0, 0xE3, out_disk_select);
+  io_in_range(0xE0, 0xE3, in_genie3s_intrq);
+  io_out_range(0xE8, 0xEB, out_printer);
+  io_in_range(0xE8, 0xEB, in_printer);
+  out_port[0xEC] = out_disk_command;
+  out_port[0xED] = out_disk_track;
+  out_port[0xEE] = out_disk_sector;
+  out_port[0xEF] = out_disk_data;
+  in_port[0xEC] = in_disk_status;
+  in_port[0xED] = in_disk_track;
+  in_port[0xEE] = in_disk_sector;
+  in_port[0xEF] = in_disk_data;
+  out_port[0xF1] = out_genie3s_mode;
+  in_port[0xF1] = in_genie3s_mode;
+  out_port[0xF6] = out_crtc_reg;
+  out_port[0xF7] = out_crtc_data;
+  in_port[0xF7] = in_crtc_data;
+  out_port[0xF9] = out_genie3s_bank;
+  in_port[0xF9] = in_genie3s_bank;
+  out_port[0xFA] = out_genie3s_sys;
+  in_port[0xFA] = in_sys_byte;
+  out_port[0xFD] = out_printer;
+  in_port[0xFD] = in_printer;
+  io_out_range(0xFE, 0xFF, out_genie3s_cassette);
+  io_in_range(0xFE, 0xFF, in_genie3s_cassette);
+}
+
+/* Ports common to all TRS-80 models */
+static void io_config_common(void)
+{
+  in_port[0x00] = in_joystick;
+  out_port[TRS_HARD_WP] = (trs_model == 1) ? out_lubomir_wp : trs_hard_out;
+  out_port[TRS_HARD_CONTROL] = trs_hard_out;
+  io_out_range(TRS_HARD_DATA, TRS_HARD_STATUS, trs_hard_out);
+  in_port[TRS_HARD_WP] = trs_hard_in;
+  in_port[TRS_HARD_CONTROL] = trs_hard_in;
+  io_in_range(TRS_HARD_DATA, TRS_HARD_STATUS, trs_hard_in);
+  out_port[TRS_UART_RESET] = out_uart_reset;
+  out_port[TRS_UART_BAUD] = out_uart_baud;
+  out_port[TRS_UART_CONTROL] = out_uart_control;
+  out_port[TRS_UART_DATA] = out_uart_data;
+  in_port[TRS_UART_MODEM] = in_uart_modem;
+  in_port[TRS_UART_SWITCHES] = in_uart_switches;
+  in_port[TRS_UART_STATUS] = in_uart_status;
+  in_port[TRS_UART_DATA] = in_uart_data;
+  if (trs_model < 4) {
+    out_port[0x43] = out_supermem;
+    in_port[0x43] = in_supermem;
   }
 
   /* Support for a special HW real-time clock (TimeDate80?)
@@ -867,165 +1007,169 @@ int z80_in(int port)
    * a 2-digit year.  It's not clear what software will do with the
    * date in years beyond 1999.
    */
-  if ((port >= 0x70 && port <= 0x7C) ||
-      (port >= 0xB0 && port <= 0xBC)) {
-    value = rtc_read(port);
-    goto done;
+  io_in_range(0x70, 0x7C, rtc_read);
+  io_in_range(0xB0, 0xBC, rtc_read);
+  io_in_range(0x68, 0x6D, in_keil_clock);
+}
+
+/* Model I only */
+static void io_config_model1(void)
+{
+  out_port[0x00] = out_hrg_onoff; /* HRG off */
+  out_port[0x01] = out_hrg_onoff; /* HRG on */
+  out_port[0x02] = out_hrg_addr_lo;
+  out_port[0x03] = out_hrg_addr_hi;
+  out_port[0x05] = out_hrg_data;
+  /* HRG off (undocumented) on in 0x00 conflicts with joystick port */
+  in_port[0x01] = in_hrg_on;
+  in_port[0x04] = in_hrg_data;
+  /* Selector doesn't decode A5 */
+  out_port[0x1F] = out_selector;
+  out_port[0x3F] = out_selector;
+  out_port[0x7E] = out_ram192b;
+  in_port[0x7E] = in_ram192b;
+  out_port[0xB5] = out_orch_right; /* Orchestra-85 */
+  out_port[0xB9] = out_orch_left;
+  out_port[0x10] = out_sys80_reg;
+  out_port[0xD0] = out_sys80_reg;
+  out_port[0x11] = out_sys80_data;
+  out_port[0xD1] = out_sys80_data;
+  out_port[0xD2] = out_s80z;
+  out_port[0xDF] = out_eg64_mba;
+  in_port[0xDF] = in_eg64_mba;
+  out_port[0xEC] = out_lowe_le18_data;
+  out_port[0xED] = out_lowe_le18_x;
+  out_port[0xEE] = out_lowe_le18_y;
+  out_port[0xEF] = out_lowe_le18_control;
+  in_port[0xEC] = in_lowe_le18;
+  io_out_range(0xF0, 0xF7, out_stringy);
+  io_in_range(0xF0, 0xF7, in_stringy);
+  out_port[0xF9] = out_genie3s_init;
+  out_port[0xFA] = out_eg3200_init;
+  out_port[0xFC] = out_ct80_reg;
+  out_port[0xFD] = out_ct80_data;
+  in_port[0xFD] = in_printer; /* GENIE location of printer port */
+  out_port[0xFE] = out_speedup;
+  in_port[0xFE] = in_speedup;
+  out_port[0xFF] = out_m1_cassette;
+  in_port[0xFF] = in_m1_cassette;
+}
+
+/* Models III/4/4P only */
+static void io_config_model3(void)
+{
+  io_out_range(0x50, 0x52, out_megamem);
+  io_out_range(0x60, 0x62, out_megamem);
+  if (trs_model == 3)
+    out_port[0x5F] = out_timer_speed; /* Sprinter III */
+  out_port[0x75] = out_orch_right; /* Orchestra-90 */
+  out_port[0x79] = out_orch_left;
+  out_port[0x80] = out_grafyx_x;
+  out_port[0x81] = out_grafyx_y;
+  out_port[0x82] = out_grafyx_data;
+  out_port[0x83] = out_grafyx_mode;
+  in_port[0x82] = in_grafyx_data;
+  if (trs_model >= 4) {
+    io_out_range(0x84, 0x87, out_m4_ctrl);
+    out_port[0x8C] = out_grafyx_xoffset;
+    out_port[0x8D] = out_grafyx_yoffset;
+    out_port[0x8E] = out_grafyx_overlay;
+    out_port[0x90] = out_hypermem;
+    out_port[0x94] = out_huffman;
+    in_port[0x94] = in_huffman;
   } else {
-    /* Ports in David Keil's TRS-80 Emulator */
-    if (port >= 0x68 && port <= 0x6D) {
-      time_t time_secs = time(NULL);
-      struct tm *time_info = localtime(&time_secs);
-
-      switch (port) {
-        case 0x68:
-          value = time_info->tm_sec;
-          break;
-        case 0x69:
-          value = time_info->tm_min;
-          break;
-        case 0x6A:
-          value = time_info->tm_hour;
-          break;
-        case 0x6B:
-          value = (time_info->tm_year + 1900) % 100;
-          break;
-        case 0x6C:
-          value = time_info->tm_mday;
-          break;
-        case 0x6D:
-          value = (time_info->tm_mon) + 1;
-          break;
-      }
-      /* BCD value */
-      value = (value / 10 * 16 + value % 10);
-      goto done;
-    }
+    out_port[0x90] = out_sound;
+  }
+  io_out_range(0x91, 0x93, out_sound);
+  if (trs_model == 5 /*4p*/) {
+    io_out_range(0x9C, 0x9F, out_m4p_romin);
+    io_in_range(0x9C, 0x9F, in_m4p_romin);
   }
+  io_out_range(0xE0, 0xE3, out_interrupt_mask);
+  io_in_range(0xE0, 0xE3, in_interrupt_latch);
+  io_out_range(TRSDISK3_INTERRUPT, 0xE7, out_nmi_mask);
+  in_port[TRSDISK3_INTERRUPT] = in_nmi_latch;
+  if (trs_model == 3) {
+    /* RTC of Holmes FDC DX-3D board */
+    out_port[0xE6] = out_rtc_reg;
+    in_port[0xE7] = in_rtc_reg;
+  }
+  io_out_range(0xEC, 0xEF, out_m3_mode);
+  io_in_range(0xEC, 0xEF, in_timer_ack);
+  out_port[TRSDISK3_COMMAND] = out_disk_command;
+  out_port[TRSDISK3_TRACK] = out_disk_track;
+  out_port[TRSDISK3_SECTOR] = out_disk_sector;
+  out_port[TRSDISK3_DATA] = out_disk_data;
+  in_port[TRSDISK3_STATUS] = in_disk_status;
+  in_port[TRSDISK3_TRACK] = in_disk_track;
+  in_port[TRSDISK3_SECTOR] = in_disk_sector;
+  in_port[TRSDISK3_DATA] = in_disk_data;
+  io_out_range(TRSDISK3_SELECT, 0xF7, out_disk_select);
+  in_port[0xF4] = in_cp500_mode;
+  io_out_range(0xF8, 0xFB, out_printer);
+  io_in_range(0xF8, 0xFB, in_m3_printer);
+  io_out_range(0xFC, 0xFF, out_m3_cassette);
+  in_port[0xFC] = in_m3_cassette;
+  in_port[0xFD] = in_m3_cassette;
+  in_port[0xFF] = in_m3_cassette;
+}
 
-  if (trs_model == 1) {
-    /* Model I only */
-    switch (port) {
-#if 0 /* Conflicts with joystick port */
-    case 0x00: /* HRG off (undocumented) */
-#endif
-    case 0x01: /* HRG on (undocumented) */
-      hrg_onoff(port);
-      goto done;
-    case 0x04: /* HRG read data byte */
-      value = hrg_read_data();
-      goto done;
-    case 0x7E: /* TCS Genie IIs/SpeedMaster RAM 192 B */
-      if (speedup == 6)
-        value = mem_read_bank_base(RAM192B);
-      goto done;
-    case 0xDF:
-      if (speedup <= 3 && lubomir == 0) {
-        eg64_mba_out(7);
-        value = 0;
-      }
-      goto done;
-    case 0xEC:
-      value = lowe_le18_read();
-      goto done;
-    case 0xF0:
-    case 0xF1:
-    case 0xF2:
-    case 0xF3:
-    case 0xF4:
-    case 0xF5:
-    case 0xF6:
-    case 0xF7:
-      if (stringy)
-        value = stringy_in(port & 7);
-      goto done;
-    case 0xFD:
-      /* GENIE location of printer port */
-      value = trs_printer_read();
-      goto done;
-    case 0xFE:
-      if (speedup >= 4)
-        value = sys_byte_in();
-      goto done;
-    case 0xFF:
-      value = (!modesel ? 0x7f : 0x3f) | trs_cassette_in();
-      goto done;
-    }
+/*
+ * Build the port tables for the current model and clone.  Must be
+ * called again when trs_model, eg3200, genie3s or trs_io_debug_flags
+ * change.
+ */
+void trs_io_config(void)
+{
+  int port;
 
-  } else {
-    /* Models III/4/4P only */
-    switch (port) {
-    case 0x82:
-      value = grafyx_read_data();
-      goto done;
-    case 0x94: /* Huffman memory expansion */
-      if (trs_model >= 4 && huffman)
-        value = mem_read_bank_base(HUFFMAN);
-      goto done;
-    case 0x9C: /* !!? */
-    case 0x9D: /* !!? */
-    case 0x9E: /* !!? */
-    case 0x9F: /* !!? */
-      if (trs_model == 5 /*4p*/) {
-	value = rominimage;
-	goto done;
-      }
-      break;
-    case 0xE0:
-    case 0xE1:
-    case 0xE2:
-    case 0xE3:
-      value = trs_interrupt_latch_read();
-      goto done;
-    case 0xE7:
-      /* RTC of Holmes FDC DX-3D board */
-      if (trs_model == 3)
-        value = rtc_read(rtc_reg);
-      goto done;
-    case 0xEC:
-    case 0xED:
-    case 0xEE:
-    case 0xEF:
-      trs_timer_interrupt(0); /* acknowledge */
-      value = 0xFF;
-      goto done;
-    case TRSDISK3_INTERRUPT: /* 0xE4 */
-      value = trs_nmi_latch_read();
-      goto done;
-    case TRSDISK3_STATUS: /* 0xF0 */
-      value = trs_disk_status_read();
-      goto done;
-    case TRSDISK3_TRACK: /* 0xF1 */
-      value = trs_disk_track_read();
-      goto done;
-    case TRSDISK3_SECTOR: /* 0xF2 */
-      value = trs_disk_sector_read();
-      goto done;
-    case TRSDISK3_DATA: /* 0xF3 */
-      value = trs_disk_data_read();
-      goto done;
-    case 0xF4:
-      value = cp500_switch_mode(Z80_A);
-      goto done;
-    case 0xF8:
-    case 0xF9:
-    case 0xFA:
-    case 0xFB:
-      value = trs_printer_read() | (ctrlimage & 0x0F);
-      goto done;
-    case 0xFC:
-    case 0xFD:
-    case 0xFF:
-      value = (modeimage & 0x7e) | trs_cassette_in();
-      goto done;
-    }
+  for (port = 0; port < 256; port++) {
+    out_port[port] = out_none;
+    in_port[port] = in_none;
   }
 
- done:
-  if (trs_io_debug_flags & IODEBUG_IN) {
-    debug("in (0x%02x) => 0x%02x; pc %04x\n", port, value, z80_state.pc.word);
+  if (eg3200)
+    io_config_eg3200();
+  else if (genie3s)
+    io_config_genie3s();
+  else {
+    io_config_common();
+    if (trs_model == 1)
+      io_config_model1();
+    else
+      io_config_model3();
   }
 
+  for (port = 0; port < 256; port++) {
+    out_call[port] = (trs_io_debug_flags & IODEBUG_OUT) ? out_debug
+                                                         : out_port[port];
+    in_call[port] = (trs_io_debug_flags & IODEBUG_IN) ? in_debug
+                                                       : in_port[port];
+#ifdef ZBX
+    if (debug_port_watches[port] & WATCH_OUT)
+      out_call[port] = out_watch;
+    if (debug_port_watches[port] & WATCH_IN)
+      in_call[port] = in_watch;
+#endif
+  }
+}
+
+void z80_out(int port, int value)
+{
+  port &= 0xFF;
+  if (trs_tracing)
+    trs_trace_access(TRACE_OUT, port, value);
+  out_call[port](port, value);
+}
+
+int z80_in(int port)
+{
+  int value;
+
+  port &= 0xFF;
+  value = in_call[port](port);
+  if (trs_tracing)
+    trs_trace_access(TRACE_IN, port, value);
   return value;
 }
 
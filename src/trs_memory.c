@@ -56,7 +56,10 @@
 #include "trs_disk.h"
 #include "trs_memory.h"
 #include "trs_imp_exp.h"
+#include "trs_input.h"
+#include "trs_rewind.h"
 #include "trs_state_save.h"
+#include "trs_trace.h"
 #include "trs_uart.h"
 
 #define MAX_ROM_SIZE       (16384)  /* 16K for CP-300/500 */
@@ -74,6 +77,16 @@
 /* Interrupt latch register in EI (Model 1) */
 #define TRS_INTLATCH(addr) (((addr)&~3) == 0x37e0)
 
+/* Finest granularity at which any memory map changes */
+#define MEM_GRAIN          (0x20)
+
+/* Pages of RAM written since the last snapshot */
+#define MEM_PAGES(size)    (((size) + (1 << MEM_PAGE_SHIFT) - 1) >> MEM_PAGE_SHIFT)
+#define MEM_STORE(addr, value) \
+  (mem_dirty[(addr) >> MEM_PAGE_SHIFT] = 1, memory[addr] = (value))
+#define SUPERMEM_STORE(addr, value) \
+  (supermem_dirty[(addr) >> MEM_PAGE_SHIFT] = 1, supermem_ram[addr] = (value))
+
 /* Check address in video memory */
 #define VIDEO_ADDR(vaddr)  (Uint16)vaddr < MAX_VIDEO_SIZE
 
@@ -110,6 +123,8 @@ static int supermem_base;
 static unsigned int supermem_hi;
 static int selector_reg;
 static int system_byte;
+static Uint8 mem_dirty[MEM_PAGES(MAX_MEMORY_SIZE + 1)];
+static Uint8 supermem_dirty[MEM_PAGES(MAX_SUPERMEM_SIZE + 1)];
 
 Uint8 mem_video_read(int vaddr)
 {
@@ -482,6 +497,7 @@ static void mem_init(void)
       supermem_ram[i++] = 0x00;
     }
     memset(&rom, 0, MAX_ROM_SIZE);
+    mem_dirty_reset(1);
 
     mem_map(0);
     mem_bank(0);
@@ -492,6 +508,11 @@ static void mem_init(void)
    handle hard reset or initial poweron if poweron=1 */
 void trs_reset(int poweron)
 {
+    if (poweron) {
+	trs_input_record(INPUT_RESET, 1);
+	trs_rewind_reset();
+    }
+
     bank_base = 0x10000;
     eg3200 = 0;
     megamem_addr = 0;
@@ -536,6 +557,7 @@ void trs_reset(int poweron)
 	trs_schedule_event(trs_reset_button_interrupt, 0, 2000);
 	trs_screen_refresh();
     }
+    trs_io_config();
     if (trs_model == 5) {
         /* Switch in boot ROM */
 	z80_out(0x9C, 1);
@@ -661,6 +683,11 @@ int mem_read(int address)
 {
     address &= 0xffff; /* allow callers to be sloppy */
 
+#ifdef ZBX
+    if (debug_watches && (debug_watches[address] & WATCH_READ))
+      debug_watch_mem(address, -1, WATCH_READ);
+#endif
+
     /* There are some adapters that sit above the system and
        either intercept before the hardware proper, or adjust
        the address. Deal with these first so that we take their
@@ -928,7 +955,7 @@ static void trs80_model1_write_mem(int address, int value)
     if ((addr & 0x8000) == bank)
       address += bank_base;
   }
-  memory[address] = value;
+  MEM_STORE(address, value);
 }
 
 static void trs80_model1_write_mmio(int address, int value)
@@ -964,7 +991,7 @@ static void trs80_model1_write_mmio(int address, int value)
 void trs80_model3_mem_write(int address, int value)
 {
   if (address >= RAM_START) {
-    memory[address] = value;
+    MEM_STORE(address, value);
   } else if (address >= VIDEO_START) {
     if (grafyx_m3_write_byte(address - VIDEO_START, value))
       return;
@@ -980,21 +1007,19 @@ void trs80_model3_mem_write(int address, int value)
   }
 }
 
-void mem_write(int address, int value)
+static void mem_store(int address, int value)
 {
-    address &= 0xffff;
-
     /* Anitek MegaMem */
     if (megamem_addr) {
       if (address >= megamem_addr && address <= megamem_addr + 0x3FFF) {
-        memory[megamem_base + (address & 0x3FFF)] = value;
+        MEM_STORE(megamem_base + (address & 0x3FFF), value);
         return;
       }
     }
     /* The SuperMem sits between the system and the Z80 */
     if (supermem) {
       if (!((address ^ supermem_hi) & 0x8000)) {
-        supermem_ram[supermem_base + (address & 0x7FFF)] = value;
+        SUPERMEM_STORE(supermem_base + (address & 0x7FFF), value);
         return;
       }
       /* Otherwise the request comes from the system */
@@ -1053,19 +1078,19 @@ void mem_write(int address, int value)
 	      ((system_byte & (1 << 4)) && address >= 0x3600 && address <= 0x37FF) ||
 	      ((system_byte & (1 << 5)) && address >= 0x3800 && address <= 0x3BFF) ||
 	      ((system_byte & (1 << 6)) && address >= 0x3C00 && address <= 0x3FFF)) {
-		memory[address] = value;
+		MEM_STORE(address, value);
 		return;
 	  }
 	  trs80_model1_write_mmio(address, value);
 	  return;
 	}
-	memory[address] = value;
+	MEM_STORE(address, value);
 	break;
       case 0x22: /* Lubomir Soft Banker */
 	if (address < RAM_START) {
 	  if (((system_byte & (1 << 7)) && address <= 0x37DF) ||
 	      ((system_byte & (1 << 5)) && address >= 0x37E0 && address <= 0x3FFF)) {
-		memory[address] = value;
+		MEM_STORE(address, value);
 		return;
 	  }
 	  trs80_model1_write_mmio(address, value);
@@ -1073,9 +1098,9 @@ void mem_write(int address, int value)
 	}
 	if ((system_byte & (1 << 4)) && address >= 0x8000)
 	  /* Write to "Expander RAM" */
-	  memory[address + 0x8000] = value;
+	  MEM_STORE(address + 0x8000, value);
 	else
-	  memory[address] = value;
+	  MEM_STORE(address, value);
 	break;
       case 0x23: /* EG 3200: bit set to 0 => bank enabled */
 	/* Bit 1 - Bank 2: Video Memory 0 (1k, 64x16, TRS-80 M1 compatible) */
@@ -1107,9 +1132,9 @@ void mem_write(int address, int value)
 	}
 	/* Bank 0: RAM */
 	if (address <= 0x7FFF) /* Low 32 KB for Genieplus Banking */
-	  memory[address + bank_base] = value;
+	  MEM_STORE(address + bank_base, value);
 	else
-	  memory[address] = value;
+	  MEM_STORE(address, value);
 	break;
       case 0x24: /* TCS Genie IIIs */
 	if ((system_byte & (1 << 0)) == 0) {
@@ -1148,9 +1173,9 @@ void mem_write(int address, int value)
 	/* "Constant bit" points to Bank 0 */
 	if ((address <= 0x3FFF && (genie3s & (1 << 0)) == 0) ||
 	    (address >= 0xE000 && (genie3s & (1 << 0))))
-	  memory[address] = value;
+	  MEM_STORE(address, value);
 	else
-	  memory[address + bank_base] = value;
+	  MEM_STORE(address + bank_base, value);
 	break;
       case 0x25: /* Schmidtke 80-Z Video Card */
 	if (system_byte & (1 << 0)) {
@@ -1160,14 +1185,14 @@ void mem_write(int address, int value)
 	  }
 	}
 	if ((system_byte & (1 << 3)) || address >= RAM_START)
-	  memory[address] = value;
+	  MEM_STORE(address, value);
 	else
 	  trs80_model1_write_mmio(address, value);
 	break;
       case 0x26: /* TCS Genie IIs/SpeedMaster */
 	/* Expansions bit (RAM 192 B) */
 	if ((system_byte & (1 << 7)) && address <= 0xBFFF) {
-	  memory[address + bank_base] = value;
+	  MEM_STORE(address + bank_base, value);
 	  return;
 	}
 	/* HRG in low 16K */
@@ -1186,7 +1211,7 @@ void mem_write(int address, int value)
 	    return;
 	  }
 	}
-	memory[address] = value;
+	MEM_STORE(address, value);
 	break;
       case 0x27: /* Aster CT-80 */
 	if ((system_byte & (1 << 5)) == 0) { /* device bank */
@@ -1210,7 +1235,7 @@ void mem_write(int address, int value)
 	    }
 	  }
 	}
-	memory[address] = value;
+	MEM_STORE(address, value);
 	break;
 
       case 0x30: /* Model III */
@@ -1226,7 +1251,7 @@ void mem_write(int address, int value)
       case 0x50: /* Model 4P map 0, boot ROM out */
       case 0x54: /* Model 4P map 0, boot ROM in */
 	if (address >= RAM_START) {
-	    memory[address + bank_offset[address >> 15]] = value;
+	    MEM_STORE(address + bank_offset[address >> 15], value);
 	} else if (address >= VIDEO_START) {
 	    if (mem_video_page_write(address, value))
 	      trs_screen_write_char(address + video_offset, value);
@@ -1239,7 +1264,7 @@ void mem_write(int address, int value)
       case 0x51: /* Model 4P map 1, boot ROM out */
       case 0x55: /* Model 4P map 1, boot ROM in */
 	if (address >= RAM_START || address < KEYBOARD_START) {
-	    memory[address + bank_offset[address >> 15]] = value;
+	    MEM_STORE(address + bank_offset[address >> 15], value);
 	} else if (address >= VIDEO_START) {
 	    if (mem_video_page_write(address, value))
 	      trs_screen_write_char(address + video_offset, value);
@@ -1250,7 +1275,7 @@ void mem_write(int address, int value)
       case 0x52: /* Model 4P map 2, boot ROM out */
       case 0x56: /* Model 4P map 2, boot ROM in */
 	if (address < 0xf400) {
-	    memory[address + bank_offset[address >> 15]] = value;
+	    MEM_STORE(address + bank_offset[address >> 15], value);
 	} else if (address >= 0xf800) {
 	    trs80_screen_write_char(address - 0xf800, value);
 	}
@@ -1259,11 +1284,33 @@ void mem_write(int address, int value)
       case 0x43: /* Model 4 map 3 */
       case 0x53: /* Model 4P map 3, boot ROM out */
       case 0x57: /* Model 4P map 3, boot ROM in */
-	memory[address + bank_offset[address >> 15]] = value;
+	MEM_STORE(address + bank_offset[address >> 15], value);
 	break;
     }
 }
 
+void mem_write(int address, int value)
+{
+    address &= 0xffff;
+
+    if (trs_tracing)
+      trs_trace_access(TRACE_WRITE, address, value);
+#ifdef ZBX
+    if (debug_watches && (debug_watches[address] & (WATCH_WRITE | WATCH_CHANGE))) {
+      int const watch = debug_watches[address];
+
+      if (watch & WATCH_WRITE)
+        debug_watch_mem(address, value, WATCH_WRITE);
+      mem_store(address, value);
+      /* What is in memory now: writes to ROM don't change it */
+      if (watch & WATCH_CHANGE)
+        debug_watch_mem(address, mem_peek(address), WATCH_CHANGE);
+      return;
+    }
+#endif
+    mem_store(address, value);
+}
+
 /*
  * Words are stored with the low-order byte in the lower address.
  */
@@ -1323,15 +1370,7 @@ Uint8 *trs80_model3_mem_addr(int address, int writing)
   return NULL;
 }
 
-/*
- * Get a pointer to the given address.  Note that there is no checking
- * whether the next virtual address is physically contiguous.  The
- * caller is responsible for making sure his strings don't span
- * memory map boundaries.
- *
- * Needs to die...
- */
-Uint8 *mem_pointer(int address, int writing)
+static Uint8 *mem_map_addr(int address, int writing)
 {
     address &= 0xffff;
 
@@ -1571,6 +1610,150 @@ Uint8 *mem_pointer(int address, int writing)
     return NULL;
 }
 
+/* Mark the pages of RAM under [ptr, ptr + len) as written */
+static void mem_dirty_ptr(const Uint8 *ptr, unsigned int len)
+{
+  if (ptr >= memory && ptr <= memory + MAX_MEMORY_SIZE) {
+    if (len > MAX_MEMORY_SIZE + 1 - (ptr - memory))
+      len = MAX_MEMORY_SIZE + 1 - (ptr - memory);
+    mem_dirty_range(MEM_RAM, ptr - memory, len);
+  } else if (ptr >= supermem_ram && ptr <= supermem_ram + MAX_SUPERMEM_SIZE) {
+    if (len > MAX_SUPERMEM_SIZE + 1 - (ptr - supermem_ram))
+      len = MAX_SUPERMEM_SIZE + 1 - (ptr - supermem_ram);
+    mem_dirty_range(MEM_SUPERMEM, ptr - supermem_ram, len);
+  }
+}
+
+/*
+ * Get a pointer to the given address.  Note that there is no checking
+ * whether the next virtual address is physically contiguous.  The
+ * caller is responsible for making sure his strings don't span
+ * memory map boundaries.
+ *
+ * Needs to die...
+ */
+Uint8 *mem_pointer(int address, int writing)
+{
+  Uint8 *ptr = mem_map_addr(address, writing);
+
+  /* The caller may write anywhere up to the next 64K */
+  if (ptr && writing)
+    mem_dirty_ptr(ptr, 0x10000);
+  return ptr;
+}
+
+/*
+ * Read the byte at address for the debugger and the tracers, without
+ * the side effects of mem_read: watchpoints do not fire and memory-mapped
+ * I/O is not touched, but returns 0xFF.
+ */
+int mem_peek(int address)
+{
+  Uint8 *ptr = mem_map_addr(address, 0);
+
+  return ptr ? *ptr : 0xFF;
+}
+
+/*
+ * Like mem_pointer, but also find out how many of the next *len bytes
+ * are contiguous in host memory, and store that count in *len.  Video
+ * memory and memory-mapped I/O are not returned: the result is NULL and
+ * *len counts the bytes up to the next plain memory, which the caller
+ * has to access with mem_read and mem_write so the screen and devices
+ * see them.  The caller must make sure the range does not wrap at 64K.
+ */
+static Uint8 *mem_direct_addr(int address, int writing)
+{
+  Uint8 *ptr = mem_map_addr(address, writing);
+
+  if (ptr >= video && ptr <= video + MAX_VIDEO_SIZE)
+    return NULL;
+  return ptr;
+}
+
+static int mem_span_match(Uint8 *base, int address, int offset, int writing)
+{
+  Uint8 *ptr = mem_direct_addr(address + offset, writing);
+
+  return base ? ptr == base + offset : ptr == NULL;
+}
+
+Uint8 *mem_pointer_span(int address, int writing, int *len)
+{
+  Uint8 *base = mem_direct_addr(address, writing);
+  int size = 0;
+
+  /* The memory maps switch on MEM_GRAIN boundaries, so checking both
+     ends of a grain is enough.  Go byte by byte if they differ, which
+     may happen at the end of an odd-sized ROM */
+  while (size < *len) {
+    int last = size + MEM_GRAIN - ((address + size) & (MEM_GRAIN - 1));
+
+    if (last > *len)
+      last = *len;
+    if (!mem_span_match(base, address, size, writing))
+      break;
+    if (mem_span_match(base, address, last - 1, writing))
+      size = last;
+    else
+      size++;
+  }
+  *len = size;
+  if (base && writing)
+    mem_dirty_ptr(base, size);
+  return base;
+}
+
+/*
+ * Get a pointer to len bytes of physical memory at address, bypassing
+ * the memory map: MEM_RAM is the main RAM including the banks of the
+ * memory expansions, MEM_SUPERMEM the AlphaTech SuperMem.  Returns NULL
+ * if the range does not fit in the memory.
+ */
+Uint8 *mem_phys_pointer(int space, unsigned int address, unsigned int len)
+{
+  switch (space) {
+    case MEM_RAM:
+      if (address <= MAX_MEMORY_SIZE && len <= MAX_MEMORY_SIZE - address)
+        return &memory[address];
+      break;
+    case MEM_SUPERMEM:
+      if (address <= MAX_SUPERMEM_SIZE && len <= MAX_SUPERMEM_SIZE - address)
+        return &supermem_ram[address];
+      break;
+  }
+  return NULL;
+}
+
+void mem_dirty_range(int space, unsigned int address, unsigned int len)
+{
+  Uint8 *dirty = space == MEM_SUPERMEM ? supermem_dirty : mem_dirty;
+
+  if (len == 0)
+    return;
+  memset(dirty + (address >> MEM_PAGE_SHIFT), 1,
+      ((address + len - 1) >> MEM_PAGE_SHIFT) - (address >> MEM_PAGE_SHIFT) + 1);
+}
+
+void mem_dirty_reset(int dirty)
+{
+  memset(mem_dirty, dirty, sizeof(mem_dirty));
+  memset(supermem_dirty, dirty, sizeof(supermem_dirty));
+}
+
+/*
+ * Get the map of written pages if buffer is the main RAM or SuperMem
+ * as saved by trs_mem_save, otherwise NULL.
+ */
+Uint8 *mem_dirty_map(const Uint8 *buffer, int size)
+{
+  if (buffer == memory && size == MAX_MEMORY_SIZE + 1)
+    return mem_dirty;
+  if (buffer == supermem_ram && size == MAX_SUPERMEM_SIZE + 1)
+    return supermem_dirty;
+  return NULL;
+}
+
 void trs_mem_save(FILE *file)
 {
   trs_save_uint8(file, memory, MAX_MEMORY_SIZE + 1);
@@ -1604,6 +1787,9 @@ void trs_mem_save(FILE *file)
 
 void trs_mem_load(FILE *file)
 {
+  /* Snapshots keep track of the pages they restore themselves */
+  if (file)
+    mem_dirty_reset(1);
   trs_load_uint8(file, memory, MAX_MEMORY_SIZE + 1);
   trs_load_uint8(file, supermem_ram, MAX_SUPERMEM_SIZE + 1);
   trs_load_uint8(file, rom, MAX_ROM_SIZE + 1);
@@ -14,6 +14,13 @@
 #define RAM192B         (4) /* TCS Genie IIs/SpeedMaster 768 KB */
 #define SUPERMEM        (5) /* AlphaTech SuperMem 512 KB (I/III) */
 
+/* Physical memory spaces for mem_phys_pointer */
+#define MEM_RAM         (1) /* Main RAM including expansion banks */
+#define MEM_SUPERMEM    (2) /* AlphaTech SuperMem RAM */
+
+/* Granularity of the tracking of written RAM */
+#define MEM_PAGE_SHIFT  (12)
+
 int  trs80_model3_mem_read(int address);
 void trs80_model3_mem_write(int address, int value);
 Uint8 *trs80_model3_mem_addr(int address, int writing);
@@ -25,6 +32,12 @@ int mem_video_write(int vaddr, Uint8 value);
 int mem_video_page_write(int vaddr, Uint8 value);
 Uint8 *mem_video_page_addr(int vaddr);
 
+Uint8 *mem_pointer_span(int address, int writing, int *len);
+Uint8 *mem_phys_pointer(int space, unsigned int address, unsigned int len);
+void mem_dirty_range(int space, unsigned int address, unsigned int len);
+void mem_dirty_reset(int dirty);
+Uint8 *mem_dirty_map(const Uint8 *buffer, int size);
+
 extern void mem_bank(int which);
 extern void mem_map(int which);
 extern void mem_bank_base(int card, int bits);
@@ -0,0 +1,168 @@
+/*
+ * Runtime metrics of the emulator.
+ *
+ * The counters are plain increments where things happen, so they cost
+ * nothing worth measuring.  Once a second of host time, at a timer
+ * interrupt, they are turned into a sample:
+ *
+ *   mhz              effective speed of the Z80, T-states per host us
+ *   frames           timer interrupts in the second
+ *   cpu_ms           host time per frame not spent waiting for the timer
+ *   cpu_percent      the same in percent of the host time
+ *   blits            glyphs and graphics blitted per frame
+ *   overflows        times the draw list was full and the whole screen
+ *                    had to be updated
+ *   underruns        times the sound device ran out of samples
+ *   disk_bytes       bytes per second through the floppy and hard disk
+ *                    data ports
+ *   events           scheduled events run per second
+ *
+ * The sample is shown in the overlay and appended to the metrics file,
+ * as JSON Lines when its name ends in ".json", else as CSV.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL.h>
+#include "error.h"
+#include "trs.h"
+#include "trs_metrics.h"
+
+#define METRICS_INTERVAL  (1000) /* ms */
+
+Uint32 trs_metrics_blits;
+Uint32 trs_metrics_overflows;
+Uint32 trs_metrics_events;
+Uint32 trs_metrics_disk;
+Uint64 trs_metrics_wait_us;
+
+int trs_metrics_overlay;
+char trs_metrics_file[FILENAME_MAX];
+
+static FILE *metrics_file;
+static int metrics_json;
+static char metrics_text[160];
+
+/* Values at the last sample */
+static Uint32 last_ms, first_ms;
+static tstate_t last_t;
+static Uint32 last_frames, frames;
+static Uint32 last_blits, last_overflows, last_underruns;
+static Uint32 last_events, last_disk;
+static Uint64 last_wait_us;
+
+static void metrics_reset(Uint32 now)
+{
+  last_ms = now;
+  last_t = z80_state.t_count;
+  last_frames = frames;
+  last_blits = trs_metrics_blits;
+  last_overflows = trs_metrics_overflows;
+  last_underruns = trs_sound_underruns;
+  last_events = trs_metrics_events;
+  last_disk = trs_metrics_disk;
+  last_wait_us = trs_metrics_wait_us;
+}
+
+static void metrics_sample(Uint32 now)
+{
+  Uint32 const ms = now - last_ms;
+  Uint32 const count = frames - last_frames;
+  Uint32 const wait_ms = (trs_metrics_wait_us - last_wait_us) / 1000;
+  Uint32 const busy_ms = wait_ms < ms ? ms - wait_ms : 0;
+  double const mhz = z80_state.t_count > last_t ?
+      (double)(z80_state.t_count - last_t) / (ms * 1000.0) : 0.0;
+  double const cpu_ms = count ? (double)busy_ms / count : 0.0;
+  double const cpu_percent = busy_ms * 100.0 / ms;
+  Uint32 const blits = count ? (trs_metrics_blits - last_blits) / count : 0;
+  Uint32 const overflows = trs_metrics_overflows - last_overflows;
+  Uint32 const underruns = trs_sound_underruns - last_underruns;
+  Uint32 const disk = (Uint64)(trs_metrics_disk - last_disk) * 1000 / ms;
+  Uint32 const events = (Uint64)(trs_metrics_events - last_events) * 1000 / ms;
+  double const time = (now - first_ms) / 1000.0;
+
+  snprintf(metrics_text, sizeof(metrics_text),
+      "%6.2f MHz %3u fps CPU %5.2f ms %3.0f%%\n"
+      "%5u blits/frame %u full %u underruns\n"
+      "disk %6u B/s events %5u/s",
+      mhz, count, cpu_ms, cpu_percent, blits, overflows, underruns,
+      disk, events);
+
+  if (metrics_file) {
+    int rc;
+
+    if (metrics_json)
+      rc = fprintf(metrics_file, "{\"time\":%.3f,\"mhz\":%.3f,\"frames\":%u,"
+          "\"cpu_ms\":%.3f,\"cpu_percent\":%.1f,\"blits\":%u,"
+          "\"overflows\":%u,\"underruns\":%u,\"disk_bytes\":%u,"
+          "\"events\":%u}\n", time, mhz, count, cpu_ms, cpu_percent,
+          blits, overflows, underruns, disk, events);
+    else
+      rc = fprintf(metrics_file, "%.3f,%.3f,%u,%.3f,%.1f,%u,%u,%u,%u,%u\n",
+          time, mhz, count, cpu_ms, cpu_percent, blits, overflows,
+          underruns, disk, events);
+    if (rc < 0 || fflush(metrics_file) != 0) {
+      error("failed to write metrics '%s': %s", trs_metrics_file,
+          strerror(errno));
+      trs_metrics_close();
+    }
+  }
+  metrics_reset(now);
+}
+
+void trs_metrics_frame(void)
+{
+  Uint32 const now = SDL_GetTicks();
+
+  frames++;
+  if (!trs_metrics_overlay && metrics_file == NULL)
+    return;
+
+  if (last_ms == 0 || z80_state.t_count < last_t) {
+    /* First frame, or loaded a state or rewound */
+    if (first_ms == 0)
+      first_ms = now;
+    metrics_reset(now);
+  } else if (now - last_ms >= METRICS_INTERVAL) {
+    metrics_sample(now);
+  }
+}
+
+const char *trs_metrics_text(void)
+{
+  return metrics_text;
+}
+
+int trs_metrics_open(void)
+{
+  static int registered;
+  size_t const len = strlen(trs_metrics_file);
+
+  trs_metrics_close();
+  if ((metrics_file = fopen(trs_metrics_file, "w")) == NULL) {
+    error("failed to write metrics '%s': %s", trs_metrics_file,
+        strerror(errno));
+    return -1;
+  }
+  metrics_json = len > 5 &&
+      strcmp(trs_metrics_file + len - 5, ".json") == 0;
+  if (!metrics_json)
+    fputs("time,mhz,frames,cpu_ms,cpu_percent,blits,overflows,underruns,"
+        "disk_bytes,events\n", metrics_file);
+
+  if (!registered && atexit(trs_metrics_close) == 0)
+    registered = 1;
+  return 0;
+}
+
+void trs_metrics_close(void)
+{
+  if (metrics_file == NULL)
+    return;
+
+  if (fclose(metrics_file) != 0)
+    error("failed to write metrics '%s': %s", trs_metrics_file,
+        strerror(errno));
+  metrics_file = NULL;
+}
@@ -0,0 +1,31 @@
+/*
+ * Runtime metrics of the emulator: speed, host CPU time, drawing, sound
+ * and disk activity, shown in an overlay with -metrics and written to a
+ * CSV or JSON file with -metricsfile.
+ */
+#ifndef _TRS_METRICS_H
+#define _TRS_METRICS_H
+
+#include <stdio.h>
+#include <SDL_types.h>
+
+/* Counters, incremented where it happens */
+extern Uint32 trs_metrics_blits;     /* glyphs and graphics blitted */
+extern Uint32 trs_metrics_overflows; /* draw list full, whole screen drawn */
+extern Uint32 trs_metrics_events;    /* scheduled events run */
+extern Uint32 trs_metrics_disk;      /* bytes through the disk data ports */
+extern Uint64 trs_metrics_wait_us;   /* host time waited for the timer */
+
+extern int trs_metrics_overlay;
+extern char trs_metrics_file[FILENAME_MAX];
+
+/* Called at every timer interrupt, takes a sample every second */
+extern void trs_metrics_frame(void);
+
+/* Last sample for the overlay, lines separated by newlines */
+extern const char *trs_metrics_text(void);
+
+extern int trs_metrics_open(void);
+extern void trs_metrics_close(void);
+
+#endif
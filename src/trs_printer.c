@@ -37,69 +37,683 @@
  * SOFTWARE.
  */
 
+/*
+ * Printer emulation.  Output is collected in a spool buffer and
+ * written in blocks.  The "text" and "raw" printers write the bytes
+ * to a file, the "epson" and "dmp" printers interpret the control
+ * codes of an Epson FX or Radio Shack DMP printer and render the
+ * pages at 144 dpi to PNG files or to a single PDF file.
+ */
+
 #include <errno.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #include "error.h"
 #include "trs.h"
 
-#define NO_PRINTER   0
-#define TEXT_PRINTER 1
+#define NO_PRINTER    0
+#define TEXT_PRINTER  1
+#define RAW_PRINTER   2
+#define EPSON_PRINTER 3
+#define DMP_PRINTER   4
+
+#define SPOOL_SIZE    16384
+
+/* Page geometry: positions are kept in 1/720 inch, pixels are 1/144 */
+#define UNIT          720
+#define DPI           144
+#define PAGE_WIDTH    (85 * DPI / 10)  /* 8.5 inch */
+#define PAGE_HEIGHT   (11 * DPI)       /* 11 inch */
+#define PAGE_PITCH    ((PAGE_WIDTH + 7) / 8)
+#define TO_PIXEL(u)   ((u) * DPI / UNIT)
 
 static FILE *printer;
 static char printer_filename[FILENAME_MAX];
 static int printer_open = FALSE;
+static int printer_number;
+static int printer_pdf;
 int trs_printer = NO_PRINTER;
+int trs_printer_pdf;
+int trs_printer_cps;
+
+static Uint8 spool[SPOOL_SIZE];
+static int spool_len;
+static int last_cr;
+static tstate_t printer_busy;
+static tstate_t printer_last;
+
+/* Dot matrix printer */
+static Uint8 *page;
+static int page_dirty;
+static int page_count;
+static int pos_x, pos_y;      /* print head, 1/720 inch */
+static int line_spacing;
+static int page_length;
+static int left_margin;
+static int emphasized;
+static int underline;
+static int expanded;
+static int expanded_line;
+static int condensed;
+static int elite;
+static int dmp_graphics;
+
+/* Escape sequence being collected */
+static Uint8 esc_buf[4];
+static int esc_len;
+static int esc_need;
+static int gfx_count;         /* bit image bytes still expected */
+static int gfx_density;       /* dots per inch */
+static int gfx_repeat;        /* DMP repeat count */
+
+/* PDF output */
+static long *pdf_offset;
+static int pdf_objects;
+
+static int trs_printer_open(const char *ext)
+{
+  struct stat st = { 0 };
+
+  for (printer_number = 0; printer_number < 10000; printer_number++) {
+    if (snprintf(printer_filename, FILENAME_MAX, "%s%ctrsprn%04d%s",
+        trs_printer_dir, DIR_SLASH, printer_number, ext) < FILENAME_MAX) {
+      if (stat(printer_filename, &st) < 0) {
+        printer_open = TRUE;
+        return 0;
+      }
+    }
+  }
+  return -1;
+}
+
+static FILE *printer_fopen(const char *filename)
+{
+  FILE *file = fopen(filename, "wb");
+
+  if (file == NULL)
+    error("failed to open printer output file '%s': %s", filename,
+        strerror(errno));
+  return file;
+}
+
+static void printer_flush(void)
+{
+  if (spool_len && printer) {
+    if (fwrite(spool, 1, spool_len, printer) != (size_t)spool_len)
+      error("failed to write printer output file '%s': %s", printer_filename,
+          strerror(errno));
+    fflush(printer);
+  }
+  spool_len = 0;
+}
+
+static void printer_put(int value)
+{
+  spool[spool_len++] = value;
+  if (spool_len == SPOOL_SIZE)
+    printer_flush();
+}
+
+/*
+ * PNG writer, using uncompressed deflate blocks so no zlib is needed.
+ */
+static Uint32 crc_table[256];
+
+static Uint32 png_crc(Uint32 crc, const Uint8 *buf, int len)
+{
+  int i, k;
+
+  if (crc_table[1] == 0) {
+    for (i = 0; i < 256; i++) {
+      Uint32 c = i;
+
+      for (k = 0; k < 8; k++)
+        c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+      crc_table[i] = c;
+    }
+  }
+  while (len--)
+    crc = crc_table[(crc ^ *buf++) & 0xFF] ^ (crc >> 8);
+  return crc;
+}
+
+static void put_be32(Uint8 *buf, Uint32 value)
+{
+  buf[0] = value >> 24;
+  buf[1] = value >> 16;
+  buf[2] = value >> 8;
+  buf[3] = value;
+}
+
+static void png_chunk(FILE *file, const char *type, const Uint8 *data, int len)
+{
+  Uint8 buf[4];
+  Uint32 crc;
+
+  put_be32(buf, len);
+  fwrite(buf, 1, 4, file);
+  fwrite(type, 1, 4, file);
+  crc = png_crc(0xFFFFFFFF, (const Uint8 *)type, 4);
+  if (len) {
+    fwrite(data, 1, len, file);
+    crc = png_crc(crc, data, len);
+  }
+  put_be32(buf, crc ^ 0xFFFFFFFF);
+  fwrite(buf, 1, 4, file);
+}
+
+static void png_write_page(const char *filename)
+{
+  static const Uint8 signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+  int const row = PAGE_PITCH + 1;
+  int const raw = row * PAGE_HEIGHT;
+  int const blocks = (raw + 65534) / 65535;
+  Uint8 *idat, *p;
+  Uint8 header[13];
+  Uint8 phys[9];
+  Uint32 a = 1, b = 0;
+  int y, i, left;
+  FILE *file;
+
+  if ((file = printer_fopen(filename)) == NULL)
+    return;
+  if ((idat = (Uint8 *)malloc(2 + raw + blocks * 5 + 4)) == NULL) {
+    error("failed to allocate memory for printer page");
+    fclose(file);
+    return;
+  }
+
+  /* 1 bit grayscale, 0 is black */
+  put_be32(header, PAGE_WIDTH);
+  put_be32(header + 4, PAGE_HEIGHT);
+  header[8] = 1;
+  header[9] = 0;
+  header[10] = header[11] = header[12] = 0;
+  put_be32(phys, DPI * 10000 / 254);
+  put_be32(phys + 4, DPI * 10000 / 254);
+  phys[8] = 1; /* meter */
+
+  /* zlib stream of stored blocks */
+  p = idat;
+  *p++ = 0x78;
+  *p++ = 0x01;
+  left = raw;
+  for (y = 0, i = 0; left > 0; ) {
+    int len = left > 65535 ? 65535 : left;
+
+    left -= len;
+    *p++ = (left == 0);
+    *p++ = len & 0xFF;
+    *p++ = len >> 8;
+    *p++ = ~len & 0xFF;
+    *p++ = (~len >> 8) & 0xFF;
+    while (len--) {
+      /* Filter byte at the start of each row, pixels inverted */
+      Uint8 byte = (i == 0) ? 0 : ~page[y * PAGE_PITCH + i - 1];
+
+      *p++ = byte;
+      a = (a + byte) % 65521;
+      b = (b + a) % 65521;
+      if (++i == row) {
+        i = 0;
+        y++;
+      }
+    }
+  }
+  put_be32(p, (b << 16) | a);
+  p += 4;
+
+  fwrite(signature, 1, 8, file);
+  png_chunk(file, "IHDR", header, 13);
+  png_chunk(file, "pHYs", phys, 9);
+  png_chunk(file, "IDAT", idat, p - idat);
+  png_chunk(file, "IEND", NULL, 0);
+  if (fclose(file) != 0)
+    error("failed to write printer output file '%s': %s", filename,
+        strerror(errno));
+  free(idat);
+}
+
+/*
+ * PDF writer: object 1 is the catalog, object 2 the page tree, which
+ * is written last.  Each page takes three objects: page, contents
+ * and a 1 bit image of the page.
+ */
+static void pdf_object(void)
+{
+  long *offset = (long *)realloc(pdf_offset, (pdf_objects + 1) * sizeof(long));
+
+  if (offset == NULL)
+    fatal("failed to allocate memory for PDF output");
+  pdf_offset = offset;
+  pdf_offset[pdf_objects++] = ftell(printer);
+  fprintf(printer, "%d 0 obj\n", pdf_objects);
+}
+
+static void pdf_begin(void)
+{
+  pdf_objects = 0;
+  fputs("%PDF-1.4\n", printer);
+  pdf_object();
+  fputs("<< /Type /Catalog /Pages 2 0 R >>\nendobj\n", printer);
+  /* Page tree is written at the end */
+  pdf_object();
+  fputs("endobj\n", printer);
+}
+
+static void pdf_write_page(void)
+{
+  char content[80];
+  int const page_obj = pdf_objects + 1;
+
+  snprintf(content, sizeof(content), "q %d 0 0 %d 0 0 cm /P Do Q\n",
+      PAGE_WIDTH * 72 / DPI, PAGE_HEIGHT * 72 / DPI);
+  pdf_object();
+  fprintf(printer, "<< /Type /Page /Parent 2 0 R /MediaBox [0 0 %d %d]\n"
+      "/Contents %d 0 R /Resources << /XObject << /P %d 0 R >> >> >>\n"
+      "endobj\n", PAGE_WIDTH * 72 / DPI, PAGE_HEIGHT * 72 / DPI,
+      page_obj + 1, page_obj + 2);
+  pdf_object();
+  fprintf(printer, "<< /Length %d >>\nstream\n%sendstream\nendobj\n",
+      (int)strlen(content), content);
+  pdf_object();
+  fprintf(printer, "<< /Type /XObject /Subtype /Image /Width %d /Height %d\n"
+      "/ColorSpace /DeviceGray /BitsPerComponent 1 /Decode [1 0]\n"
+      "/Length %d >>\nstream\n", PAGE_WIDTH, PAGE_HEIGHT,
+      PAGE_PITCH * PAGE_HEIGHT);
+  fwrite(page, 1, PAGE_PITCH * PAGE_HEIGHT, printer);
+  fputs("\nendstream\nendobj\n", printer);
+}
+
+static void pdf_end(void)
+{
+  long xref;
+  int i;
+
+  /* Page tree, as object 2 */
+  pdf_offset[1] = ftell(printer);
+  fputs("2 0 obj\n<< /Type /Pages /Kids [", printer);
+  for (i = 0; i < page_count; i++)
+    fprintf(printer, "%d 0 R ", 3 + i * 3);
+  fprintf(printer, "] /Count %d >>\nendobj\n", page_count);
+
+  xref = ftell(printer);
+  fprintf(printer, "xref\n0 %d\n0000000000 65535 f \n", pdf_objects + 1);
+  for (i = 0; i < pdf_objects; i++)
+    fprintf(printer, "%010ld 00000 n \n", pdf_offset[i]);
+  fprintf(printer, "trailer\n<< /Size %d /Root 1 0 R >>\nstartxref\n%ld\n"
+      "%%%%EOF\n", pdf_objects + 1, xref);
+  free(pdf_offset);
+  pdf_offset = NULL;
+}
+
+static void page_reset(void)
+{
+  pos_x = left_margin = 0;
+  pos_y = 0;
+  line_spacing = UNIT / 6;
+  page_length = 11 * UNIT;
+  emphasized = underline = expanded = expanded_line = 0;
+  condensed = elite = dmp_graphics = 0;
+  esc_len = esc_need = gfx_count = 0;
+}
+
+static void page_eject(void)
+{
+  char filename[FILENAME_MAX];
+
+  if (page_dirty) {
+    if (printer_pdf) {
+      if (printer)
+        pdf_write_page();
+    } else {
+      if (snprintf(filename, FILENAME_MAX, "%s%ctrsprn%04d-%03d.png",
+          trs_printer_dir, DIR_SLASH, printer_number, page_count + 1)
+          < FILENAME_MAX)
+        png_write_page(filename);
+    }
+    page_count++;
+    memset(page, 0, PAGE_PITCH * PAGE_HEIGHT);
+    page_dirty = FALSE;
+  }
+  pos_y = 0;
+}
+
+static void page_dot(int x0, int x1, int y0, int y1)
+{
+  int x, y;
+
+  if (x1 > PAGE_WIDTH) x1 = PAGE_WIDTH;
+  if (y1 > PAGE_HEIGHT) y1 = PAGE_HEIGHT;
+  for (y = y0; y < y1; y++)
+    for (x = x0; x < x1; x++)
+      page[y * PAGE_PITCH + (x >> 3)] |= 0x80 >> (x & 7);
+  page_dirty = TRUE;
+}
+
+static int char_width(void)
+{
+  int width = condensed ? UNIT * 10 / 171 : (elite ? UNIT / 12 : UNIT / 10);
+
+  return (expanded || expanded_line) ? width * 2 : width;
+}
+
+/* Print a character using the Model 4 character generator */
+static void page_char(int ch)
+{
+  const Uint8 *bitmap = trs_char_bitmap(7, ch);
+  int const width = char_width();
+  int const top = TO_PIXEL(pos_y);
+  int col, row;
+
+  for (col = 0; col < 8; col++) {
+    int const x0 = TO_PIXEL(pos_x + col * width / 8);
+    int const x1 = TO_PIXEL(pos_x + (col + 1) * width / 8) + emphasized;
+
+    for (row = 0; row < 12; row++)
+      if (bitmap[row] & (1 << col))
+        page_dot(x0, x1, top + row * 2, top + row * 2 + 2);
+    if (underline)
+      page_dot(x0, x1, top + 22, top + 24);
+  }
+  pos_x += width;
+}
+
+/* Print one column of bit image graphics, "pins" dots from "dots" */
+static void page_column(int dots, int pins, int top_bit)
+{
+  int const width = UNIT / gfx_density;
+  int const x0 = TO_PIXEL(pos_x);
+  int const x1 = TO_PIXEL(pos_x + width) + (width >= UNIT / 60);
+  int pin;
+
+  for (pin = 0; pin < pins; pin++) {
+    if (dots & (top_bit ? (0x80 >> pin) : (1 << pin))) {
+      int const y = TO_PIXEL(pos_y + pin * UNIT / 72);
+
+      page_dot(x0, x1, y, y + DPI / 72);
+    }
+  }
+  pos_x += width;
+}
+
+static void page_linefeed(int distance)
+{
+  pos_y += distance;
+  expanded_line = 0;
+  if (pos_y + line_spacing > page_length)
+    page_eject();
+}
+
+/* Number of parameter bytes following ESC and the command */
+static int esc_params(int cmd)
+{
+  switch (cmd) {
+    case '3': case 'A': case 'C': case 'J': case 'N': case 'Q':
+    case 'S': case 'U': case 'W': case 'l': case 'x': case '-':
+    case '!': case 'j': case 'R': case 'k': case 'p': case 's':
+      return 1;
+    case 'K': case 'L': case 'Y': case 'Z':
+      return 2;
+    case '*':
+      return 3;
+    default:
+      return 0;
+  }
+}
+
+static void epson_escape(void)
+{
+  static const int density[] = { 60, 120, 120, 240, 80, 72, 90 };
+  int const n = esc_buf[1];
+
+  switch (esc_buf[0]) {
+    case '@': page_reset(); break;
+    case '0': line_spacing = UNIT / 8; break;
+    case '1': line_spacing = UNIT * 7 / 72; break;
+    case '2': line_spacing = UNIT / 6; break;
+    case '3': line_spacing = n * UNIT / 216; break;
+    case 'A': line_spacing = n * UNIT / 72; break;
+    case 'J': page_linefeed(n * UNIT / 216); break;
+    case 'C':
+      if (n)
+        page_length = n * line_spacing;
+      else
+        esc_need = 1; /* ESC C 0 n: length in inches */
+      break;
+    case 'E': emphasized = 1; break;
+    case 'F': emphasized = 0; break;
+    case 'M': elite = 1; break;
+    case 'P': elite = 0; break;
+    case 'W': expanded = n & 1; break;
+    case '-': underline = n & 1; break;
+    case 'l': left_margin = n * UNIT / 10; break;
+    case '!':
+      elite = n & 0x01;
+      condensed = (n & 0x04) != 0;
+      emphasized = (n & 0x08) != 0;
+      expanded = (n & 0x20) != 0;
+      underline = (n & 0x80) != 0;
+      break;
+    case 0x0E: expanded_line = 1; break;
+    case 0x0F: condensed = 1; break;
+    case 'K': case 'L': case 'Y': case 'Z': case '*':
+      if (esc_buf[0] == '*') {
+        gfx_density = density[n < 7 ? n : 0];
+        gfx_count = esc_buf[2] | (esc_buf[3] << 8);
+      } else {
+        gfx_density = esc_buf[0] == 'K' ? 60 : (esc_buf[0] == 'Z' ? 240 : 120);
+        gfx_count = n | (esc_buf[2] << 8);
+      }
+      break;
+  }
+}
+
+static void dot_matrix_write(int value)
+{
+  /* Bit image data */
+  if (gfx_count) {
+    page_column(value, 8, 1);
+    gfx_count--;
+    return;
+  }
+
+  if (esc_need) {
+    esc_buf[esc_len++] = value;
+    if (--esc_need == 0) {
+      if (esc_buf[0] == 'C' && esc_len == 3)
+        page_length = esc_buf[2] * UNIT;
+      else
+        epson_escape();
+      if (esc_need == 0)
+        esc_len = 0;
+    }
+    return;
+  }
+  if (esc_len) {
+    /* Command after ESC */
+    esc_buf[0] = value;
+    esc_len = 1;
+    esc_need = esc_params(value);
+    if (esc_need == 0) {
+      epson_escape();
+      esc_len = 0;
+    }
+    return;
+  }
+
+  if (trs_printer == DMP_PRINTER) {
+    if (dmp_graphics) {
+      if (gfx_repeat == -1) {
+        gfx_repeat = value;
+        return;
+      }
+      if (value & 0x80) {
+        do
+          page_column(value, 7, 0);
+        while (gfx_repeat-- > 1);
+        gfx_repeat = 0;
+        return;
+      }
+      switch (value) {
+        case 0x1C: gfx_repeat = -1; return;     /* repeat next column */
+        case 0x1E: dmp_graphics = 0; return;    /* back to text */
+        case 0x0D:
+          pos_x = left_margin;
+          page_linefeed(UNIT * 7 / 72);
+          last_cr = TRUE;
+          return;
+      }
+      return;
+    }
+    switch (value) {
+      case 0x12: /* graphics mode */
+        dmp_graphics = 1;
+        gfx_density = 60;
+        gfx_repeat = 0;
+        return;
+      case 0x0E: expanded = 1; return;
+      case 0x0F: expanded = 0; return;
+    }
+  }
+
+  switch (value) {
+    case 0x1B:
+      esc_len = 1;
+      break;
+    case 0x0D:
+      pos_x = left_margin;
+      page_linefeed(line_spacing);
+      break;
+    case 0x0A:
+      /* TRS-80 software sends CR, often followed by LF */
+      if (!last_cr)
+        page_linefeed(line_spacing);
+      break;
+    case 0x0C:
+      pos_x = left_margin;
+      page_eject();
+      break;
+    case 0x08:
+      pos_x -= char_width();
+      if (pos_x < left_margin)
+        pos_x = left_margin;
+      break;
+    case 0x09:
+      pos_x += 8 * char_width() - (pos_x - left_margin) % (8 * char_width());
+      break;
+    case 0x0E: expanded_line = 1; break;
+    case 0x0F: condensed = 1; break;
+    case 0x12: condensed = 0; break;
+    case 0x14: expanded_line = 0; break;
+    default:
+      if (value >= 0x20 && value < 0x7F) {
+        if (TO_PIXEL(pos_x + char_width()) > PAGE_WIDTH) {
+          pos_x = left_margin;
+          page_linefeed(line_spacing);
+        }
+        page_char(value);
+      }
+      break;
+  }
+  last_cr = (value == 0x0D);
+}
 
 int trs_printer_reset(void)
 {
   if (printer_open) {
-    fclose(printer);
+    printer_flush();
+    if (page) {
+      page_eject();
+      if (printer_pdf && printer)
+        pdf_end();
+      free(page);
+      page = NULL;
+    }
+    if (printer)
+      fclose(printer);
+    printer = NULL;
     printer_open = FALSE;
     return 0;
   } else
     return -1;
 }
 
-static void trs_printer_open(void)
+static void trs_printer_start(void)
 {
-  int file_num;
-  struct stat st = { 0 };
-
-  for (file_num = 0; file_num < 10000; file_num++) {
-    if (snprintf(printer_filename, FILENAME_MAX, "%s%ctrsprn%04d.txt",
-        trs_printer_dir, DIR_SLASH, file_num) < FILENAME_MAX) {
-      if (stat(printer_filename, &st) < 0) {
-        printer_open = TRUE;
-        printer = fopen(printer_filename,"w");
-        if (printer == NULL) {
-          error("failed to open printer output file '%s': %s", printer_filename,
-              strerror(errno));
-          printer_open = FALSE;
-        }
-        return;
+  switch (trs_printer) {
+    case TEXT_PRINTER:
+    case RAW_PRINTER:
+      if (trs_printer_open(trs_printer == TEXT_PRINTER ? ".txt" : ".prn") == 0)
+        printer = printer_fopen(printer_filename);
+      break;
+    default:
+      printer_pdf = trs_printer_pdf;
+      if (trs_printer_open(printer_pdf ? ".pdf" : "-001.png") != 0)
+        break;
+      page = (Uint8 *)calloc(PAGE_PITCH, PAGE_HEIGHT);
+      if (page == NULL) {
+        error("failed to allocate memory for printer page");
+        printer_open = FALSE;
+        break;
       }
-    }
+      page_count = 0;
+      page_dirty = FALSE;
+      page_reset();
+      if (printer_pdf) {
+        if ((printer = printer_fopen(printer_filename)) != NULL)
+          pdf_begin();
+      }
+      break;
   }
+  last_cr = FALSE;
 }
 
 void trs_printer_write(int value)
 {
-  if (trs_printer == TEXT_PRINTER) {
-    if (!printer_open)
-      trs_printer_open();
+  if (trs_printer == NO_PRINTER)
+    return;
+
+  if (!printer_open)
+    trs_printer_start();
+  if (!printer_open)
+    return;
+
+  printer_last = z80_state.t_count;
+  if (trs_printer_cps)
+    printer_busy = printer_last +
+      (tstate_t)(z80_state.clockMHz * 1000000.0 / trs_printer_cps);
 
-    if (printer_open) {
+  switch (trs_printer) {
+    case TEXT_PRINTER:
       if (value == 0x0D) {
-        fputc('\n',printer);
-      } else {
-        fputc(value,printer);
+        printer_put('\n');
+      } else if (value != 0x0A || !last_cr) {
+        printer_put(value);
       }
-    }
+      last_cr = (value == 0x0D);
+      break;
+    case RAW_PRINTER:
+      printer_put(value);
+      break;
+    default:
+      dot_matrix_write(value);
+      break;
   }
 }
 
+/* Write out the spool after a second of emulated time without output */
+void trs_printer_idle(void)
+{
+  if (spool_len && z80_state.t_count - printer_last >
+      (tstate_t)(z80_state.clockMHz * 1000000.0))
+    printer_flush();
+}
+
 int trs_printer_read(void)
 {
-    return 0x30;	/* printer selected, ready, with paper, not busy */
+  if (trs_printer_cps && z80_state.t_count < printer_busy)
+    return 0xB0;	/* busy */
+  return 0x30;	/* printer selected, ready, with paper, not busy */
 }
@@ -0,0 +1,432 @@
+/*
+ * Profiler of the emulated Z80.
+ *
+ * Before every instruction, the T-states since the previous one are
+ * added to the address of that instruction and to the call path it ran
+ * in.  Calls are followed on a shadow stack: a CALL or RST which was
+ * taken, or an interrupt, pushes a frame, which is popped again when the
+ * stack pointer goes above the return address, so returns by POP and
+ * JP (HL) are followed as well as RET.  The call paths seen form a tree
+ * holding the T-states spent in each, from which the functions, the call
+ * graph and the folded stacks for flame graphs are written at exit.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "error.h"
+#include "trs.h"
+#include "trs_input.h"
+#include "trs_profile.h"
+
+#define PROFILE_DEPTH  (256)
+#define PROFILE_NODES  (1 << 20)
+#define PROFILE_TOP    (-1) /* function of the root, and site of interrupts */
+
+typedef struct {
+  int parent;
+  int child;      /* first called from here */
+  int sibling;    /* next called from the parent */
+  int func;       /* address called */
+  int site;       /* address of the call, PROFILE_TOP for an interrupt */
+  Uint64 self;    /* T-states spent in the function itself */
+  Uint64 calls;
+} profile_node;
+
+typedef struct {
+  int node;
+  Uint16 sp;      /* pointing to the return address */
+} profile_frame;
+
+typedef struct {
+  int caller;
+  int site;
+  int callee;
+  Uint64 calls;
+  Uint64 total;
+} profile_edge;
+
+char trs_profile_file[FILENAME_MAX];
+int trs_profiling;
+
+static Uint64 *profile_tstates;  /* by address */
+static Uint32 *profile_count;
+static Uint64 profile_total;
+
+static profile_node *profile_nodes;
+static int profile_node_count;
+static int profile_node_size;
+
+static profile_frame profile_stack[PROFILE_DEPTH];
+static int profile_depth;
+
+/* Instruction being run */
+static int profile_pc = -1;
+static Uint16 profile_sp;
+static Uint8 profile_op;
+static tstate_t profile_t;
+static int profile_irq;
+
+static int profile_child(int parent, int func, int site)
+{
+  profile_node *node;
+  int i;
+
+  for (i = profile_nodes[parent].child; i >= 0;
+       i = profile_nodes[i].sibling) {
+    if (profile_nodes[i].func == func && profile_nodes[i].site == site)
+      return i;
+  }
+
+  if (profile_node_count == profile_node_size) {
+    int size = profile_node_size * 2;
+    profile_node *nodes;
+
+    if (size > PROFILE_NODES ||
+        (nodes = realloc(profile_nodes, size * sizeof(*nodes))) == NULL)
+      return parent;
+    profile_nodes = nodes;
+    profile_node_size = size;
+  }
+  i = profile_node_count++;
+  node = &profile_nodes[i];
+  node->parent = parent;
+  node->child = -1;
+  node->sibling = profile_nodes[parent].child;
+  node->func = func;
+  node->site = site;
+  node->self = 0;
+  node->calls = 0;
+  profile_nodes[parent].child = i;
+  return i;
+}
+
+static void profile_push(int func, int site, Uint16 sp)
+{
+  int node;
+
+  if (profile_depth == PROFILE_DEPTH)
+    return;
+  node = profile_child(profile_depth ?
+      profile_stack[profile_depth - 1].node : 0, func, site);
+  profile_nodes[node].calls++;
+  profile_stack[profile_depth].node = node;
+  profile_stack[profile_depth].sp = sp;
+  profile_depth++;
+}
+
+void trs_profile_tick(void)
+{
+  tstate_t const t_count = z80_state.t_count;
+  Uint16 const pc = Z80_PC;
+  Uint16 const sp = Z80_SP;
+
+  /* Running again what was already profiled */
+  if (trs_input_replaying == INPUT_REPLAY_HISTORY) {
+    profile_pc = -1;
+    return;
+  }
+
+  if (profile_pc < 0 || t_count < profile_t) {
+    /* Started, or gone back in time: the call stack is unknown */
+    profile_depth = 0;
+  } else {
+    tstate_t const t = t_count - profile_t;
+    /* Stack pointer before an interrupt pushed the return address */
+    Uint16 const sp_op = profile_irq ? sp + 2 : sp;
+    int callee = -1;
+
+    profile_tstates[profile_pc] += t;
+    profile_count[profile_pc]++;
+    profile_nodes[profile_depth ?
+        profile_stack[profile_depth - 1].node : 0].self += t;
+    profile_total += t;
+
+    while (profile_depth && sp_op > profile_stack[profile_depth - 1].sp)
+      profile_depth--;
+
+    if (sp_op == (Uint16)(profile_sp - 2)) {
+      if (profile_op == 0xCD || (profile_op & 0xC7) == 0xC4)
+        callee = mem_peek(profile_pc + 1) | mem_peek(profile_pc + 2) << 8;
+      else if ((profile_op & 0xC7) == 0xC7)
+        callee = profile_op & 0x38;
+    }
+    if (callee >= 0)
+      profile_push(callee, profile_pc, sp_op);
+    if (profile_irq)
+      profile_push(pc, PROFILE_TOP, sp);
+  }
+
+  profile_irq = 0;
+  profile_pc = pc;
+  profile_sp = sp;
+  profile_t = t_count;
+  profile_op = mem_peek(pc);
+}
+
+void trs_profile_interrupt(void)
+{
+  profile_irq = 1;
+}
+
+int trs_profile_start(void)
+{
+  static int registered;
+
+  if (profile_tstates == NULL) {
+    profile_tstates = calloc(0x10000, sizeof(*profile_tstates));
+    profile_count = calloc(0x10000, sizeof(*profile_count));
+    profile_nodes = malloc(1024 * sizeof(*profile_nodes));
+    if (profile_tstates == NULL || profile_count == NULL ||
+        profile_nodes == NULL) {
+      error("failed to allocate profile");
+      free(profile_tstates);
+      free(profile_count);
+      free(profile_nodes);
+      profile_tstates = NULL;
+      return -1;
+    }
+    profile_node_size = 1024;
+  }
+  /* The root of the call paths */
+  profile_node_count = 1;
+  profile_nodes[0].parent = -1;
+  profile_nodes[0].child = -1;
+  profile_nodes[0].sibling = -1;
+  profile_nodes[0].func = PROFILE_TOP;
+  profile_nodes[0].site = PROFILE_TOP;
+  profile_nodes[0].self = 0;
+  profile_nodes[0].calls = 0;
+  profile_pc = -1;
+  trs_profiling = 1;
+
+  if (!registered && atexit(trs_profile_write) == 0)
+    registered = 1;
+  return 0;
+}
+
+static const char *profile_name(int func, int site)
+{
+  static char name[16];
+
+  if (func == PROFILE_TOP)
+    return "top";
+  snprintf(name, sizeof(name), site == PROFILE_TOP ? "int_%04x" : "%04x",
+      func);
+  return name;
+}
+
+static int profile_by_tstates(const void *a, const void *b)
+{
+  Uint64 const x = profile_tstates[*(const Uint16 *)a];
+  Uint64 const y = profile_tstates[*(const Uint16 *)b];
+
+  return x < y ? 1 : x > y ? -1 : 0;
+}
+
+static int profile_by_edge(const void *a, const void *b)
+{
+  const profile_edge *x = a;
+  const profile_edge *y = b;
+
+  if (x->caller != y->caller)
+    return x->caller - y->caller;
+  if (x->site != y->site)
+    return x->site - y->site;
+  return x->callee - y->callee;
+}
+
+static double profile_percent(Uint64 t)
+{
+  return profile_total ? t * 100.0 / profile_total : 0.0;
+}
+
+/* Is the function of node i also further up in its call path? */
+static int profile_recursive(int i)
+{
+  int p;
+
+  for (p = profile_nodes[i].parent; p > 0; p = profile_nodes[p].parent) {
+    if (profile_nodes[p].func == profile_nodes[i].func)
+      return 1;
+  }
+  return 0;
+}
+
+static void profile_report(FILE *file, const Uint64 *total)
+{
+  Uint16 *order = malloc(0x10000 * sizeof(*order));
+  Uint64 *func_self = calloc(0x10001, sizeof(*func_self));
+  Uint64 *func_total = calloc(0x10001, sizeof(*func_total));
+  Uint64 *func_calls = calloc(0x10001, sizeof(*func_calls));
+  profile_edge *edges = malloc(profile_node_count * sizeof(*edges));
+  unsigned long instructions = 0;
+  int count = 0, n = 0;
+  int i, addr;
+
+  if (order == NULL || func_self == NULL || func_total == NULL ||
+      func_calls == NULL || edges == NULL) {
+    error("failed to allocate profile");
+    goto done;
+  }
+
+  for (addr = 0; addr < 0x10000; addr++) {
+    if (profile_count[addr]) {
+      order[count++] = addr;
+      instructions += profile_count[addr];
+    }
+  }
+  fprintf(file, "Z80 profile: %" TSTATE_T_LEN " T-states, %lu instructions\n",
+      profile_total, instructions);
+
+  fputs("\nFlat profile:\n"
+        "      T-states       %    Executed  Instruction\n", file);
+  qsort(order, count, sizeof(*order), profile_by_tstates);
+  for (i = 0; i < count; i++) {
+    fprintf(file, "%14" TSTATE_T_LEN " %6.2f%% %11lu  ",
+        profile_tstates[order[i]], profile_percent(profile_tstates[order[i]]),
+        (unsigned long)profile_count[order[i]]);
+    disassemble_file(file, order[i]);
+  }
+
+  /* Functions indexed by address, with the top after them */
+  for (i = 0; i < profile_node_count; i++) {
+    int const func = profile_nodes[i].func == PROFILE_TOP ? 0x10000
+                                                          : profile_nodes[i].func;
+
+    func_self[func] += profile_nodes[i].self;
+    func_calls[func] += profile_nodes[i].calls;
+    if (!profile_recursive(i))
+      func_total[func] += total[i];
+  }
+  fputs("\nFunctions:\n"
+        "          Self       %           Total       %       Calls  Function\n",
+        file);
+  for (addr = 0; addr <= 0x10000; addr++) {
+    if (func_total[addr] == 0 && func_calls[addr] == 0)
+      continue;
+    fprintf(file, "%14" TSTATE_T_LEN " %6.2f%% %15" TSTATE_T_LEN
+        " %6.2f%% %11" TSTATE_T_LEN "  %s\n",
+        func_self[addr], profile_percent(func_self[addr]),
+        func_total[addr], profile_percent(func_total[addr]),
+        func_calls[addr],
+        addr == 0x10000 ? "top" : profile_name(addr, 0));
+  }
+
+  /* Calls by caller and call site, over all the call paths */
+  for (i = 1; i < profile_node_count; i++) {
+    edges[n].caller = profile_nodes[profile_nodes[i].parent].func;
+    edges[n].site = profile_nodes[i].site;
+    edges[n].callee = profile_nodes[i].func;
+    edges[n].calls = profile_nodes[i].calls;
+    edges[n].total = total[i];
+    n++;
+  }
+  qsort(edges, n, sizeof(*edges), profile_by_edge);
+  fputs("\nCall graph:\n"
+        "  Caller  Site  Callee        Calls           Total       %\n", file);
+  for (i = 0; i < n; i++) {
+    profile_edge edge = edges[i];
+
+    while (i + 1 < n && profile_by_edge(&edge, &edges[i + 1]) == 0) {
+      edge.calls += edges[++i].calls;
+      edge.total += edges[i].total;
+    }
+    fprintf(file, "%8s", profile_name(edge.caller, 0));
+    if (edge.site == PROFILE_TOP)
+      fprintf(file, "   int  %-6s", profile_name(edge.callee, 0));
+    else
+      fprintf(file, "  %04x  %-6s", edge.site, profile_name(edge.callee, 0));
+    fprintf(file, " %11" TSTATE_T_LEN " %15" TSTATE_T_LEN " %6.2f%%\n",
+        edge.calls, edge.total, profile_percent(edge.total));
+  }
+
+  fputs("\nAnnotated disassembly:\n"
+        "      T-states    Executed  Instruction\n", file);
+  for (addr = 0; addr < 0x10000; ) {
+    int next;
+
+    if (profile_count[addr] == 0) {
+      addr++;
+      continue;
+    }
+    if (addr == 0 || profile_count[addr - 1] == 0 || func_calls[addr])
+      fprintf(file, "\n%*s%s:\n", 28, "", profile_name(addr, 0));
+    fprintf(file, "%14" TSTATE_T_LEN " %11lu  ", profile_tstates[addr],
+        (unsigned long)profile_count[addr]);
+    next = disassemble_file(file, addr);
+    /* Skip the operands unless they were run as instructions too */
+    while (++addr < next && addr < 0x10000 && profile_count[addr] == 0)
+      ;
+  }
+
+done:
+  free(order);
+  free(func_self);
+  free(func_total);
+  free(func_calls);
+  free(edges);
+}
+
+/* One line per call path: the functions separated by ; and T-states */
+static void profile_folded(FILE *file)
+{
+  int path[PROFILE_DEPTH + 1];
+  int i;
+
+  for (i = 0; i < profile_node_count; i++) {
+    int depth = 0, node;
+
+    if (profile_nodes[i].self == 0)
+      continue;
+    for (node = i; node >= 0 && depth <= PROFILE_DEPTH;
+         node = profile_nodes[node].parent)
+      path[depth++] = node;
+    while (depth-- > 0) {
+      node = path[depth];
+      fputs(profile_name(profile_nodes[node].func, profile_nodes[node].site),
+          file);
+      putc(depth ? ';' : ' ', file);
+    }
+    fprintf(file, "%" TSTATE_T_LEN "\n", profile_nodes[i].self);
+  }
+}
+
+void trs_profile_write(void)
+{
+  char folded[FILENAME_MAX + 8];
+  Uint64 *total;
+  FILE *file;
+  int i;
+
+  if (!trs_profiling)
+    return;
+
+  /* T-states of the call paths including the ones called from them */
+  if ((total = calloc(profile_node_count, sizeof(*total))) == NULL) {
+    error("failed to allocate profile");
+    return;
+  }
+  for (i = profile_node_count - 1; i >= 0; i--) {
+    total[i] += profile_nodes[i].self;
+    if (i > 0)
+      total[profile_nodes[i].parent] += total[i];
+  }
+
+  if ((file = fopen(trs_profile_file, "w")) == NULL) {
+    error("failed to write profile '%s': %s", trs_profile_file,
+        strerror(errno));
+  } else {
+    profile_report(file, total);
+    fclose(file);
+  }
+  free(total);
+
+  snprintf(folded, sizeof(folded), "%s.folded", trs_profile_file);
+  if ((file = fopen(folded, "w")) == NULL) {
+    error("failed to write profile '%s': %s", folded, strerror(errno));
+  } else {
+    profile_folded(file);
+    fclose(file);
+  }
+}
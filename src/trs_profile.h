@@ -0,0 +1,24 @@
+/*
+ * Profiler of the emulated Z80: T-states spent by address and by call
+ * path, written to a report and a folded stack file for flame graphs.
+ */
+#ifndef _TRS_PROFILE_H
+#define _TRS_PROFILE_H
+
+#include <stdio.h>
+
+/* Report to write, given with -profile */
+extern char trs_profile_file[FILENAME_MAX];
+
+/* Non-zero while profiling, so z80_run() calls trs_profile_tick() */
+extern int trs_profiling;
+
+/* Called before every instruction, and when an interrupt is taken */
+extern void trs_profile_tick(void);
+extern void trs_profile_interrupt(void);
+
+/* Start profiling, written to the report at exit */
+extern int trs_profile_start(void);
+extern void trs_profile_write(void);
+
+#endif
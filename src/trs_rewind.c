@@ -0,0 +1,201 @@
+/*
+ * Rewind and reverse execution.
+ *
+ * While the emulation runs, a snapshot is taken every tenth of a second
+ * of emulated time, together with the position in the input log.  The
+ * oldest snapshots are dropped to keep within the memory given with
+ * -rewind.  Going back to any T-state restores the last snapshot before
+ * it and runs the emulation from there, as fast as possible, feeding it
+ * the logged input again.  Stepping backwards and searching backwards
+ * for a breakpoint are made the same way.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "error.h"
+#include "trs.h"
+#include "trs_input.h"
+#include "trs_rewind.h"
+#include "trs_snapshot.h"
+
+#define REWIND_PER_SECOND (10)
+
+typedef struct {
+  trs_snapshot *snap;
+  unsigned long mark; /* position in the input log */
+} rewind_point;
+
+int trs_rewind_mb;
+int trs_rewind_seconds = 5;
+
+static rewind_point *rewind_ring; /* oldest first */
+static int rewind_count;
+static int rewind_size;
+static int rewind_back;           /* seconds to go back at the next tick */
+static unsigned long rewind_mark; /* where the last replay stopped in the log */
+
+static tstate_t rewind_tstates(int i)
+{
+  return trs_snapshot_tstates(rewind_ring[i].snap);
+}
+
+static void rewind_drop(int from, int to)
+{
+  int i;
+
+  for (i = from; i < to; i++)
+    trs_snapshot_free(rewind_ring[i].snap);
+  memmove(rewind_ring + from, rewind_ring + to,
+          (rewind_count - to) * sizeof(*rewind_ring));
+  rewind_count -= to - from;
+}
+
+/* The newest snapshot not after the T-state count */
+static int rewind_find(tstate_t t_count)
+{
+  int i;
+
+  for (i = rewind_count - 1; i >= 0 && rewind_tstates(i) > t_count; i--)
+    ;
+  return i;
+}
+
+/*
+ * Run from snapshot i until the T-state count end, calling match() before
+ * every instruction.  Returns 1 and the last T-state count where it was
+ * true in found, 0 if it never was, or -1 on error.
+ */
+static int rewind_scan(int i, tstate_t end, int (*match)(void),
+                       tstate_t *found)
+{
+  int const continuous = trs_continuous;
+  int hit = 0;
+
+  if (trs_snapshot_restore(rewind_ring[i].snap))
+    return -1;
+
+  trs_input_replay(rewind_ring[i].mark);
+  while (z80_state.t_count < end) {
+    if (match == NULL || match()) {
+      *found = z80_state.t_count;
+      hit = 1;
+    }
+    z80_run(0);
+  }
+  rewind_mark = trs_input_mark();
+  trs_input_replay_end();
+  trs_continuous = continuous;
+  return hit;
+}
+
+void trs_rewind_reset(void)
+{
+  rewind_drop(0, rewind_count);
+  trs_input_forget(trs_input_mark());
+  rewind_back = 0;
+}
+
+int trs_rewind_to(tstate_t target)
+{
+  int const i = rewind_find(target);
+  tstate_t found;
+
+  if (i < 0)
+    return -1;
+  if (rewind_scan(i, target, NULL, &found) < 0) {
+    trs_rewind_reset();
+    return -1;
+  }
+  /* The emulation takes another course from here */
+  rewind_drop(i + 1, rewind_count);
+  trs_input_truncate(rewind_mark);
+  return 0;
+}
+
+int trs_rewind_search(int (*match)(void))
+{
+  tstate_t const now = z80_state.t_count;
+  tstate_t end = now, found = 0;
+  int i, hit = 0;
+
+  if (now == 0 || (i = rewind_find(now - 1)) < 0)
+    return -1;
+
+  for (; i >= 0 && !hit; i--) {
+    if ((hit = rewind_scan(i, end, match, &found)) < 0) {
+      trs_rewind_reset();
+      return -1;
+    }
+    end = rewind_tstates(i);
+  }
+  if (!hit) {
+    /* Stop at the start of the history */
+    return trs_rewind_to(rewind_tstates(0)) ? -1 : 1;
+  }
+  return trs_rewind_to(found);
+}
+
+void trs_rewind_back(int seconds)
+{
+  rewind_back = seconds;
+}
+
+void trs_rewind_tick(void)
+{
+  tstate_t const interval = z80_state.clockMHz * 1000000 / REWIND_PER_SECOND;
+  trs_snapshot *snap;
+
+  if (trs_rewind_mb <= 0 || trs_input_replaying)
+    return;
+
+  if (rewind_back) {
+    tstate_t const back = z80_state.clockMHz * 1000000 * rewind_back;
+
+    rewind_back = 0;
+    if (rewind_count) {
+      tstate_t target = rewind_tstates(0);
+
+      if (z80_state.t_count - target > back)
+        target = z80_state.t_count - back;
+      if (trs_rewind_to(target) == 0)
+        trs_screen_init(1);
+    }
+    return;
+  }
+
+  if (rewind_count) {
+    tstate_t const last = rewind_tstates(rewind_count - 1);
+
+    if (z80_state.t_count < last)
+      trs_rewind_reset();
+    else if (z80_state.t_count - last < interval)
+      return;
+  }
+
+  if (rewind_count == rewind_size) {
+    int size = rewind_size ? rewind_size * 2 : 64;
+    rewind_point *ring = realloc(rewind_ring, size * sizeof(*ring));
+
+    if (ring == NULL) {
+      error("failed to allocate rewind history");
+      return;
+    }
+    rewind_ring = ring;
+    rewind_size = size;
+  }
+  if ((snap = trs_snapshot_take()) == NULL) {
+    error("rewind disabled");
+    trs_rewind_mb = 0;
+    trs_rewind_reset();
+    return;
+  }
+  rewind_ring[rewind_count].snap = snap;
+  rewind_ring[rewind_count].mark = trs_input_mark();
+  rewind_count++;
+
+  /* Keep at least two snapshots to go back to */
+  while (rewind_count > 2 &&
+         trs_snapshot_memory() > (unsigned long)trs_rewind_mb << 20)
+    rewind_drop(0, 1);
+  trs_input_forget(rewind_ring[0].mark);
+}
@@ -0,0 +1,35 @@
+/*
+ * Rewind: snapshots taken periodically while the emulation runs and
+ * the input logged in between let it go back to any earlier T-state.
+ */
+#ifndef _TRS_REWIND_H
+#define _TRS_REWIND_H
+
+#include "z80.h"
+
+/* Memory for the snapshots in MB, 0 to disable */
+extern int trs_rewind_mb;
+
+/* Seconds to go back with the rewind key */
+extern int trs_rewind_seconds;
+
+/* Take a snapshot if it is time to, called between instructions */
+extern void trs_rewind_tick(void);
+
+/* Go back some seconds at the next tick */
+extern void trs_rewind_back(int seconds);
+
+/* Forget the history after a reset or loading a state */
+extern void trs_rewind_reset(void);
+
+/* Go back to a T-state count in the history */
+extern int trs_rewind_to(tstate_t target);
+
+/*
+ * Go back to the last instruction before now where match() is true, or
+ * to the previous instruction if match is NULL.  Returns 1 if it stopped
+ * at the start of the history instead.
+ */
+extern int trs_rewind_search(int (*match)(void));
+
+#endif
@@ -2095,9 +2095,11 @@ void trs_gui_misc_settings(void)
    {"Turbo Paste                                             ", MENU_NORMAL},
 #endif
    {"", 0}};
-  const char *printer[] = {"     None", "     Text"};
+  const char *printer[] = {"     None", "     Text", "      Raw",
+                           "    Epson", "      DMP"};
   char input[12];
   int selection = 0;
+  int value;
 
   while (1) {
     snprintf(&menu[2].text[50], 11, "%s", yes_no[trs_emtsafe]);
@@ -2134,7 +2136,11 @@ void trs_gui_misc_settings(void)
         }
         break;
       case 4:
-        trs_printer = trs_gui_display_popup("Printer", printer, 2, trs_printer);
+        value = trs_gui_display_popup("Printer", printer, 5, trs_printer);
+        if (value != trs_printer) {
+          trs_printer_reset();
+          trs_printer = value;
+        }
         break;
       case 6:
         filename[0] = 0;
@@ -44,15 +44,23 @@
 #include "blit.h"
 #include "error.h"
 #include "trs.h"
+#include "trs_auto.h"
 #include "trs_cassette.h"
 #include "trs_clones.h"
 #include "trs_disk.h"
 #include "trs_hard.h"
+#include "trs_input.h"
+#include "trs_metrics.h"
+#include "trs_profile.h"
+#include "trs_rewind.h"
 #include "trs_sdl_gui.h"
 #include "trs_sdl_keyboard.h"
 #include "trs_state_save.h"
 #include "trs_stringy.h"
+#include "trs_textdump.h"
+#include "trs_trace.h"
 #include "trs_uart.h"
+#include "trs_video.h"
 
 #define MAX_RECTS   2048
 #define MAX_SCALE   4
@@ -77,6 +85,21 @@
 #define TRS_CHAR_HEIGHT  12
 #define TRS_CHAR_HEIGHT4 10
 
+/* Glyph sets in the atlas */
+#define GLYPH_NORMAL       0
+#define GLYPH_EXPANDED     1
+#define GLYPH_INVERSE      2
+#define GLYPH_EXP_INVERSE  3
+#define GLYPH_GUI          4
+#define GLYPH_GUI_INVERSE  5
+#define GLYPH_BOX          6
+#define GLYPH_BOX_EXPANDED 7
+#define GLYPH_BOX_GUI      8
+#define GLYPH_SETS         9
+#define GLYPH_COLUMNS      32 /* normal width glyphs in a row of the atlas */
+
+#define METRICS_COLUMNS    40 /* width of the metrics overlay */
+
 /* Public data */
 int foreground;
 int background;
@@ -127,6 +150,7 @@ static int border_width = 2;
 static int scale_factor = 2;
 static int m6845_raster = 12;
 static int window_scale;
+static int draw_scale = 1;
 static int y_scale = 2;
 static int trs_resize;
 static int text80x24, screen640x240;
@@ -148,13 +172,35 @@ static int mouse_sens = 3;
 static int mouse_last_x = -1, mouse_last_y = -1;
 static int mouse_old_style;
 static unsigned int mouse_last_buttons;
-static SDL_Surface *trs_char[6][MAX_CHARS];
-static SDL_Surface *trs_box[3][64];
+static SDL_Surface *glyph_atlas;
+static int glyph_width, glyph_height;
+static int glyph_top[GLYPH_SETS];
 static SDL_Surface *image;
 static SDL_Surface *screen;
 static SDL_Rect drawnRects[MAX_RECTS];
 #ifdef SDL2
 static SDL_Window *window;
+static int vsync;
+
+/* Presentation with a renderer, paced to the display refresh */
+#define RENDER_RUN    1
+#define RENDER_QUIT   2
+static SDL_Renderer *renderer;
+static SDL_Texture *render_texture;
+static SDL_Thread *render_thread;
+static SDL_mutex *render_lock;
+static SDL_cond *render_cond;
+static Uint32 *render_frame;     /* snapshot of the screen surface */
+static Uint32 *render_output;    /* prepared frame for the texture */
+static int render_width, render_height;
+static int render_state;
+static int render_ready;         /* new snapshot to prepare */
+static int render_done;          /* prepared frame to present */
+static int render_shade;
+static int render_scan_height;
+static Uint64 render_period;     /* counts between presents, or 0 */
+static Uint64 render_last;       /* count of the last present */
+static int render_failed;        /* use the window surface instead */
 #endif
 static Uint32 light_red;
 static Uint32 bright_red;
@@ -184,9 +230,9 @@ static int selectionStartY;
 static int selectionEndX;
 static int selectionEndY;
 static int selectAll;
+#endif
 static int timer_saved;
 static unsigned int cycles_saved;
-#endif
 
 /* Support for Micro-Labs Grafyx Solution and Radio Shack hi-res card
  * ... also used for other graphic cards ... */
@@ -197,12 +243,31 @@ static unsigned int cycles_saved;
 #define G_MSIZE (2 * G_YSIZE * MAX_SCALE) * (G_XSIZE * MAX_SCALE)
 static Uint8 grafyx[G_MSIZE];
 static Uint8 grafyx_unscaled[G_YSIZE][G_XSIZE];
+/* Rows written since the last frame, and the first and last byte of each */
+static Uint32 grafyx_dirty[G_YSIZE / 32];
+static Uint8 grafyx_dirty_x0[G_YSIZE], grafyx_dirty_x1[G_YSIZE];
 static int grafyx_microlabs;
 static int grafyx_x, grafyx_y, grafyx_mode;
 static int grafyx_enable;
 static int grafyx_overlay;
 static int grafyx_xoffset, grafyx_yoffset;
 
+/*
+ * Raster mode: text is drawn line by line as the beam of the monitor
+ * passes, so writes to video memory and mode changes in the middle of a
+ * frame show as on a real TRS-80.  Changes only mark the lines as dirty;
+ * before the next change the lines the beam went over since are drawn,
+ * if dirty, from the state before the change.
+ */
+#define RASTER_HZ     60
+#define RASTER_TOTAL  262   /* lines of a frame, including blanking */
+#define RASTER_LINES  1024
+static int raster_mode;
+static Uint8 raster_dirty[RASTER_LINES];
+static int raster_line;          /* next line to draw in this frame */
+static tstate_t raster_start;    /* T-state when the frame started */
+static int cursor_position = -1, cursor_start, cursor_end, cursor_visible;
+
 /* Port 0x83 (grafyx_mode) bits */
 #define G_ENABLE    1
 #define G_UL_NOTEXT 2   /* Micro-Labs only */
@@ -227,6 +292,8 @@ static int hrg_enable;
 static int hrg_addr;
 static Uint8 le18_x, le18_y, le18_on;
 
+static void trs_opt_audiolatency(char *arg, int intarg, int *stringarg);
+static void trs_opt_automation(char *arg, int intarg, int *stringarg);
 static void trs_opt_borderwidth(char *arg, int intarg, int *stringarg);
 static void trs_opt_cass(char *arg, int intarg, int *stringarg);
 static void trs_opt_charset(char *arg, int intarg, int *stringarg);
@@ -246,9 +313,16 @@ static void trs_opt_hypermem(char *arg, int intarg, int *stringarg);
 static void trs_opt_joybuttonmap(char *arg, int intarg, int *stringarg);
 static void trs_opt_joysticknum(char *arg, int intarg, int *stringarg);
 static void trs_opt_keystretch(char *arg, int intarg, int *stringarg);
+static void trs_opt_metricsfile(char *arg, int intarg, int *stringarg);
 static void trs_opt_microlabs(char *arg, int intarg, int *stringarg);
 static void trs_opt_model(char *arg, int intarg, int *stringarg);
 static void trs_opt_printer(char *arg, int intarg, int *stringarg);
+static void trs_opt_printerspeed(char *arg, int intarg, int *stringarg);
+static void trs_opt_profile(char *arg, int intarg, int *stringarg);
+static void trs_opt_record(char *arg, int intarg, int *stringarg);
+static void trs_opt_replay(char *arg, int intarg, int *stringarg);
+static void trs_opt_rewind(char *arg, int intarg, int *stringarg);
+static void trs_opt_rewindstep(char *arg, int intarg, int *stringarg);
 static void trs_opt_rom(char *arg, int intarg, int *stringarg);
 static void trs_opt_samplerate(char *arg, int intarg, int *stringarg);
 static void trs_opt_scale(char *arg, int intarg, int *stringarg);
@@ -260,8 +334,14 @@ static void trs_opt_sizemap(char *arg, int intarg, int *stringarg);
 static void trs_opt_speedup(char *arg, int intarg, int *stringarg);
 static void trs_opt_supermem(char *arg, int intarg, int *stringarg);
 static void trs_opt_switches(char *arg, int intarg, int *stringarg);
+static void trs_opt_textdump(char *arg, int intarg, int *stringarg);
+static void trs_opt_textdumpframes(char *arg, int intarg, int *stringarg);
+static void trs_opt_trace(char *arg, int intarg, int *stringarg);
+static void trs_opt_tracepc(char *arg, int intarg, int *address);
 static void trs_opt_turborate(char *arg, int intarg, int *stringarg);
 static void trs_opt_value(char *arg, int intarg, int *variable);
+static void trs_opt_video(char *arg, int intarg, int *stringarg);
+static void trs_opt_videorate(char *arg, int intarg, int *stringarg);
 static void trs_opt_wafer(char *arg, int intarg, int *stringarg);
 
 /* Option handling */
@@ -272,6 +352,9 @@ static const struct {
   int intArg;
   void *strArg;
 } options[] = {
+  { "audiolatency",    trs_opt_audiolatency,  1, 0, NULL                 },
+  { "audiosync",       trs_opt_value,         0, 1, &timer_audio_sync    },
+  { "automation",      trs_opt_automation,    1, 0, NULL                 },
   { "background",      trs_opt_color,         1, 0, &background          },
   { "bg",              trs_opt_color,         1, 0, &background          },
   { "borderwidth",     trs_opt_borderwidth,   1, 0, NULL                 },
@@ -335,6 +418,8 @@ static const struct {
   { "lower",           trs_opt_value,         0, 1, &lowercase           },
   { "lowercase",       trs_opt_value,         0, 1, &lowercase           },
   { "lubomir",         trs_opt_value,         0, 1, &lubomir             },
+  { "metrics",         trs_opt_value,         0, 1, &trs_metrics_overlay },
+  { "metricsfile",     trs_opt_metricsfile,   1, 0, NULL                 },
   { "microlabs",       trs_opt_microlabs,     0, 1, NULL                 },
   { "m1",              trs_opt_value,         0, 1, &trs_model           },
   { "m3",              trs_opt_value,         0, 3, &trs_model           },
@@ -343,6 +428,7 @@ static const struct {
   { "megamem",         trs_opt_value,         0, 1, &megamem             },
   { "model",           trs_opt_model,         1, 0, NULL                 },
   { "mousepointer",    trs_opt_value,         0, 1, &mousepointer        },
+  { "noaudiosync",     trs_opt_value,         0, 0, &timer_audio_sync    },
   { "noemtsafe",       trs_opt_value,         0, 0, &trs_emtsafe         },
   { "nofdc",           trs_opt_value,         0, 0, &trs_disk_controller },
   { "nofullscreen",    trs_opt_value,         0, 0, &fullscreen          },
@@ -357,8 +443,11 @@ static const struct {
   { "nolowercase",     trs_opt_value,         0, 0, &lowercase           },
   { "nolubomir",       trs_opt_value,         0, 0, &lubomir             },
   { "nomegamem",       trs_opt_value,         0, 0, &megamem             },
+  { "nometrics",       trs_opt_value,         0, 0, &trs_metrics_overlay },
   { "nomicrolabs",     trs_opt_microlabs,     0, 0, NULL                 },
   { "nomousepointer",  trs_opt_value,         0, 0, &mousepointer        },
+  { "noprinterpdf",    trs_opt_value,         0, 0, &trs_printer_pdf     },
+  { "noraster",        trs_opt_value,         0, 0, &raster_mode         },
   { "noresize3",       trs_opt_value,         0, 0, &resize3             },
   { "noresize4",       trs_opt_value,         0, 0, &resize4             },
   { "noscanlines",     trs_opt_value,         0, 0, &scanlines           },
@@ -371,8 +460,17 @@ static const struct {
   { "noturbo",         trs_opt_value,         0, 0, &timer_overclock     },
   { "printer",         trs_opt_printer,       1, 0, NULL                 },
   { "printerdir",      trs_opt_dirname,       1, 0, trs_printer_dir      },
+  { "printerpdf",      trs_opt_value,         0, 1, &trs_printer_pdf     },
+  { "printerspeed",    trs_opt_printerspeed,  1, 0, NULL                 },
+  { "profile",         trs_opt_profile,       1, 0, NULL                 },
+  { "raster",          trs_opt_value,         0, 1, &raster_mode         },
+  { "record",          trs_opt_record,        1, 0, NULL                 },
+  { "replay",          trs_opt_replay,        1, 0, NULL                 },
+  { "replayquit",      trs_opt_value,         0, 1, &trs_input_replay_quit },
   { "resize3",         trs_opt_value,         0, 1, &resize3             },
   { "resize4",         trs_opt_value,         0, 1, &resize4             },
+  { "rewind",          trs_opt_rewind,        1, 0, NULL                 },
+  { "rewindstep",      trs_opt_rewindstep,    1, 0, NULL                 },
   { "rom",             trs_opt_rom,           1, 0, NULL                 },
   { "romfile",         trs_opt_rom,           1, 0, NULL                 },
   { "romfile1",        trs_opt_rom,           1, 1, NULL                 },
@@ -393,13 +491,24 @@ static const struct {
   { "stringy",         trs_opt_value,         0, 1, &stringy             },
   { "supermem",        trs_opt_supermem,      0, 1, NULL                 },
   { "switches",        trs_opt_switches,      1, 0, NULL                 },
+  { "textdump",        trs_opt_textdump,      1, 0, NULL                 },
+  { "textdumpframes",  trs_opt_textdumpframes, 1, 0, NULL                },
+  { "trace",           trs_opt_trace,         1, 0, NULL                 },
+  { "tracestart",      trs_opt_tracepc,       1, 0, &trs_trace_start     },
+  { "tracestop",       trs_opt_tracepc,       1, 0, &trs_trace_stop      },
   { "truedam",         trs_opt_value,         0, 1, &trs_disk_truedam    },
   { "turbo",           trs_opt_value,         0, 1, &timer_overclock     },
 #if defined(SDL2) || !defined(NOX)
   { "turbopaste",      trs_opt_value,         0, 1, &turbo_paste         },
   { "noturbopaste",    trs_opt_value,         0, 0, &turbo_paste         },
+#endif
+#ifdef SDL2
+  { "vsync",           trs_opt_value,         0, 1, &vsync               },
+  { "novsync",         trs_opt_value,         0, 0, &vsync               },
 #endif
   { "turborate",       trs_opt_turborate,     1, 0, NULL                 },
+  { "video",           trs_opt_video,         1, 0, NULL                 },
+  { "videorate",       trs_opt_videorate,     1, 0, NULL                 },
   { "wafer0",          trs_opt_wafer,         1, 0, NULL                 },
   { "wafer1",          trs_opt_wafer,         1, 1, NULL                 },
   { "wafer2",          trs_opt_wafer,         1, 2, NULL                 },
@@ -415,8 +524,21 @@ static const int num_options = sizeof(options) / sizeof(options[0]);
 /* Private routines */
 static void bitmap_init(int ram);
 static void bitmap_char(int char_index, int ram);
-static void bitmap_free(int char_index, int start, int end);
+static void glyph_blit(int set, int index, const SDL_Rect *srcRect,
+    SDL_Rect *dstRect);
 static void grafyx_rescale(int y, int x, Uint8 byte);
+static void grafyx_draw_row(int y, int x0, int x1, int xor);
+static void grafyx_update(int draw);
+static void raster_draw(int from, int to);
+static void raster_touch(int position);
+static void raster_update(void);
+static void trs_screen_present(SDL_Rect *rects, int count);
+#ifdef SDL2
+static void render_start(void);
+static void render_stop(void);
+static void render_resize(void);
+static void render_present(void);
+#endif
 
 static Uint8 mirror_bits(Uint8 byte)
 {
@@ -477,6 +599,20 @@ static const char *charset_name(int charset)
   }
 }
 
+static void trs_opt_audiolatency(char *arg, int intarg, int *stringarg)
+{
+  sscanf(arg, "%d,%d", &timer_audio_low, &timer_audio_high);
+  if (timer_audio_low < 0)
+    timer_audio_low = 0;
+  if (timer_audio_high < timer_audio_low)
+    timer_audio_high = timer_audio_low;
+}
+
+static void trs_opt_automation(char *arg, int intarg, int *stringarg)
+{
+  snprintf(trs_auto_source, FILENAME_MAX, "%s", arg);
+}
+
 static void trs_opt_borderwidth(char *arg, int intarg, int *stringarg)
 {
   window_border_width = atol(arg);
@@ -711,6 +847,11 @@ static void trs_opt_keystretch(char *arg, int intarg, int *stringarg)
     stretch_amount = STRETCH_AMOUNT;
 }
 
+static void trs_opt_metricsfile(char *arg, int intarg, int *stringarg)
+{
+  snprintf(trs_metrics_file, FILENAME_MAX, "%s", arg);
+}
+
 static void trs_opt_microlabs(char *arg, int intarg, int *stringarg)
 {
   grafyx_set_microlabs(intarg);
@@ -750,7 +891,7 @@ static void trs_opt_printer(char *arg, int intarg, int *stringarg)
 {
   if (isdigit((int)*arg)) {
     trs_printer = atoi(arg);
-    if (trs_printer < 0 || trs_printer > 1)
+    if (trs_printer < 0 || trs_printer > 4)
       trs_printer = 0;
   } else {
     switch (tolower((int)*arg)) {
@@ -760,12 +901,59 @@ static void trs_opt_printer(char *arg, int intarg, int *stringarg)
       case 't': /*text*/
         trs_printer = 1;
         break;
+      case 'r': /*raw*/
+        trs_printer = 2;
+        break;
+      case 'e': /*epson*/
+        trs_printer = 3;
+        break;
+      case 'd': /*dmp*/
+        trs_printer = 4;
+        break;
       default:
         error("unknown printer type: '%s'", arg);
     }
   }
 }
 
+static void trs_opt_printerspeed(char *arg, int intarg, int *stringarg)
+{
+  trs_printer_cps = atoi(arg);
+  if (trs_printer_cps < 0)
+    trs_printer_cps = 0;
+}
+
+static void trs_opt_profile(char *arg, int intarg, int *stringarg)
+{
+  snprintf(trs_profile_file, FILENAME_MAX, "%s", arg);
+}
+
+static void trs_opt_record(char *arg, int intarg, int *stringarg)
+{
+  snprintf(trs_input_record_file, FILENAME_MAX, "%s", arg);
+}
+
+static void trs_opt_replay(char *arg, int intarg, int *stringarg)
+{
+  snprintf(trs_input_replay_file, FILENAME_MAX, "%s", arg);
+}
+
+static void trs_opt_rewind(char *arg, int intarg, int *stringarg)
+{
+  trs_rewind_mb = atoi(arg);
+  if (trs_rewind_mb < 0)
+    trs_rewind_mb = 0;
+  else if (trs_rewind_mb > 4095)
+    trs_rewind_mb = 4095;
+}
+
+static void trs_opt_rewindstep(char *arg, int intarg, int *stringarg)
+{
+  trs_rewind_seconds = atoi(arg);
+  if (trs_rewind_seconds < 1)
+    trs_rewind_seconds = 5;
+}
+
 static void trs_opt_samplerate(char *arg, int intarg, int *stringarg)
 {
   cassette_default_sample_rate = atol(arg);
@@ -863,6 +1051,28 @@ static void trs_opt_switches(char *arg, int intarg, int *stringarg)
   trs_uart_switches = strtol(arg, NULL, base);
 }
 
+static void trs_opt_textdump(char *arg, int intarg, int *stringarg)
+{
+  snprintf(trs_textdump_file, FILENAME_MAX, "%s", arg);
+}
+
+static void trs_opt_textdumpframes(char *arg, int intarg, int *stringarg)
+{
+  trs_textdump_frames = atoi(arg);
+  if (trs_textdump_frames < 0)
+    trs_textdump_frames = 0;
+}
+
+static void trs_opt_trace(char *arg, int intarg, int *stringarg)
+{
+  snprintf(trs_trace_file, FILENAME_MAX, "%s", arg);
+}
+
+static void trs_opt_tracepc(char *arg, int intarg, int *address)
+{
+  *address = strtol(arg, NULL, 16) & 0xFFFF;
+}
+
 static void trs_opt_turborate(char *arg, int intarg, int *stringarg)
 {
   timer_overclock_rate = atoi(arg);
@@ -875,6 +1085,18 @@ static void trs_opt_value(char *arg, int intarg, int *variable)
   *variable = intarg;
 }
 
+static void trs_opt_video(char *arg, int intarg, int *stringarg)
+{
+  snprintf(trs_video_file, FILENAME_MAX, "%s", arg);
+}
+
+static void trs_opt_videorate(char *arg, int intarg, int *stringarg)
+{
+  trs_video_rate = atoi(arg);
+  if (trs_video_rate < 1 || trs_video_rate > 100)
+    trs_video_rate = 30;
+}
+
 static void trs_opt_wafer(char *arg, int intarg, int *stringarg)
 {
   if (arg[0])
@@ -927,6 +1149,9 @@ int trs_load_config_file(void)
   trs_cassette_remove();
 
   background = BLACK;
+  timer_audio_sync = 0;
+  timer_audio_low = 40;
+  timer_audio_high = 120;
   cassette_default_sample_rate = MAX_SAMPLE_RATE;
   /* Disk Sizes are 5" or 8" for all Eight Default Drives */
   /* Corrected by Larry Kraemer 08-01-2011 */
@@ -985,7 +1210,12 @@ int trs_load_config_file(void)
   trs_kb_bracket(FALSE);
   trs_keypad_joystick = TRUE;
   trs_model = 1;
+  trs_printer_cps = 0;
+  trs_printer_pdf = 0;
   trs_show_led = TRUE;
+#ifdef SDL2
+  vsync = 0;
+#endif
   trs_uart_switches = 0x7 | TRS_UART_NOPAR | TRS_UART_WORD8;
   window_border_width = 2;
 
@@ -1101,6 +1331,8 @@ int trs_write_config_file(const char *filename)
     return -1;
   }
 
+  fprintf(config_file, "audiolatency=%d,%d\n", timer_audio_low, timer_audio_high);
+  fprintf(config_file, "%saudiosync\n", timer_audio_sync ? "" : "no");
   fprintf(config_file, "background=0x%x\n", background);
   fprintf(config_file, "borderwidth=%d\n", window_border_width);
   fprintf(config_file, "cassdir=%s\n", trs_cass_dir);
@@ -1163,8 +1395,12 @@ int trs_write_config_file(const char *filename)
   fprintf(config_file, "%smousepointer\n", mousepointer ? "" : "no");
   fprintf(config_file, "printer=%d\n", trs_printer);
   fprintf(config_file, "printerdir=%s\n", trs_printer_dir);
+  fprintf(config_file, "%sprinterpdf\n", trs_printer_pdf ? "" : "no");
+  fprintf(config_file, "printerspeed=%d\n", trs_printer_cps);
   fprintf(config_file, "%sresize3\n", resize3 ? "" : "no");
   fprintf(config_file, "%sresize4\n", resize4 ? "" : "no");
+  fprintf(config_file, "rewind=%d\n", trs_rewind_mb);
+  fprintf(config_file, "rewindstep=%d\n", trs_rewind_seconds);
   fprintf(config_file, "romfile1=%s\n", romfile);
   fprintf(config_file, "romfile3=%s\n", romfile3);
   fprintf(config_file, "romfile4p=%s\n", romfile4p);
@@ -1209,6 +1445,9 @@ int trs_write_config_file(const char *filename)
   fprintf(config_file, "%sturbopaste\n", turbo_paste ? "" : "no");
 #endif
   fprintf(config_file, "turborate=%d\n", timer_overclock_rate);
+#ifdef SDL2
+  fprintf(config_file, "%svsync\n", vsync ? "" : "no");
+#endif
 
   for (i = 0; i < 8; i++)
     fprintf(config_file, "wafer%d=%s\n", i, stringy_get_name(i));
@@ -1232,13 +1471,14 @@ void trs_screen_reset(void)
   row_chars = 64;
   col_chars = 16;
   scale_factor = 2;
-  y_scale = scale * 2;
+  y_scale = draw_scale * 2;
 
   /* initially, screen is blank (i.e. full of spaces) */
   memset(trs_screen, ' ', SCREEN_SIZE);
   memset(char_ram, 0, 1024);
   memset(grafyx, 0, G_MSIZE);
   memset(grafyx_unscaled, 0, G_YSIZE * G_XSIZE);
+  memset(grafyx_dirty, 0, sizeof(grafyx_dirty));
   memset(hrg_screen, 0, HRG_MEMSIZE);
 }
 
@@ -1269,10 +1509,19 @@ void trs_screen_caption(void)
 
 void trs_screen_init(int resize)
 {
-  int led_height;
+  int led_height, zoom;
   int x, y;
   SDL_Color colors[2];
 
+#ifdef SDL2
+  /* With the renderer, draw at native size and scale at presentation */
+  draw_scale = (render_thread || (!render_failed && screen == NULL))
+      ? 1 : scale;
+#else
+  draw_scale = scale;
+#endif
+  zoom = scale / draw_scale;
+
   switch (trs_model) {
     case 1:
       if (eg3200) {
@@ -1293,20 +1542,20 @@ void trs_screen_init(int resize)
        trs_resize = resize4;
   }
 
-  y_scale = scale * scale_factor;
+  y_scale = draw_scale * scale_factor;
 
   if (trs_model == 1) {
     if (trs_charset < 3 && genie3s == 0)
-      cur_char_width = 6 * scale;
+      cur_char_width = 6 * draw_scale;
     else
-      cur_char_width = 8 * scale;
+      cur_char_width = 8 * draw_scale;
 
     if (genie3s)
       cur_char_height = m6845_raster * y_scale;
     else
       cur_char_height = TRS_CHAR_HEIGHT * y_scale;
   } else {
-    cur_char_width = TRS_CHAR_WIDTH * scale;
+    cur_char_width = TRS_CHAR_WIDTH * draw_scale;
 
     if (screen640x240 || text80x24)
       cur_char_height = TRS_CHAR_HEIGHT4 * y_scale;
@@ -1315,7 +1564,7 @@ void trs_screen_init(int resize)
   }
 
   border_width = fullscreen ? 0 : window_border_width;
-  led_height = trs_show_led ? (8 * scale) : 0;
+  led_height = trs_show_led ? (8 * draw_scale) : 0;
 
   if (trs_model >= 3 && !trs_resize) {
     OrigWidth = cur_char_width * 80 + 2 * border_width;
@@ -1345,16 +1594,37 @@ void trs_screen_init(int resize)
     window = SDL_CreateWindow(NULL,
                               SDL_WINDOWPOS_UNDEFINED,
                               SDL_WINDOWPOS_UNDEFINED,
-                              OrigWidth, OrigHeight,
+                              OrigWidth * zoom, OrigHeight * zoom,
                               SDL_WINDOW_SHOWN);
     if (window == NULL)
       fatal("failed to create window: %s", SDL_GetError());
   }
+  /* Draw through a renderer from the first window on: the window can't
+   * go back to its surface once a renderer was created for it. */
+  if (!render_failed && render_thread == NULL && screen == NULL) {
+    render_start();
+    if (render_thread == NULL) {
+      /* Fall back to the window surface, drawn at full scale */
+      trs_screen_init(1);
+      return;
+    }
+  }
   if (resize) {
     SDL_SetWindowFullscreen(window, fullscreen ? SDL_WINDOW_FULLSCREEN : 0);
-    SDL_SetWindowSize(window, OrigWidth, OrigHeight);
+    SDL_SetWindowSize(window, OrigWidth * zoom, OrigHeight * zoom);
   }
-  screen = SDL_GetWindowSurface(window);
+  if (render_thread) {
+    if (screen == NULL || screen->w != OrigWidth || screen->h != OrigHeight) {
+      if (screen)
+        SDL_FreeSurface(screen);
+      screen = SDL_CreateRGBSurface(SDL_SWSURFACE, OrigWidth, OrigHeight, 32,
+                                    0x00FF0000, 0x0000FF00, 0x000000FF, 0);
+      if (screen == NULL)
+        fatal("failed to create screen surface: %s", SDL_GetError());
+      render_resize();
+    }
+  } else
+    screen = SDL_GetWindowSurface(window);
   if (screen == NULL)
     fatal("failed to get window surface: %s", SDL_GetError());
 #else
@@ -1371,11 +1641,12 @@ void trs_screen_init(int resize)
   for (y = 0; y < G_YSIZE; y++)
     for (x = 0; x < G_XSIZE; x++)
       grafyx_rescale(y, x, grafyx_unscaled[y][x]);
+  memset(grafyx_dirty, 0, sizeof(grafyx_dirty));
 
   if (image)
     SDL_FreeSurface(image);
-  image = SDL_CreateRGBSurfaceFrom(grafyx, G_XSIZE * scale * 8, G_YSIZE * scale * 2,
-                                   1, G_XSIZE * scale, 1, 1, 1, 0);
+  image = SDL_CreateRGBSurfaceFrom(grafyx, G_XSIZE * draw_scale * 8, G_YSIZE * draw_scale * 2,
+                                   1, G_XSIZE * draw_scale, 1, 1, 1, 0);
 
 #if defined(big_endian) && !defined(__linux)
   colors[0].r   = (background) & 0xFF;
@@ -1412,10 +1683,67 @@ void trs_screen_init(int resize)
   trs_screen_refresh();
 }
 
+/*
+ * Position of the mouse on the screen surface.  With the renderer the
+ * window shows the surface scaled, possibly with borders.
+ */
+static Uint32 screen_mouse_state(int *x, int *y)
+{
+  Uint32 const mask = SDL_GetMouseState(x, y);
+
+#ifdef SDL2
+  if (renderer) {
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+    float logical_x, logical_y;
+
+    SDL_RenderWindowToLogical(renderer, *x, *y, &logical_x, &logical_y);
+    *x = logical_x;
+    *y = logical_y;
+#else
+    SDL_Rect view;
+    float scale_x, scale_y;
+
+    /* The viewport is in logical coordinates, offset by the borders */
+    SDL_RenderGetViewport(renderer, &view);
+    SDL_RenderGetScale(renderer, &scale_x, &scale_y);
+    *x = *x / scale_x - view.x;
+    *y = *y / scale_y - view.y;
+#endif
+  }
+#endif
+  return mask;
+}
+
+/* Move the mouse to a position on the screen surface */
+static void screen_warp_mouse(int x, int y)
+{
+#ifdef SDL2
+  if (renderer) {
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+    SDL_RenderLogicalToWindow(renderer, x, y, &x, &y);
+#else
+    SDL_Rect view;
+    float scale_x, scale_y;
+
+    SDL_RenderGetViewport(renderer, &view);
+    SDL_RenderGetScale(renderer, &scale_x, &scale_y);
+    x = (x + view.x) * scale_x;
+    y = (y + view.y) * scale_y;
+#endif
+  }
+  SDL_WarpMouseInWindow(window, x, y);
+#else
+  SDL_WarpMouse(x, y);
+#endif
+}
+
 static void addToDrawList(SDL_Rect *rect)
 {
-  if (drawnRectCount < MAX_RECTS)
+  if (drawnRectCount < MAX_RECTS) {
     drawnRects[drawnRectCount++] = *rect;
+    if (drawnRectCount == MAX_RECTS)
+      trs_metrics_overflows++;
+  }
 }
 
 #if defined(SDL2) || !defined(NOX)
@@ -1492,8 +1820,8 @@ static void MarkSelection(void)
 
     orig_x = 0;
     orig_y = 0;
-    copy_x = end_x = screen->w - scale;
-    copy_y = end_y = screen_height - scale;
+    copy_x = end_x = screen->w - draw_scale;
+    copy_y = end_y = screen_height - draw_scale;
     DrawRectangle(orig_x, orig_y, end_x, end_y);
     selectionStartX = orig_x - left_margin;
     selectionStartY = orig_y - top_margin;
@@ -1502,12 +1830,12 @@ static void MarkSelection(void)
     drawnRectCount = MAX_RECTS;
     copyStatus = COPY_DEFINED;
   } else {
-    mouse = SDL_GetMouseState(&copy_x, &copy_y);
-    if (copy_x > screen->w - scale)
-      copy_x = screen->w - scale;
+    mouse = screen_mouse_state(&copy_x, &copy_y);
+    if (copy_x > screen->w - draw_scale)
+      copy_x = screen->w - draw_scale;
 
-    if (copy_y > screen_height - scale)
-      copy_y = screen_height - scale;
+    if (copy_y > screen_height - draw_scale)
+      copy_y = screen_height - draw_scale;
 
     if ((copyStatus == COPY_IDLE) &&
         ((mouse & SDL_BUTTON(SDL_BUTTON_LEFT)) == 0))
@@ -1648,6 +1976,275 @@ static char *GetSelection(void)
 }
 #endif
 
+#ifdef SDL2
+/*
+ * The renderer and its streaming texture belong to the main thread, as
+ * SDL requires on many platforms.  The render thread only prepares the
+ * frames: it sleeps until a new snapshot of the screen is available and
+ * turns it into the pixels of the texture, with the scanlines, while the
+ * Z80 runs on.  Snapshots arriving faster than that are merged, and the
+ * main thread presents the last prepared frame once per frame.  It must
+ * never wait for the vertical retrace there, as it also runs the Z80:
+ * with -vsync it presents at most once per refresh of the display.
+ */
+static int render_loop(void *data)
+{
+  SDL_LockMutex(render_lock);
+  while (render_state == RENDER_RUN) {
+    int y;
+
+    if (!render_ready) {
+      SDL_CondWait(render_cond, render_lock);
+      continue;
+    }
+    render_ready = FALSE;
+
+    for (y = 0; y < render_height; y++) {
+      Uint32 const *src = render_frame + y * render_width;
+      Uint32 *dst = render_output + y * render_width;
+
+      /* Darken every other line of the display area */
+      if (render_shade >= 0 && y < render_scan_height && (y & 1) == 0) {
+        int x;
+
+        for (x = 0; x < render_width; x++) {
+          Uint32 const pixel = src[x];
+
+          dst[x] = ((((pixel >> 16) & 0xFF) * render_shade / 255) << 16) |
+                   ((((pixel >> 8) & 0xFF) * render_shade / 255) << 8) |
+                   ((pixel & 0xFF) * render_shade / 255);
+        }
+      } else
+        memcpy(dst, src, render_width * 4);
+    }
+    render_done = TRUE;
+  }
+  SDL_UnlockMutex(render_lock);
+  return 0;
+}
+
+static void render_start(void)
+{
+  /* Keep pixels sharp when scaling to the window size */
+  SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "0");
+  renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+  if (renderer == NULL)
+    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_SOFTWARE);
+  if (renderer == NULL) {
+    error("failed to create renderer: %s", SDL_GetError());
+    render_failed = TRUE;
+    return;
+  }
+
+  render_lock = SDL_CreateMutex();
+  render_cond = SDL_CreateCond();
+  render_state = RENDER_RUN;
+  render_ready = render_done = FALSE;
+  render_period = 0;
+  if (vsync) {
+    SDL_DisplayMode mode;
+    int rate = 60;
+
+    if (SDL_GetWindowDisplayMode(window, &mode) == 0 && mode.refresh_rate > 0)
+      rate = mode.refresh_rate;
+    render_period = SDL_GetPerformanceFrequency() / rate;
+  }
+  if (render_lock && render_cond)
+    render_thread = SDL_CreateThread(render_loop, "render", NULL);
+  if (render_thread)
+    return;
+
+  error("failed to start render thread: %s", SDL_GetError());
+  /* The window can't go back to its surface after a renderer */
+  SDL_DestroyRenderer(renderer);
+  renderer = NULL;
+  render_failed = TRUE;
+}
+
+static void render_stop(void)
+{
+  if (render_thread == NULL)
+    return;
+
+  SDL_LockMutex(render_lock);
+  render_state = RENDER_QUIT;
+  SDL_CondBroadcast(render_cond);
+  SDL_UnlockMutex(render_lock);
+  SDL_WaitThread(render_thread, NULL);
+  render_thread = NULL;
+
+  if (render_texture)
+    SDL_DestroyTexture(render_texture);
+  SDL_DestroyRenderer(renderer);
+  render_texture = NULL;
+  renderer = NULL;
+  free(render_frame);
+  free(render_output);
+  render_frame = render_output = NULL;
+}
+
+/* Size the buffers and the texture to the offscreen screen surface */
+static void render_resize(void)
+{
+  SDL_LockMutex(render_lock);
+  free(render_frame);
+  free(render_output);
+  render_width = screen->w;
+  render_height = screen->h;
+  render_frame = calloc(render_width * render_height, sizeof(Uint32));
+  render_output = calloc(render_width * render_height, sizeof(Uint32));
+  if (render_frame == NULL || render_output == NULL)
+    fatal("failed to allocate frame buffer");
+  render_ready = render_done = FALSE;
+  SDL_UnlockMutex(render_lock);
+
+  if (render_texture)
+    SDL_DestroyTexture(render_texture);
+  render_texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGB888,
+      SDL_TEXTUREACCESS_STREAMING, render_width, render_height);
+  if (render_texture == NULL)
+    fatal("failed to create texture: %s", SDL_GetError());
+  /* Scales the texture (and mouse coordinates) to the window */
+  SDL_RenderSetLogicalSize(renderer, render_width, render_height);
+}
+
+/* Show the last prepared frame, in the main thread */
+static void render_present(void)
+{
+  Uint64 const now = SDL_GetPerformanceCounter();
+  int done;
+
+  /* Keep the frame for the next flush if the display can't show it yet */
+  if (render_period && now - render_last < render_period)
+    return;
+
+  SDL_LockMutex(render_lock);
+  done = render_done;
+  if (done) {
+    SDL_UpdateTexture(render_texture, NULL, render_output, render_width * 4);
+    render_done = FALSE;
+  }
+  SDL_UnlockMutex(render_lock);
+  if (!done)
+    return;
+
+  SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+  SDL_RenderClear(renderer);
+  SDL_RenderCopy(renderer, render_texture, NULL, NULL);
+  SDL_RenderPresent(renderer);
+  render_last = now;
+}
+
+/* Copy the changed areas of the screen into the frame snapshot */
+static void render_snapshot(SDL_Rect *rects, int count)
+{
+  SDL_Rect full;
+  int i;
+
+  if (count == 0) {
+    full.x = full.y = 0;
+    full.w = screen->w;
+    full.h = screen->h;
+    rects = &full;
+    count = 1;
+  }
+
+  SDL_LockMutex(render_lock);
+  for (i = 0; i < count; i++) {
+    int const x = rects[i].x < 0 ? 0 : rects[i].x;
+    int const y = rects[i].y < 0 ? 0 : rects[i].y;
+    int w = rects[i].x + rects[i].w - x;
+    int h = rects[i].y + rects[i].h - y;
+    Uint8 *src;
+    Uint32 *dst;
+
+    if (x + w > render_width)
+      w = render_width - x;
+    if (y + h > render_height)
+      h = render_height - y;
+    if (w <= 0 || h <= 0)
+      continue;
+
+    src = (Uint8 *)screen->pixels + y * screen->pitch + x * 4;
+    dst = render_frame + y * render_width + x;
+    while (h--) {
+      memcpy(dst, src, w * 4);
+      src += screen->pitch;
+      dst += render_width;
+    }
+  }
+  render_shade = scanlines ? scanshade : -1;
+  render_scan_height = screen_height;
+  render_ready = TRUE;
+  SDL_CondSignal(render_cond);
+  SDL_UnlockMutex(render_lock);
+}
+#endif
+
+/* Show areas of the screen surface, or all of it if count is 0 */
+static void trs_screen_present(SDL_Rect *rects, int count)
+{
+#ifdef SDL2
+  if (render_thread)
+    render_snapshot(rects, count);
+  else if (count)
+    SDL_UpdateWindowSurfaceRects(window, rects, count);
+  else
+    SDL_UpdateWindowSurface(window);
+#else
+  if (count)
+    SDL_UpdateRects(screen, count, rects);
+  else
+    SDL_UpdateRect(screen, 0, 0, 0, 0);
+#endif
+}
+
+/*
+ * Draw the last sample of the metrics over the top left corner.  The
+ * emulated screen may draw over it, so it is drawn again whenever
+ * anything else was drawn.
+ */
+static void metrics_draw(void)
+{
+  static char shown[160];
+  const char *text = trs_metrics_text();
+  SDL_Rect srcRect, dstRect, rect;
+  int col, lines = 0;
+
+  if (drawnRectCount == 0 && strcmp(text, shown) == 0)
+    return;
+  snprintf(shown, sizeof(shown), "%s", text);
+  if (*text == 0)
+    return;
+
+  srcRect.x = 0;
+  srcRect.y = 0;
+  srcRect.w = cur_char_width;
+  srcRect.h = cur_char_height;
+
+  /* Lines padded with spaces over what was shown before */
+  while (*text) {
+    for (col = 0; col < METRICS_COLUMNS; col++) {
+      int ch = ' ';
+
+      if (*text && *text != '\n')
+        ch = (Uint8)*text++;
+      dstRect.x = left_margin + col * cur_char_width;
+      dstRect.y = top_margin + lines * cur_char_height;
+      glyph_blit(GLYPH_GUI_INVERSE, ch, &srcRect, &dstRect);
+    }
+    while (*text && *text++ != '\n')
+      ;
+    lines++;
+  }
+
+  rect.x = left_margin;
+  rect.y = top_margin;
+  rect.w = METRICS_COLUMNS * cur_char_width;
+  rect.h = lines * cur_char_height;
+  addToDrawList(&rect);
+}
+
 /*
  * Flush SDL output
  */
@@ -1661,21 +2258,35 @@ static void trs_screen_flush(void)
     }
   }
 #endif
+#ifdef SDL2
+  if (render_thread)
+    render_present();
+#endif
+  if (raster_mode)
+    raster_update();
+  grafyx_update(1);
+  if (trs_metrics_overlay)
+    metrics_draw();
   if (drawnRectCount == 0)
     return;
 
+#ifdef SDL2
+  /* The render thread draws scanlines at presentation */
+  if (scanlines && render_thread == NULL) {
+#else
   if (scanlines) {
+#endif
 #ifdef OLD_SCANLINES
     SDL_Rect rect;
 
     rect.x = 0;
     rect.w = OrigWidth;
-    rect.h = scale;
+    rect.h = draw_scale;
 
-    for (rect.y = 0; rect.y < screen_height; rect.y += (scale * 2))
+    for (rect.y = 0; rect.y < screen_height; rect.y += (draw_scale * 2))
       SDL_FillRect(screen, &rect, back_color);
 #else
-    int const width = screen->format->BytesPerPixel * scale * OrigWidth;
+    int const width = screen->format->BytesPerPixel * draw_scale * OrigWidth;
     int const pitch = screen->pitch;
     Uint8 *pixels   = screen->pixels;
     Uint8 *pixel;
@@ -1684,7 +2295,7 @@ static void trs_screen_flush(void)
     if (SDL_MUSTLOCK(screen))
       SDL_LockSurface(screen);
 
-    for (y = 0; y < pitch * screen_height; y += pitch * (scale * 2)) {
+    for (y = 0; y < pitch * screen_height; y += pitch * (draw_scale * 2)) {
       pixel = pixels + y;
       for (x = 0; x < width; x++)
         *pixel++ &= scanshade;
@@ -1695,16 +2306,8 @@ static void trs_screen_flush(void)
 #endif
   }
 
-  if (drawnRectCount == MAX_RECTS)
-#ifdef SDL2
-    SDL_UpdateWindowSurface(window);
-  else
-    SDL_UpdateWindowSurfaceRects(window, drawnRects, drawnRectCount);
-#else
-    SDL_UpdateRect(screen, 0, 0, 0, 0);
-  else
-    SDL_UpdateRects(screen, drawnRectCount, drawnRects);
-#endif
+  trs_screen_present(drawnRects,
+      drawnRectCount == MAX_RECTS ? 0 : drawnRectCount);
   drawnRectCount = 0;
 }
 
@@ -1732,28 +2335,45 @@ void trs_exit(int confirm)
 
 void trs_sdl_cleanup(void)
 {
-  int i, ch;
+  int i;
+
+  /* Write out pending printer output */
+  trs_printer_reset();
+
+  /* Write back mounted host directories */
+  for (i = 0; i < 8; i++)
+    trs_disk_remove(i);
 
   /* Free color map */
   TrsBlitMap(NULL, NULL);
 
-  for (ch = 0; ch < MAX_CHARS; ch++)
-    bitmap_free(ch, 0, 5);
-
-  for (i = 0; i < 3; i++) {
-    for (ch = 0; ch < 64; ch++)
-      SDL_FreeSurface(trs_box[i][ch]);
-  }
+  SDL_FreeSurface(glyph_atlas);
+  glyph_atlas = NULL;
 
   SDL_FreeSurface(image);
   /* Will free screen */
 #ifdef SDL2
+  render_stop();
   SDL_FreeSurface(screen);
   SDL_DestroyWindow(window);
 #endif
   SDL_Quit();
 }
 
+/* Change the window size after a change of scale */
+static void trs_screen_scale(void)
+{
+#ifdef SDL2
+  /* Drawn at native size by the renderer: nothing to rebuild */
+  if (render_thread) {
+    SDL_SetWindowFullscreen(window, 0);
+    SDL_SetWindowSize(window, OrigWidth * scale, OrigHeight * scale);
+    return;
+  }
+#endif
+  trs_screen_init(1);
+}
+
 static void trs_flip_fullscreen(void)
 {
   fullscreen = !fullscreen;
@@ -1766,6 +2386,27 @@ static void trs_flip_fullscreen(void)
   trs_screen_init(1);
 }
 
+/* Speed up the emulation while pasting, logged as it changes the timing */
+int trs_paste_speed(int on)
+{
+  if (trs_input_record(INPUT_PASTE, on))
+    return -1;
+
+  if (on) {
+    if (turbo_paste) {
+      timer_saved = timer_overclock;
+      trs_timer_mode(1);
+    }
+    cycles_saved = cycles_per_timer;
+    cycles_per_timer *= 4;
+  } else {
+    if (turbo_paste)
+      trs_timer_mode(timer_saved);
+    cycles_per_timer = cycles_saved;
+  }
+  return 0;
+}
+
 /*
  * Get and process SDL event(s).
  *   If wait is true, process one event, blocking until one is available.
@@ -1787,6 +2428,8 @@ void trs_get_event(int wait)
   if (trs_model > 1)
     (void)trs_uart_check_avail();
 
+  trs_printer_idle();
+
   trs_screen_flush();
 
   if (cpu_panel)
@@ -1828,9 +2471,7 @@ void trs_get_event(int wait)
       case PASTE_KEYUP:
         if (paste_lastkey) {
           paste_state = PASTE_IDLE;
-          if (turbo_paste)
-            trs_timer_mode(timer_saved);
-          cycles_per_timer = cycles_saved;
+          trs_paste_speed(0);
         }
         else
           paste_state = PASTE_GETNEXT;
@@ -1854,11 +2495,12 @@ void trs_get_event(int wait)
 #ifdef SDL2
       case SDL_WINDOWEVENT:
         SDL_FlushEvent(SDL_KEYDOWN);
-        SDL_UpdateWindowSurface(window);
+        trs_screen_update();
 #if SDLDEBUG
         debug("Active\n");
 #endif
-        if (event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
+        if (event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED &&
+            render_thread == NULL) {
           if ((screen = SDL_GetWindowSurface(window)) == NULL)
             fatal("failed to get window surface: %s", SDL_GetError());
           trs_screen_refresh();
@@ -1913,7 +2555,12 @@ void trs_get_event(int wait)
             }
             continue;
           case SDLK_F10:
-            trs_reset(SDL_GetModState() & KMOD_SHIFT);
+            if (SDL_GetModState() & KMOD_SHIFT) {
+              /* Power on records itself, and comes from the replay */
+              if (!trs_input_replaying)
+                trs_reset(1);
+            } else if (trs_input_record(INPUT_RESET, 0) == 0)
+              trs_reset(0);
             continue;
           case SDLK_F11:
             if (SDL_GetModState() & KMOD_SHIFT)
@@ -1957,22 +2604,22 @@ void trs_get_event(int wait)
               copyStatus = COPY_IDLE;
               break;
             case SDLK_v:
-              if (turbo_paste) {
-                timer_saved = timer_overclock;
-                trs_timer_mode(1);
+              if (trs_paste_speed(1) == 0) {
+                PasteManagerStartPaste();
+                paste_state = PASTE_GETNEXT;
               }
-              cycles_saved = cycles_per_timer;
-              cycles_per_timer *= 4;
-              PasteManagerStartPaste();
-              paste_state = PASTE_GETNEXT;
               break;
             case SDLK_a:
               selectAll = mousepointer = TRUE;
               SDL_ShowCursor(SDL_ENABLE);
               break;
 #endif
+            case SDLK_BACKSPACE:
+              trs_rewind_back(trs_rewind_seconds);
+              break;
             case SDLK_DELETE:
-              trs_reset(0);
+              if (trs_input_record(INPUT_RESET, 0) == 0)
+                trs_reset(0);
               break;
             case SDLK_INSERT:
               call_function(KEYBRD);
@@ -1983,20 +2630,20 @@ void trs_get_event(int wait)
             case SDLK_HOME:
               fullscreen = 0;
               scale = 1;
-              trs_screen_init(1);
+              trs_screen_scale();
               break;
             case SDLK_PAGEDOWN:
               if (scale < MAX_SCALE) {
                 scale++;
                 fullscreen = 0;
-                trs_screen_init(1);
+                trs_screen_scale();
               }
               break;
             case SDLK_PAGEUP:
               if (scale > 1) {
                 scale--;
                 fullscreen = 0;
-                trs_screen_init(1);
+                trs_screen_scale();
               }
               break;
             case SDLK_MINUS:
@@ -2430,6 +3077,12 @@ done:
 void trs_screen_expanded(int flag)
 {
   if ((currentmode ^ (flag ? EXPANDED : 0)) & EXPANDED) {
+    if (raster_mode) {
+      raster_update();
+      currentmode ^= EXPANDED;
+      memset(raster_dirty, 1, sizeof(raster_dirty));
+      return;
+    }
     currentmode ^= EXPANDED;
     trs_screen_refresh();
   }
@@ -2440,6 +3093,8 @@ void trs_screen_inverse(int flag)
   int i;
 
   if ((currentmode ^ (flag ? INVERSE : 0)) & INVERSE) {
+    if (raster_mode)
+      raster_update();
     currentmode ^= INVERSE;
     for (i = 0; i < screen_chars; i++) {
       if (trs_screen[i] & 0x80)
@@ -2453,6 +3108,8 @@ void trs_screen_alternate(int flag)
   int i;
 
   if ((currentmode ^ (flag ? ALTERNATE : 0)) & ALTERNATE) {
+    if (raster_mode)
+      raster_update();
     currentmode ^= ALTERNATE;
     for (i = 0; i < screen_chars; i++) {
       if (trs_screen[i] >= 0xc0)
@@ -2499,11 +3156,88 @@ void trs_screen_80x24(int flag)
     trs_screen_640x240(flag);
 }
 
+/*
+ * All glyphs are drawn into one atlas: each set of normal and inverse,
+ * expanded, GUI and block graphics glyphs is packed in rows of cells,
+ * so a glyph is blitted from its cell.  The atlas is only reallocated
+ * when the size of the cells changes, and a glyph of the programmable
+ * character generator is redrawn in its cell when it is changed.
+ */
+static int glyph_expanded(int set)
+{
+  return set == GLYPH_EXPANDED || set == GLYPH_EXP_INVERSE ||
+         set == GLYPH_BOX_EXPANDED;
+}
+
+static void glyph_cell(int set, int index, SDL_Rect *rect)
+{
+  int const columns = glyph_expanded(set) ? GLYPH_COLUMNS / 2 : GLYPH_COLUMNS;
+
+  rect->w = glyph_expanded(set) ? glyph_width * 2 : glyph_width;
+  rect->h = glyph_height;
+  rect->x = (index % columns) * rect->w;
+  rect->y = glyph_top[set] + (index / columns) * glyph_height;
+}
+
+static void glyph_atlas_init(void)
+{
+  int const width = TRS_CHAR_WIDTH * draw_scale;
+  int const height = cur_char_height > MAX_CHAR_HEIGHT * y_scale ?
+      cur_char_height : MAX_CHAR_HEIGHT * y_scale;
+  int rows = 0;
+  int set;
+
+  if (glyph_atlas && width == glyph_width && height == glyph_height)
+    return;
+
+  for (set = 0; set < GLYPH_SETS; set++) {
+    int const glyphs = set < GLYPH_BOX ? MAX_CHARS : 64;
+
+    glyph_top[set] = rows * height;
+    rows += glyphs / (glyph_expanded(set) ? GLYPH_COLUMNS / 2 : GLYPH_COLUMNS);
+  }
+
+  if (glyph_atlas)
+    SDL_FreeSurface(glyph_atlas);
+
+  glyph_atlas = SDL_CreateRGBSurface(SDL_SWSURFACE,
+      GLYPH_COLUMNS * width, rows * height, 32,
+#if defined(big_endian) && !defined(__linux)
+      0x000000ff, 0x0000ff00, 0x00ff0000, 0);
+#else
+      0x00ff0000, 0x0000ff00, 0x000000ff, 0);
+#endif
+  if (glyph_atlas == NULL)
+    fatal("failed to create glyph atlas: %s", SDL_GetError());
+
+  glyph_width = width;
+  glyph_height = height;
+}
+
+static void glyph_blit(int set, int index, const SDL_Rect *srcRect,
+    SDL_Rect *dstRect)
+{
+  SDL_Rect cell, rect = *srcRect;
+
+  glyph_cell(set, index, &cell);
+
+  /* Never beyond the cell into the next glyph */
+  if (rect.w > cell.w - rect.x)
+    rect.w = cell.w - rect.x;
+  if (rect.h > cell.h - rect.y)
+    rect.h = cell.h - rect.y;
+
+  rect.x += cell.x;
+  rect.y += cell.y;
+  SDL_BlitSurface(glyph_atlas, &rect, screen, dstRect);
+  trs_metrics_blits++;
+}
+
 static void
-boxes_init(int fg_color, int bg_color, int width, int height, int expanded)
+boxes_init(int fg_color, int bg_color, int width, int height, int set)
 {
   int graphics_char, bit;
-  SDL_Rect fullrect;
+  SDL_Rect cell, fullrect, rect;
   SDL_Rect bits[6];
 
   /*
@@ -2520,80 +3254,60 @@ boxes_init(int fg_color, int bg_color, int width, int height, int expanded)
   bits[2].h = bits[3].h = bits[4].y - bits[2].y;
   bits[4].h = bits[5].h = height - bits[4].y;
 
-  fullrect.x = 0;
-  fullrect.y = 0;
-  fullrect.h = height;
-  fullrect.w = width;
-
   for (graphics_char = 0; graphics_char < 64; ++graphics_char) {
-    if (trs_box[expanded][graphics_char])
-      SDL_FreeSurface(trs_box[expanded][graphics_char]);
-
-    trs_box[expanded][graphics_char] =
-      SDL_CreateRGBSurface(SDL_SWSURFACE, width, height, 32,
-#if defined(big_endian) && !defined(__linux)
-          0x000000ff, 0x0000ff00, 0x00ff0000, 0);
-#else
-          0x00ff0000, 0x0000ff00, 0x000000ff, 0);
-#endif
+    glyph_cell(set, graphics_char, &cell);
 
     /* Clear everything */
-    SDL_FillRect(trs_box[expanded][graphics_char], &fullrect, bg_color);
+    fullrect.x = cell.x;
+    fullrect.y = cell.y;
+    fullrect.w = width;
+    fullrect.h = height;
+    SDL_FillRect(glyph_atlas, &fullrect, bg_color);
 
     for (bit = 0; bit < 6; ++bit) {
-      if (graphics_char & (1 << bit))
-        SDL_FillRect(trs_box[expanded][graphics_char], &bits[bit], fg_color);
+      if (graphics_char & (1 << bit)) {
+        rect = bits[bit];
+        rect.x += cell.x;
+        rect.y += cell.y;
+        SDL_FillRect(glyph_atlas, &rect, fg_color);
+      }
     }
   }
 }
 
-static SDL_Surface *CreateSurfaceFromDataScale(const Uint8 *data,
-    int fg_color, int bg_color, int scale_x, int ram)
+/* Character generator bitmap, bit 0 is the leftmost pixel */
+const Uint8 *trs_char_bitmap(int charset, int char_index)
 {
-  Uint8 *mypixels, *currpixel;
-  int *mydata, *currdata;
-  int i, j, w;
-  int const size = TRS_CHAR_WIDTH * (ram ? MAX_CHAR_HEIGHT : TRS_CHAR_HEIGHT);
+  return trs_char_data[charset][char_index & 0xFF];
+}
 
-  /*
-   * The memory allocated for "mydata" will be released in the
-   * "bitmap_free" function.
-   */
-  mydata = (int*)calloc(1, TRS_CHAR_WIDTH * MAX_CHAR_HEIGHT *
-      scale_x * y_scale * sizeof(int));
-  mypixels = (Uint8 *)calloc(1, TRS_CHAR_WIDTH * MAX_CHAR_HEIGHT * 8);
-  if (mydata == NULL || mypixels == NULL)
-    fatal("CreateSurfaceFromDataScale: failed to allocate memory");
-
-  /* Read the character data */
-  for (j = 0; j < size; j += 8)
-    for (i = j + 7; i >= j; i--)
-      *(mypixels + i) = (*(data + (j >> 3)) >> (i - j)) & 1;
-
-  currdata = mydata;
-  /* And prepare our rescaled character. */
-  for (j = 0; j < MAX_CHAR_HEIGHT * y_scale; j++) {
-    currpixel = mypixels + ((j / y_scale) * TRS_CHAR_WIDTH);
-    for (w = 0; w < TRS_CHAR_WIDTH; w++) {
-      if (*currpixel++ == 0) {
-        for (i = 0; i < scale_x; i++)
-          *currdata++ = bg_color;
-      } else {
-        for (i = 0; i < scale_x; i++)
-          *currdata++ = fg_color;
-      }
-    }
-  }
+/* Draw a character into its cell, scaled, bit 0 is the leftmost pixel */
+static void glyph_draw(int set, int char_index, const Uint8 *data,
+    int fg_color, int bg_color, int ram)
+{
+  int const lines = ram ? MAX_CHAR_HEIGHT : TRS_CHAR_HEIGHT;
+  SDL_Rect cell;
+  int scale_x;
+  int x, y;
 
-  free(mypixels);
+  glyph_cell(set, char_index, &cell);
+  scale_x = cell.w / TRS_CHAR_WIDTH;
 
-  return SDL_CreateRGBSurfaceFrom(mydata, TRS_CHAR_WIDTH * scale_x,
-         MAX_CHAR_HEIGHT * y_scale, 32, TRS_CHAR_WIDTH * scale_x * 4,
-#if defined(big_endian) && !defined(__linux)
-         0x000000ff, 0x0000ff00, 0x00ff0000, 0);
-#else
-         0x00ff0000, 0x0000ff00, 0x000000ff, 0);
-#endif
+  if (SDL_MUSTLOCK(glyph_atlas))
+    SDL_LockSurface(glyph_atlas);
+
+  for (y = 0; y < cell.h; y++) {
+    Uint32 *pixel = (Uint32 *)((Uint8 *)glyph_atlas->pixels +
+        (cell.y + y) * glyph_atlas->pitch) + cell.x;
+    int const line = y / y_scale;
+    int const bits = line < lines ? data[line] : 0;
+
+    for (x = 0; x < cell.w; x++)
+      *pixel++ = (bits >> (x / scale_x)) & 1 ? fg_color : bg_color;
+  }
+
+  if (SDL_MUSTLOCK(glyph_atlas))
+    SDL_UnlockSurface(glyph_atlas);
 }
 
 static void
@@ -2603,16 +3317,17 @@ bitmap_init(int ram)
   int height;
   int i;
 
+  glyph_atlas_init();
+
   for (i = 0; i < MAX_CHARS; i++) {
     /* Create also bitmap chars 192-255 for Genie III EG 3210 PGA Card */
     bitmap_char(i, (i > 191 && eg3200) ? 1 : ram);
 
     /* GUI Normal + Inverse */
-    bitmap_free(i, 4, 5);
-    trs_char[4][i] = CreateSurfaceFromDataScale(
-        trs_char_data[gui][i], gui_foreground, gui_background, scale, 0);
-    trs_char[5][i] = CreateSurfaceFromDataScale(
-        trs_char_data[gui][i], gui_background, gui_foreground, scale, 0);
+    glyph_draw(GLYPH_GUI, i, trs_char_data[gui][i],
+        gui_foreground, gui_background, 0);
+    glyph_draw(GLYPH_GUI_INVERSE, i, trs_char_data[gui][i],
+        gui_background, gui_foreground, 0);
   }
 
   /* Adjust block graphics for CP-500/M80 80x24 video mode */
@@ -2621,9 +3336,11 @@ bitmap_init(int ram)
   else
     height = cur_char_height;
 
-  boxes_init(foreground, background, cur_char_width, height, 0);
-  boxes_init(foreground, background, cur_char_width * 2, height, 1);
-  boxes_init(gui_foreground, gui_background, cur_char_width, cur_char_height, 2);
+  boxes_init(foreground, background, cur_char_width, height, GLYPH_BOX);
+  boxes_init(foreground, background, cur_char_width * 2, height,
+      GLYPH_BOX_EXPANDED);
+  boxes_init(gui_foreground, gui_background, cur_char_width, cur_char_height,
+      GLYPH_BOX_GUI);
 }
 
 static void
@@ -2632,34 +3349,14 @@ bitmap_char(int char_index, int ram)
   Uint8 const *char_data = ram ?
       char_ram[char_index] : trs_char_data[trs_charset][char_index];
 
-  bitmap_free(char_index, 0, 3);
-
-  /* Normal */
-  trs_char[0][char_index] = CreateSurfaceFromDataScale(
-      char_data, foreground, background, scale, ram);
-  /* Expanded */
-  trs_char[1][char_index] = CreateSurfaceFromDataScale(
-      char_data, foreground, background, scale * 2, ram);
-  /* Inverse */
-  trs_char[2][char_index] = CreateSurfaceFromDataScale(
-      char_data, background, foreground, scale, ram);
-  /* Expanded + Inverse */
-  trs_char[3][char_index] = CreateSurfaceFromDataScale(
-      char_data, background, foreground, scale * 2, ram);
-}
-
-static void
-bitmap_free(int char_index, int start, int end)
-{
-  int i;
-
-  /* Free all surface pixels */
-  for (i = start; i <= end; i++) {
-    if (trs_char[i][char_index]) {
-      free(trs_char[i][char_index]->pixels);
-      SDL_FreeSurface(trs_char[i][char_index]);
-    }
-  }
+  glyph_draw(GLYPH_NORMAL, char_index, char_data,
+      foreground, background, ram);
+  glyph_draw(GLYPH_EXPANDED, char_index, char_data,
+      foreground, background, ram);
+  glyph_draw(GLYPH_INVERSE, char_index, char_data,
+      background, foreground, ram);
+  glyph_draw(GLYPH_EXP_INVERSE, char_index, char_data,
+      background, foreground, ram);
 }
 
 
@@ -2668,13 +3365,15 @@ void trs_screen_refresh(void)
 #if SDLDEBUG
   debug("trs_screen_refresh\n");
 #endif
+  /* Everything is redrawn from the current graphics */
+  grafyx_update(0);
   SDL_FillRect(screen, NULL, back_color);
 
   if (grafyx_enable && !grafyx_overlay) {
     int const srcx   = cur_char_width * grafyx_xoffset;
-    int const srcy   = (scale * 2) * grafyx_yoffset;
-    int const dunx   = (G_XSIZE * scale * 8) - srcx;
-    int const duny   = (G_YSIZE * scale * 2) - srcy;
+    int const srcy   = (draw_scale * 2) * grafyx_yoffset;
+    int const dunx   = (G_XSIZE * draw_scale * 8) - srcx;
+    int const duny   = (G_YSIZE * draw_scale * 2) - srcy;
     int const height = cur_char_height * col_chars;
     int const width  = cur_char_width  * row_chars;
     SDL_Rect srcRect, dstRect;
@@ -2723,17 +3422,13 @@ void trs_screen_refresh(void)
 
     for (i = 0; i < screen_chars; i++)
       trs_screen_write_char(i, trs_screen[i]);
+    if (raster_mode)
+      raster_draw(0, col_chars * cur_char_height / y_scale);
 
-    /* Redraw HRG screen */
+    /* Draw HRG extension region right of the text */
     if (hrg_enable == 2) {
-      memset(grafyx_unscaled, 0, G_YSIZE * G_XSIZE);
-
-      grafyx_overlay = 0;
-      for (i = 0; i <= 0x3FFF; i++) {
-        hrg_write_addr(i, 0x3FFF);
-        hrg_write_data(hrg_screen[i]);
-      }
-      grafyx_overlay = 1;
+      for (i = 0; i < 192; i++)
+        grafyx_draw_row(i, 64, 79, 0);
     }
   }
 
@@ -2759,8 +3454,8 @@ void trs_disk_led(int drive, int on_off)
   int i;
   SDL_Rect rect;
 
-  rect.w = 16 * scale;
-  rect.h = 4 * scale;
+  rect.w = 16 * draw_scale;
+  rect.h = 4 * draw_scale;
   rect.y = OrigHeight - rect.h;
 
   if (drive == -1) {
@@ -2768,14 +3463,14 @@ void trs_disk_led(int drive, int on_off)
       if (on_off == -1)
         countdown[i] = 0;
 
-      rect.x = border_width + 24 * scale * i;
+      rect.x = border_width + 24 * draw_scale * i;
       SDL_FillRect(screen, &rect, countdown[i] ? bright_red : light_red);
       addToDrawList(&rect);
     }
   }
   else if (on_off) {
     if (countdown[drive] == 0) {
-      rect.x = border_width + 24 * scale * drive;
+      rect.x = border_width + 24 * draw_scale * drive;
       SDL_FillRect(screen, &rect, bright_red);
       addToDrawList(&rect);
     }
@@ -2786,7 +3481,7 @@ void trs_disk_led(int drive, int on_off)
       if (countdown[i]) {
         countdown[i]--;
         if (countdown[i] == 0) {
-          rect.x = border_width + 24 * scale * i;
+          rect.x = border_width + 24 * draw_scale * i;
           SDL_FillRect(screen, &rect, light_red);
           addToDrawList(&rect);
         }
@@ -2798,12 +3493,12 @@ void trs_disk_led(int drive, int on_off)
 void trs_hard_led(int drive, int on_off)
 {
   static int countdown[4];
-  int const drive0_led_x = OrigWidth - border_width - 88 * scale;
+  int const drive0_led_x = OrigWidth - border_width - 88 * draw_scale;
   int i;
   SDL_Rect rect;
 
-  rect.w = 16 * scale;
-  rect.h = 4 * scale;
+  rect.w = 16 * draw_scale;
+  rect.h = 4 * draw_scale;
   rect.y = OrigHeight - rect.h;
 
   if (drive == -1) {
@@ -2811,14 +3506,14 @@ void trs_hard_led(int drive, int on_off)
       if (on_off == -1)
         countdown[i] = 0;
 
-      rect.x = drive0_led_x + 24 * scale * i;
+      rect.x = drive0_led_x + 24 * draw_scale * i;
       SDL_FillRect(screen, &rect, countdown[i] ? bright_red : light_red);
       addToDrawList(&rect);
     }
   }
   else if (on_off) {
     if (countdown[drive] == 0) {
-      rect.x = drive0_led_x + 24 * scale * drive;
+      rect.x = drive0_led_x + 24 * draw_scale * drive;
       SDL_FillRect(screen, &rect, bright_red);
       addToDrawList(&rect);
     }
@@ -2829,7 +3524,7 @@ void trs_hard_led(int drive, int on_off)
       if (countdown[i]) {
         countdown[i]--;
         if (countdown[i] == 0) {
-          rect.x = drive0_led_x + 24 * scale * i;
+          rect.x = drive0_led_x + 24 * draw_scale * i;
           SDL_FillRect(screen, &rect, light_red);
           addToDrawList(&rect);
         }
@@ -2842,24 +3537,61 @@ void trs_turbo_led(void)
 {
   SDL_Rect rect;
 
-  rect.w = 16 * scale;
-  rect.h = 4 * scale;
-  rect.x = (OrigWidth - border_width) / 2 - 8 * scale;
+  rect.w = 16 * draw_scale;
+  rect.h = 4 * draw_scale;
+  rect.x = (OrigWidth - border_width) / 2 - 8 * draw_scale;
   rect.y = OrigHeight - rect.h;
 
   SDL_FillRect(screen, &rect, timer_overclock ? bright_orange : light_orange);
   addToDrawList(&rect);
 }
 
+/* Glyph set and index of a character as it is shown in the current mode */
+static int screen_glyph(int char_index, int expanded, int *set)
+{
+  if (genie3s) {
+    *set = expanded;
+    return char_index;
+  }
+  if (trs_model == 1 && (trs_clones.model & (CT80 | EG3200)) == 0) {
+    /* On Model I, 0xc0-0xff is another copy of 0x80-0xbf */
+    if (char_index >= 0xc0)
+      char_index -= 0x40;
+  }
+  if (!(currentmode & INVERSE) && char_index >= 0x80 && char_index <= 0xbf) {
+    /* Use box graphics character bitmap */
+    *set = GLYPH_BOX + expanded;
+    return char_index - 0x80;
+  }
+  /* Use regular character bitmap */
+  if (trs_model > 1) {
+    if ((currentmode & (ALTERNATE + INVERSE)) == 0 && char_index >= 0xc0)
+      char_index -= 0x40;
+  }
+  if ((currentmode & INVERSE) && (char_index & 0x80)) {
+    expanded += GLYPH_INVERSE;
+    char_index &= 0x7f;
+  }
+  *set = expanded;
+  return char_index;
+}
+
 void trs_screen_write_char(int position, Uint8 char_index)
 {
   unsigned int row, col;
-  int expanded;
+  int expanded, set, index;
   SDL_Rect srcRect, dstRect;
 
   if (position >= screen_chars)
     return;
 
+  if (raster_mode) {
+    raster_update();
+    trs_screen[position] = char_index;
+    raster_touch(position);
+    return;
+  }
+
   trs_screen[position] = char_index;
   if ((currentmode & EXPANDED) && (position & 1))
     return;
@@ -2883,30 +3615,8 @@ void trs_screen_write_char(int position, Uint8 char_index)
   dstRect.x = col * cur_char_width + left_margin;
   dstRect.y = row * cur_char_height + top_margin;
 
-  if (genie3s) {
-    SDL_BlitSurface(trs_char[expanded][char_index], &srcRect, screen, &dstRect);
-  } else {
-    if (trs_model == 1 && (trs_clones.model & (CT80 | EG3200)) == 0) {
-      /* On Model I, 0xc0-0xff is another copy of 0x80-0xbf */
-      if (char_index >= 0xc0)
-        char_index -= 0x40;
-    }
-    if (!(currentmode & INVERSE) && char_index >= 0x80 && char_index <= 0xbf) {
-      /* Use box graphics character bitmap */
-      SDL_BlitSurface(trs_box[expanded][char_index - 0x80], &srcRect, screen, &dstRect);
-    } else {
-      /* Use regular character bitmap */
-      if (trs_model > 1) {
-        if ((currentmode & (ALTERNATE + INVERSE)) == 0 && char_index >= 0xc0)
-          char_index -= 0x40;
-      }
-      if ((currentmode & INVERSE) && (char_index & 0x80)) {
-        expanded += 2;
-        char_index &= 0x7f;
-      }
-      SDL_BlitSurface(trs_char[expanded][char_index], &srcRect, screen, &dstRect);
-    }
-  }
+  index = screen_glyph(char_index, expanded, &set);
+  glyph_blit(set, index, &srcRect, &dstRect);
   addToDrawList(&dstRect);
 
   /* Overlay grafyx on character */
@@ -2932,13 +3642,128 @@ void trs_screen_write_char(int position, Uint8 char_index)
   }
 }
 
+/* Draw one line of text, in the screen as it is now */
+static void raster_draw_line(int y)
+{
+  int const lines = cur_char_height / y_scale;
+  int const row = y / lines;
+  int const line = y - row * lines;
+  int const expanded = (currentmode & EXPANDED) != 0;
+  SDL_Rect srcRect, dstRect;
+  int col;
+
+  for (col = 0; col < row_chars; col += expanded + 1) {
+    int const position = row * row_chars + col;
+    int set, index;
+
+    if (position == cursor_position && cursor_visible &&
+        line >= cursor_start && line <= cursor_end) {
+      index = trs_screen[position];
+      set = ((currentmode & INVERSE) && (index & 0x80) ? 0 : GLYPH_INVERSE)
+          + expanded;
+    } else {
+      index = screen_glyph(trs_screen[position], expanded, &set);
+    }
+
+    srcRect.x = 0;
+    srcRect.y = line * y_scale;
+    srcRect.w = expanded ? cur_char_width * 2 : cur_char_width;
+    srcRect.h = y_scale;
+    dstRect.x = col * cur_char_width + left_margin;
+    dstRect.y = row * cur_char_height + top_margin + srcRect.y;
+    glyph_blit(set, index, &srcRect, &dstRect);
+
+    /* Overlay grafyx on the line */
+    if (grafyx_enable) {
+      srcRect.x = ((col + grafyx_xoffset) % G_XSIZE) * cur_char_width;
+      srcRect.y = (row * cur_char_height + line * y_scale +
+          grafyx_yoffset * y_scale) % (G_YSIZE * y_scale);
+      dstRect.x = col * cur_char_width + left_margin;
+      dstRect.y = row * cur_char_height + top_margin + line * y_scale;
+      TrsSoftBlit(image, &srcRect, screen, &dstRect, 1);
+    }
+  }
+}
+
+/* Draw the dirty lines from line "from" up to "to" */
+static void raster_draw(int from, int to)
+{
+  SDL_Rect rect;
+  int y, run = -1;
+
+  if (grafyx_enable && !grafyx_overlay)
+    return;
+  if (to > RASTER_LINES)
+    to = RASTER_LINES;
+
+  for (y = from; y <= to; y++) {
+    if (y < to && raster_dirty[y]) {
+      raster_draw_line(y);
+      raster_dirty[y] = 0;
+      if (run < 0)
+        run = y;
+    } else if (run >= 0) {
+      rect.x = left_margin;
+      rect.y = top_margin + run * y_scale;
+      rect.w = row_chars * cur_char_width;
+      rect.h = (y - run) * y_scale;
+      addToDrawList(&rect);
+      run = -1;
+    }
+  }
+}
+
+/* Mark the lines of the character at position as dirty */
+static void raster_touch(int position)
+{
+  int const lines = cur_char_height / y_scale;
+  int y;
+
+  if (position < 0 || position >= screen_chars)
+    return;
+
+  y = position / row_chars * lines;
+  if (y + lines <= RASTER_LINES)
+    memset(raster_dirty + y, 1, lines);
+}
+
+/* Draw the lines the beam has passed since the last change */
+static void raster_update(void)
+{
+  tstate_t const now = z80_state.t_count;
+  tstate_t frame = z80_state.clockMHz * 1000000.0 / RASTER_HZ;
+  int const visible = col_chars * cur_char_height / y_scale;
+  int const total = visible > RASTER_TOTAL ? visible : RASTER_TOTAL;
+  int beam;
+
+  if (frame == 0)
+    frame = 1;
+
+  /* Loaded a state or rewound */
+  if (now < raster_start) {
+    raster_start = now;
+    raster_line = 0;
+  }
+
+  /* The rest of the frame, the lines after are of the next ones */
+  if (now - raster_start >= frame) {
+    raster_draw(raster_line, visible);
+    raster_start += (now - raster_start) / frame * frame;
+    raster_line = 0;
+  }
+
+  beam = (now - raster_start) * total / frame;
+  if (beam > visible)
+    beam = visible;
+  if (beam > raster_line) {
+    raster_draw(raster_line, beam);
+    raster_line = beam;
+  }
+}
+
 void trs_screen_update(void)
 {
-#ifdef SDL2
-  SDL_UpdateWindowSurface(window);
-#else
-  SDL_UpdateRect(screen, 0, 0, 0, 0);
-#endif
+  trs_screen_present(NULL, 0);
 }
 
 void trs_gui_clear_rect(int x, int y, int w, int h)
@@ -2991,55 +3816,105 @@ void trs_gui_write_char(int col, int row, Uint8 char_index, int invert)
 
   if (char_index >= 0x80 && char_index <= 0xbf)
     /* Use graphics character bitmap instead of font */
-    SDL_BlitSurface(trs_box[2][char_index - 0x80], &srcRect, screen, &dstRect);
+    glyph_blit(GLYPH_BOX_GUI, char_index - 0x80, &srcRect, &dstRect);
   else
     /* Draw character using a builtin bitmap */
-    SDL_BlitSurface(trs_char[invert ? 5 : 4][char_index], &srcRect, screen, &dstRect);
+    glyph_blit(invert ? GLYPH_GUI_INVERSE : GLYPH_GUI, char_index, &srcRect,
+        &dstRect);
 }
 
+/*
+ * Writes only change the unscaled graphics memory and mark the row as
+ * dirty.  Once per frame grafyx_update() expands the dirty rows into the
+ * scaled image and blits each of them to the screen at once, so the
+ * scaled image always holds what is on the screen until then.
+ */
 static void grafyx_write_byte(int x, int y, Uint8 byte)
 {
-  if (grafyx_unscaled[y][x] == byte) {
+  Uint32 const bit = 1U << (y % 32);
+
+  if (grafyx_unscaled[y][x] == byte)
     return;
+
+  grafyx_unscaled[y][x] = byte;
+  if (grafyx_dirty[y / 32] & bit) {
+    if (x < grafyx_dirty_x0[y])
+      grafyx_dirty_x0[y] = x;
+    else if (x > grafyx_dirty_x1[y])
+      grafyx_dirty_x1[y] = x;
   } else {
-    int const screen_x = ((x - grafyx_xoffset + G_XSIZE) % G_XSIZE);
-    int const screen_y = ((y - grafyx_yoffset + G_YSIZE) % G_YSIZE);
-    int const on_screen = (screen_x < row_chars && screen_y < col_chars
-        * cur_char_height / y_scale) || (hrg_enable == 2 && y < 192);
-    SDL_Rect srcRect, dstRect;
+    grafyx_dirty[y / 32] |= bit;
+    grafyx_dirty_x0[y] = grafyx_dirty_x1[y] = x;
+  }
+}
 
-    if (grafyx_enable && grafyx_overlay && on_screen) {
-      /* Erase old byte, preserving text */
-      srcRect.x = x * cur_char_width;
+/* Blit the bytes x0 to x1 of row y which are on the screen */
+static void grafyx_draw_row(int y, int x0, int x1, int xor)
+{
+  int const screen_y = (y - grafyx_yoffset + G_YSIZE) % G_YSIZE;
+  int const text_row = screen_y < col_chars * cur_char_height / y_scale;
+  int const hrg_row = hrg_enable == 2 && y < 192;
+  int start = -1, last = 0;
+  int x;
+
+  for (x = x0; x <= x1 + 1; x++) {
+    int const screen_x = (x - grafyx_xoffset + G_XSIZE) % G_XSIZE;
+    int const on_screen = x <= x1 &&
+        ((screen_x < row_chars && text_row) || hrg_row);
+
+    /* One blit for each run of bytes side by side on the screen */
+    if (start >= 0 && (!on_screen || screen_x != last + 1)) {
+      SDL_Rect srcRect, dstRect;
+
+      srcRect.x = start * cur_char_width;
       srcRect.y = y * y_scale;
-      srcRect.w = cur_char_width;
+      srcRect.w = (x - start) * cur_char_width;
       srcRect.h = y_scale;
-      dstRect.x = left_margin + screen_x * cur_char_width;
+      dstRect.x = left_margin + ((start - grafyx_xoffset + G_XSIZE) % G_XSIZE)
+          * cur_char_width;
       dstRect.y = top_margin + screen_y * y_scale;
-      TrsSoftBlit(image, &srcRect, screen, &dstRect, 1);
+      TrsSoftBlit(image, &srcRect, screen, &dstRect, xor);
+      addToDrawList(&dstRect);
+      start = -1;
     }
+    if (on_screen && start < 0)
+      start = x;
+    last = screen_x;
+  }
+}
 
-    /* Save new byte in local memory */
-    grafyx_unscaled[y][x] = byte;
-    grafyx_rescale(y, x, byte);
-
-    if (grafyx_enable && on_screen) {
-      /* Draw new byte */
-      srcRect.x = x * cur_char_width;
-      srcRect.y = y * y_scale;
-      srcRect.w = cur_char_width;
-      srcRect.h = y_scale;
-      dstRect.x = left_margin + screen_x * cur_char_width;
-      dstRect.y = top_margin + screen_y * y_scale;
-      TrsSoftBlit(image, &srcRect, screen, &dstRect, grafyx_overlay);
-      addToDrawList(&dstRect);
+/* Expand the dirty rows, and draw them if the screen is not redrawn */
+static void grafyx_update(int draw)
+{
+  int i, x, y;
+
+  draw = draw && grafyx_enable;
+  for (i = 0; i < G_YSIZE / 32; i++) {
+    Uint32 dirty = grafyx_dirty[i];
+
+    grafyx_dirty[i] = 0;
+    for (y = i * 32; dirty; y++, dirty >>= 1) {
+      int x0, x1;
+
+      if ((dirty & 1) == 0)
+        continue;
+      x0 = grafyx_dirty_x0[y];
+      x1 = grafyx_dirty_x1[y];
+
+      /* Erase old bytes, preserving text */
+      if (draw && grafyx_overlay)
+        grafyx_draw_row(y, x0, x1, 1);
+      for (x = x0; x <= x1; x++)
+        grafyx_rescale(y, x, grafyx_unscaled[y][x]);
+      if (draw)
+        grafyx_draw_row(y, x0, x1, grafyx_overlay);
     }
   }
 }
 
 static void grafyx_rescale(int y, int x, Uint8 byte)
 {
-  if (scale == 1) {
+  if (draw_scale == 1) {
     if (scale_factor == 2) {
       int const p = y * 2 * G_XSIZE + x;
 
@@ -3050,12 +3925,12 @@ static void grafyx_rescale(int y, int x, Uint8 byte)
     }
   } else {
     Uint8 exp[MAX_SCALE];
-    int const w = G_XSIZE * scale;
-    int const s = w - scale;
-    int p = y * y_scale * w + x * scale;
+    int const w = G_XSIZE * draw_scale;
+    int const s = w - draw_scale;
+    int p = y * y_scale * w + x * draw_scale;
     int i, j;
 
-    switch (scale) {
+    switch (draw_scale) {
       case 2:
         exp[1] =  ((byte & 0x01)       + ((byte & 0x02) << 1)
                +  ((byte & 0x04) << 2) + ((byte & 0x08) << 3)) * 3;
@@ -3079,7 +3954,7 @@ static void grafyx_rescale(int y, int x, Uint8 byte)
     }
 
     for (j = 0; j < y_scale; j++) {
-      for (i = 0; i < scale; i++)
+      for (i = 0; i < draw_scale; i++)
         grafyx[p++] = exp[i];
       p += s;
     }
@@ -3426,6 +4301,17 @@ void m6845_cursor(int position, int start, int end, int visible)
   int inverted;
   SDL_Rect srcRect, dstRect;
 
+  if (raster_mode) {
+    raster_update();
+    raster_touch(cursor_position);
+    cursor_position = position;
+    cursor_start = start;
+    cursor_end = end;
+    cursor_visible = visible;
+    raster_touch(position);
+    return;
+  }
+
   if (position >= screen_chars)
     return;
 
@@ -3437,7 +4323,7 @@ void m6845_cursor(int position, int start, int end, int visible)
   }
 
   expanded = (currentmode & EXPANDED) != 0;
-  inverted = (currentmode & INVERSE) && (cur_char & 0x80) ? 0 : 2;
+  inverted = (currentmode & INVERSE) && (cur_char & 0x80) ? 0 : GLYPH_INVERSE;
 
   if (row_chars == 64) {
     row = position / 64;
@@ -3454,7 +4340,7 @@ void m6845_cursor(int position, int start, int end, int visible)
   dstRect.x = col * cur_char_width + left_margin;
   dstRect.y = row * cur_char_height + top_margin + srcRect.y;
 
-  SDL_BlitSurface(trs_char[inverted + expanded][cur_char], &srcRect, screen, &dstRect);
+  glyph_blit(inverted + expanded, cur_char, &srcRect, &dstRect);
   addToDrawList(&dstRect);
 }
 
@@ -3548,7 +4434,7 @@ Uint8 genie3s_hrg_read(int position)
 void trs_get_mouse_pos(int *x, int *y, unsigned int *buttons)
 {
   int win_x, win_y;
-  Uint8 const mask = SDL_GetMouseState(&win_x, &win_y);
+  Uint8 const mask = screen_mouse_state(&win_x, &win_y);
 
 #if MOUSEDEBUG
   debug("get_mouse %d %d 0x%x ->", win_x, win_y, mask);
@@ -3575,6 +4461,7 @@ void trs_get_mouse_pos(int *x, int *y, unsigned int *buttons)
   *x = mouse_last_x;
   *y = mouse_last_y;
   *buttons = mouse_last_buttons;
+  trs_input_mouse(x, y, buttons);
 #if MOUSEDEBUG
   debug("%d %d 0x%x\n",
       mouse_last_x, mouse_last_y, mouse_last_buttons);
@@ -3596,11 +4483,7 @@ void trs_set_mouse_pos(int x, int y)
 #if MOUSEDEBUG
     debug("set_mouse %d %d -> %d %d\n", x, y, dest_x, dest_y);
 #endif
-#ifdef SDL2
-    SDL_WarpMouseInWindow(window, dest_x, dest_y);
-#else
-    SDL_WarpMouse(dest_x, dest_y);
-#endif
+    screen_warp_mouse(dest_x, dest_y);
   }
 }
 
@@ -3700,6 +4583,141 @@ void trs_main_load(FILE *file)
   trs_load_int(file, &lowe_le18, 1);
 }
 
+/* Text shown on the screen, rows separated by newlines */
+int trs_screen_text(char *buf, int size)
+{
+  int row, col, len = 0;
+
+  for (row = 0; row < col_chars; row++) {
+    Uint8 const *screen_ptr = &trs_screen[row * row_chars];
+
+    for (col = 0; col < row_chars && len < size - 2; col++) {
+      Uint8 data = *screen_ptr++;
+
+      if (data < 0x20)
+        data += 0x40;
+
+      if ((currentmode & INVERSE) && (data & 0x80))
+        data -= 0x80;
+
+      buf[len++] = (data >= 0x20 && data <= 0x7e) ? data : ' ';
+    }
+    if (row != col_chars - 1 && len < size - 1)
+      buf[len++] = '\n';
+  }
+  buf[len] = 0;
+  return len;
+}
+
+/* Unicode character shown at a position of the screen */
+static int screen_unicode(int position)
+{
+  int data = trs_screen[position];
+
+  if (!genie3s) {
+    if (trs_model == 1 && (trs_clones.model & (CT80 | EG3200)) == 0) {
+      /* On Model I, 0xc0-0xff is another copy of 0x80-0xbf */
+      if (data >= 0xc0)
+        data -= 0x40;
+    }
+    if (!(currentmode & INVERSE) && data >= 0x80 && data <= 0xbf) {
+      /* 2x3 block graphics, in the same bit order as the sextants */
+      data -= 0x80;
+      if (data == 0)
+        return ' ';
+      if (data == 0x15)
+        return 0x258C; /* left half block */
+      if (data == 0x2A)
+        return 0x2590; /* right half block */
+      if (data == 0x3F)
+        return 0x2588; /* full block */
+      return 0x1FB00 + data - 1 - (data > 0x15) - (data > 0x2A);
+    }
+  }
+
+  if ((currentmode & INVERSE) && (data & 0x80))
+    data -= 0x80;
+  if (data < 0x20)
+    data += 0x40;
+
+  /* Glyph not in ASCII */
+  return (data >= 0x20 && data <= 0x7e) ? data : 0xFFFD;
+}
+
+/* Visible text of the screen in UTF-8, rows ending with newlines */
+int trs_screen_utf8(char *buf, int size)
+{
+  int const step = (currentmode & EXPANDED) ? 2 : 1;
+  int row, col, len = 0;
+
+  for (row = 0; row < col_chars; row++) {
+    for (col = 0; col < row_chars; col += step) {
+      int const c = screen_unicode(row * row_chars + col);
+
+      if (len > size - 6)
+        break;
+      if (c < 0x80) {
+        buf[len++] = c;
+      } else if (c < 0x800) {
+        buf[len++] = 0xC0 | (c >> 6);
+        buf[len++] = 0x80 | (c & 0x3F);
+      } else if (c < 0x10000) {
+        buf[len++] = 0xE0 | (c >> 12);
+        buf[len++] = 0x80 | ((c >> 6) & 0x3F);
+        buf[len++] = 0x80 | (c & 0x3F);
+      } else {
+        buf[len++] = 0xF0 | (c >> 18);
+        buf[len++] = 0x80 | ((c >> 12) & 0x3F);
+        buf[len++] = 0x80 | ((c >> 6) & 0x3F);
+        buf[len++] = 0x80 | (c & 0x3F);
+      }
+    }
+    if (len < size - 1)
+      buf[len++] = '\n';
+  }
+  buf[len] = 0;
+  return len;
+}
+
+void trs_screen_size(int *width, int *height)
+{
+  *width = OrigWidth;
+  *height = screen_height;
+}
+
+/* Copy the screen as it is shown to 0xRRGGBB pixels of the given size */
+void trs_screen_pixels(Uint32 *pixels, int width, int height)
+{
+  static SDL_Surface *buffer;
+  int y;
+
+  if (buffer && (buffer->w != width || buffer->h != height)) {
+    SDL_FreeSurface(buffer);
+    buffer = NULL;
+  }
+  if (buffer == NULL) {
+    buffer = SDL_CreateRGBSurface(SDL_SWSURFACE, width, height, 32,
+        0x00ff0000, 0x0000ff00, 0x000000ff, 0);
+    if (buffer == NULL) {
+      memset(pixels, 0, width * height * 4);
+      return;
+    }
+  }
+
+  /* Hi-res graphics are drawn once per frame */
+  grafyx_update(1);
+  SDL_FillRect(buffer, NULL, 0);
+  SDL_BlitSurface(screen, NULL, buffer, NULL);
+
+  if (SDL_MUSTLOCK(buffer))
+    SDL_LockSurface(buffer);
+  for (y = 0; y < height; y++)
+    memcpy(pixels + y * width, (Uint8 *)buffer->pixels + y * buffer->pitch,
+        width * 4);
+  if (SDL_MUSTLOCK(buffer))
+    SDL_UnlockSurface(buffer);
+}
+
 int trs_sdl_savebmp(const char *filename)
 {
   SDL_Surface *buffer = SDL_CreateRGBSurface(
@@ -45,10 +45,10 @@
 #include "error.h"
 #include "trs.h"
 #include "trs_clones.h"
+#include "trs_input.h"
 #include "trs_sdl_keyboard.h"
 #include "trs_state_save.h"
 
-static void queue_key(int state);
 static int dequeue_key(void);
 
 /*
@@ -692,6 +692,7 @@ int trs_joystick_in(void)
 #if JOYDEBUG
   debug("joy %02x ", joystate);
 #endif
+  joystate = trs_input_joystick(joystate);
   return ~joystate;
 }
 
@@ -845,6 +846,8 @@ int trs_kb_mem_read(int address)
 
 void clear_key_queue(void)
 {
+  if (trs_input_record(INPUT_KEYCLEAR, 0))
+    return;
   key_queue_head = 0;
   key_queue_entries = 0;
 #if QDEBUG
@@ -854,6 +857,8 @@ void clear_key_queue(void)
 
 void queue_key(int state)
 {
+  if (trs_input_record(INPUT_KEY, state))
+    return;
   key_queue[(key_queue_head + key_queue_entries) % KEY_QUEUE_SIZE] = state;
 #if QDEBUG
   debug("queue_key 0x%x\n", state);
@@ -893,6 +898,7 @@ void trs_keyboard_save(FILE *file)
   trs_save_int(file, &key_queue_entries, 1);
   trs_save_int(file, &stretch_amount, 1);
   trs_save_int(file, &trs_kb_bracket_state, 1);
+  trs_save_int(file, &key_heartbeat, 1);
 }
 
 void trs_keyboard_load(FILE *file)
@@ -906,4 +912,9 @@ void trs_keyboard_load(FILE *file)
   trs_load_int(file, &key_queue_entries, 1);
   trs_load_int(file, &stretch_amount, 1);
   trs_load_int(file, &trs_kb_bracket_state, 1);
+  /* Not in version 5 */
+  if (trs_state_version >= 1)
+    trs_load_int(file, &key_heartbeat, 1);
+  else
+    key_heartbeat = 0;
 }
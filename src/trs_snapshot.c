@@ -0,0 +1,569 @@
+/*
+ * In-memory snapshots of the emulator state.
+ *
+ * A snapshot is the stream written by trs_state_write() cut into pages.
+ * Data smaller than a page is packed, larger blocks start on a page of
+ * their own.  Pages equal to those of the previous snapshot are shared
+ * with it, and pages of RAM which were not written since are taken over
+ * without even looking at them, so a snapshot costs little more than
+ * copying the memory written since the previous one.
+ *
+ * Snapshot files are written with every page compressed by a simple
+ * LZSS, so the mostly empty RAM of the bigger memory expansions takes
+ * little space on disk.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "error.h"
+#include "trs.h"
+#include "trs_memory.h"
+#include "trs_snapshot.h"
+#include "trs_state_save.h"
+
+#define SNAP_PAGE      (1 << MEM_PAGE_SHIFT)
+#define SNAP_RAMS      (2)    /* main RAM and SuperMem */
+#define SNAP_WINDOW    (4096) /* LZSS distances fit in 12 bits */
+#define SNAP_MATCH     (3)    /* shortest match */
+#define SNAP_LONG      (SNAP_MATCH + 15)
+#define SNAP_MAX       (SNAP_LONG + 255)
+
+typedef struct {
+  int refs;
+  Uint8 data[SNAP_PAGE];
+} snap_page;
+
+struct trs_snapshot {
+  tstate_t t_count;
+  unsigned int bytes;
+  int npages;
+  int size;
+  snap_page **page;
+  /* Pages where the RAM blocks start, to match their maps of written pages */
+  const Uint8 *ram_map[SNAP_RAMS];
+  int ram_page[SNAP_RAMS];
+};
+
+static const char snapFileBanner[] = "SDLTRS Snapshot File";
+static int const snapFileBannerLen = sizeof(snapFileBanner) - 1;
+static unsigned snapVersionNumber = 1;
+
+/* The last snapshot taken or restored: the RAM maps tell what changed */
+static trs_snapshot snap_base;
+
+/* The snapshot being taken or restored */
+static trs_snapshot *snap_cur;
+static int snap_index;
+static int snap_fill;
+static int snap_failed;
+static Uint8 snap_buf[SNAP_PAGE];
+
+/* Pages held by all snapshots */
+static unsigned long snap_pages;
+
+static void snap_release(trs_snapshot *snap)
+{
+  int i;
+
+  for (i = 0; i < snap->npages; i++) {
+    if (--snap->page[i]->refs == 0) {
+      free(snap->page[i]);
+      snap_pages--;
+    }
+  }
+  free(snap->page);
+  snap->page = NULL;
+  snap->npages = snap->size = 0;
+}
+
+static int snap_append(trs_snapshot *snap, snap_page *page)
+{
+  if (snap->npages == snap->size) {
+    int size = snap->size ? snap->size * 2 : 256;
+    snap_page **pages = realloc(snap->page, size * sizeof(*pages));
+
+    if (pages == NULL)
+      return -1;
+    snap->page = pages;
+    snap->size = size;
+  }
+  snap->page[snap->npages++] = page;
+  if (page->refs++ == 0)
+    snap_pages++;
+  return 0;
+}
+
+static int snap_ram_page(const trs_snapshot *snap, const Uint8 *map)
+{
+  int i;
+
+  for (i = 0; i < SNAP_RAMS; i++) {
+    if (snap->ram_map[i] == map)
+      return snap->ram_page[i];
+  }
+  return -1;
+}
+
+static void snap_set_ram_page(trs_snapshot *snap, const Uint8 *map, int page)
+{
+  int i;
+
+  for (i = 0; i < SNAP_RAMS; i++) {
+    if (snap->ram_map[i] == map || snap->ram_map[i] == NULL) {
+      snap->ram_map[i] = map;
+      snap->ram_page[i] = page;
+      return;
+    }
+  }
+}
+
+static void snap_begin(trs_snapshot *snap)
+{
+  snap_cur = snap;
+  snap_index = 0;
+  snap_fill = 0;
+  snap_failed = 0;
+}
+
+/* The state now is that of snap, the base of the next snapshot */
+static void snap_rebase(trs_snapshot *snap)
+{
+  int i;
+
+  snap_release(&snap_base);
+  for (i = 0; i < snap->npages; i++) {
+    if (snap_append(&snap_base, snap->page[i])) {
+      snap_release(&snap_base);
+      mem_dirty_reset(1);
+      return;
+    }
+  }
+  memcpy(snap_base.ram_map, snap->ram_map, sizeof(snap_base.ram_map));
+  memcpy(snap_base.ram_page, snap->ram_page, sizeof(snap_base.ram_page));
+  mem_dirty_reset(0);
+}
+
+/* Add a page, shared with the previous snapshot if it is the same */
+static void snap_emit(const Uint8 *data)
+{
+  snap_page *page;
+  int const i = snap_cur->npages;
+
+  if (i < snap_base.npages &&
+      memcmp(snap_base.page[i]->data, data, SNAP_PAGE) == 0) {
+    page = snap_base.page[i];
+  } else {
+    page = malloc(sizeof(*page));
+    if (page) {
+      page->refs = 0;
+      memcpy(page->data, data, SNAP_PAGE);
+      snap_cur->bytes += SNAP_PAGE;
+    }
+  }
+  if (page == NULL || snap_append(snap_cur, page)) {
+    if (page && page->refs == 0)
+      free(page);
+    snap_failed = 1;
+  }
+}
+
+static void snap_flush(void)
+{
+  if (snap_fill) {
+    memset(snap_buf + snap_fill, 0, SNAP_PAGE - snap_fill);
+    snap_emit(snap_buf);
+    snap_fill = 0;
+  }
+}
+
+void trs_snapshot_put(const void *buffer, int size)
+{
+  const Uint8 *data = buffer;
+  const Uint8 *dirty;
+  int clean, i;
+
+  if (snap_cur == NULL || snap_failed)
+    return;
+
+  if (size < SNAP_PAGE) {
+    while (size > 0) {
+      int n = SNAP_PAGE - snap_fill;
+
+      if (n > size)
+        n = size;
+      memcpy(snap_buf + snap_fill, data, n);
+      snap_fill += n;
+      data += n;
+      size -= n;
+      if (snap_fill == SNAP_PAGE) {
+        snap_emit(snap_buf);
+        snap_fill = 0;
+      }
+    }
+    return;
+  }
+
+  snap_flush();
+  dirty = mem_dirty_map(buffer, size);
+  clean = dirty && snap_ram_page(&snap_base, dirty) == snap_cur->npages;
+  if (dirty)
+    snap_set_ram_page(snap_cur, dirty, snap_cur->npages);
+
+  for (i = 0; size > 0 && !snap_failed; i++) {
+    int const n = size < SNAP_PAGE ? size : SNAP_PAGE;
+    int const index = snap_cur->npages;
+
+    if (clean && !dirty[i] && index < snap_base.npages) {
+      if (snap_append(snap_cur, snap_base.page[index]))
+        snap_failed = 1;
+    } else if (n == SNAP_PAGE) {
+      snap_emit(data);
+    } else {
+      memcpy(snap_buf, data, n);
+      memset(snap_buf + n, 0, SNAP_PAGE - n);
+      snap_emit(snap_buf);
+    }
+    data += n;
+    size -= n;
+  }
+}
+
+void trs_snapshot_get(void *buffer, int size)
+{
+  Uint8 *data = buffer;
+  const Uint8 *dirty;
+  int clean, i;
+
+  if (snap_cur == NULL || snap_failed)
+    return;
+
+  if (size < SNAP_PAGE) {
+    while (size > 0) {
+      int n = SNAP_PAGE - snap_fill;
+
+      if (snap_index >= snap_cur->npages) {
+        snap_failed = 1;
+        return;
+      }
+      if (n > size)
+        n = size;
+      memcpy(data, snap_cur->page[snap_index]->data + snap_fill, n);
+      snap_fill += n;
+      data += n;
+      size -= n;
+      if (snap_fill == SNAP_PAGE) {
+        snap_index++;
+        snap_fill = 0;
+      }
+    }
+    return;
+  }
+
+  if (snap_fill) {
+    snap_index++;
+    snap_fill = 0;
+  }
+  /* Pages of RAM which are still those of the last snapshot need no copy */
+  dirty = mem_dirty_map(buffer, size);
+  clean = dirty && snap_ram_page(&snap_base, dirty) == snap_index;
+  if (dirty)
+    snap_set_ram_page(snap_cur, dirty, snap_index);
+
+  for (i = 0; size > 0; i++, snap_index++) {
+    int const n = size < SNAP_PAGE ? size : SNAP_PAGE;
+    const snap_page *page;
+
+    if (snap_index >= snap_cur->npages) {
+      snap_failed = 1;
+      return;
+    }
+    page = snap_cur->page[snap_index];
+    if (!clean || dirty[i] || snap_index >= snap_base.npages ||
+        snap_base.page[snap_index] != page)
+      memcpy(data, page->data, n);
+    data += n;
+    size -= n;
+  }
+}
+
+trs_snapshot *trs_snapshot_take(void)
+{
+  trs_snapshot *snap = calloc(1, sizeof(*snap));
+
+  if (snap == NULL) {
+    error("failed to allocate snapshot");
+    return NULL;
+  }
+  snap->t_count = z80_state.t_count;
+
+  snap_begin(snap);
+  trs_state_write(NULL);
+  snap_flush();
+  snap_cur = NULL;
+
+  if (snap_failed) {
+    trs_snapshot_free(snap);
+    error("failed to allocate snapshot");
+    return NULL;
+  }
+  snap_rebase(snap);
+  return snap;
+}
+
+int trs_snapshot_restore(trs_snapshot *snap)
+{
+  snap_begin(snap);
+  trs_state_read(NULL);
+  snap_cur = NULL;
+
+  if (snap_failed) {
+    /* Don't trust any page of RAM to be unchanged now */
+    snap_release(&snap_base);
+    mem_dirty_reset(1);
+    error("failed to restore snapshot: truncated");
+    return -1;
+  }
+  snap_rebase(snap);
+  return 0;
+}
+
+void trs_snapshot_free(trs_snapshot *snap)
+{
+  if (snap) {
+    snap_release(snap);
+    free(snap);
+  }
+}
+
+unsigned long trs_snapshot_memory(void)
+{
+  return snap_pages * sizeof(snap_page);
+}
+
+tstate_t trs_snapshot_tstates(const trs_snapshot *snap)
+{
+  return snap->t_count;
+}
+
+unsigned int trs_snapshot_bytes(const trs_snapshot *snap)
+{
+  return snap->bytes + snap->size * sizeof(snap_page *) + sizeof(*snap);
+}
+
+/*
+ * LZSS within a page: a flag byte tells the kinds of the next eight
+ * items, either a literal byte or a match of two bytes.  The match holds
+ * the distance back in 12 bits and the length - 3 in the upper nibble of
+ * the second byte; 15 is followed by a byte to add for long matches.
+ * Returns the compressed size, SNAP_PAGE if it does not pay off.
+ */
+static int snap_compress(const Uint8 *in, Uint8 *out)
+{
+  static Uint16 head[SNAP_WINDOW];
+  int pos = 0, len = 0, flags = 0, bit = 8;
+
+  memset(head, 0, sizeof(head));
+  while (pos < SNAP_PAGE) {
+    int best = 0, dist = 0;
+
+    if (len >= SNAP_PAGE - 4)
+      return SNAP_PAGE;
+    if (bit == 8) {
+      flags = len++;
+      out[flags] = 0;
+      bit = 0;
+    }
+    if (pos + SNAP_MATCH <= SNAP_PAGE) {
+      int const hash = ((in[pos] << 4) ^ (in[pos + 1] << 2) ^ in[pos + 2])
+          & (SNAP_WINDOW - 1);
+      int const cand = head[hash] - 1;
+
+      head[hash] = pos + 1;
+      if (cand >= 0 && pos - cand < SNAP_WINDOW) {
+        int max = SNAP_PAGE - pos;
+
+        if (max > SNAP_MAX)
+          max = SNAP_MAX;
+        while (best < max && in[cand + best] == in[pos + best])
+          best++;
+        dist = pos - cand;
+      }
+    }
+    if (best >= SNAP_MATCH) {
+      out[flags] |= 1 << bit;
+      out[len++] = dist & 0xFF;
+      if (best >= SNAP_LONG) {
+        out[len++] = (dist >> 8) | 0xF0;
+        out[len++] = best - SNAP_LONG;
+      } else {
+        out[len++] = (dist >> 8) | (best - SNAP_MATCH) << 4;
+      }
+      pos += best;
+    } else {
+      out[len++] = in[pos++];
+    }
+    bit++;
+  }
+  return len;
+}
+
+static int snap_expand(const Uint8 *in, int size, Uint8 *out)
+{
+  int pos = 0, i = 0, flags = 0, bit = 8;
+
+  while (pos < SNAP_PAGE) {
+    if (bit == 8) {
+      if (i >= size)
+        return -1;
+      flags = in[i++];
+      bit = 0;
+    }
+    if (flags & (1 << bit++)) {
+      int dist, n;
+
+      if (i + 2 > size)
+        return -1;
+      dist = in[i] | (in[i + 1] & 0x0F) << 8;
+      n = (in[i + 1] >> 4) + SNAP_MATCH;
+      i += 2;
+      if (n == SNAP_LONG) {
+        if (i >= size)
+          return -1;
+        n += in[i++];
+      }
+      if (dist == 0 || dist > pos || n > SNAP_PAGE - pos)
+        return -1;
+      while (n--) {
+        out[pos] = out[pos - dist];
+        pos++;
+      }
+    } else {
+      if (i >= size)
+        return -1;
+      out[pos++] = in[i++];
+    }
+  }
+  return 0;
+}
+
+int trs_snapshot_banner(const char *banner, int len)
+{
+  return len >= snapFileBannerLen &&
+      strncmp(banner, snapFileBanner, snapFileBannerLen) == 0;
+}
+
+Uint32 trs_snapshot_checksum(const trs_snapshot *snap)
+{
+  Uint32 sum = 2166136261U;
+  int i, j;
+
+  /* FNV-1a */
+  for (i = 0; i < snap->npages; i++) {
+    const Uint8 *data = snap->page[i]->data;
+
+    for (j = 0; j < SNAP_PAGE; j++)
+      sum = (sum ^ data[j]) * 16777619U;
+  }
+  return sum;
+}
+
+void trs_snapshot_save(const trs_snapshot *snap, FILE *file)
+{
+  Uint8 out[SNAP_PAGE];
+  int i;
+
+  trs_save_uint8(file, (Uint8 *)snapFileBanner, snapFileBannerLen);
+  trs_save_uint32(file, &snapVersionNumber, 1);
+  trs_save_uint64(file, &snap->t_count, 1);
+  trs_save_int(file, &snap->npages, 1);
+  for (i = 0; i < snap->npages; i++) {
+    const Uint8 *data = snap->page[i]->data;
+    Uint16 len = snap_compress(data, out);
+
+    trs_save_uint16(file, &len, 1);
+    trs_save_uint8(file, len == SNAP_PAGE ? data : out, len);
+  }
+}
+
+int trs_snapshot_write(const trs_snapshot *snap, const char *filename)
+{
+  FILE *file = fopen(filename, "wb");
+
+  if (file == NULL) {
+    error("failed to write snapshot '%s': %s", filename, strerror(errno));
+    return -1;
+  }
+  trs_snapshot_save(snap, file);
+  if (fclose(file) != 0) {
+    error("failed to write snapshot '%s': %s", filename, strerror(errno));
+    return -1;
+  }
+  return 0;
+}
+
+trs_snapshot *trs_snapshot_load(FILE *file, const char *filename)
+{
+  trs_snapshot *snap;
+  char banner[80];
+  unsigned version;
+  int i, npages = 0;
+
+  trs_load_uint8(file, (Uint8 *)banner, snapFileBannerLen);
+  trs_load_uint32(file, &version, 1);
+  if (!trs_snapshot_banner(banner, snapFileBannerLen) ||
+      version != snapVersionNumber) {
+    error("unsupported snapshot in '%s'", filename);
+    return NULL;
+  }
+  if ((snap = calloc(1, sizeof(*snap))) == NULL)
+    return NULL;
+  trs_load_uint64(file, &snap->t_count, 1);
+  trs_load_int(file, &npages, 1);
+
+  for (i = 0; i < npages; i++) {
+    Uint8 in[SNAP_PAGE];
+    snap_page *page = malloc(sizeof(*page));
+    Uint16 len = 0;
+
+    trs_load_uint16(file, &len, 1);
+    if (page == NULL || len > SNAP_PAGE || fread(in, 1, len, file) != len)
+      len = 0;
+    else if (len == SNAP_PAGE)
+      memcpy(page->data, in, SNAP_PAGE);
+    else if (snap_expand(in, len, page->data) != 0)
+      len = 0;
+    if (len == 0) {
+      error("failed to read snapshot '%s': corrupt page %d", filename, i);
+      free(page);
+      break;
+    }
+    page->refs = 0;
+    snap->bytes += SNAP_PAGE;
+    if (snap_append(snap, page)) {
+      free(page);
+      break;
+    }
+  }
+
+  if (i < npages) {
+    trs_snapshot_free(snap);
+    return NULL;
+  }
+  return snap;
+}
+
+trs_snapshot *trs_snapshot_read(const char *filename)
+{
+  FILE *file = fopen(filename, "rb");
+  trs_snapshot *snap;
+
+  if (file == NULL) {
+    error("failed to read snapshot '%s': %s", filename, strerror(errno));
+    return NULL;
+  }
+  snap = trs_snapshot_load(file, filename);
+  fclose(file);
+  return snap;
+}
@@ -0,0 +1,51 @@
+/*
+ * In-memory snapshots of the emulator state.
+ *
+ * Snapshots are taken incrementally: parts of the state unchanged since
+ * the previous snapshot are shared with it.  Snapshot files are written
+ * compressed.
+ */
+#ifndef _TRS_SNAPSHOT_H
+#define _TRS_SNAPSHOT_H
+
+#include <stdio.h>
+#include "z80.h"
+
+typedef struct trs_snapshot trs_snapshot;
+
+/* Capture the current state; NULL if out of memory */
+extern trs_snapshot *trs_snapshot_take(void);
+
+/* Go back to the state of a snapshot */
+extern int trs_snapshot_restore(trs_snapshot *snap);
+
+extern void trs_snapshot_free(trs_snapshot *snap);
+
+/* T-state counter at the time of the snapshot */
+extern tstate_t trs_snapshot_tstates(const trs_snapshot *snap);
+
+/* Memory used by the snapshot and not shared with the previous one */
+extern unsigned int trs_snapshot_bytes(const trs_snapshot *snap);
+
+/* Memory used by the pages of all snapshots */
+extern unsigned long trs_snapshot_memory(void);
+
+/* Checksum of the state in the snapshot */
+extern Uint32 trs_snapshot_checksum(const trs_snapshot *snap);
+
+/* Write a compressed snapshot file, or read one back */
+extern int trs_snapshot_write(const trs_snapshot *snap, const char *filename);
+extern trs_snapshot *trs_snapshot_read(const char *filename);
+
+/* The same within another file, named for error messages */
+extern void trs_snapshot_save(const trs_snapshot *snap, FILE *file);
+extern trs_snapshot *trs_snapshot_load(FILE *file, const char *filename);
+
+/* Is this the start of a snapshot file? */
+extern int trs_snapshot_banner(const char *banner, int len);
+
+/* Stream of the snapshot being taken or restored, see trs_state_write */
+extern void trs_snapshot_put(const void *buffer, int size);
+extern void trs_snapshot_get(void *buffer, int size);
+
+#endif
@@ -30,42 +30,198 @@
 #include <stdio.h>
 #include <string.h>
 #include "error.h"
+#include "trs.h"
+#include "trs_input.h"
+#include "trs_rewind.h"
+#include "trs_snapshot.h"
 #include "trs_state_save.h"
 
 static const char stateFileBanner[] = "SDLTRS State Save File";
 static int const stateFileBannerLen = sizeof(stateFileBanner) - 1;
-static unsigned stateVersionNumber = 5;
+static unsigned stateVersionNumber = 7;
+
+/*
+ * From version 7 on, a state file holds a chunk for every part of the
+ * emulator: a tag of four characters, the version of that part, the
+ * length of the data and the data.  A part whose layout changes gets a
+ * new version, and its loader reads the older ones by trs_state_version.
+ * Chunks of unknown parts or of newer versions are skipped, and only
+ * some parts may be loaded.
+ *
+ * Version 5 files hold all parts in a row, in the order of the chunks,
+ * with the layout of version 0 of every part.
+ */
+typedef struct {
+  const char *name;
+  char tag[5];
+  unsigned version;
+  void (*save)(FILE *file);
+  void (*load)(FILE *file);
+} state_chunk;
+
+static const state_chunk state_chunks[] = {
+  { "main",      "MAIN", 1, trs_main_save,      trs_main_load      },
+  { "cassette",  "CASS", 1, trs_cassette_save,  trs_cassette_load  },
+  { "clone",     "CLON", 1, trs_clone_save,     trs_clone_load     },
+  { "cp500",     "C500", 1, trs_cp500_save,     trs_cp500_load     },
+  { "disk",      "DISK", 1, trs_disk_save,      trs_disk_load      },
+  { "hard",      "HARD", 1, trs_hard_save,      trs_hard_load      },
+  { "stringy",   "STRY", 1, trs_stringy_save,   trs_stringy_load   },
+  { "interrupt", "INTR", 1, trs_interrupt_save, trs_interrupt_load },
+  { "io",        "IO  ", 1, trs_io_save,        trs_io_load        },
+  { "memory",    "MEM ", 1, trs_mem_save,       trs_mem_load       },
+  { "keyboard",  "KEYB", 1, trs_keyboard_save,  trs_keyboard_load  },
+  { "uart",      "UART", 1, trs_uart_save,      trs_uart_load      },
+  { "z80",       "Z80 ", 1, trs_z80_save,       trs_z80_load       },
+  { "impexp",    "IMPX", 1, trs_imp_exp_save,   trs_imp_exp_load   },
+};
+
+#define STATE_CHUNKS (int)(sizeof(state_chunks) / sizeof(state_chunks[0]))
+
+static const char stateEndTag[] = "END ";
+
+/*
+ * Save or load the state of all parts of the emulator.  A NULL file
+ * stands for the stream of the in-memory snapshot being taken or
+ * restored, which is kept in host byte order.
+ */
+void trs_state_write(FILE *file)
+{
+  int i;
+
+  for (i = 0; i < STATE_CHUNKS; i++)
+    state_chunks[i].save(file);
+}
+
+unsigned trs_state_version;
+
+void trs_state_read(FILE *file)
+{
+  int i;
+
+  for (i = 0; i < STATE_CHUNKS; i++) {
+    trs_state_version = state_chunks[i].version;
+    state_chunks[i].load(file);
+  }
+  trs_io_config();
+}
+
+int trs_state_parts(const char *names, unsigned int *parts)
+{
+  *parts = 0;
+  while (*names) {
+    size_t const len = strcspn(names, ",");
+    int i;
+
+    if (len == 3 && strncmp(names, "all", 3) == 0) {
+      *parts = STATE_ALL;
+    } else {
+      for (i = 0; i < STATE_CHUNKS; i++) {
+        if (strlen(state_chunks[i].name) == len &&
+            strncmp(names, state_chunks[i].name, len) == 0)
+          break;
+      }
+      if (i == STATE_CHUNKS) {
+        error("unknown part of State '%.*s'", (int)len, names);
+        return -1;
+      }
+      *parts |= 1U << i;
+    }
+    names += len;
+    if (*names == ',')
+      names++;
+  }
+  return 0;
+}
+
+/* The length is known after writing the data, so it is filled in later */
+static int state_write_chunk(FILE *file, const state_chunk *chunk)
+{
+  Uint32 version = chunk->version, length = 0;
+  long start, end;
+
+  trs_save_uint8(file, (Uint8 *)chunk->tag, 4);
+  trs_save_uint32(file, &version, 1);
+  if ((start = ftell(file)) < 0)
+    return -1;
+  trs_save_uint32(file, &length, 1);
+  chunk->save(file);
+  if ((end = ftell(file)) < 0)
+    return -1;
+  length = end - start - 4;
+  if (fseek(file, start, SEEK_SET) != 0)
+    return -1;
+  trs_save_uint32(file, &length, 1);
+  return fseek(file, end, SEEK_SET);
+}
+
+static int state_read_chunks(FILE *file, const char *filename, unsigned parts)
+{
+  for (;;) {
+    char tag[4];
+    Uint32 version, length;
+    long start;
+    int i;
+
+    if (fread(tag, sizeof(tag), 1, file) != 1) {
+      error("State '%s' ends early", filename);
+      return -1;
+    }
+    if (memcmp(tag, stateEndTag, sizeof(tag)) == 0)
+      return 0;
+    trs_load_uint32(file, &version, 1);
+    trs_load_uint32(file, &length, 1);
+    if ((start = ftell(file)) < 0)
+      return -1;
+
+    for (i = 0; i < STATE_CHUNKS; i++) {
+      if (memcmp(tag, state_chunks[i].tag, sizeof(tag)) == 0)
+        break;
+    }
+    if (i == STATE_CHUNKS) {
+      error("unknown part '%.4s' of State '%s' skipped", tag, filename);
+    } else if (version == 0 || version > state_chunks[i].version) {
+      error("unsupported version %u of %s State skipped", version,
+          state_chunks[i].name);
+    } else if (parts & (1U << i)) {
+      trs_state_version = version;
+      state_chunks[i].load(file);
+      if (ftell(file) != start + (long)length)
+        error("bad length of %s State in '%s'", state_chunks[i].name,
+            filename);
+    }
+    if (fseek(file, start + (long)length, SEEK_SET) != 0)
+      return -1;
+  }
+}
 
 int trs_state_save(const char *filename)
 {
   FILE *file;
+  int i;
 
   file = fopen(filename, "wb");
   if (file) {
+    int ret = 0;
+
     trs_save_uint8(file, (Uint8 *)stateFileBanner, stateFileBannerLen);
     trs_save_uint32(file, &stateVersionNumber, 1);
-    trs_main_save(file);
-    trs_cassette_save(file);
-    trs_clone_save(file);
-    trs_cp500_save(file);
-    trs_disk_save(file);
-    trs_hard_save(file);
-    trs_stringy_save(file);
-    trs_interrupt_save(file);
-    trs_io_save(file);
-    trs_mem_save(file);
-    trs_keyboard_save(file);
-    trs_uart_save(file);
-    trs_z80_save(file);
-    trs_imp_exp_save(file);
-    fclose(file);
-    return 0;
+    for (i = 0; i < STATE_CHUNKS && ret == 0; i++)
+      ret = state_write_chunk(file, &state_chunks[i]);
+    trs_save_uint8(file, (Uint8 *)stateEndTag, 4);
+    if (fclose(file) == 0 && ret == 0)
+      return 0;
   }
   error("failed to save State '%s': %s", filename, strerror(errno));
   return -1;
 }
 
 int trs_state_load(const char *filename)
+{
+  return trs_state_load_parts(filename, STATE_ALL);
+}
+
+int trs_state_load_parts(const char *filename, unsigned int parts)
 {
   FILE *file;
   char banner[80];
@@ -73,34 +229,58 @@ int trs_state_load(const char *filename)
 
   file = fopen(filename, "rb");
   if (file) {
+    int ret = 0;
+
     trs_load_uint8(file, (Uint8 *)banner, stateFileBannerLen);
-    if (strncmp(banner, stateFileBanner, stateFileBannerLen)) {
-      error("failed to get State Banner from '%s'", filename);
+    if (trs_snapshot_banner(banner, stateFileBannerLen)) {
+      /* Compressed snapshot file */
+      trs_snapshot *snap;
+
       fclose(file);
-      return -1;
-    }
-    trs_load_uint32(file, &version, 1);
-    if (version != stateVersionNumber) {
-      error("unsupported version %d of State file", version);
+      if (parts != STATE_ALL) {
+        error("State '%s' can only be loaded as a whole", filename);
+        return -1;
+      }
+      ret = -1;
+      if ((snap = trs_snapshot_read(filename)) != NULL) {
+        ret = trs_snapshot_restore(snap);
+        trs_snapshot_free(snap);
+      }
+    } else {
+      if (strncmp(banner, stateFileBanner, stateFileBannerLen)) {
+        error("failed to get State Banner from '%s'", filename);
+        fclose(file);
+        return -1;
+      }
+      trs_load_uint32(file, &version, 1);
+      if (version == 5) {
+        if (parts == STATE_ALL) {
+          int i;
+
+          for (i = 0; i < STATE_CHUNKS; i++) {
+            trs_state_version = 0;
+            state_chunks[i].load(file);
+          }
+          trs_io_config();
+        } else {
+          error("State '%s' can only be loaded as a whole", filename);
+          ret = -1;
+        }
+      } else if (version == stateVersionNumber) {
+        ret = state_read_chunks(file, filename, parts);
+        trs_io_config();
+      } else {
+        error("unsupported version %d of State file", version);
+        ret = -1;
+      }
       fclose(file);
-      return -1;
     }
-    trs_main_load(file);
-    trs_cassette_load(file);
-    trs_clone_load(file);
-    trs_cp500_load(file);
-    trs_disk_load(file);
-    trs_hard_load(file);
-    trs_stringy_load(file);
-    trs_interrupt_load(file);
-    trs_io_load(file);
-    trs_mem_load(file);
-    trs_keyboard_load(file);
-    trs_uart_load(file);
-    trs_z80_load(file);
-    trs_imp_exp_load(file);
-    fclose(file);
-    return 0;
+    if (ret == 0) {
+      trs_input_record_stop();
+      trs_input_replay_end();
+      trs_rewind_reset();
+    }
+    return ret;
   }
   error("failed to load State '%s': %s", filename, strerror(errno));
   return -1;
@@ -108,12 +288,18 @@ int trs_state_load(const char *filename)
 
 void trs_save_uint8(FILE *file, const Uint8 *buffer, int count)
 {
-  fwrite(buffer, count, 1, file);
+  if (file == NULL)
+    trs_snapshot_put(buffer, count);
+  else
+    fwrite(buffer, count, 1, file);
 }
 
 void trs_load_uint8(FILE *file, Uint8 *buffer, int count)
 {
-  fread(buffer, count, 1, file);
+  if (file == NULL)
+    trs_snapshot_get(buffer, count);
+  else
+    fread(buffer, count, 1, file);
 }
 
 void trs_save_uint16(FILE *file, const Uint16 *buffer, int count)
@@ -122,6 +308,11 @@ void trs_save_uint16(FILE *file, const Uint16 *buffer, int count)
   Uint16 temp;
   Uint8 byte;
 
+  if (file == NULL) {
+    trs_snapshot_put(buffer, count * sizeof(*buffer));
+    return;
+  }
+
   for (i = 0; i < count; i++) {
     temp = *buffer++;
     byte = temp & 0xFF;
@@ -136,6 +327,11 @@ void trs_load_uint16(FILE *file, Uint16 *buffer, int count)
   int i;
   Uint8 byte0, byte1;
 
+  if (file == NULL) {
+    trs_snapshot_get(buffer, count * sizeof(*buffer));
+    return;
+  }
+
   for (i = 0; i < count; i++) {
     fread(&byte0, 1, 1, file);
     fread(&byte1, 1, 1, file);
@@ -149,6 +345,11 @@ void trs_save_uint32(FILE *file, const Uint32 *buffer, int count)
   unsigned temp;
   Uint8 byte;
 
+  if (file == NULL) {
+    trs_snapshot_put(buffer, count * sizeof(*buffer));
+    return;
+  }
+
   for (i = 0; i < count; i++) {
     temp = *buffer++;
     byte = temp & 0xFF;
@@ -170,6 +371,11 @@ void trs_load_uint32(FILE *file, Uint32 *buffer, int count)
   int i;
   Uint8 byte0, byte1, byte2, byte3;
 
+  if (file == NULL) {
+    trs_snapshot_get(buffer, count * sizeof(*buffer));
+    return;
+  }
+
   for (i = 0; i < count; i++) {
     fread(&byte0, 1, 1, file);
     fread(&byte1, 1, 1, file);
@@ -185,6 +391,11 @@ void trs_save_uint64(FILE *file, const Uint64 *buffer, int count)
   Uint64 temp;
   Uint8 byte;
 
+  if (file == NULL) {
+    trs_snapshot_put(buffer, count * sizeof(*buffer));
+    return;
+  }
+
   for (i = 0; i < count; i++) {
     temp = *buffer++;
      for (j = 0; j < 8; j++) {
@@ -201,6 +412,11 @@ void trs_load_uint64(FILE *file, Uint64 *buffer, int count)
   Uint8 byte[8];
   Uint64 temp;
 
+  if (file == NULL) {
+    trs_snapshot_get(buffer, count * sizeof(*buffer));
+    return;
+  }
+
   for (i = 0; i < count; i++) {
     for (j = 0; j < 8; j++)
       fread(&byte[j], 1, 1, file);
@@ -222,6 +438,11 @@ void trs_save_short(FILE *file, const short *buffer, int count)
   Uint8 sign;
   Uint8 byte;
 
+  if (file == NULL) {
+    trs_snapshot_put(buffer, count * sizeof(*buffer));
+    return;
+  }
+
   for (i = 0; i < count; i++) {
     num = *buffer++;
     if (num < 0) {
@@ -247,6 +468,11 @@ void trs_load_short(FILE *file, short *buffer, int count)
   short temp;
   Uint8 byte0, byte1, sign;
 
+  if (file == NULL) {
+    trs_snapshot_get(buffer, count * sizeof(*buffer));
+    return;
+  }
+
   for (i = 0; i < count; i++) {
     fread(&byte0, 1, 1, file);
     fread(&byte1, 1, 1, file);
@@ -268,6 +494,11 @@ void trs_save_int(FILE *file, const int *buffer, int count)
   Uint8 sign;
   Uint8 byte;
 
+  if (file == NULL) {
+    trs_snapshot_put(buffer, count * sizeof(*buffer));
+    return;
+  }
+
   for (i = 0; i < count; i++) {
     num = *buffer++;
     if (num < 0) {
@@ -299,6 +530,11 @@ void trs_load_int(FILE *file, int *buffer, int count)
   int temp;
   Uint8 byte0, byte1, byte2, byte3, sign;
 
+  if (file == NULL) {
+    trs_snapshot_get(buffer, count * sizeof(*buffer));
+    return;
+  }
+
   for (i = 0; i < count; i++) {
     fread(&byte0, 1, 1, file);
     fread(&byte1, 1, 1, file);
@@ -319,6 +555,11 @@ void trs_save_float(FILE *file, const float *buffer, int count)
   int i;
   char float_buff[21];
 
+  if (file == NULL) {
+    trs_snapshot_put(buffer, count * sizeof(*buffer));
+    return;
+  }
+
   for (i = 0; i < count; i++)
   {
     snprintf(float_buff, 21, "%20f", *buffer++);
@@ -331,6 +572,11 @@ void trs_load_float(FILE *file, float *buffer, int count)
   int i;
   char float_buff[21];
 
+  if (file == NULL) {
+    trs_snapshot_get(buffer, count * sizeof(*buffer));
+    return;
+  }
+
   for (i = 0; i < count; i++)
   {
     trs_load_uint8(file, (Uint8 *)float_buff, 20);
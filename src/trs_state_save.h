@@ -24,6 +24,13 @@
 
 #include <SDL_types.h>
 
+/* Save or load all of the state; a NULL file is the snapshot stream */
+void trs_state_write(FILE *file);
+void trs_state_read(FILE *file);
+
+/* Version of the part being loaded, 0 for files of version 5 */
+extern unsigned trs_state_version;
+
 int  trs_state_save(const char *filename);
 void trs_save_filename(FILE *file, char *filename);
 void trs_save_float(FILE *file, const float *buffer, int count);
@@ -34,7 +41,12 @@ void trs_save_uint16(FILE *file, const Uint16 *buffer, int count);
 void trs_save_uint32(FILE *file, const Uint32 *buffer, int count);
 void trs_save_uint64(FILE *file, const Uint64 *buffer, int count);
 
+/* Parts of the state to load, from a list of names separated by commas */
+#define STATE_ALL (~0U)
+int  trs_state_parts(const char *names, unsigned int *parts);
+
 int  trs_state_load(const char *filename);
+int  trs_state_load_parts(const char *filename, unsigned int parts);
 void trs_load_filename(FILE *file, char *filename);
 void trs_load_float(FILE *file, float *buffer, int count);
 void trs_load_int(FILE *file, int *buffer, int count);
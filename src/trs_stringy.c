@@ -728,14 +728,33 @@ void trs_stringy_save(FILE *file)
     trs_save_stringy(file, &stringy_info[i]);
 }
 
+/* A wafer which stays in its drive is kept open */
 void trs_stringy_load(FILE *file)
 {
+  static char old_name[STRINGY_MAX_UNITS][FILENAME_MAX];
+  FILE *old_file[STRINGY_MAX_UNITS];
+  int old_protect[STRINGY_MAX_UNITS];
   int i;
 
+  for (i = 0; i < STRINGY_MAX_UNITS; i++) {
+    old_file[i] = stringy_info[i].file;
+    old_protect[i] = stringy_info[i].in_port & STRINGY_WRITE_PROT;
+    memcpy(old_name[i], stringy_info[i].name, FILENAME_MAX);
+  }
   trs_load_int(file, &stringy, 1);
 
   for (i = 0; i < STRINGY_MAX_UNITS; i++) {
     trs_load_stringy(file, &stringy_info[i]);
+    if (old_file[i] != NULL) {
+      if (stringy_info[i].file != NULL &&
+          strcmp(stringy_info[i].name, old_name[i]) == 0) {
+        stringy_info[i].file = old_file[i];
+        stringy_info[i].in_port =
+          (stringy_info[i].in_port & ~STRINGY_WRITE_PROT) | old_protect[i];
+        continue;
+      }
+      fclose(old_file[i]);
+    }
     if (stringy_info[i].file != NULL) {
       stringy_info[i].file = fopen(stringy_info[i].name, "rb+");
       if (stringy_info[i].file == NULL) {
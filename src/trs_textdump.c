@@ -0,0 +1,85 @@
+/*
+ * Dump of the text on the screen.
+ *
+ * Every frame the visible text is compared with the last dump, and when
+ * it changed (or every N frames with -textdumpframes) it is appended to
+ * the file, after a line with the frame and T-state:
+ *
+ *   --- frame 120 T-state 21288960
+ *   <one line for each row of the screen>
+ *
+ * Block graphics are written as Unicode sextants and half blocks, and
+ * characters with no such equivalent as U+FFFD.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "error.h"
+#include "trs.h"
+#include "trs_textdump.h"
+
+#define TEXTDUMP_SIZE  (4 * 2048 + 64)
+
+char trs_textdump_file[FILENAME_MAX];
+int trs_textdump_frames;
+int trs_textdumping;
+
+static FILE *textdump_file;
+static char textdump_last[TEXTDUMP_SIZE];
+static unsigned long textdump_frame;
+
+void trs_textdump_frame(void)
+{
+  char text[TEXTDUMP_SIZE];
+
+  textdump_frame++;
+  if (trs_textdump_frames > 0) {
+    if (textdump_frame % trs_textdump_frames)
+      return;
+    trs_screen_utf8(text, sizeof(text));
+  } else {
+    trs_screen_utf8(text, sizeof(text));
+    if (strcmp(text, textdump_last) == 0)
+      return;
+  }
+  strcpy(textdump_last, text);
+
+  if (fprintf(textdump_file, "--- frame %lu T-state %" TSTATE_T_LEN "\n%s",
+      textdump_frame, z80_state.t_count, text) < 0) {
+    error("failed to write text dump '%s': %s", trs_textdump_file,
+        strerror(errno));
+    trs_textdump_close();
+  }
+}
+
+int trs_textdump_open(void)
+{
+  static int registered;
+
+  trs_textdump_close();
+  if ((textdump_file = fopen(trs_textdump_file, "w")) == NULL) {
+    error("failed to write text dump '%s': %s", trs_textdump_file,
+        strerror(errno));
+    return -1;
+  }
+  textdump_last[0] = 0;
+  textdump_frame = 0;
+  trs_textdumping = 1;
+
+  if (!registered && atexit(trs_textdump_close) == 0)
+    registered = 1;
+  return 0;
+}
+
+void trs_textdump_close(void)
+{
+  if (textdump_file == NULL)
+    return;
+
+  if (fclose(textdump_file) != 0)
+    error("failed to write text dump '%s': %s", trs_textdump_file,
+        strerror(errno));
+  textdump_file = NULL;
+  trs_textdumping = 0;
+}
@@ -0,0 +1,23 @@
+/*
+ * Dump of the text on the screen in UTF-8, written with -textdump so
+ * the output of programs can be compared as text, not as screenshots.
+ */
+#ifndef _TRS_TEXTDUMP_H
+#define _TRS_TEXTDUMP_H
+
+#include <stdio.h>
+
+/* File to write, and dump every N frames or whenever the text changes */
+extern char trs_textdump_file[FILENAME_MAX];
+extern int trs_textdump_frames;
+
+/* Non-zero while z80_run() must call trs_textdump_frame() */
+extern int trs_textdumping;
+
+/* Called once every frame, at the timer interrupt */
+extern void trs_textdump_frame(void);
+
+extern int trs_textdump_open(void);
+extern void trs_textdump_close(void);
+
+#endif
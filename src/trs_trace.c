@@ -0,0 +1,235 @@
+/*
+ * Binary execution trace of the emulated Z80.
+ *
+ * Before every instruction, the record of the previous one is completed
+ * with the registers it changed and the memory writes and port I/O it
+ * made, and put into a buffer which is written to the file when full.
+ * Only what changed is written, a few bytes per instruction, so the
+ * emulation keeps running at nearly full speed.  See trs_trace.h for
+ * the format, and tracedump to read it.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "error.h"
+#include "trs.h"
+#include "trs_input.h"
+#include "trs_trace.h"
+
+#define TRACE_BUFFER  (1 << 16)
+#define TRACE_RECORD  (128) /* longest record */
+
+typedef struct {
+  int kind;
+  Uint16 address;
+  Uint8 value;
+} trace_access;
+
+char trs_trace_file[FILENAME_MAX];
+int trs_trace_start = -1;
+int trs_trace_stop = -1;
+int trs_tracing;
+
+static FILE *trace_file;
+static Uint8 trace_buffer[TRACE_BUFFER];
+static int trace_len;
+static int trace_started;
+static int trace_pending;  /* an instruction is being run */
+
+/* Instruction being run */
+static Uint16 trace_pc;
+static Uint8 trace_op[4];
+static int trace_op_len;
+static tstate_t trace_t;
+static Uint16 trace_regs[TRACE_NUM_REGS];
+static trace_access trace_accesses[TRACE_MAX_ACCESS];
+static int trace_count;
+static int trace_truncated;  /* accesses were dropped */
+
+static void trace_flush(void)
+{
+  if (trace_len && fwrite(trace_buffer, 1, trace_len, trace_file) !=
+      (size_t)trace_len)
+    error("failed to write trace '%s': %s", trs_trace_file, strerror(errno));
+  trace_len = 0;
+}
+
+static void trace_put(int byte)
+{
+  trace_buffer[trace_len++] = byte;
+}
+
+static void trace_put_word(int word)
+{
+  trace_buffer[trace_len++] = word & 0xFF;
+  trace_buffer[trace_len++] = (word >> 8) & 0xFF;
+}
+
+static void trace_put_number(Uint64 number)
+{
+  while (number >= 0x80) {
+    trace_buffer[trace_len++] = (number & 0x7F) | 0x80;
+    number >>= 7;
+  }
+  trace_buffer[trace_len++] = number;
+}
+
+static void trace_get_regs(Uint16 *regs)
+{
+  regs[TRACE_AF] = Z80_AF;
+  regs[TRACE_BC] = Z80_BC;
+  regs[TRACE_DE] = Z80_DE;
+  regs[TRACE_HL] = Z80_HL;
+  regs[TRACE_IX] = Z80_IX;
+  regs[TRACE_IY] = Z80_IY;
+  regs[TRACE_SP] = Z80_SP;
+  regs[TRACE_AF_PRIME] = Z80_AF_PRIME;
+  regs[TRACE_BC_PRIME] = Z80_BC_PRIME;
+  regs[TRACE_DE_PRIME] = Z80_DE_PRIME;
+  regs[TRACE_HL_PRIME] = Z80_HL_PRIME;
+  regs[TRACE_I] = Z80_I;
+  regs[TRACE_IFF] = z80_state.iff1 | z80_state.iff2 << 1 |
+      z80_state.interrupt_mode << 2;
+}
+
+static void trace_begin(void)
+{
+  Uint64 t_count = z80_state.t_count;
+  int i;
+
+  trace_get_regs(trace_regs);
+  for (i = 0; TRACE_BANNER[i]; i++)
+    trace_put(TRACE_BANNER[i]);
+  trace_put(TRACE_VERSION);
+  for (i = 0; i < 8; i++)
+    trace_put((t_count >> (i * 8)) & 0xFF);
+  trace_put_word(Z80_PC);
+  for (i = 0; i < TRACE_NUM_REGS; i++)
+    trace_put_word(trace_regs[i]);
+  trace_started = 1;
+}
+
+/* Record of the instruction which just ran */
+static void trace_record(void)
+{
+  Sint64 const delta = z80_state.t_count - trace_t;
+  Uint16 regs[TRACE_NUM_REGS];
+  int mask = 0;
+  int i;
+
+  trace_get_regs(regs);
+  for (i = 0; i < TRACE_NUM_REGS; i++) {
+    if (regs[i] != trace_regs[i])
+      mask |= 1 << i;
+  }
+
+  trace_put(trace_op_len | (mask ? TRACE_REGS : 0) |
+      (trace_count ? TRACE_ACCESS : 0) |
+      (trace_truncated ? TRACE_TRUNCATED : 0));
+  trace_put_word(trace_pc);
+  for (i = 0; i < trace_op_len; i++)
+    trace_put(trace_op[i]);
+  /* Time goes backwards after loading a state or rewinding */
+  trace_put_number(delta < 0 ? ((Uint64)~delta << 1) | 1
+                             : (Uint64)delta << 1);
+  if (mask) {
+    trace_put_word(mask);
+    for (i = 0; i < TRACE_NUM_REGS; i++) {
+      if (mask & (1 << i))
+        trace_put_word(trace_regs[i] = regs[i]);
+    }
+  }
+  if (trace_count) {
+    trace_put(trace_count);
+    for (i = 0; i < trace_count; i++) {
+      trace_put(trace_accesses[i].kind);
+      trace_put_word(trace_accesses[i].address);
+      trace_put(trace_accesses[i].value);
+    }
+  }
+  trace_pending = 0;
+  if (trace_len > TRACE_BUFFER - TRACE_RECORD)
+    trace_flush();
+}
+
+void trs_trace_tick(void)
+{
+  int i;
+
+  /* Running again what was already traced */
+  if (trs_input_replaying == INPUT_REPLAY_HISTORY)
+    return;
+
+  if (!trace_started) {
+    if (trs_trace_start >= 0 && Z80_PC != trs_trace_start)
+      return;
+    trace_begin();
+  } else {
+    trace_record();
+    if (Z80_PC == trs_trace_stop) {
+      trs_trace_close();
+      return;
+    }
+  }
+
+  trace_pc = Z80_PC;
+  trace_op_len = instruction_length(trace_pc);
+  if (trace_op_len < 1 || trace_op_len > 4)
+    trace_op_len = 1;
+  for (i = 0; i < trace_op_len; i++)
+    trace_op[i] = mem_peek(trace_pc + i);
+  trace_t = z80_state.t_count;
+  trace_count = 0;
+  trace_truncated = 0;
+  trace_pending = 1;
+}
+
+void trs_trace_access(int kind, int address, int value)
+{
+  if (!trace_started || trs_input_replaying == INPUT_REPLAY_HISTORY)
+    return;
+  if (trace_count == TRACE_MAX_ACCESS) {
+    trace_truncated = 1;
+    return;
+  }
+  trace_accesses[trace_count].kind = kind;
+  trace_accesses[trace_count].address = address;
+  trace_accesses[trace_count].value = value;
+  trace_count++;
+}
+
+int trs_trace_open(void)
+{
+  static int registered;
+
+  trs_trace_close();
+  if ((trace_file = fopen(trs_trace_file, "wb")) == NULL) {
+    error("failed to write trace '%s': %s", trs_trace_file, strerror(errno));
+    return -1;
+  }
+  trace_len = 0;
+  trace_started = 0;
+  trs_tracing = 1;
+
+  if (!registered && atexit(trs_trace_close) == 0)
+    registered = 1;
+  return 0;
+}
+
+void trs_trace_close(void)
+{
+  if (trace_file == NULL)
+    return;
+
+  if (trace_pending)
+    trace_record();
+  if (trace_started)
+    trace_put(0);
+  trace_flush();
+  if (fclose(trace_file) != 0)
+    error("failed to write trace '%s': %s", trs_trace_file, strerror(errno));
+  trace_file = NULL;
+  trace_started = 0;
+  trs_tracing = 0;
+}
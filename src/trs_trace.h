@@ -0,0 +1,73 @@
+/*
+ * Binary execution trace of the emulated Z80, written with -trace and
+ * read by tracedump.
+ *
+ * The file starts with the banner, the version, the T-state counter and
+ * all registers.  Every instruction is then one record:
+ *
+ *   byte      TRACE_LENGTH bits: length of the opcode, other TRACE_ flags
+ *   2 bytes   PC
+ *   1-4       opcode bytes
+ *   number    T-states since the previous record, zigzag encoded
+ *   2 bytes   if TRACE_REGS: mask of the registers changed, then the
+ *             new value of each in 2 bytes
+ *   byte      if TRACE_ACCESS: count of accesses, then for each the kind,
+ *             2 bytes of address or port and the byte.  TRACE_TRUNCATED
+ *             is set if there were more than TRACE_MAX_ACCESS
+ *
+ * Numbers are 7 bits to a byte, lowest first, and words little endian.
+ * A record byte of 0 ends the trace.
+ */
+#ifndef _TRS_TRACE_H
+#define _TRS_TRACE_H
+
+#include <stdio.h>
+
+#define TRACE_BANNER       "SDLTRS Execution Trace"
+#define TRACE_VERSION      (1)
+
+/* Flags of a record */
+#define TRACE_LENGTH       (0x07)
+#define TRACE_REGS         (0x08)
+#define TRACE_ACCESS       (0x10)
+#define TRACE_TRUNCATED    (0x20)
+
+/* Registers in the mask, in this order */
+#define TRACE_AF           (0)
+#define TRACE_BC           (1)
+#define TRACE_DE           (2)
+#define TRACE_HL           (3)
+#define TRACE_IX           (4)
+#define TRACE_IY           (5)
+#define TRACE_SP           (6)
+#define TRACE_AF_PRIME     (7)
+#define TRACE_BC_PRIME     (8)
+#define TRACE_DE_PRIME     (9)
+#define TRACE_HL_PRIME     (10)
+#define TRACE_I            (11)
+#define TRACE_IFF          (12) /* iff1, iff2 << 1, interrupt mode << 2 */
+#define TRACE_NUM_REGS     (13)
+
+/* Kinds of accesses */
+#define TRACE_WRITE        (0)
+#define TRACE_IN           (1)
+#define TRACE_OUT          (2)
+#define TRACE_MAX_ACCESS   (16)
+
+/* Trace to write, and PC to start and stop at or -1 */
+extern char trs_trace_file[FILENAME_MAX];
+extern int trs_trace_start;
+extern int trs_trace_stop;
+
+/* Non-zero while z80_run() must call trs_trace_tick() */
+extern int trs_tracing;
+
+/* Called before every instruction, and on memory writes and port I/O */
+extern void trs_trace_tick(void);
+extern void trs_trace_access(int kind, int address, int value);
+
+/* Open the trace, started when the PC reaches trs_trace_start */
+extern int trs_trace_open(void);
+extern void trs_trace_close(void);
+
+#endif
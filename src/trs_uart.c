@@ -24,31 +24,66 @@
 
 /*
  * Emulation of the Radio Shack TRS-80 Model I/III/4/4P serial port.
+ *
+ * The host side is served by an I/O thread, which moves bytes between
+ * the endpoint and a pair of lock-free single-producer/single-consumer
+ * queues.  The Z80 side only looks at the queues: received bytes are
+ * handed to the Z80 at the programmed baud rate in emulated time, and
+ * the transmitter is empty again one word time after each write, so
+ * the transfer rate follows the speed of the emulated CPU, and polling
+ * the status port does not cost a system call.  If the host falls
+ * behind and the output queue fills up, the transmitter stays busy
+ * until the I/O thread has made room.
+ *
+ * Endpoints (trs_uart_name):
+ *   ttyname      host serial port
+ *   pty          new pseudo-terminal, its name is shown at startup
+ *   unix:path    UNIX-domain socket listening at path
+ *   file:in,out  read from file "in", write to file "out"
  */
 
+#ifdef __linux
+#define _GNU_SOURCE /* posix_openpt */
+#endif
 #include <errno.h>
 #include <fcntl.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/file.h>
 #ifndef _WIN32
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <termios.h>
 #endif
 #include <unistd.h>
+#include <SDL.h>
 #include "error.h"
 #include "trs.h"
 #include "trs_uart.h"
 #include "trs_state_save.h"
 
-#ifndef FNONBLOCK
-#define FNONBLOCK O_NONBLOCK
-#endif
-
-#define BUFSIZE 256
+#define BUFSIZE   256
+#define QUEUESIZE 4096 /* must be a power of 2 */
 /*#define UARTDEBUG 1*/
 /*#define UARTDEBUG2 1*/
 
+/* Endpoint types */
+#define UART_TTY    0
+#define UART_PTY    1
+#define UART_SOCKET 2
+#define UART_FILE   3
+
+#ifdef SDL2
+#define UART_ACQUIRE() SDL_MemoryBarrierAcquire()
+#define UART_RELEASE() SDL_MemoryBarrierRelease()
+#else
+#define UART_ACQUIRE() __sync_synchronize()
+#define UART_RELEASE() __sync_synchronize()
+#endif
+
 #if __linux
 char trs_uart_name[FILENAME_MAX] = "/dev/ttyS0";
 #else
@@ -69,22 +104,411 @@ static struct {
   int idata;
   int odata;
 
-  Uint8 buf[BUFSIZE];
-  Uint8* bufp;
-  int bufleft;
   int tstates;
-
-  int fd;
-  int fdflags;
+  int rx_wait;        /* trs_uart_set_avail is scheduled */
+  tstate_t rx_due;
+  tstate_t tx_done;
+  int tx_busy;        /* output queue was full at trs_uart_set_empty */
+
+  int type;
+  volatile int fd;    /* input, -1 if not connected */
+  volatile int ofd;   /* output, same as fd except for file pairs */
+  int lfd;            /* listening socket */
+  int wake[2];        /* pipe to wake up the I/O thread */
 #ifndef _WIN32
   struct termios t;
 #endif
 } uart;
 
 #ifndef _WIN32
+/*
+ * Single-producer/single-consumer queue: "head" is only written by the
+ * producer, "tail" only by the consumer.
+ */
+struct uart_queue {
+  Uint8 data[QUEUESIZE];
+  volatile unsigned int head;
+  volatile unsigned int tail;
+};
+
+static struct uart_queue rxq; /* I/O thread -> Z80 */
+static struct uart_queue txq; /* Z80 -> I/O thread */
+
+static SDL_Thread *uart_thread;
+static volatile int uart_quit;
+static char uart_open_name[FILENAME_MAX];
+static char uart_socket_path[FILENAME_MAX];
+
 static int trs_uart_wordbits[] = TRS_UART_WORDBITS_TABLE;
 static float trs_uart_baud[] = TRS_UART_BAUD_TABLE;
 
+static unsigned int
+queue_count(struct uart_queue *q)
+{
+  unsigned int count = q->head - q->tail;
+
+  UART_ACQUIRE();
+  return count;
+}
+
+static int
+queue_put(struct uart_queue *q, int value)
+{
+  if (q->head - q->tail == QUEUESIZE)
+    return 0;
+  q->data[q->head & (QUEUESIZE - 1)] = value;
+  UART_RELEASE();
+  q->head++;
+  return 1;
+}
+
+static int
+queue_get(struct uart_queue *q)
+{
+  int value;
+
+  if (q->head == q->tail)
+    return -1;
+  UART_ACQUIRE();
+  value = q->data[q->tail & (QUEUESIZE - 1)];
+  UART_RELEASE();
+  q->tail++;
+  return value;
+}
+
+/* Contiguous run of bytes at the tail of the queue */
+static unsigned int
+queue_peek(struct uart_queue *q, Uint8 **data)
+{
+  unsigned int offset = q->tail & (QUEUESIZE - 1);
+  unsigned int count = queue_count(q);
+
+  if (count > QUEUESIZE - offset)
+    count = QUEUESIZE - offset;
+  *data = &q->data[offset];
+  return count;
+}
+
+static void
+queue_skip(struct uart_queue *q, unsigned int count)
+{
+  UART_RELEASE();
+  q->tail += count;
+}
+
+static void
+uart_wake(void)
+{
+  if (write(uart.wake[1], "", 1) == -1 && errno != EAGAIN)
+    error("can't wake serial port thread: %s", strerror(errno));
+}
+
+static void
+uart_hangup(int fd)
+{
+  switch (uart.type) {
+  case UART_SOCKET:
+    /* Client has gone, wait for the next one */
+    close(fd);
+    uart.fd = uart.ofd = -1;
+    break;
+  case UART_FILE:
+    close(fd);
+    if (fd == uart.fd)
+      uart.fd = -1;
+    else
+      uart.ofd = -1;
+    break;
+  default:
+    /* No process on the pty slave, or tty error: retry later */
+    SDL_Delay(100);
+    break;
+  }
+}
+
+static int
+uart_io_thread(void *data)
+{
+  Uint8 buf[BUFSIZE];
+  Uint8 *out;
+  struct pollfd fds[4];
+  int in_idx, out_idx, lfd_idx;
+  int nfds;
+  int rc;
+  int i;
+
+  while (!uart_quit) {
+    fds[0].fd = uart.wake[0];
+    fds[0].events = POLLIN;
+    nfds = 1;
+    in_idx = out_idx = lfd_idx = -1;
+
+    if (uart.lfd != -1 && uart.fd == -1) {
+      fds[nfds].fd = uart.lfd;
+      fds[nfds].events = POLLIN;
+      lfd_idx = nfds++;
+    }
+    if (uart.fd != -1 && queue_count(&rxq) < QUEUESIZE) {
+      fds[nfds].fd = uart.fd;
+      fds[nfds].events = POLLIN;
+      in_idx = nfds++;
+    }
+    if (uart.ofd != -1 && queue_count(&txq) > 0) {
+      fds[nfds].fd = uart.ofd;
+      fds[nfds].events = POLLOUT;
+      out_idx = nfds++;
+    }
+
+    rc = poll(fds, nfds, 100);
+    if (rc < 0) {
+      if (errno != EINTR) {
+	error("can't poll '%s': %s", trs_uart_name, strerror(errno));
+	SDL_Delay(100);
+      }
+      continue;
+    }
+
+    if (fds[0].revents & POLLIN) {
+      while (read(uart.wake[0], buf, sizeof(buf)) > 0)
+	;
+    }
+
+    if (lfd_idx != -1 && (fds[lfd_idx].revents & POLLIN)) {
+      int fd = accept(uart.lfd, NULL, NULL);
+
+      if (fd != -1) {
+	fcntl(fd, F_SETFL, O_NONBLOCK);
+	uart.ofd = uart.fd = fd;
+      }
+    }
+
+    if (in_idx != -1 && (fds[in_idx].revents & (POLLIN | POLLHUP | POLLERR))) {
+      int space = QUEUESIZE - queue_count(&rxq);
+
+      rc = read(fds[in_idx].fd, buf, space < BUFSIZE ? space : BUFSIZE);
+#if UARTDEBUG
+      debug("trs_uart read returns %d\n", rc);
+#endif
+      if (rc > 0) {
+	for (i = 0; i < rc; i++)
+	  queue_put(&rxq, buf[i]);
+      } else if (rc == 0 || (errno != EAGAIN && errno != EINTR)) {
+	uart_hangup(fds[in_idx].fd);
+	continue;
+      }
+    }
+
+    if (out_idx != -1 && (fds[out_idx].revents & (POLLOUT | POLLHUP | POLLERR))) {
+      int count = queue_peek(&txq, &out);
+
+      rc = write(fds[out_idx].fd, out, count);
+      if (rc > 0)
+	queue_skip(&txq, rc);
+      else if (rc < 0 && errno != EAGAIN && errno != EINTR) {
+	error("can't write to '%s': %s", trs_uart_name, strerror(errno));
+	uart_hangup(fds[out_idx].fd);
+      }
+    }
+  }
+  return 0;
+}
+
+static int
+uart_open_tty(const char *name)
+{
+  uart.fd = open(name, O_RDWR|O_NOCTTY|O_NONBLOCK);
+  if (uart.fd == -1) {
+    error("can't open '%s': %s", name, strerror(errno));
+    return -1;
+  }
+  if (tcgetattr(uart.fd, &uart.t) < 0) {
+    error("can't get attributes of '%s': %s", name, strerror(errno));
+    return -1;
+  }
+  uart.ofd = uart.fd;
+  uart.type = UART_TTY;
+  return 0;
+}
+
+static int
+uart_open_pty(void)
+{
+  uart.fd = posix_openpt(O_RDWR|O_NOCTTY);
+  if (uart.fd == -1 || grantpt(uart.fd) || unlockpt(uart.fd) ||
+      tcgetattr(uart.fd, &uart.t) < 0) {
+    error("can't open pseudo-terminal: %s", strerror(errno));
+    return -1;
+  }
+  fcntl(uart.fd, F_SETFL, O_NONBLOCK);
+  debug("serial port is connected to %s\n", ptsname(uart.fd));
+  uart.ofd = uart.fd;
+  uart.type = UART_PTY;
+  return 0;
+}
+
+static int
+uart_open_socket(const char *path)
+{
+  struct sockaddr_un addr;
+
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    error("socket path '%s' is too long", path);
+    return -1;
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+
+  uart.lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (uart.lfd == -1) {
+    error("can't create socket '%s': %s", path, strerror(errno));
+    return -1;
+  }
+  unlink(path);
+  if (bind(uart.lfd, (struct sockaddr *)&addr, sizeof(addr)) == -1 ||
+      listen(uart.lfd, 1) == -1) {
+    error("can't listen on socket '%s': %s", path, strerror(errno));
+    return -1;
+  }
+  fcntl(uart.lfd, F_SETFL, O_NONBLOCK);
+  snprintf(uart_socket_path, FILENAME_MAX, "%s", path);
+  uart.type = UART_SOCKET;
+  return 0;
+}
+
+static int
+uart_open_files(const char *names)
+{
+  char input[FILENAME_MAX];
+  const char *output = strchr(names, ',');
+
+  snprintf(input, FILENAME_MAX, "%.*s",
+      output ? (int)(output - names) : (int)strlen(names), names);
+  uart.type = UART_FILE;
+  if (input[0]) {
+    uart.fd = open(input, O_RDONLY|O_NONBLOCK);
+    if (uart.fd == -1) {
+      error("can't open '%s': %s", input, strerror(errno));
+      return -1;
+    }
+  }
+  if (output && output[1]) {
+    uart.ofd = open(output + 1, O_WRONLY|O_CREAT|O_TRUNC|O_NONBLOCK, 0644);
+    if (uart.ofd == -1) {
+      error("can't open '%s': %s", output + 1, strerror(errno));
+      return -1;
+    }
+  }
+  return 0;
+}
+
+static void
+uart_release(void)
+{
+  if (uart.ofd != -1 && uart.ofd != uart.fd)
+    close(uart.ofd);
+  if (uart.fd != -1)
+    close(uart.fd);
+  if (uart.lfd != -1)
+    close(uart.lfd);
+  if (uart.wake[0] != -1) {
+    close(uart.wake[0]);
+    close(uart.wake[1]);
+  }
+  if (uart_socket_path[0]) {
+    unlink(uart_socket_path);
+    uart_socket_path[0] = '\0';
+  }
+  uart.fd = uart.ofd = uart.lfd = uart.wake[0] = uart.wake[1] = -1;
+  rxq.head = rxq.tail = 0;
+  txq.head = txq.tail = 0;
+}
+
+static void
+uart_close(void)
+{
+  if (uart_open_name[0] == '\0')
+    return;
+  uart_quit = 1;
+  uart_wake();
+  SDL_WaitThread(uart_thread, NULL);
+  uart_thread = NULL;
+  uart_release();
+  uart_open_name[0] = '\0';
+}
+
+static int
+uart_open(const char *name)
+{
+  int rc;
+
+  uart.fd = uart.ofd = uart.lfd = -1;
+  memset(&uart.t, 0, sizeof(uart.t));
+
+  if (pipe(uart.wake) == -1) {
+    error("can't create pipe: %s", strerror(errno));
+    uart.wake[0] = uart.wake[1] = -1;
+    uart_release();
+    return -1;
+  }
+  fcntl(uart.wake[0], F_SETFL, O_NONBLOCK);
+  fcntl(uart.wake[1], F_SETFL, O_NONBLOCK);
+
+  if (strcmp(name, "pty") == 0)
+    rc = uart_open_pty();
+  else if (strncmp(name, "unix:", 5) == 0)
+    rc = uart_open_socket(name + 5);
+  else if (strncmp(name, "file:", 5) == 0)
+    rc = uart_open_files(name + 5);
+  else
+    rc = uart_open_tty(name);
+
+  if (rc == 0) {
+    uart_quit = 0;
+#ifdef SDL2
+    uart_thread = SDL_CreateThread(uart_io_thread, "serial", NULL);
+#else
+    uart_thread = SDL_CreateThread(uart_io_thread, NULL);
+#endif
+    if (uart_thread == NULL) {
+      error("failed to create serial port thread: %s", SDL_GetError());
+      rc = -1;
+    }
+  }
+  if (rc == -1) {
+    uart_release();
+    return -1;
+  }
+  snprintf(uart_open_name, FILENAME_MAX, "%s", name);
+  return 0;
+}
+
+/* Set attributes of a host serial port or pseudo-terminal */
+static void
+uart_set_attr(void)
+{
+  if (uart.type <= UART_PTY && uart.fd != -1) {
+    if (tcsetattr(uart.fd, TCSADRAIN, &uart.t) == -1) {
+      error("can't set attributes of '%s': %s", trs_uart_name, strerror(errno));
+    }
+  }
+}
+
+/* T-states needed to transfer one word */
+static void
+uart_timing(void)
+{
+  int bits = 1 + trs_uart_wordbits[TRS_UART_WORDBITS(uart.control)] +
+    ((uart.control & TRS_UART_NOPAR) ? 0 : 1) +
+    ((uart.control & TRS_UART_STOP2) ? 2 : 1);
+
+  uart.tstates = (z80_state.clockMHz * 1000000.0 * bits)
+    / trs_uart_baud[TRS_UART_SNDBAUD(uart.baud)];
+#if UARTDEBUG
+  debug("total bits %d; tstates per word %d\n", bits, uart.tstates);
+#endif
+}
+
 static int
 xlate_baud(int trs_baud)
 {
@@ -139,12 +563,10 @@ xlate_baud(int trs_baud)
 }
 #endif
 
+
 void
 trs_uart_init(int reset_button)
 {
-#ifndef _WIN32
-  int err;
-#endif
 #if UARTDEBUG
   debug("trs_uart_init\n");
 #endif
@@ -152,28 +574,21 @@ trs_uart_init(int reset_button)
   initialized = -1;
   return;
 #else
-  if (initialized == 1 && uart.fd != -1) close(uart.fd);
   if (trs_uart_name[0] == '\000') {
     /* Emulate having no serial port */
+    uart_close();
     initialized = -1;
     return;
   }
-  initialized = 1;
-  uart.fd = open(trs_uart_name, O_RDWR|O_NOCTTY|O_NONBLOCK);
-  if (uart.fd == -1) {
-    error("can't open '%s': %s", trs_uart_name, strerror(errno));
-    initialized = -1;
-    return;
-  } else {
-    uart.fdflags = FNONBLOCK;
-    err = tcgetattr(uart.fd, &uart.t);
-    if (err < 0) {
-      error("can't get attributes of '%s': %s", trs_uart_name, strerror(errno));
-      close(uart.fd);
-      initialized = uart.fd = -1;
+  /* Keep the endpoint open over a reset, so the pty name stays valid */
+  if (strcmp(uart_open_name, trs_uart_name) != 0) {
+    uart_close();
+    if (uart_open(trs_uart_name) == -1) {
+      initialized = -1;
       return;
     }
   }
+  initialized = 1;
 
   uart.t.c_iflag = 0;
   uart.t.c_oflag = 0;
@@ -185,20 +600,23 @@ trs_uart_init(int reset_button)
 
   uart.switches = (trs_model == 1) ? trs_uart_switches : 0xff;
 
-  /* arbitrary default */
-  uart.baud = -1;
-  trs_uart_baud_out((TRS_UART_9600 << 4) + TRS_UART_9600);
-
   /* arbitrary default */
   uart.control = -1;
   trs_uart_control_out(TRS_UART_NOPAR | TRS_UART_WORD8 | TRS_UART_NOTBREAK |
 		       TRS_UART_DTR | TRS_UART_RTS);
 
+  /* arbitrary default */
+  uart.baud = -1;
+  trs_uart_baud_out((TRS_UART_9600 << 4) + TRS_UART_9600);
+
   uart.status = TRS_UART_SENT;
   trs_uart_snd_interrupt(1);
 
-  uart.bufp = uart.buf;
-  uart.bufleft = 0;
+  /* Discard pending input */
+  rxq.tail = rxq.head;
+  uart.rx_wait = 0;
+  uart.tx_done = 0;
+  uart.tx_busy = 0;
 #endif
 }
 
@@ -242,10 +660,6 @@ trs_uart_switches_in(void)
 void
 trs_uart_baud_out(int value)
 {
-#ifndef _WIN32
-  int err;
-  int bits;
-#endif
 #if UARTDEBUG
   debug("trs_uart_baud_out 0x%02x\n", value);
 #endif
@@ -259,28 +673,26 @@ trs_uart_baud_out(int value)
 
   cfsetispeed(&uart.t, xlate_baud(TRS_UART_RCVBAUD(value)));
   cfsetospeed(&uart.t, xlate_baud(TRS_UART_SNDBAUD(value)));
-
-  bits = 1 + trs_uart_wordbits[TRS_UART_WORDBITS(uart.control)] +
-    ((uart.control & TRS_UART_NOPAR) ? 0 : 1) +
-    ((uart.control & TRS_UART_STOP2) ? 2 : 1);
-  uart.tstates = (z80_state.clockMHz * 1000000.0 * bits)
-    / trs_uart_baud[TRS_UART_SNDBAUD(value)];
-#if UARTDEBUG
-  debug("total bits %d; tstates per word %d\n", bits, uart.tstates);
-#endif
-
-  if (uart.fd != -1) {
-    err = tcsetattr(uart.fd, TCSADRAIN, &uart.t);
-    if (err == -1) {
-      error("can't set attributes of '%s': %s", trs_uart_name, strerror(errno));
-    }
-  }
+  uart_timing();
+  uart_set_attr();
 #endif
 }
 
 void
 trs_uart_set_avail(int dummy)
 {
+#ifndef _WIN32
+  int full = (queue_count(&rxq) == QUEUESIZE);
+  int value;
+
+  uart.rx_wait = 0;
+  if (uart.status & TRS_UART_RCVD) return;
+  value = queue_get(&rxq);
+  if (value == -1) return;
+  /* The I/O thread stopped reading while the queue was full */
+  if (full) uart_wake();
+  uart.idata = value;
+#endif
   uart.status |= TRS_UART_RCVD;
   trs_uart_rcv_interrupt(1);
 }
@@ -288,6 +700,14 @@ trs_uart_set_avail(int dummy)
 void
 trs_uart_set_empty(int dummy)
 {
+#ifndef _WIN32
+  /* Wait for the I/O thread, see trs_uart_check_avail */
+  if (uart.ofd != -1 && queue_count(&txq) == QUEUESIZE) {
+    uart.tx_busy = 1;
+    return;
+  }
+  uart.tx_busy = 0;
+#endif
   uart.status |= TRS_UART_SENT;
   trs_uart_snd_interrupt(1);
 }
@@ -298,42 +718,26 @@ trs_uart_check_avail(void)
 #ifdef _WIN32
   return 0;
 #else
-  if (initialized == 1 && uart.bufleft == 0 && uart.fd != -1) {
-    /* check for data available */
-    int rc;
-    if (!(uart.fdflags & FNONBLOCK)) {
-#if UARTDEBUG
-      debug("trs_uart nonblocking\n");
-#endif
-      uart.fdflags |= FNONBLOCK;
-      fcntl(uart.fd, F_SETFL, uart.fdflags);
-    }
-    do {
-      rc = read(uart.fd, uart.buf, BUFSIZE);
-    } while (rc < 0 && errno == EINTR);
-#if UARTDEBUG
-#if !UARTDEBUG2
-    if (rc >= 0 || errno != EAGAIN)
-#endif
-      debug("trs_uart read returns %d, errno %d: %s\n", rc, errno, strerror(errno));
-#endif
-    if (rc < 0) {
-      if (errno != EAGAIN) {
-	error("can't read from '%s': %s", trs_uart_name, strerror(errno));
-      }
-      rc = 0;
-    }
-    uart.bufp = uart.buf;
-    uart.bufleft = rc;
-    if (rc > 0) {
-      /* be sure events don't happen too fast */
+  int avail;
+
+  if (initialized != 1) return 0;
+  /* The host has taken some output */
+  if (uart.tx_busy && queue_count(&txq) < QUEUESIZE)
+    trs_uart_set_empty(0);
+  avail = queue_count(&rxq);
+  if (avail && !(uart.status & TRS_UART_RCVD)) {
+    /* Hand the next word to the Z80 one word time from now, unless
+       already scheduled (and the event has not been cancelled) */
+    if (!uart.rx_wait || z80_state.t_count > uart.rx_due) {
+      uart.rx_wait = 1;
+      uart.rx_due = z80_state.t_count + uart.tstates;
       trs_schedule_event(trs_uart_set_avail, 1, uart.tstates);
     }
   }
 #if UARTDEBUG2
-  debug("trs_uart_check_avail returns %d\n", uart.bufleft);
+  debug("trs_uart_check_avail returns %d\n", avail);
 #endif
-  return uart.bufleft;
+  return avail;
 #endif
 }
 
@@ -346,6 +750,15 @@ trs_uart_status_in(void)
   if (initialized == 0) trs_uart_init(0);
   if (initialized == -1) return 0xff;
   trs_uart_check_avail();
+  /* Transmitter is busy for one word time after each write, and while
+     the output queue is full */
+  if (uart.tx_busy)
+    uart.status &= ~TRS_UART_SENT;
+  else if (uart.tx_done <= z80_state.t_count ||
+      uart.tx_done - z80_state.t_count > (tstate_t)uart.tstates)
+    uart.status |= TRS_UART_SENT;
+  else
+    uart.status &= ~TRS_UART_SENT;
 #if UARTDEBUG
   if (uart.status != oldstatus) {
     debug("trs_uart_status_in returns 0x%02x\n", uart.status);
@@ -361,7 +774,6 @@ trs_uart_control_out(int value)
 #ifdef _WIN32
   return;
 #else
-  int err;
   int cflag = HUPCL|CREAD|CLOCAL;
 #if UARTDEBUG
   debug("trs_uart_control_out 0x%02x\n", value);
@@ -388,16 +800,12 @@ trs_uart_control_out(int value)
   if (value & TRS_UART_STOP2) cflag |= CSTOPB;
   if (!(value & TRS_UART_NOPAR)) cflag |= PARENB;
   uart.t.c_cflag = cflag;
-  if (uart.fd != -1) {
-    err = tcsetattr(uart.fd, TCSADRAIN, &uart.t);
-    if (err == -1) {
-      error("can't set attributes of '%s': %s", trs_uart_name, strerror(errno));
-    }
-  }
+  if (uart.baud != -1)
+    uart_timing();
+  uart_set_attr();
 
-  if (!(value & TRS_UART_NOTBREAK) && uart.fd != -1) {
-    err = tcsendbreak(uart.fd, 0);
-    if (err == -1) {
+  if (!(value & TRS_UART_NOTBREAK) && uart.type == UART_TTY) {
+    if (tcsendbreak(uart.fd, 0) == -1) {
       error("can't send break on '%s': %s", trs_uart_name, strerror(errno));
     }
   }
@@ -409,16 +817,12 @@ trs_uart_data_in(void)
 {
   if (initialized == 0) trs_uart_init(0);
   if (initialized == -1) return 0xff;
-  trs_uart_check_avail();
   if (uart.status & TRS_UART_RCVD) {
     uart.status &= ~TRS_UART_RCVD;
     trs_uart_rcv_interrupt(0);
-    uart.bufleft--;
-    uart.idata = *uart.bufp++;
-    if (uart.bufleft) {
-      trs_schedule_event(trs_uart_set_avail, 1, uart.tstates);
-    }
   }
+  /* Schedule the next word, if any */
+  trs_uart_check_avail();
 #if UARTDEBUG
   debug("trs_uart_data_in returns 0x%02x\n", uart.idata);
 #endif
@@ -431,7 +835,7 @@ trs_uart_data_out(int value)
 #ifdef _WIN32
   return;
 #else
-  int err;
+  int empty;
 
 #if UARTDEBUG
   debug("trs_uart_data_out 0x%02x\n", value);
@@ -439,24 +843,23 @@ trs_uart_data_out(int value)
   if (initialized == 0) trs_uart_init(0);
   if (initialized == -1) return;
   uart.odata = value;
-  if (uart.fd != -1) {
-    for (;;) {
-      err = write(uart.fd, &uart.odata, 1);
-      if (err >= 0) return;
-      if (errno != EAGAIN) {
-	error("can't read from '%s': %s", trs_uart_name, strerror(errno));
-	return;
-      }
-      /* Oops, here we didn't really want nonblocking i/o */
+  uart.tx_done = z80_state.t_count + uart.tstates;
+  uart.status &= ~TRS_UART_SENT;
+  trs_uart_snd_interrupt(0);
+  trs_schedule_event(trs_uart_set_empty, 1, uart.tstates);
+
+  /* Nobody is listening */
+  if (uart.ofd == -1) return;
+
+  empty = (queue_count(&txq) == 0);
+  if (!queue_put(&txq, value)) {
+    /* Written while the transmitter was busy: the word is lost */
 #if UARTDEBUG
-      debug("trs_uart blocking\n");
+    debug("trs_uart_data_out overrun\n");
 #endif
-      uart.fdflags &= ~FNONBLOCK;
-      fcntl(uart.fd, F_SETFL, uart.fdflags);
-    }
-    trs_uart_snd_interrupt(0);
-    trs_schedule_event(trs_uart_set_empty, 1, uart.tstates);
+    return;
   }
+  if (empty) uart_wake();
 #endif
 }
 
@@ -475,4 +878,3 @@ void trs_uart_load(FILE *file)
   trs_load_int(file, &trs_uart_switches, 1);
   trs_load_int(file, &initialized, 1);
 }
-
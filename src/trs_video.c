@@ -0,0 +1,319 @@
+/*
+ * Video capture of the emulated screen and sound.
+ *
+ * A frame is taken every 1/trs_video_rate second of emulated time, so a
+ * capture does not depend on the speed of the host: it is the same when
+ * the emulation runs throttled, unthrottled or without a window.  The
+ * Z80 thread copies the screen and the sound of the frame into a queue,
+ * and an encoder thread converts the pixels and writes them, waiting for
+ * the encoder only when the queue is full.
+ *
+ * The video is a Y4M stream (YUV 4:4:4, lossless for the few colors of
+ * the screen) and the sound an 8-bit stereo WAV file of the levels the
+ * Z80 sends to the cassette port, the Model 4 sound port and the
+ * Orchestra 85/90, whether the host plays sound or not.  Both have the
+ * same length and are combined with, for example:
+ *
+ *   ffmpeg -i run.y4m -i run.y4m.wav -c:v ffv1 run.mkv
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL.h>
+#include "error.h"
+#include "trs.h"
+#include "trs_input.h"
+#include "trs_video.h"
+
+#define VIDEO_FRAMES      (8) /* frames queued for the encoder */
+#define VIDEO_AUDIO_RATE  (44100)
+#define VIDEO_NEVER       ((tstate_t) -1)
+
+typedef struct {
+  Uint32 *pixels; /* 0xRRGGBB */
+  Uint8 *audio;   /* left and right samples */
+  int samples;
+} video_frame;
+
+char trs_video_file[FILENAME_MAX];
+int trs_video_rate = 30;
+tstate_t trs_video_due = VIDEO_NEVER;
+
+static FILE *video_file;
+static FILE *audio_file;
+static char audio_name[FILENAME_MAX + 4];
+static Uint32 audio_bytes;
+static int video_width, video_height;
+static Uint8 *video_planes;
+
+static video_frame video_queue[VIDEO_FRAMES];
+static int video_head, video_count; /* frames waiting for the encoder */
+static int video_next;              /* frame being filled */
+static int video_quit;
+static SDL_mutex *video_lock;
+static SDL_cond *video_cond;
+static SDL_Thread *video_thread;
+
+/* Frame being filled */
+static tstate_t video_start;
+static tstate_t video_span;
+static int video_samples;
+static int audio_remainder;
+static int audio_left = 0x80, audio_right = 0x80;
+
+static void put_le(FILE *file, Uint32 value, int bytes)
+{
+  while (bytes-- > 0) {
+    putc(value & 0xFF, file);
+    value >>= 8;
+  }
+}
+
+static void audio_header(FILE *file, Uint32 size)
+{
+  fputs("RIFF", file);
+  put_le(file, 36 + size, 4);
+  fputs("WAVEfmt ", file);
+  put_le(file, 16, 4);
+  put_le(file, 1, 2);                    /* PCM */
+  put_le(file, 2, 2);                    /* stereo */
+  put_le(file, VIDEO_AUDIO_RATE, 4);
+  put_le(file, VIDEO_AUDIO_RATE * 2, 4); /* bytes per second */
+  put_le(file, 2, 2);                    /* bytes per sample */
+  put_le(file, 8, 2);                    /* bits */
+  fputs("data", file);
+  put_le(file, size, 4);
+}
+
+/* Convert to BT.601 YUV and write the frame, in the encoder thread */
+static void video_write(const video_frame *frame)
+{
+  int const size = video_width * video_height;
+  Uint8 *y = video_planes;
+  Uint8 *u = y + size;
+  Uint8 *v = u + size;
+  int i;
+
+  for (i = 0; i < size; i++) {
+    int const r = (frame->pixels[i] >> 16) & 0xFF;
+    int const g = (frame->pixels[i] >> 8) & 0xFF;
+    int const b = frame->pixels[i] & 0xFF;
+
+    y[i] = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+    u[i] = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+    v[i] = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+  }
+
+  fputs("FRAME\n", video_file);
+  fwrite(video_planes, 1, size * 3, video_file);
+  fwrite(frame->audio, 2, frame->samples, audio_file);
+  audio_bytes += frame->samples * 2;
+}
+
+static int video_encoder(void *data)
+{
+  SDL_LockMutex(video_lock);
+  for (;;) {
+    if (video_count == 0) {
+      if (video_quit)
+        break;
+      SDL_CondWait(video_cond, video_lock);
+      continue;
+    }
+    SDL_UnlockMutex(video_lock);
+
+    video_write(&video_queue[video_head]);
+
+    SDL_LockMutex(video_lock);
+    video_head = (video_head + 1) % VIDEO_FRAMES;
+    video_count--;
+    SDL_CondBroadcast(video_cond);
+  }
+  SDL_UnlockMutex(video_lock);
+  return 0;
+}
+
+/* Sound of the frame at its current level up to sample */
+static void video_fill_audio(int sample)
+{
+  video_frame *frame = &video_queue[video_next];
+
+  if (sample > video_samples)
+    sample = video_samples;
+  while (frame->samples < sample) {
+    frame->audio[frame->samples * 2] = audio_left;
+    frame->audio[frame->samples * 2 + 1] = audio_right;
+    frame->samples++;
+  }
+}
+
+static void video_begin(tstate_t start)
+{
+  video_start = start;
+  video_span = z80_state.clockMHz * 1000000.0 / trs_video_rate;
+  if (video_span == 0)
+    video_span = 1;
+  trs_video_due = start + video_span;
+
+  /* Exactly VIDEO_AUDIO_RATE samples every second */
+  audio_remainder += VIDEO_AUDIO_RATE;
+  video_samples = audio_remainder / trs_video_rate;
+  audio_remainder %= trs_video_rate;
+  video_queue[video_next].samples = 0;
+}
+
+void trs_video_frame(void)
+{
+  tstate_t const now = z80_state.t_count;
+
+  /* Rewound, loaded a state or running again what was captured */
+  if (now < video_start || now - trs_video_due >= video_span ||
+      trs_input_replaying == INPUT_REPLAY_HISTORY) {
+    audio_remainder = 0;
+    video_begin(now);
+    return;
+  }
+
+  video_fill_audio(video_samples);
+  trs_screen_pixels(video_queue[video_next].pixels, video_width,
+      video_height);
+
+  SDL_LockMutex(video_lock);
+  video_count++;
+  SDL_CondBroadcast(video_cond);
+  while (video_count == VIDEO_FRAMES)
+    SDL_CondWait(video_cond, video_lock);
+  SDL_UnlockMutex(video_lock);
+
+  video_next = (video_next + 1) % VIDEO_FRAMES;
+  video_begin(trs_video_due);
+}
+
+void trs_video_audio(int left, int right)
+{
+  if (video_thread == NULL)
+    return;
+
+  if (z80_state.t_count > video_start)
+    video_fill_audio((z80_state.t_count - video_start) * video_samples /
+        video_span);
+  if (left >= 0)
+    audio_left = left;
+  if (right >= 0)
+    audio_right = right;
+}
+
+static void video_free(void)
+{
+  int i;
+
+  for (i = 0; i < VIDEO_FRAMES; i++) {
+    free(video_queue[i].pixels);
+    free(video_queue[i].audio);
+    video_queue[i].pixels = NULL;
+    video_queue[i].audio = NULL;
+  }
+  free(video_planes);
+  video_planes = NULL;
+
+  if (video_cond)
+    SDL_DestroyCond(video_cond);
+  if (video_lock)
+    SDL_DestroyMutex(video_lock);
+  video_cond = NULL;
+  video_lock = NULL;
+}
+
+int trs_video_open(void)
+{
+  static int registered;
+  int samples;
+  int i;
+
+  trs_video_close();
+  if (trs_video_rate < 1 || trs_video_rate > 100) {
+    error("video rate must be 1 to 100 frames per second");
+    return -1;
+  }
+  samples = VIDEO_AUDIO_RATE / trs_video_rate + 1;
+
+  trs_screen_size(&video_width, &video_height);
+  for (i = 0; i < VIDEO_FRAMES; i++) {
+    video_queue[i].pixels = malloc(video_width * video_height * 4);
+    video_queue[i].audio = malloc(samples * 2);
+    if (video_queue[i].pixels == NULL || video_queue[i].audio == NULL)
+      fatal("failed to allocate video frames");
+  }
+  if ((video_planes = malloc(video_width * video_height * 3)) == NULL)
+    fatal("failed to allocate video frames");
+
+  snprintf(audio_name, sizeof(audio_name), "%s.wav", trs_video_file);
+  if ((video_file = fopen(trs_video_file, "wb")) == NULL) {
+    error("failed to write video '%s': %s", trs_video_file, strerror(errno));
+    video_free();
+    return -1;
+  }
+  if ((audio_file = fopen(audio_name, "wb")) == NULL) {
+    error("failed to write video '%s': %s", audio_name, strerror(errno));
+    fclose(video_file);
+    video_file = NULL;
+    video_free();
+    return -1;
+  }
+  fprintf(video_file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444\n",
+      video_width, video_height, trs_video_rate);
+  audio_header(audio_file, 0);
+  audio_bytes = 0;
+
+  video_head = video_count = video_next = 0;
+  video_quit = 0;
+  video_lock = SDL_CreateMutex();
+  video_cond = SDL_CreateCond();
+  if (video_lock && video_cond) {
+#ifdef SDL2
+    video_thread = SDL_CreateThread(video_encoder, "video", NULL);
+#else
+    video_thread = SDL_CreateThread(video_encoder, NULL);
+#endif
+  }
+  if (video_thread == NULL) {
+    error("failed to create video thread: %s", SDL_GetError());
+    fclose(video_file);
+    fclose(audio_file);
+    video_file = audio_file = NULL;
+    video_free();
+    return -1;
+  }
+
+  audio_remainder = 0;
+  video_begin(z80_state.t_count);
+
+  if (!registered && atexit(trs_video_close) == 0)
+    registered = 1;
+  return 0;
+}
+
+void trs_video_close(void)
+{
+  if (video_thread == NULL)
+    return;
+
+  /* Write what is queued */
+  SDL_LockMutex(video_lock);
+  video_quit = 1;
+  SDL_CondBroadcast(video_cond);
+  SDL_UnlockMutex(video_lock);
+  SDL_WaitThread(video_thread, NULL);
+  video_thread = NULL;
+  trs_video_due = VIDEO_NEVER;
+
+  if (fclose(video_file) != 0)
+    error("failed to write video '%s': %s", trs_video_file, strerror(errno));
+  if (fseek(audio_file, 0, SEEK_SET) == 0)
+    audio_header(audio_file, audio_bytes);
+  if (fclose(audio_file) != 0)
+    error("failed to write video '%s': %s", audio_name, strerror(errno));
+  video_file = audio_file = NULL;
+  video_free();
+}
@@ -0,0 +1,26 @@
+/*
+ * Video capture of the emulated screen and sound, written with -video
+ * at a fixed rate of emulated time.
+ */
+#ifndef _TRS_VIDEO_H
+#define _TRS_VIDEO_H
+
+#include <stdio.h>
+#include "z80.h"
+
+/* Y4M video to write, with the sound in the same name plus ".wav" */
+extern char trs_video_file[FILENAME_MAX];
+extern int trs_video_rate; /* frames per second of emulated time */
+
+/* T-state when z80_run() must call trs_video_frame() */
+extern tstate_t trs_video_due;
+
+extern void trs_video_frame(void);
+
+/* New levels of the sound output, 8-bit unsigned, -1 if not changed */
+extern void trs_video_audio(int left, int right);
+
+extern int trs_video_open(void);
+extern void trs_video_close(void);
+
+#endif
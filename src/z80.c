@@ -60,8 +60,16 @@
 
 #include "error.h"
 #include "trs.h"
+#include "trs_auto.h"
 #include "trs_imp_exp.h"
+#include "trs_input.h"
+#include "trs_metrics.h"
+#include "trs_profile.h"
+#include "trs_rewind.h"
 #include "trs_state_save.h"
+#include "trs_textdump.h"
+#include "trs_trace.h"
+#include "trs_video.h"
 
 /*
  * The state of our Z80 registers is kept in this structure:
@@ -1279,6 +1287,7 @@ static void do_int(void)
     Z80_SP -= 2;
     mem_write_word(Z80_SP, Z80_PC);
     z80_state.iff1 = z80_state.iff2 = 0;
+    if (trs_profiling) trs_profile_interrupt();
     Z80_R++;
     switch (z80_state.interrupt_mode) {
     case 0:
@@ -1304,6 +1313,7 @@ static void do_nmi(void)
     Z80_SP -= 2;
     mem_write_word(Z80_SP, Z80_PC);
     z80_state.iff1 = 0;
+    if (trs_profiling) trs_profile_interrupt();
     Z80_R++;
     Z80_PC = 0x66;
     T_COUNT(11);
@@ -2864,6 +2874,12 @@ static int do_ED_instruction(void)
       case 0x2b:        /* emt_setddir */
 	do_emt_setddir();
 	break;
+      case 0x2c:        /* emt_readx */
+	do_emt_readx();
+	break;
+      case 0x2d:        /* emt_writex */
+	do_emt_writex();
+	break;
       case 0x2e:        /* SSPD A (David Keil) */
 	timer_overclock = ((Z80_A & (1 << 2)) != 0);
 	trs_timer_mode(timer_overclock);
@@ -2959,16 +2975,50 @@ int z80_run(int continuous)
 	else
 	  t_delta = last_t_count - z80_state.t_count;
 
-	if (t_delta >= cycles_per_timer) {
-	  trs_get_event(0);
-	  if (trs_paused) {
-	    while (trs_paused)
-	      trs_get_event(1);
+	if (t_delta >= cycles_per_timer / TIMER_SLICES) {
+	  /* No live events while running again what was logged */
+	  if (trs_timer_sync_with_host() &&
+	      trs_input_replaying != INPUT_REPLAY_HISTORY) {
+	    trs_get_event(0);
+	    if (trs_paused) {
+	      while (trs_paused)
+	        trs_get_event(1);
+	    }
+	    if (trs_textdumping)
+	      trs_textdump_frame();
+	    trs_metrics_frame();
 	  }
-	  trs_timer_sync_with_host();
 	  last_t_count = z80_state.t_count;
+	  if (trs_input_replaying != INPUT_REPLAY_HISTORY) {
+	    trs_auto_poll();
+	    trs_rewind_tick();
+	  }
+#ifdef ZBX
+	  /* And so do the devices, like the clock of the DOS */
+	  if (debug_watches)
+	    debug_watch_check();
+#endif
 	}
 
+	if (z80_state.t_count >= trs_input_due)
+	  trs_input_run();
+	if (z80_state.t_count >= trs_auto_due &&
+	    trs_input_replaying != INPUT_REPLAY_HISTORY)
+	  trs_auto_run();
+	if (z80_state.t_count >= trs_video_due)
+	  trs_video_frame();
+
+#ifdef ZBX
+	/* Stop before the instruction at a breakpoint */
+	if (debug_traps && debug_traps[Z80_PC] &&
+	    trs_input_replaying != INPUT_REPLAY_HISTORY && debug_trap())
+	  break;
+#endif
+	if (trs_profiling)
+	  trs_profile_tick();
+	if (trs_tracing)
+	  trs_trace_tick();
+
 	Z80_R++;
 	instruction = mem_read(Z80_PC++);
 
@@ -2985,6 +3035,11 @@ int z80_run(int continuous)
 	  case 0xED:	/* ED.. extended instruction */
 	    Z80_R++;
 	    ret = do_ED_instruction();
+#ifdef ZBX
+	    /* The emulator traps write memory directly */
+	    if (debug_watches)
+	      debug_watch_check();
+#endif
 	    break;
 	  case 0xFD:	/* FD.. extended instruction */
 	    Z80_R++;
@@ -247,9 +247,13 @@ struct z80_state_struct
 extern struct z80_state_struct z80_state;
 extern unsigned int cycles_per_timer;
 
+/* Host synchronizations per timer interrupt */
+#define TIMER_SLICES 4
+
 extern void z80_reset(void);
 extern int z80_run(int continuous);
 extern int mem_read(int address);
+extern int mem_peek(int address);
 extern void mem_write(int address, int value);
 extern void rom_write(int address, int value);
 extern int mem_read_word(int address);
@@ -258,9 +262,35 @@ extern Uint8 *mem_pointer(int address, int writing);
 extern void z80_out(int port, int value);
 extern int z80_in(int port);
 
-#ifdef ZBX
 extern int disassemble(Uint16 pc);
+extern int disassemble_file(FILE *file, Uint16 pc);
+extern int instruction_length(Uint16 pc);
+
+#ifdef ZBX
 extern void debug_init(void);
 extern void debug_shell(void);
+
+/* Accesses watched by the debugger */
+#define WATCH_READ	(0x1)
+#define WATCH_WRITE	(0x2)
+#define WATCH_EXEC	(0x4)
+#define WATCH_CHANGE	(0x8)
+#define WATCH_IN	(0x10)
+#define WATCH_OUT	(0x20)
+
+/*
+ * Maps by address of the traps to check before executing an instruction
+ * and of the watched memory, NULL unless the debugger runs the Z80 and
+ * any are set, so z80_run() and the memory access need only test them.
+ */
+extern Uint8 *debug_traps;
+extern Uint8 *debug_watches;
+extern Uint8 debug_port_watches[256];
+
+/* Called on a hit; debug_trap() is non-zero to stop before the instruction */
+extern int debug_trap(void);
+extern void debug_watch_mem(int address, int value, int access);
+extern void debug_watch_check(void);
+extern void debug_watch_port(int port, int value, int access);
 #endif /* ZBX */
 #endif
@@ -36,6 +36,8 @@ extern int emt_open(/* char *fname, int oflag, int mode */);
 extern int emt_close(/* int fd */);
 extern int emt_read(/* int fd, char *buffer, int bytes */);
 extern int emt_write(/* int fd, char *buffer, int bytes */);
+extern int /*emt_readx*/ emt_xread(/* int fd, int space, char *block */);
+extern int /*emt_writex*/ emt_xwrite(/* int fd, int space, char *block */);
 extern long emt_lseek(/* int fd, long offset, int whence */);
 extern int emt_strerror(/* int err, char *buffer, int size */);
 extern time_t emt_time(/* int local */);
@@ -60,6 +62,11 @@ extern int /*emt_closedisk*/ emt_dkclose(/* int fd */);
 #define EO_TRUNC  01000
 #define EO_APPEND 02000
 
+/* space values for emt_readx and emt_writex */
+#define EX_Z80       0
+#define EX_RAM       1
+#define EX_SUPERMEM  2
+
 /* local values for emt_time */
 #define EMT_TIME_GMT 0
 #define EMT_TIME_LOCAL 1